@@ -0,0 +1,218 @@
+#include "at_engine.h"
+
+#include "timing.h"
+#include "trace.h"
+
+#include <cstring>
+
+static bool startsWith(const char *s, const char *prefix)
+{
+    return strncmp(s, prefix, strlen(prefix)) == 0;
+}
+
+static bool isError(const char *line)
+{
+    if (!strcmp(line, "ERROR") || startsWith(line, "+CME ERROR") || startsWith(line, "+CMS ERROR"))
+        return true;
+    // SEND FAIL, CONNECT FAIL
+    const size_t len = strlen(line);
+    return len >= 5 && !strcmp(line + len - 5, " FAIL");
+}
+
+bool AtEngine::rxChar(char c)
+{
+    // Answers come as "\r\n<text>\r\n", the echo as "<command>\r": a line
+    // ends at either. The data prompt of AT+CIPSEND / AT+CMGS is "> "
+    // without a line end.
+    const bool prompt = c == ' ' && rxLine.len == 1 && rxLine.text[0] == '>';
+    if (c != '\r' && c != '\n' && !prompt)
+    {
+        if (rxLine.len < AT_LINE_MAX - 1)
+            rxLine.text[rxLine.len++] = c;
+        else
+            rxCut = true;
+        return false;
+    }
+    if (rxLine.len == 0)
+        return false;
+    if (rxCut)
+        cutLines++;
+    rxLine.text[rxLine.len] = '\0';
+    lines.push(rxLine);
+    rxLine.len = 0;
+    rxCut = false;
+    return true;
+}
+
+bool AtEngine::send(const char *cmd, uint32_t timeoutMs, at_done_fn done, void *ctx, const char *expect,
+                    const uint8_t *payload, size_t payloadLen)
+{
+    const size_t len = strlen(cmd);
+    if (queueCount == AT_QUEUE || len > AT_CMD_MAX - 1)
+    {
+        rejected++;
+        return false;
+    }
+    Command &c = queue[(queueHead + queueCount) % AT_QUEUE];
+    memcpy(c.text, cmd, len);
+    c.text[len] = '\r';
+    c.text[len + 1] = '\0';
+    c.len = (uint8_t)(len + 1);
+    c.timeoutMs = timeoutMs;
+    c.done = done;
+    c.ctx = ctx;
+    c.expect = expect;
+    c.payload = payload;
+    c.payloadLen = payloadLen;
+    queueCount++;
+    return true;
+}
+
+bool AtEngine::onUrc(const char *prefix, at_urc_fn fn, void *ctx)
+{
+    if (urcCount == AT_URC_HANDLERS)
+        return false;
+    urcHandlers[urcCount++] = {prefix, fn, ctx};
+    return true;
+}
+
+void AtEngine::poll()
+{
+    if (dmaRx)
+    {
+        const uint8_t *data;
+        size_t len;
+        while ((len = uart_dma_rx_peek(dmaRx, &data)) > 0)
+        {
+            for (size_t i = 0; i < len; i++)
+                rxChar((char)data[i]);
+            uart_dma_rx_skip(dmaRx, len);
+        }
+    }
+
+    AtLine line;
+    while (lines.pop(line))
+        handleLine(line.text);
+
+    if (busy && time_us_64() >= deadlineUs)
+        finish(AT_RESULT::TIMEOUT);
+    if (!busy && queueCount)
+        start();
+    transmit();
+}
+
+bool AtEngine::dispatchUrc(const char *line)
+{
+    for (size_t i = 0; i < urcCount; i++)
+        if (startsWith(line, urcHandlers[i].prefix))
+        {
+            urcs++;
+            urcHandlers[i].fn(line, urcHandlers[i].ctx);
+            return true;
+        }
+    return false;
+}
+
+// "+CPIN: ..." answers AT+CPIN? and AT+CPIN=...
+bool AtEngine::isAnswer(const char *line) const
+{
+    const char *name = cur.text + 2;
+    if (*name != '+')
+        return false;
+    const size_t len = strcspn(name, "=?\r");
+    return strncmp(line, name, len) == 0 && line[len] == ':';
+}
+
+void AtEngine::handleLine(const char *line)
+{
+    if (!busy)
+    {
+        if (!dispatchUrc(line))
+            strayLines++;
+        return;
+    }
+    // the echo, unless it was turned off with ATE0
+    if (strncmp(line, cur.text, cur.len - 1) == 0 && line[cur.len - 1] == '\0')
+        return;
+    if (awaitingPrompt && !strcmp(line, ">"))
+    {
+        awaitingPrompt = false;
+        txData = cur.payload;
+        txLen = cur.payloadLen;
+        txPos = 0;
+        deadlineUs = UINT64_MAX;
+        return;
+    }
+
+    bool final = true;
+    AT_RESULT result = AT_RESULT::OK;
+    if (isError(line))
+        result = AT_RESULT::ERROR;
+    else if (!startsWith(line, cur.expect))
+        final = false;
+    if (!final && !isAnswer(line) && dispatchUrc(line))
+        return;
+
+    const size_t len = strlen(line);
+    if (responseLen && responseLen < AT_RESPONSE_MAX - 1)
+        response[responseLen++] = '\n';
+    size_t n = AT_RESPONSE_MAX - 1 - responseLen;
+    if (len > n)
+        responseCuts++;
+    else
+        n = len;
+    memcpy(response + responseLen, line, n);
+    responseLen += n;
+    response[responseLen] = '\0';
+
+    if (final)
+        finish(result);
+}
+
+void AtEngine::start()
+{
+    cur = queue[queueHead];
+    queueHead = (queueHead + 1) % AT_QUEUE;
+    queueCount--;
+    busy = true;
+    awaitingPrompt = cur.payload != nullptr;
+    txData = (const uint8_t *)cur.text;
+    txLen = cur.len;
+    txPos = 0;
+    deadlineUs = UINT64_MAX;
+    responseLen = 0;
+    response[0] = '\0';
+    startedAt = time_us_32();
+    TRACE_BEGIN(TRACE_AT_COMMAND, 0);
+}
+
+void AtEngine::finish(AT_RESULT result)
+{
+    busy = false;
+    awaitingPrompt = false;
+    txData = nullptr;
+    TIMING_END(TIMING_AT_COMMAND, startedAt);
+    TRACE_END(TRACE_AT_COMMAND, result != AT_RESULT::TIMEOUT, 0);
+    completed++;
+    if (result == AT_RESULT::ERROR)
+        errors++;
+    else if (result == AT_RESULT::TIMEOUT)
+        timeouts++;
+    // the callback may queue the next command
+    if (cur.done)
+        cur.done(result, response, cur.ctx);
+}
+
+// As much as the transmit FIFO takes, the rest on the next poll
+void AtEngine::transmit()
+{
+    if (!txData)
+        return;
+    while (txPos < txLen && uart_is_writable(uart))
+        uart_putc_raw(uart, (char)txData[txPos++]);
+    if (txPos == txLen)
+    {
+        txData = nullptr;
+        deadlineUs = time_us_64() + 1000ull * cur.timeoutMs;
+    }
+}
@@ -0,0 +1,136 @@
+#ifndef __at_engine_H__
+#define __at_engine_H__
+
+#include "pico/time.h"
+#include "hardware/uart.h"
+
+#include "spsc_ring.h"
+#include "uart_dma_rx.h"
+
+#include <cinttypes>
+#include <cstddef>
+
+// Longer lines are cut
+#define AT_LINE_MAX      128
+// received lines waiting for poll(), a power of two
+#define AT_LINE_QUEUE    16
+#define AT_CMD_MAX       128
+// commands waiting behind the one in flight
+#define AT_QUEUE         8
+// intermediate and final lines handed to the completion callback
+#define AT_RESPONSE_MAX  256
+#define AT_URC_HANDLERS  12
+
+enum class AT_RESULT {
+    OK,       // the expected final result
+    ERROR,    // ERROR, +CME ERROR, +CMS ERROR or a "... FAIL" result
+    TIMEOUT
+};
+
+// response: the lines received for the command, final result included,
+// separated by '\n'
+typedef void (*at_done_fn)(AT_RESULT result, const char *response, void *ctx);
+typedef void (*at_urc_fn)(const char *line, void *ctx);
+
+struct AtLine {
+    uint8_t len;
+    char text[AT_LINE_MAX];
+};
+
+// Queued, non-blocking AT command engine. Received bytes are split into
+// lines in the UART RX interrupt (rxChar()) or, with a DMA ring, in poll().
+// poll() runs in the main loop only: it matches lines to the command in
+// flight or to the URC handlers, runs the callbacks, times commands out and
+// starts the next one, and moves the transmission along as far as the UART
+// FIFO takes it. Nothing in it waits for the modem.
+class AtEngine {
+public:
+    explicit AtEngine(uart_inst_t *uart) : uart(uart) {}
+
+    // Receive path, one of the two: bytes from the RX interrupt handler,
+    // true at the end of a line...
+    bool rxChar(char c);
+    // ...or a DMA ring that poll() reads
+    void attachDmaRx(uart_dma_rx_t *dma) { dmaRx = dma; }
+
+    // Queues cmd (without the CR). It completes with OK on a line starting
+    // with expect, with ERROR on an error result and with TIMEOUT after
+    // timeoutMs from being sent. With a payload the engine waits for the
+    // "> " prompt and sends it (AT+CIPSEND, AT+CMGS); it must stay valid
+    // until the callback. Returns false if the queue is full.
+    bool send(const char *cmd, uint32_t timeoutMs, at_done_fn done = nullptr, void *ctx = nullptr,
+              const char *expect = "OK", const uint8_t *payload = nullptr, size_t payloadLen = 0);
+
+    // Unsolicited result codes: lines starting with prefix, unless they are
+    // the answer to the command in flight (+CPIN: for AT+CPIN?)
+    bool onUrc(const char *prefix, at_urc_fn fn, void *ctx = nullptr);
+
+    void poll();
+    // nothing queued or in flight
+    bool idle() const { return !busy && queueCount == 0; }
+    // part of a command still to go out, poll() again soon
+    bool transmitting() const { return txData != nullptr; }
+
+    // statistics
+    uint32_t completed = 0;     // whatever the result
+    uint32_t errors = 0;
+    uint32_t timeouts = 0;
+    uint32_t urcs = 0;
+    uint32_t strayLines = 0;    // neither an answer nor a known URC
+    uint32_t cutLines = 0;      // longer than AT_LINE_MAX
+    uint32_t rejected = 0;      // send() with the queue full
+    uint32_t responseCuts = 0;  // responses longer than AT_RESPONSE_MAX
+    uint32_t lineOverflows() const { return lines.overflows(); }
+    uint32_t linesHighWater() const { return lines.highWater(); }
+
+private:
+    struct Command {
+        char text[AT_CMD_MAX + 1];  // with the CR
+        uint8_t len;
+        uint32_t timeoutMs;
+        at_done_fn done;
+        void *ctx;
+        const char *expect;
+        const uint8_t *payload;
+        size_t payloadLen;
+    };
+
+    struct Urc {
+        const char *prefix;
+        at_urc_fn fn;
+        void *ctx;
+    };
+
+    void handleLine(const char *line);
+    bool dispatchUrc(const char *line);
+    bool isAnswer(const char *line) const;
+    void start();
+    void finish(AT_RESULT result);
+    void transmit();
+
+    uart_inst_t *uart;
+    uart_dma_rx_t *dmaRx = nullptr;
+
+    // producer side: the RX interrupt or poll() with DMA
+    AtLine rxLine = {};
+    bool rxCut = false;
+    SpscRing<AtLine, AT_LINE_QUEUE> lines;
+
+    Command queue[AT_QUEUE];
+    size_t queueHead = 0, queueCount = 0;
+
+    Command cur;
+    bool busy = false;
+    bool awaitingPrompt = false;
+    uint64_t deadlineUs = 0;    // armed once the command (or payload) is out
+    uint32_t startedAt = 0;
+    const uint8_t *txData = nullptr;
+    size_t txLen = 0, txPos = 0;
+    char response[AT_RESPONSE_MAX];
+    size_t responseLen = 0;
+
+    Urc urcHandlers[AT_URC_HANDLERS];
+    size_t urcCount = 0;
+};
+
+#endif
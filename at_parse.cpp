@@ -0,0 +1,118 @@
+#include "at_parse.h"
+
+#include <cstring>
+
+bool AtTokens::parse(const char *line, const char *prefix)
+{
+    fieldCount = 0;
+    overflowed = false;
+
+    const char *p = line;
+    if (prefix)
+    {
+        const size_t len = strlen(prefix);
+        if (strncmp(line, prefix, len) != 0 || line[len] != ':')
+            return false;
+        p = line + len + 1;
+    }
+    else
+    {
+        const char *colon = strstr(line, ": ");
+        const char *end = strchr(line, '\n');
+        if (colon && (!end || colon < end))
+            p = colon + 1;
+    }
+
+    while (true)
+    {
+        while (*p == ' ')
+            p++;
+        AtField f = {p, 0, false};
+        if (*p == '"')
+        {
+            f.text = ++p;
+            while (*p && *p != '"' && *p != '\n')
+                p++;
+            if (*p != '"' || p - f.text > UINT8_MAX)
+                return false;
+            f.quoted = true;
+            f.len = (uint8_t)(p - f.text);
+            p++;
+        }
+        else
+        {
+            while (*p && *p != ',' && *p != '\n')
+                p++;
+            // "\r" is not left by AtEngine, but a raw line may have one
+            const char *end = p;
+            while (end > f.text && (end[-1] == '\r' || end[-1] == ' '))
+                end--;
+            if (end - f.text > UINT8_MAX)
+                return false;
+            f.len = (uint8_t)(end - f.text);
+        }
+        if (fieldCount < AT_MAX_FIELDS)
+            fields[fieldCount++] = f;
+        else
+            overflowed = true;
+        if (*p != ',')
+            return true;
+        p++;
+    }
+}
+
+bool AtTokens::integer(size_t i, int32_t *value) const
+{
+    if (i >= fieldCount)
+        return false;
+    const AtField &f = fields[i];
+    const char *p = f.text, *end = f.text + f.len;
+    const bool negative = p < end && *p == '-';
+    if (p < end && (*p == '-' || *p == '+'))
+        p++;
+    if (p == end)
+        return false;
+    int64_t v = 0;
+    for (; p < end; p++)
+    {
+        if (*p < '0' || *p > '9')
+            return false;
+        v = v * 10 + (*p - '0');
+        if (v > (int64_t)INT32_MAX + 1)
+            return false;
+    }
+    if (negative)
+        v = -v;
+    if (v > INT32_MAX)
+        return false;
+    *value = (int32_t)v;
+    return true;
+}
+
+bool AtTokens::string(size_t i, char *buf, size_t size) const
+{
+    if (i >= fieldCount || fields[i].len >= size)
+        return false;
+    memcpy(buf, fields[i].text, fields[i].len);
+    buf[fields[i].len] = '\0';
+    return true;
+}
+
+bool AtTokens::equals(size_t i, const char *s) const
+{
+    return i < fieldCount && strlen(s) == fields[i].len && !memcmp(fields[i].text, s, fields[i].len);
+}
+
+const char *AtTokens::findLine(const char *response, const char *prefix)
+{
+    const size_t len = strlen(prefix);
+    for (const char *line = response; line; )
+    {
+        if (!strncmp(line, prefix, len))
+            return line;
+        line = strchr(line, '\n');
+        if (line)
+            line++;
+    }
+    return nullptr;
+}
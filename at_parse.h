@@ -0,0 +1,49 @@
+#ifndef __at_parse_H__
+#define __at_parse_H__
+
+#include <cinttypes>
+#include <cstddef>
+
+// fields per response line, "+CIPSTATUS: 0,,"TCP","1.2.3.4","80","CONNECTED"" has 6
+#define AT_MAX_FIELDS 12
+
+struct AtField {
+    const char *text;   // into the line, without the quotes, not terminated
+    uint8_t len;
+    bool quoted;
+};
+
+// Splits a "+XXX: a,b,"c"" response line into its fields in place: no
+// copies and no heap, the line must outlive the tokens. Errors are explicit:
+// parse() fails on a different prefix or an unterminated quote, overflow()
+// tells that there were more than AT_MAX_FIELDS fields (the rest are
+// dropped), and the accessors fail rather than truncate or wrap.
+class AtTokens {
+public:
+    // The line up to '\n' or the end. With prefix ("+CSQ") the line must
+    // start with it and a ':'; without one everything before ": " is the
+    // name, or the whole line is a single field if there is none.
+    bool parse(const char *line, const char *prefix = nullptr);
+
+    size_t count() const { return fieldCount; }
+    bool overflow() const { return overflowed; }
+    const AtField &operator[](size_t i) const { return fields[i]; }
+
+    // A decimal field, optionally signed, in range; false if it is empty,
+    // has anything else in it or is out of range
+    bool integer(size_t i, int32_t *value) const;
+    // The field terminated in buf, false (and nothing copied) if it does not fit
+    bool string(size_t i, char *buf, size_t size) const;
+    bool equals(size_t i, const char *s) const;
+
+    // The first line of a multi-line response that starts with prefix, or
+    // nullptr; lines are separated by '\n' as AtEngine hands them over
+    static const char *findLine(const char *response, const char *prefix);
+
+private:
+    AtField fields[AT_MAX_FIELDS];
+    size_t fieldCount = 0;
+    bool overflowed = false;
+};
+
+#endif
@@ -0,0 +1,313 @@
+#include "fix_codec.h"
+
+#include <cstring>
+
+#define FIX_COURSE_FULL (36000 / FIX_COURSE_UNIT)
+
+// to the nearest unit, halves away from zero
+static int32_t quantise(int32_t v, int32_t unit)
+{
+    return v >= 0 ? (v + unit / 2) / unit : -((-v + unit / 2) / unit);
+}
+
+static uint32_t zigzag(int32_t v)
+{
+    return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+static int32_t unzigzag(uint32_t v)
+{
+    return (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+}
+
+static uint8_t *putVarint(uint8_t *p, uint32_t v)
+{
+    while (v >= 0x80)
+    {
+        *p++ = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    *p++ = (uint8_t)v;
+    return p;
+}
+
+// The position if it moves on as over the last step; after a gap of more
+// than a few steps it stays
+static int32_t predict(int32_t last, int32_t step, uint32_t dt, uint32_t lastDt)
+{
+    return lastDt && dt <= 4 * lastDt ? last + (int32_t)((int64_t)step * dt / lastDt) : last;
+}
+
+// Course change the short way round
+static int32_t courseStep(int32_t from, int32_t to)
+{
+    int32_t d = (to - from) % FIX_COURSE_FULL;
+    if (d >= FIX_COURSE_FULL / 2)
+        d -= FIX_COURSE_FULL;
+    else if (d < -FIX_COURSE_FULL / 2)
+        d += FIX_COURSE_FULL;
+    return d;
+}
+
+uint16_t fix_crc16(const uint8_t *data, size_t len, uint16_t crc)
+{
+    while (len--)
+    {
+        crc ^= (uint16_t)(*data++ << 8);
+        for (int i = 0; i < 8; i++)
+            crc = crc & 0x8000 ? (uint16_t)(crc << 1 ^ 0x1021) : (uint16_t)(crc << 1);
+    }
+    return crc;
+}
+
+FixEncoder::FixEncoder(uint8_t *buffer, size_t size)
+  : buf(buffer), capacity(size)
+{
+    begin();
+}
+
+void FixEncoder::begin()
+{
+    buf[0] = FIX_FRAME_SYNC;
+    used = 3;
+    fixes = 0;
+}
+
+bool FixEncoder::add(const FixRecord &fix)
+{
+    FixState s;
+    s.time = fix.time;
+    s.lat = quantise(fix.latE7, FIX_POS_UNIT_E7);
+    s.lng = quantise(fix.lngE7, FIX_POS_UNIT_E7);
+    s.alt = fix.fields & FIX_HAS_ALT ? quantise(fix.altitudeCm, FIX_ALT_UNIT_CM) : 0;
+    s.speed = fix.fields & FIX_HAS_SPEED ? quantise(fix.speedKmph100, FIX_SPEED_UNIT) : 0;
+    s.course = fix.fields & FIX_HAS_COURSE
+        ? (quantise(fix.courseCdeg, FIX_COURSE_UNIT) % FIX_COURSE_FULL + FIX_COURSE_FULL) % FIX_COURSE_FULL : 0;
+    s.sats = fix.fields & FIX_HAS_SATS ? fix.sats : 0;
+    s.fields = fix.fields;
+
+    // worst case: header and seven five byte varints
+    uint8_t record[36];
+    uint8_t *p = record + 1;
+    uint8_t header;
+    // a new key record when the optional fields change or time goes back
+    if (fixes == 0 || fix.fields != state.fields || fix.time < state.time)
+    {
+        header = FIX_REC_KEY | FIX_REC_TIME | FIX_REC_LAT | FIX_REC_LNG;
+        p = putVarint(p, fix.time > FIX_EPOCH_S ? fix.time - FIX_EPOCH_S : 0);
+        s.time = fix.time > FIX_EPOCH_S ? fix.time : FIX_EPOCH_S;
+        p = putVarint(p, zigzag(s.lat));
+        p = putVarint(p, zigzag(s.lng));
+        if (s.fields & FIX_HAS_ALT)
+        {
+            header |= FIX_REC_ALT;
+            p = putVarint(p, zigzag(s.alt));
+        }
+        if (s.fields & FIX_HAS_SPEED)
+        {
+            header |= FIX_REC_SPEED;
+            p = putVarint(p, zigzag(s.speed));
+        }
+        if (s.fields & FIX_HAS_COURSE)
+        {
+            header |= FIX_REC_COURSE;
+            p = putVarint(p, (uint32_t)s.course);
+        }
+        if (s.fields & FIX_HAS_SATS)
+        {
+            header |= FIX_REC_SATS;
+            p = putVarint(p, (uint32_t)s.sats);
+        }
+        s.dLat = s.dLng = 0;
+        s.dt = 0;
+    }
+    else
+    {
+        header = 0;
+        s.dt = fix.time - state.time;
+        const int32_t d[7] = {
+            (int32_t)(s.dt - state.dt),
+            s.lat - predict(state.lat, state.dLat, s.dt, state.dt),
+            s.lng - predict(state.lng, state.dLng, s.dt, state.dt),
+            s.alt - state.alt,
+            s.speed - state.speed,
+            courseStep(state.course, s.course),
+            s.sats - state.sats,
+        };
+        for (int i = 0; i < 7; i++)
+        {
+            if (d[i])
+            {
+                header |= (uint8_t)(1 << i);
+                p = putVarint(p, zigzag(d[i]));
+            }
+        }
+        s.dLat = s.lat - state.lat;
+        s.dLng = s.lng - state.lng;
+    }
+    record[0] = header;
+
+    const size_t len = (size_t)(p - record);
+    if (used + len + 2 > capacity || used + len - 3 > FIX_FRAME_MAX)
+        return false;
+    memcpy(buf + used, record, len);
+    used += len;
+    fixes++;
+    state = s;
+    return true;
+}
+
+size_t FixEncoder::finish()
+{
+    if (fixes == 0)
+        return 0;
+    const size_t payload = used - 3;
+    buf[1] = (uint8_t)payload;
+    buf[2] = (uint8_t)(payload >> 8);
+    const uint16_t crc = fix_crc16(buf, used);
+    buf[used] = (uint8_t)crc;
+    buf[used + 1] = (uint8_t)(crc >> 8);
+    return used + 2;
+}
+
+struct FixReader {
+    const uint8_t *p, *end;
+    bool ok;
+
+    uint32_t varint()
+    {
+        uint32_t v = 0;
+        for (int shift = 0; shift < 35; shift += 7)
+        {
+            if (p == end)
+                break;
+            const uint8_t b = *p++;
+            v |= (uint32_t)(b & 0x7F) << shift;
+            if (!(b & 0x80))
+                return v;
+        }
+        ok = false;
+        return 0;
+    }
+    int32_t signedVarint() { return unzigzag(varint()); }
+};
+
+void FixDecoder::push(const uint8_t *data, size_t len)
+{
+    for (size_t i = 0; i < len; i++)
+    {
+        if (have == 0 && data[i] != FIX_FRAME_SYNC)
+        {
+            skipped++;
+            continue;
+        }
+        buf[have++] = data[i];
+        while (have >= 3)
+        {
+            const size_t payload = (size_t)(buf[1] | buf[2] << 8);
+            if (payload <= FIX_FRAME_MAX && have < payload + FIX_FRAME_OVERHEAD)
+                break;
+            if (payload <= FIX_FRAME_MAX && frame())
+            {
+                have = 0;
+                break;
+            }
+            // not a frame after all: the next sync byte in what was taken
+            badFrames++;
+            size_t next = 1;
+            while (next < have && buf[next] != FIX_FRAME_SYNC)
+                next++;
+            skipped += (uint32_t)next;
+            have -= next;
+            memmove(buf, buf + next, have);
+        }
+    }
+}
+
+// Checks and decodes the frame in buf, false if it is bad
+bool FixDecoder::frame()
+{
+    const size_t payload = (size_t)(buf[1] | buf[2] << 8);
+    const uint16_t crc = (uint16_t)(buf[3 + payload] | buf[4 + payload] << 8);
+    if (fix_crc16(buf, 3 + payload) != crc)
+        return false;
+    FixReader r = {buf + 3, buf + 3 + payload, true};
+    if (payload == 0 || !(buf[3] & FIX_REC_KEY))
+        return false;
+    FixState s = {};
+    frames++;
+    while (r.p < r.end)
+    {
+        const uint8_t header = *r.p++;
+        if (header & FIX_REC_KEY)
+        {
+            if ((header & (FIX_REC_TIME | FIX_REC_LAT | FIX_REC_LNG)) != (FIX_REC_TIME | FIX_REC_LAT | FIX_REC_LNG))
+                r.ok = false;
+            s.time = FIX_EPOCH_S + r.varint();
+            s.lat = r.signedVarint();
+            s.lng = r.signedVarint();
+            s.fields = 0;
+            s.alt = s.speed = s.course = s.sats = 0;
+            if (header & FIX_REC_ALT)
+            {
+                s.fields |= FIX_HAS_ALT;
+                s.alt = r.signedVarint();
+            }
+            if (header & FIX_REC_SPEED)
+            {
+                s.fields |= FIX_HAS_SPEED;
+                s.speed = r.signedVarint();
+            }
+            if (header & FIX_REC_COURSE)
+            {
+                s.fields |= FIX_HAS_COURSE;
+                s.course = (int32_t)r.varint();
+            }
+            if (header & FIX_REC_SATS)
+            {
+                s.fields |= FIX_HAS_SATS;
+                s.sats = (int32_t)r.varint();
+            }
+            s.dLat = s.dLng = 0;
+            s.dt = 0;
+        }
+        else
+        {
+            int32_t d[7] = {};
+            for (int i = 0; i < 7; i++)
+                if (header & (1 << i))
+                    d[i] = r.signedVarint();
+            const uint32_t dt = s.dt + (uint32_t)d[0];
+            const int32_t lat = predict(s.lat, s.dLat, dt, s.dt) + d[1];
+            const int32_t lng = predict(s.lng, s.dLng, dt, s.dt) + d[2];
+            s.dLat = lat - s.lat;
+            s.dLng = lng - s.lng;
+            s.lat = lat;
+            s.lng = lng;
+            s.dt = dt;
+            s.time += dt;
+            s.alt += d[3];
+            s.speed += d[4];
+            s.course = ((s.course + d[5]) % FIX_COURSE_FULL + FIX_COURSE_FULL) % FIX_COURSE_FULL;
+            s.sats += d[6];
+        }
+        if (!r.ok)
+        {
+            badFrames++;
+            return true;
+        }
+        FixRecord fix;
+        fix.time = s.time;
+        fix.latE7 = s.lat * FIX_POS_UNIT_E7;
+        fix.lngE7 = s.lng * FIX_POS_UNIT_E7;
+        fix.altitudeCm = s.alt * FIX_ALT_UNIT_CM;
+        fix.speedKmph100 = s.speed * FIX_SPEED_UNIT;
+        fix.courseCdeg = s.course * FIX_COURSE_UNIT;
+        fix.sats = (uint8_t)s.sats;
+        fix.fields = s.fields;
+        fixes++;
+        if (fn)
+            fn(fix, ctx);
+    }
+    return true;
+}
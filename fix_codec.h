@@ -0,0 +1,126 @@
+#ifndef __fix_codec_H__
+#define __fix_codec_H__
+
+#include <cinttypes>
+#include <cstddef>
+
+// Binary position reports. Fixes go into frames:
+//
+//   'F', payload length (u16 LE), records, CRC-16/CCITT-FALSE (u16 LE) of
+//   everything before it
+//
+// A record is a header byte followed by the fields its bits mark present,
+// each a varint (7 bits a byte, low first). The first record of a frame is
+// a key record with absolute values, so a frame decodes without the ones
+// before it. The others carry zigzag coded differences to a prediction and
+// leave out what was predicted exactly: the time step is predicted to be the
+// last one, the position to move on as it did over the last step, the rest
+// to stay. A vehicle at a steady pace reported at a steady period needs the
+// header and two one byte position corrections.
+//
+// Values are quantised to the units below before coding, the decoder gives
+// back the quantised values in the FixRecord units.
+#define FIX_POS_UNIT_E7     100     // 1e-5 degrees, 1.1 m
+#define FIX_ALT_UNIT_CM     100     // 1 m
+#define FIX_SPEED_UNIT      100     // 1 km/h
+#define FIX_COURSE_UNIT     100     // 1 degree
+// key record times count from here (2020-01-01 UTC)
+#define FIX_EPOCH_S         1577836800u
+
+#define FIX_FRAME_SYNC      'F'
+#define FIX_FRAME_OVERHEAD  5
+// payload bytes a frame can have
+#define FIX_FRAME_MAX       1024
+
+// record header bits
+#define FIX_REC_TIME        0x01
+#define FIX_REC_LAT         0x02
+#define FIX_REC_LNG         0x04
+#define FIX_REC_ALT         0x08
+#define FIX_REC_SPEED       0x10
+#define FIX_REC_COURSE      0x20
+#define FIX_REC_SATS        0x40
+#define FIX_REC_KEY         0x80
+
+// optional fields of a fix
+#define FIX_HAS_ALT         0x01
+#define FIX_HAS_SPEED       0x02
+#define FIX_HAS_COURSE      0x04
+#define FIX_HAS_SATS        0x08
+
+struct FixRecord {
+    uint32_t time;          // unix seconds, UTC
+    int32_t latE7, lngE7;
+    int32_t altitudeCm;
+    int32_t speedKmph100;
+    int32_t courseCdeg;
+    uint8_t sats;
+    uint8_t fields;         // FIX_HAS_...
+};
+
+// The coded values of the last fix and the step to it, shared by encoder
+// and decoder so both predict the same
+struct FixState {
+    uint32_t time;
+    int32_t lat, lng, alt, speed, course, sats;
+    int32_t dLat, dLng;
+    uint32_t dt;
+    uint8_t fields;
+};
+
+// Builds one frame at a time in a buffer of the caller's
+class FixEncoder {
+public:
+    FixEncoder(uint8_t *buffer, size_t size);
+
+    // Drops whatever was added and starts a new frame
+    void begin();
+    // Adds a fix, false if it does not fit (the frame is unchanged)
+    bool add(const FixRecord &fix);
+    // Completes the frame and returns its length, 0 if it has no fixes.
+    // The frame stays in the buffer until begin().
+    size_t finish();
+
+    const uint8_t *data() const { return buf; }
+    // frame bytes so far, without the CRC
+    size_t size() const { return used; }
+    size_t count() const { return fixes; }
+
+private:
+    uint8_t *buf;
+    size_t capacity;
+    size_t used = 0;
+    size_t fixes = 0;
+    FixState state;
+};
+
+// Called for each fix of a frame once the frame's CRC checked out
+typedef void (*fix_decoded_fn)(const FixRecord &fix, void *ctx);
+
+// Streaming decoder: takes frames in pieces of any size, skips to the next
+// sync byte after a bad frame
+class FixDecoder {
+public:
+    FixDecoder(fix_decoded_fn fn, void *ctx) : fn(fn), ctx(ctx) {}
+
+    void push(const uint8_t *data, size_t len);
+
+    // statistics
+    uint32_t frames = 0;
+    uint32_t fixes = 0;
+    uint32_t badFrames = 0;     // CRC or record errors
+    uint32_t skipped = 0;       // bytes outside frames
+
+private:
+    bool frame();
+
+    fix_decoded_fn fn;
+    void *ctx;
+    uint8_t buf[FIX_FRAME_OVERHEAD + FIX_FRAME_MAX];
+    size_t have = 0;
+};
+
+// CRC-16/CCITT-FALSE; pass the last result as crc to continue over pieces
+uint16_t fix_crc16(const uint8_t *data, size_t len, uint16_t crc = 0xFFFF);
+
+#endif
@@ -0,0 +1,286 @@
+#include "flash_queue.h"
+
+#include "hardware/regs/addressmap.h"
+#include "hardware/sync.h"
+
+#include "fix_codec.h"
+
+#include <algorithm>
+#include <cstring>
+
+#define SECTOR_MAGIC    0x31515146u     // "FQ1"
+#define HEADER_SIZE     12
+#define REC_DATA        0x01
+#define REC_ACK         0x02
+#define REC_FREE        0xFF
+// type, length and CRC
+#define REC_OVERHEAD    5
+#define ACK_SIZE        8
+
+static uint32_t get32(const uint8_t *p)
+{
+    return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static void put32(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+FlashQueue::FlashQueue(uint32_t offset, uint32_t size)
+  : base(offset), sectors(size / FLASH_SECTOR_SIZE)
+{
+}
+
+const uint8_t *FlashQueue::at(uint32_t seq, uint32_t off) const
+{
+    return (const uint8_t *)(XIP_BASE + base + (seq % sectors) * FLASH_SECTOR_SIZE + off);
+}
+
+bool FlashQueue::sectorValid(uint32_t seq) const
+{
+    const uint8_t *h = at(seq, 0);
+    return get32(h) == SECTOR_MAGIC && get32(h + 4) == seq && get32(h + 8) == ~seq;
+}
+
+size_t FlashQueue::record(Pos p, uint8_t *type) const
+{
+    *type = REC_FREE;
+    if (p.off + REC_OVERHEAD > FLASH_SECTOR_SIZE)
+        return 0;
+    const uint8_t *r = at(p.seq, p.off);
+    *type = r[0];
+    if (r[0] == REC_FREE)
+        return 0;
+    const size_t len = r[1] | r[2] << 8;
+    if (len > FLASH_QUEUE_RECORD_MAX || p.off + len + REC_OVERHEAD > FLASH_SECTOR_SIZE)
+        return 0;
+    if (fix_crc16(r, len + 3) != (r[len + 3] | r[len + 4] << 8))
+        return 0;
+    return len + REC_OVERHEAD;
+}
+
+// Moves p to the next data record before the head, skipping acks and the
+// ends of sectors
+bool FlashQueue::nextData(Pos &p, const uint8_t **data, size_t *len) const
+{
+    while (p.seq < head.seq || (p.seq == head.seq && p.off < head.off))
+    {
+        uint8_t type;
+        const size_t n = record(p, &type);
+        if (n == 0)
+        {
+            p.seq++;
+            p.off = HEADER_SIZE;
+        }
+        else if (type != REC_DATA)
+            p.off += n;
+        else
+        {
+            *data = at(p.seq, p.off + 3);
+            *len = n - REC_OVERHEAD;
+            return true;
+        }
+    }
+    return false;
+}
+
+void FlashQueue::recover()
+{
+    bool any = false;
+    for (uint32_t slot = 0; slot < sectors; slot++)
+    {
+        const uint32_t seq = get32(at(slot, 4));
+        if (seq % sectors == slot && sectorValid(seq) && (!any || seq > newest))
+        {
+            newest = seq;
+            any = true;
+        }
+    }
+    readCount = 0;
+    if (!any)
+    {
+        // a new queue
+        oldest = 0;
+        newest = UINT32_MAX;
+        tail = rd = {0, HEADER_SIZE};
+        headFull = true;
+        openSector();
+        return;
+    }
+    oldest = newest;
+    while (oldest > 0 && newest - oldest + 1 < sectors && sectorValid(oldest - 1))
+        oldest--;
+
+    // the head, after the last good record of the newest sector
+    Pos p = {newest, HEADER_SIZE};
+    Pos ack = {0, 0};
+    bool haveAck = false;
+    uint8_t type;
+    size_t n;
+    while ((n = record(p, &type)) > 0)
+    {
+        if (type == REC_ACK)
+        {
+            ack = {get32(at(p.seq, p.off + 3)), get32(at(p.seq, p.off + 7))};
+            haveAck = true;
+        }
+        p.off += n;
+    }
+    head = p;
+    // a record cut short: the rest of the sector stays as it is
+    headFull = type != REC_FREE;
+    corrupt += headFull;
+
+    // a power failure while a sector was opened can leave it without an ack
+    for (uint32_t seq = newest; !haveAck && seq-- > oldest;)
+    {
+        for (p = {seq, HEADER_SIZE}; (n = record(p, &type)) > 0; p.off += n)
+            if (type == REC_ACK)
+            {
+                ack = {get32(at(p.seq, p.off + 3)), get32(at(p.seq, p.off + 7))};
+                haveAck = true;
+            }
+    }
+    tail = haveAck && ack.seq >= oldest && ack.seq <= newest ? ack : Pos{oldest, HEADER_SIZE};
+    rd = tail;
+}
+
+bool FlashQueue::append(const uint8_t *data, size_t len)
+{
+    if (len > FLASH_QUEUE_RECORD_MAX)
+        return false;
+    write(REC_DATA, data, len);
+    appended++;
+    return true;
+}
+
+size_t FlashQueue::read(record_fn fn, void *ctx, size_t max)
+{
+    size_t n = 0;
+    const uint8_t *data;
+    size_t len;
+    while (n < max && nextData(rd, &data, &len) && fn(data, len, ctx))
+    {
+        rd.off += len + REC_OVERHEAD;
+        n++;
+    }
+    readCount += n;
+    return n;
+}
+
+void FlashQueue::commit()
+{
+    if (rd.seq == tail.seq && rd.off == tail.off)
+        return;
+    tail = rd;
+    committed += readCount;
+    readCount = 0;
+    writeAck();
+}
+
+bool FlashQueue::empty() const
+{
+    Pos p = tail;
+    const uint8_t *data;
+    size_t len;
+    return !nextData(p, &data, &len);
+}
+
+bool FlashQueue::drained() const
+{
+    Pos p = rd;
+    const uint8_t *data;
+    size_t len;
+    return !nextData(p, &data, &len);
+}
+
+// Starts the next sector in the next slot, erasing it
+void FlashQueue::openSector()
+{
+    const uint32_t seq = newest + 1;
+    if (seq - oldest >= sectors)
+    {
+        // full, the oldest sector goes with what was not read of it
+        const uint8_t *data;
+        size_t len;
+        while (rd.seq == oldest && nextData(rd, &data, &len) && rd.seq == oldest)
+        {
+            rd.off += len + REC_OVERHEAD;
+            dropped++;
+        }
+        oldest++;
+        if (tail.seq < oldest)
+            tail = {oldest, HEADER_SIZE};
+        if (rd.seq < oldest)
+            rd = tail;
+    }
+
+    const uint32_t off = base + (seq % sectors) * FLASH_SECTOR_SIZE;
+    const uint32_t irq = save_and_disable_interrupts();
+    flash_range_erase(off, FLASH_SECTOR_SIZE);
+    restore_interrupts(irq);
+    erases++;
+
+    memset(page, 0xFF, sizeof(page));
+    put32(page, SECTOR_MAGIC);
+    put32(page + 4, seq);
+    put32(page + 8, ~seq);
+    programPage(off);
+    newest = seq;
+    head = {seq, HEADER_SIZE};
+    headFull = false;
+    writeAck();
+}
+
+void FlashQueue::write(uint8_t type, const uint8_t *data, size_t len)
+{
+    if (headFull || head.off + len + REC_OVERHEAD > FLASH_SECTOR_SIZE)
+        openSector();
+
+    const uint8_t pre[3] = {type, (uint8_t)len, (uint8_t)(len >> 8)};
+    const uint16_t crc = fix_crc16(data, len, fix_crc16(pre, sizeof(pre)));
+    const uint8_t post[2] = {(uint8_t)crc, (uint8_t)(crc >> 8)};
+    const uint8_t *pieces[3] = {pre, data, post};
+    const size_t lens[3] = {sizeof(pre), len, sizeof(post)};
+
+    // a page is programmed once with all of the record that falls in it
+    uint32_t off = base + (head.seq % sectors) * FLASH_SECTOR_SIZE + head.off;
+    memset(page, 0xFF, sizeof(page));
+    for (int k = 0; k < 3; k++)
+    {
+        for (size_t done = 0; done < lens[k];)
+        {
+            const size_t i = off % FLASH_PAGE_SIZE;
+            const size_t n = std::min(lens[k] - done, (size_t)FLASH_PAGE_SIZE - i);
+            memcpy(page + i, pieces[k] + done, n);
+            done += n;
+            off += (uint32_t)n;
+            if (off % FLASH_PAGE_SIZE == 0)
+                programPage(off - FLASH_PAGE_SIZE);
+        }
+    }
+    if (off % FLASH_PAGE_SIZE)
+        programPage(off - off % FLASH_PAGE_SIZE);
+    head.off += (uint32_t)(len + REC_OVERHEAD);
+}
+
+void FlashQueue::writeAck()
+{
+    uint8_t ack[ACK_SIZE];
+    put32(ack, tail.seq);
+    put32(ack + 4, tail.off);
+    write(REC_ACK, ack, sizeof(ack));
+}
+
+// Programs the page buffer and clears it
+void FlashQueue::programPage(uint32_t off)
+{
+    const uint32_t irq = save_and_disable_interrupts();
+    flash_range_program(off, page, FLASH_PAGE_SIZE);
+    restore_interrupts(irq);
+    memset(page, 0xFF, sizeof(page));
+}
@@ -0,0 +1,101 @@
+#ifndef __flash_queue_H__
+#define __flash_queue_H__
+
+#include "pico.h"
+#include "hardware/flash.h"
+
+#include <cinttypes>
+#include <cstddef>
+
+// Region at the end of flash, clear of the program
+#ifndef FLASH_QUEUE_SIZE
+#define FLASH_QUEUE_SIZE    (64 * FLASH_SECTOR_SIZE)
+#endif
+#ifndef FLASH_QUEUE_OFFSET
+#define FLASH_QUEUE_OFFSET  (PICO_FLASH_SIZE_BYTES - FLASH_QUEUE_SIZE)
+#endif
+#define FLASH_QUEUE_RECORD_MAX  1024
+
+// Store and forward queue in flash, a log of sectors used in turn. A sector
+// starts with a header (magic, sequence number, its complement) and holds
+// records one after the other until the next would not fit:
+//
+//   type, length (u16 LE), data, CRC-16 (u16 LE) of everything before it
+//
+// Sector n of the log sits in slot n % sectors of the region, so the
+// sectors wear evenly. Data records are what append() was given. An ack
+// record holds the position of the oldest record not yet removed; every
+// sector starts with one, and commit() writes one. Nothing is ever
+// rewritten in place.
+//
+// recover() reads the sector headers and the newest sector only: its
+// free space is the head, its last ack the tail. A record cut short by a
+// power failure fails its CRC and ends its sector; the queue carries on in
+// the next. Records are removed at least once: a power failure before the
+// ack of a commit() brings them back. When the queue is full the oldest
+// sector is erased and its records are lost.
+//
+// Erasing and programming stall the flash and so everything running from
+// it: interrupts are off meanwhile (45 ms for an erase, under 1 ms for a
+// page). UART reception goes on through DMA. Single core only, core1 would
+// have to be locked out too.
+class FlashQueue {
+public:
+    FlashQueue(uint32_t offset = FLASH_QUEUE_OFFSET, uint32_t size = FLASH_QUEUE_SIZE);
+
+    // Finds head and tail after a reset, starts an empty queue in a region
+    // that holds none
+    void recover();
+    // Adds a record, false if it is longer than FLASH_QUEUE_RECORD_MAX
+    bool append(const uint8_t *data, size_t len);
+
+    // Reader: called with the record in flash, false leaves it unread
+    typedef bool (*record_fn)(const uint8_t *data, size_t len, void *ctx);
+    // Hands up to max records after the last read one to fn, oldest first,
+    // returns how many it took
+    size_t read(record_fn fn, void *ctx, size_t max);
+    // Removes the records read so far
+    void commit();
+    // Reads again from the oldest record
+    void rewind() { rd = tail; readCount = 0; }
+
+    // no records left, read or not
+    bool empty() const;
+    // nothing left to read
+    bool drained() const;
+
+    // statistics
+    uint32_t appended = 0;
+    uint32_t committed = 0;
+    uint32_t dropped = 0;       // lost to a full queue
+    uint32_t erases = 0;
+    uint32_t corrupt = 0;       // records failing the CRC, from power failures
+
+private:
+    struct Pos {
+        uint32_t seq;       // sector of the log
+        uint32_t off;       // byte in it
+    };
+
+    const uint8_t *at(uint32_t seq, uint32_t off) const;
+    bool sectorValid(uint32_t seq) const;
+    // length of a valid record at p, 0 for free space or a bad record
+    size_t record(Pos p, uint8_t *type) const;
+    bool nextData(Pos &p, const uint8_t **data, size_t *len) const;
+    void openSector();
+    void write(uint8_t type, const uint8_t *data, size_t len);
+    void writeAck();
+    void programPage(uint32_t off);
+
+    uint32_t base, sectors;
+    uint32_t oldest = 0;        // sequence numbers of the sectors in use
+    uint32_t newest = 0;
+    Pos head = {0, 0};
+    Pos tail = {0, 0};
+    Pos rd = {0, 0};
+    uint32_t readCount = 0;
+    bool headFull = true;       // next record goes to a new sector
+    uint8_t page[FLASH_PAGE_SIZE];
+};
+
+#endif
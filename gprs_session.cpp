@@ -0,0 +1,352 @@
+#include "gprs_session.h"
+
+#include "at_parse.h"
+
+#include <cstdio>
+#include <cstring>
+
+struct GprsStep {
+    const char *cmd;
+    uint32_t timeoutMs;
+    const char *expect;
+};
+
+// From any state to an active PDP context with a local IP address
+static const GprsStep attachSteps[] = {
+    // closes whatever is left, back to IP INITIAL
+    {"AT+CIPSHUT", 65000, "SHUT OK"},
+    // no echo of the AT+CIPSEND data
+    {"ATE0", 1000, "OK"},
+    {"AT+CIPMUX=0", 1000, "OK"},
+    // received data waits in the module until read, it does not mix with
+    // the result codes
+    {"AT+CIPRXGET=1", 1000, "OK"},
+    {"AT+CGATT=1", GPRS_ATTACH_TIMEOUT_MS, "OK"},
+    {"AT+CSTT=\"" GPRS_APN "\",\"" GPRS_USER "\",\"" GPRS_PASSWORD "\"", 1000, "OK"},
+    {"AT+CIICR", GPRS_CIICR_TIMEOUT_MS, "OK"},
+    // answers the bare address, without OK
+    {"AT+CIFSR", 2000, ""},
+};
+
+GprsSession::GprsSession(SIM800L &modem)
+  : modem(modem)
+{
+    // the server closed the connection, or the network dropped the context
+    modem.at.onUrc("CLOSED", &onUrc, this);
+    modem.at.onUrc("+PDP: DEACT", &onUrc, this);
+    // data from the server is waiting
+    modem.at.onUrc("+CIPRXGET: 1", &onUrc, this);
+}
+
+bool GprsSession::queue(const uint8_t *data, size_t len)
+{
+    if (len == 0 || len > GPRS_SEND_MAX || records == GPRS_MAX_RECORDS || used + len > GPRS_BUFFER_SIZE)
+    {
+        dropped++;
+        return false;
+    }
+    // appended behind the batch in flight, which stays where it is
+    memcpy(buffer + used, data, len);
+    used += len;
+    recordLen[records] = (uint16_t)len;
+    recordMs[records] = to_ms_since_boot(get_absolute_time());
+    records++;
+    return true;
+}
+
+void GprsSession::clear()
+{
+    used = inFlightBytes;
+    records = inFlightRecords;
+}
+
+void GprsSession::flush()
+{
+    flushing = true;
+}
+
+void GprsSession::close()
+{
+    closeRequested = true;
+}
+
+void GprsSession::poll()
+{
+    if (waiting)
+        return;
+    if (linkLost)
+    {
+        linkLost = false;
+        if (st == GPRS_STATE::CONNECTED || st == GPRS_STATE::CONNECTING)
+            lost();
+    }
+    if (closeRequested)
+    {
+        closeRequested = false;
+        if (st == GPRS_STATE::CONNECTED)
+        {
+            waiting = modem.at.send("AT+CIPCLOSE", 5000, &onClose, this, "CLOSE OK");
+            if (waiting)
+                return;
+            lost();
+        }
+    }
+    if (st == GPRS_STATE::BACKOFF && time_reached(retryAt))
+        st = GPRS_STATE::IDLE;
+    if (st == GPRS_STATE::CONNECTED && rxPending)
+    {
+        /*
+        AT+CIPRXGET=3,<reqlength>
+        Response
+        +CIPRXGET: 3,<cnflength>,<cnflength still in the module>
+        <data as hex>
+        OK
+        */
+        char cmd[24];
+        snprintf(cmd, sizeof(cmd), "AT+CIPRXGET=3,%u", (unsigned)GPRS_RX_CHUNK);
+        waiting = modem.at.send(cmd, 2000, &onRead, this);
+        if (waiting)
+            return;
+    }
+    if (!flushing)
+        return;
+    if (st == GPRS_STATE::IDLE && modem.state == SIM_STATE::READY)
+        connect();
+    else if (st == GPRS_STATE::CONNECTED)
+        sendNext();
+}
+
+void GprsSession::connect()
+{
+    if (contextUp)
+    {
+        startTcp();
+        return;
+    }
+    st = GPRS_STATE::ATTACHING;
+    step = 0;
+    nextStep();
+}
+
+void GprsSession::nextStep()
+{
+    const GprsStep &s = attachSteps[step];
+    waiting = modem.at.send(s.cmd, s.timeoutMs, &onStep, this, s.expect);
+    if (!waiting)
+        fail();
+}
+
+void GprsSession::onStep(AT_RESULT result, const char *response, void *ctx)
+{
+    GprsSession *self = (GprsSession *)ctx;
+    self->waiting = false;
+    const GprsStep &s = attachSteps[self->step];
+    // AT+CIFSR takes any line, an error included: it has to be an address
+    const bool ok = result == AT_RESULT::OK
+        && (*s.expect || (strchr(response, '.') && !strstr(response, "ERROR")));
+    if (!ok)
+    {
+        self->fail();
+        return;
+    }
+    if (++self->step < sizeof(attachSteps) / sizeof(attachSteps[0]))
+    {
+        self->nextStep();
+        return;
+    }
+    self->contextUp = true;
+    self->contexts++;
+    self->startTcp();
+}
+
+void GprsSession::startTcp()
+{
+    /*
+    AT+CIPSTART="TCP","<address>","<port>"
+    Response
+    OK
+    CONNECT OK, ALREADY CONNECT or STATE: <state> with CONNECT FAIL
+    */
+    char cmd[AT_CMD_MAX];
+    snprintf(cmd, sizeof(cmd), "AT+CIPSTART=\"TCP\",\"%s\",\"%u\"", GPRS_SERVER_HOST, (unsigned)GPRS_SERVER_PORT);
+    st = GPRS_STATE::CONNECTING;
+    waiting = modem.at.send(cmd, GPRS_CONNECT_TIMEOUT_MS, &onConnect, this, "CONNECT OK");
+    if (!waiting)
+        fail();
+}
+
+void GprsSession::onConnect(AT_RESULT result, const char *, void *ctx)
+{
+    GprsSession *self = (GprsSession *)ctx;
+    self->waiting = false;
+    if (result != AT_RESULT::OK)
+    {
+        // the context may be what is broken
+        if (++self->tcpFailures >= GPRS_TCP_RETRIES)
+            self->contextUp = false;
+        self->fail();
+        return;
+    }
+    self->st = GPRS_STATE::CONNECTED;
+    self->connects++;
+    self->consecutiveFailures = 0;
+    self->tcpFailures = 0;
+    self->notify(GPRS_EVENT::CONNECTED);
+}
+
+void GprsSession::sendNext()
+{
+    if (records == 0)
+    {
+        flushing = false;
+        return;
+    }
+    // whole records up to GPRS_SEND_MAX
+    inFlightBytes = 0;
+    inFlightRecords = 0;
+    while (inFlightRecords < records && inFlightBytes + recordLen[inFlightRecords] <= GPRS_SEND_MAX)
+        inFlightBytes += recordLen[inFlightRecords++];
+
+    /*
+    AT+CIPSEND=<length>
+    Response
+    > (then exactly <length> bytes of data)
+    SEND OK, or SEND FAIL
+    */
+    char cmd[24];
+    snprintf(cmd, sizeof(cmd), "AT+CIPSEND=%u", (unsigned)inFlightBytes);
+    waiting = modem.at.send(cmd, GPRS_SEND_TIMEOUT_MS, &onSent, this, "SEND OK", buffer, inFlightBytes);
+    if (!waiting)
+        fail();
+}
+
+void GprsSession::onSent(AT_RESULT result, const char *, void *ctx)
+{
+    GprsSession *self = (GprsSession *)ctx;
+    self->waiting = false;
+    if (result != AT_RESULT::OK)
+    {
+        // the records stay, the connection is started over
+        self->inFlightBytes = 0;
+        self->inFlightRecords = 0;
+        self->contextUp = false;
+        self->fail();
+        self->notify(GPRS_EVENT::CLOSED);
+        return;
+    }
+    self->sends++;
+    self->bytesSent += self->inFlightBytes;
+    self->recordsSent += self->inFlightRecords;
+
+    self->used -= self->inFlightBytes;
+    self->records -= self->inFlightRecords;
+    memmove(self->buffer, self->buffer + self->inFlightBytes, self->used);
+    memmove(self->recordLen, self->recordLen + self->inFlightRecords, self->records * sizeof(self->recordLen[0]));
+    memmove(self->recordMs, self->recordMs + self->inFlightRecords, self->records * sizeof(self->recordMs[0]));
+    self->inFlightBytes = 0;
+    self->inFlightRecords = 0;
+    if (self->records == 0)
+        self->flushing = false;
+}
+
+static uint8_t hexDigit(char c)
+{
+    return c <= '9' ? c - '0' : (c | 0x20) - 'a' + 10;
+}
+
+void GprsSession::onRead(AT_RESULT result, const char *response, void *ctx)
+{
+    GprsSession *self = (GprsSession *)ctx;
+    self->waiting = false;
+    self->rxPending = false;
+    AtTokens tokens;
+    const char *line = AtTokens::findLine(response, "+CIPRXGET: 3");
+    int32_t len, remaining;
+    if (result != AT_RESULT::OK || !line || !tokens.parse(line, "+CIPRXGET") || !tokens.integer(1, &len)
+        || !tokens.integer(2, &remaining) || len < 0 || len > GPRS_RX_CHUNK)
+        return;
+    // more arrived while reading
+    self->rxPending = remaining > 0 || strstr(response, "+CIPRXGET: 1");
+    const char *hex = strchr(line, '\n');
+    if (!len || !hex || strspn(hex + 1, "0123456789abcdefABCDEF") < 2 * (size_t)len)
+        return;
+    hex++;
+    uint8_t data[GPRS_RX_CHUNK];
+    for (int32_t i = 0; i < len; i++)
+        data[i] = (uint8_t)(hexDigit(hex[2 * i]) << 4 | hexDigit(hex[2 * i + 1]));
+    self->bytesReceived += len;
+    self->notify(GPRS_EVENT::DATA, data, (size_t)len);
+}
+
+void GprsSession::onClose(AT_RESULT, const char *, void *ctx)
+{
+    GprsSession *self = (GprsSession *)ctx;
+    self->waiting = false;
+    self->lost();
+}
+
+void GprsSession::onUrc(const char *line, void *ctx)
+{
+    GprsSession *self = (GprsSession *)ctx;
+    if (!strncmp(line, "+CIPRXGET", 9))
+    {
+        self->rxPending = true;
+        return;
+    }
+    if (!strncmp(line, "+PDP", 4))
+        self->contextUp = false;
+    if (self->st == GPRS_STATE::CONNECTED || self->st == GPRS_STATE::CONNECTING)
+    {
+        self->closed++;
+        // taken up in poll(), a command of ours may still be in flight
+        self->linkLost = true;
+    }
+}
+
+void GprsSession::lost()
+{
+    st = GPRS_STATE::IDLE;
+    rxPending = false;
+    notify(GPRS_EVENT::CLOSED);
+}
+
+void GprsSession::notify(GPRS_EVENT event, const uint8_t *data, size_t len)
+{
+    if (handler)
+        handler(event, data, len, handlerCtx);
+}
+
+void GprsSession::fail()
+{
+    failures++;
+    consecutiveFailures++;
+    st = GPRS_STATE::BACKOFF;
+    retryAt = make_timeout_time_ms(backoffMs());
+}
+
+uint32_t GprsSession::backoffMs() const
+{
+    if (consecutiveFailures == 0)
+        return 0;
+    uint32_t ms = GPRS_BACKOFF_MIN_MS;
+    for (uint32_t i = 1; i < consecutiveFailures && ms < GPRS_BACKOFF_MAX_MS; i++)
+        ms *= 2;
+    return ms < GPRS_BACKOFF_MAX_MS ? ms : GPRS_BACKOFF_MAX_MS;
+}
+
+const char *GprsSession::stateName(GPRS_STATE s)
+{
+    switch (s)
+    {
+    case GPRS_STATE::ATTACHING:
+        return "attaching";
+    case GPRS_STATE::CONNECTING:
+        return "connecting";
+    case GPRS_STATE::CONNECTED:
+        return "connected";
+    case GPRS_STATE::BACKOFF:
+        return "backoff";
+    default:
+        return "idle";
+    }
+}
@@ -0,0 +1,153 @@
+#ifndef __gprs_session_H__
+#define __gprs_session_H__
+
+#include "pico/time.h"
+
+#include "sim800l.h"
+#include "secrets.h"
+
+#include <cinttypes>
+#include <cstddef>
+
+// Access point and server, normally from secrets.h
+#ifndef GPRS_APN
+#define GPRS_APN "internet"
+#endif
+#ifndef GPRS_USER
+#define GPRS_USER ""
+#endif
+#ifndef GPRS_PASSWORD
+#define GPRS_PASSWORD ""
+#endif
+#ifndef GPRS_SERVER_HOST
+#define GPRS_SERVER_HOST "tracker.example.net"
+#endif
+#ifndef GPRS_SERVER_PORT
+#define GPRS_SERVER_PORT 5000
+#endif
+
+// Records waiting to be sent, bytes and count
+#define GPRS_BUFFER_SIZE 4096
+#define GPRS_MAX_RECORDS 64
+// Bytes per AT+CIPSEND, whole records only (the module takes up to 1460)
+#define GPRS_SEND_MAX    1024
+
+// Retry delay after a failed attach, connect or send, doubling up to the
+// maximum; reset by a successful connect
+#define GPRS_BACKOFF_MIN_MS 5000
+#define GPRS_BACKOFF_MAX_MS 300000
+// AT+CIPSTART failures on an active PDP context before it is set up anew
+#define GPRS_TCP_RETRIES    2
+
+// Bytes per AT+CIPRXGET=3 read, hex encoded they must fit an AT line
+#define GPRS_RX_CHUNK 60
+
+#define GPRS_ATTACH_TIMEOUT_MS  10000
+#define GPRS_CIICR_TIMEOUT_MS   85000
+#define GPRS_CONNECT_TIMEOUT_MS 75000
+#define GPRS_SEND_TIMEOUT_MS    20000
+
+enum class GPRS_EVENT {
+    CONNECTED,      // a new TCP connection, nothing sent on it yet
+    CLOSED,         // the connection is gone, by close() or not
+    DATA            // bytes from the server
+};
+
+typedef void (*gprs_event_fn)(GPRS_EVENT event, const uint8_t *data, size_t len, void *ctx);
+
+enum class GPRS_STATE {
+    IDLE,           // no connection, nothing to send or the modem not ready
+    ATTACHING,      // bringing up the PDP context (AT+CSTT, AT+CIICR)
+    CONNECTING,     // AT+CIPSTART
+    CONNECTED,
+    BACKOFF         // waiting to retry
+};
+
+// TCP uplink over the SIM800L's GPRS stack in single connection mode.
+// Records are queued, and flush() sends them in batches of whole records
+// with AT+CIPSEND=<length>. The connection stays open between flushes; if
+// the server closes it, it is reopened on the PDP context that is still
+// up, everything else starts over from AT+CIPSHUT after a backoff. Unsent
+// records stay queued through all of it. Data from the server waits in the
+// module (AT+CIPRXGET=1) until poll() reads it. Like SIM800L, nothing here
+// waits for the modem: poll() from the modem task moves the session along.
+class GprsSession {
+public:
+    explicit GprsSession(SIM800L &modem);
+
+    // Connection events and received data, for a protocol on top
+    void setHandler(gprs_event_fn fn, void *ctx) { handler = fn; handlerCtx = ctx; }
+
+    // Copies a record into the queue, false if it does not fit
+    bool queue(const uint8_t *data, size_t len);
+    // Drops the queued records that are not being sent
+    void clear();
+    // Sends everything queued, connecting first if needed (also with
+    // nothing queued)
+    void flush();
+    // Closes the TCP connection (AT+CIPCLOSE), the PDP context stays
+    void close();
+    // After the modem's poll()
+    void poll();
+
+    GPRS_STATE state() const { return st; }
+    bool connected() const { return st == GPRS_STATE::CONNECTED; }
+    // queued records, the oldest queued at oldestMs()
+    size_t pending() const { return records; }
+    uint32_t oldestMs() const { return records ? recordMs[0] : 0; }
+    // the current retry delay, 0 without failures
+    uint32_t backoffMs() const;
+
+    static const char *stateName(GPRS_STATE s);
+
+    // statistics
+    uint32_t contexts = 0;      // PDP context activations
+    uint32_t connects = 0;      // TCP connections opened
+    uint32_t sends = 0;         // AT+CIPSEND
+    uint32_t recordsSent = 0;
+    uint64_t bytesSent = 0;
+    uint32_t failures = 0;      // attach, connect or send
+    uint32_t closed = 0;        // connections lost (CLOSED, +PDP: DEACT)
+    uint32_t dropped = 0;       // records that did not fit in the queue
+    uint64_t bytesReceived = 0;
+
+private:
+    void connect();
+    void nextStep();
+    void startTcp();
+    void sendNext();
+    void fail();
+    void lost();
+    void notify(GPRS_EVENT event, const uint8_t *data = nullptr, size_t len = 0);
+
+    static void onStep(AT_RESULT result, const char *response, void *ctx);
+    static void onConnect(AT_RESULT result, const char *response, void *ctx);
+    static void onSent(AT_RESULT result, const char *response, void *ctx);
+    static void onRead(AT_RESULT result, const char *response, void *ctx);
+    static void onClose(AT_RESULT result, const char *response, void *ctx);
+    static void onUrc(const char *line, void *ctx);
+
+    SIM800L &modem;
+    GPRS_STATE st = GPRS_STATE::IDLE;
+    size_t step = 0;
+    bool waiting = false;       // one of our commands is queued or in flight
+    bool flushing = false;
+    bool contextUp = false;
+    bool linkLost = false;
+    bool rxPending = false;
+    bool closeRequested = false;
+    gprs_event_fn handler = nullptr;
+    void *handlerCtx = nullptr;
+    uint32_t consecutiveFailures = 0;
+    uint32_t tcpFailures = 0;
+    absolute_time_t retryAt;
+
+    uint8_t buffer[GPRS_BUFFER_SIZE];
+    size_t used = 0;
+    uint16_t recordLen[GPRS_MAX_RECORDS];
+    uint32_t recordMs[GPRS_MAX_RECORDS];
+    size_t records = 0;
+    size_t inFlightBytes = 0, inFlightRecords = 0;
+};
+
+#endif
@@ -0,0 +1,364 @@
+// AtEngine against a scripted modem in the simulated HAL: plain OK,
+// intermediate lines, error results, timeouts, URCs arriving in the middle
+// of a command, pipelined commands, the data prompt of AT+CMGS / AT+CIPSEND
+// and a full queue. The engine on uart0 receives through uart_dma_rx, the
+// one on uart1 through the per-character interrupt; both run the same
+// cases. Also checks that poll() never takes virtual time, i.e. never waits
+// for the modem. Exits non-zero if a case fails.
+//
+//   at_bench
+
+#include "sim_hal.h"
+
+#include "pico/stdlib.h"
+#include "at_engine.h"
+#include "uart_dma_rx.h"
+
+#include <cstring>
+#include <deque>
+#include <string>
+#include <vector>
+
+#define BENCH_BAUD    9600
+#define BENCH_POLL_MS 5
+
+// Expects commands in script order and answers each with canned lines. A
+// step with a prompt sends "> " and takes dataLen bytes (or up to Ctrl-Z
+// with dataLen 0) before its replies. Unexpected commands get ERROR.
+struct ScriptedModem : SimUartDevice
+{
+    struct Reply
+    {
+        uint32_t delayMs;
+        std::string text;
+    };
+    struct Step
+    {
+        std::string expect;
+        std::vector<Reply> replies;
+        bool prompt;
+        size_t dataLen;
+    };
+
+    explicit ScriptedModem(uart_inst_t* u) : uart(u) { sim_uart_attach(uart, this); }
+
+    void expect(const std::string& cmd, std::vector<Reply> replies, bool prompt = false, size_t dataLen = 0)
+    {
+        script.push_back({cmd, replies, prompt, dataLen});
+    }
+
+    // A line at a time, framed like the module does
+    void line(const std::string& text, uint32_t delayMs)
+    {
+        raw("\r\n" + text + "\r\n", delayMs);
+    }
+
+    void raw(const std::string& text, uint32_t delayMs)
+    {
+        uart_inst_t* u = uart;
+        sim_schedule_at(sim_now_us() + 1000ull * delayMs, [u, text]() {
+            sim_uart_inject(u, (const uint8_t*)text.data(), text.size());
+        });
+    }
+
+    void onRx(uint8_t c)
+    {
+        if (inData)
+        {
+            const bool end = dataLen ? (data += (char)c, data.size() == dataLen) : c == 0x1a;
+            if (!end && !dataLen)
+                data += (char)c;
+            if (end)
+            {
+                inData = false;
+                answer(dataStep);
+            }
+            return;
+        }
+        if (echo)
+            sim_uart_inject(uart, &c, 1);
+        if (c != '\r')
+        {
+            cmd += (char)c;
+            return;
+        }
+        std::string got;
+        got.swap(cmd);
+        if (script.empty() || script.front().expect != got)
+        {
+            unexpected++;
+            line("ERROR", 10);
+            return;
+        }
+        Step step = script.front();
+        script.pop_front();
+        if (!step.prompt)
+        {
+            answer(step);
+            return;
+        }
+        raw("\r\n> ", 10);
+        inData = true;
+        data.clear();
+        dataLen = step.dataLen;
+        dataStep = step;
+    }
+
+    void answer(const Step& step)
+    {
+        for (const Reply& r : step.replies)
+            line(r.text, r.delayMs);
+    }
+
+    uart_inst_t* uart;
+    bool echo = true;
+    std::deque<Step> script;
+    std::string cmd;
+    bool inData = false;
+    size_t dataLen = 0;
+    std::string data;
+    Step dataStep;
+    uint32_t unexpected = 0;
+};
+
+struct Result
+{
+    bool done = false;
+    AT_RESULT result = AT_RESULT::OK;
+    std::string response;
+    uint64_t atUs = 0;
+    int order = 0;
+};
+
+static int completions;
+
+static void on_done(AT_RESULT result, const char* response, void* ctx)
+{
+    Result* r = (Result*)ctx;
+    r->done = true;
+    r->result = result;
+    r->response = response;
+    r->atUs = sim_now_us();
+    r->order = ++completions;
+}
+
+static std::vector<std::string> urcLines;
+
+static void on_urc(const char* line, void*)
+{
+    urcLines.push_back(line);
+}
+
+static AtEngine engine0(uart0), engine1(uart1);
+UART_DMA_RX_BUFFER(dma_buffer, 10);
+static uart_dma_rx_t dma_rx;
+
+static void on_uart0_rx()
+{
+    uart_dma_rx_irq(&dma_rx);
+}
+
+static void on_uart1_rx()
+{
+    while (uart_is_readable(uart1))
+        engine1.rxChar(uart_getc(uart1));
+}
+
+static void setupUart(uart_inst_t* uart, irq_handler_t handler)
+{
+    uart_init(uart, BENCH_BAUD);
+    uart_set_format(uart, 8, 1, UART_PARITY_NONE);
+    uart_set_fifo_enabled(uart, false);
+    const uint irq = uart == uart0 ? UART0_IRQ : UART1_IRQ;
+    irq_set_exclusive_handler(irq, handler);
+    irq_set_enabled(irq, true);
+    uart_set_irq_enables(uart, true, false);
+}
+
+struct Bench
+{
+    const char* path;
+    AtEngine& at;
+    ScriptedModem modem;
+    uint64_t pollsTakingTime = 0;
+    int failures = 0;
+
+    Bench(const char* p, AtEngine& e, uart_inst_t* uart) : path(p), at(e), modem(uart) {}
+
+    // Polls like the modem task until the engine is idle and the line is
+    // quiet for settleMs
+    void run(uint32_t settleMs = 100)
+    {
+        uint64_t quietFrom = sim_now_us();
+        while (!at.idle() || sim_now_us() - quietFrom < 1000ull * settleMs)
+        {
+            if (!at.idle())
+                quietFrom = sim_now_us();
+            const uint64_t before = sim_now_us();
+            at.poll();
+            pollsTakingTime += sim_now_us() != before;
+            sleep_ms(BENCH_POLL_MS);
+        }
+    }
+
+    void check(const char* name, bool ok)
+    {
+        printf("%-6s %-34s %s\n", path, name, ok ? "ok" : "FAIL");
+        failures += !ok;
+    }
+
+    void cases()
+    {
+        typedef std::vector<ScriptedModem::Reply> R;
+
+        Result plain;
+        modem.expect("AT", R{{20, "OK"}});
+        at.send("AT", 1000, &on_done, &plain);
+        run();
+        check("ok", plain.done && plain.result == AT_RESULT::OK && plain.response == "OK");
+
+        Result csq;
+        modem.expect("AT+CSQ", R{{20, "+CSQ: 18,0"}, {20, "OK"}});
+        at.send("AT+CSQ", 1000, &on_done, &csq);
+        run();
+        check("intermediate line", csq.done && csq.result == AT_RESULT::OK && csq.response == "+CSQ: 18,0\nOK");
+
+        Result cme;
+        modem.expect("AT+CPIN=0000", R{{400, "+CME ERROR: 16"}});
+        at.send("AT+CPIN=0000", 5000, &on_done, &cme);
+        run();
+        check("+CME ERROR", cme.done && cme.result == AT_RESULT::ERROR && cme.response == "+CME ERROR: 16");
+
+        Result silent;
+        modem.expect("AT+CIICR", R{});
+        const uint64_t sentAt = sim_now_us();
+        at.send("AT+CIICR", 500, &on_done, &silent);
+        run();
+        // counted from the end of the command, which leaves a character
+        // per poll without the transmit FIFO
+        const uint64_t waited = silent.atUs - sentAt;
+        check("timeout", silent.done && silent.result == AT_RESULT::TIMEOUT && waited >= 500000
+            && waited < 500000 + (strlen("AT+CIICR\r") + 1) * BENCH_POLL_MS * 1000);
+
+        // RING and +CMTI between the answer lines
+        Result cops;
+        urcLines.clear();
+        modem.expect("AT+COPS?", R{{200, "+COPS: 0,0,\"NET\""}, {300, "OK"}});
+        modem.line("RING", 100);
+        modem.line("+CMTI: \"SM\",3", 250);
+        at.send("AT+COPS?", 1000, &on_done, &cops);
+        run();
+        check("urcs during a command", cops.done && cops.result == AT_RESULT::OK
+            && cops.response == "+COPS: 0,0,\"NET\"\nOK" && urcLines.size() == 2 && urcLines[0] == "RING"
+            && urcLines[1] == "+CMTI: \"SM\",3");
+
+        // +CPIN: is a URC as well, but here it is the answer
+        Result cpin;
+        urcLines.clear();
+        modem.expect("AT+CPIN?", R{{20, "+CPIN: READY"}, {20, "OK"}});
+        at.send("AT+CPIN?", 1000, &on_done, &cpin);
+        run();
+        modem.line("+CPIN: NOT READY", 10);
+        run();
+        check("answer with a urc prefix", cpin.done && cpin.response == "+CPIN: READY\nOK" && urcLines.size() == 1
+            && urcLines[0] == "+CPIN: NOT READY");
+
+        Result p[3];
+        completions = 0;
+        modem.expect("AT", R{{20, "OK"}});
+        modem.expect("AT+CSQ", R{{20, "+CSQ: 20,0"}, {20, "OK"}});
+        modem.expect("AT+CBC", R{{20, "+CBC: 0,82,4012"}, {20, "OK"}});
+        const uint32_t completedBefore = at.completed;
+        at.send("AT", 1000, &on_done, &p[0]);
+        at.send("AT+CSQ", 1000, &on_done, &p[1]);
+        at.send("AT+CBC", 1000, &on_done, &p[2]);
+        run();
+        check("pipelined", at.completed == completedBefore + 3 && p[0].order == 1 && p[1].order == 2
+            && p[2].order == 3 && p[2].response == "+CBC: 0,82,4012\nOK");
+
+        modem.echo = false;
+        Result quiet;
+        modem.expect("AT+CSQ", R{{20, "+CSQ: 7,3"}, {20, "OK"}});
+        at.send("AT+CSQ", 1000, &on_done, &quiet);
+        run();
+        modem.echo = true;
+        check("without echo", quiet.done && quiet.response == "+CSQ: 7,3\nOK");
+
+        static const uint8_t sms[] = "tracker parked\x1a";
+        Result cmgs;
+        modem.expect("AT+CMGS=\"+3612345678\"", R{{500, "+CMGS: 7"}, {500, "OK"}}, true);
+        at.send("AT+CMGS=\"+3612345678\"", 60000, &on_done, &cmgs, "OK", sms, sizeof(sms) - 1);
+        run();
+        check("prompt and payload (Ctrl-Z)", cmgs.done && cmgs.result == AT_RESULT::OK
+            && modem.data == "tracker parked" && cmgs.response.find("+CMGS: 7\nOK") != std::string::npos);
+
+        static const uint8_t packet[] = {0x10, 0x0c, 0x00, 0x04, 'M', 'Q', 'T', 'T'};
+        Result cipsend, failed;
+        modem.expect("AT+CIPSEND=8", R{{300, "SEND OK"}}, true, sizeof(packet));
+        modem.expect("AT+CIPSEND=8", R{{300, "SEND FAIL"}}, true, sizeof(packet));
+        at.send("AT+CIPSEND=8", 5000, &on_done, &cipsend, "SEND OK", packet, sizeof(packet));
+        at.send("AT+CIPSEND=8", 5000, &on_done, &failed, "SEND OK", packet, sizeof(packet));
+        run();
+        check("prompt and payload (length)", cipsend.done && cipsend.result == AT_RESULT::OK
+            && failed.done && failed.result == AT_RESULT::ERROR
+            && modem.data == std::string((const char*)packet, sizeof(packet)));
+
+        urcLines.clear();
+        const uint32_t strayBefore = at.strayLines;
+        modem.line("UNDER-VOLTAGE WARNNING", 10);
+        modem.line("+CREG: 1", 20);
+        run();
+        check("idle urc and stray line", urcLines.size() == 1 && at.strayLines == strayBefore + 1);
+
+        const uint32_t cutBefore = at.cutLines;
+        modem.line(std::string(300, 'x'), 10);
+        // 300 characters take 313 ms at 9600 baud
+        run(400);
+        check("overlong line", at.cutLines == cutBefore + 1);
+
+        Result q[AT_QUEUE + 1];
+        for (int i = 0; i < AT_QUEUE; i++)
+            modem.expect("AT", R{{10, "OK"}});
+        bool accepted = true;
+        for (int i = 0; i < AT_QUEUE; i++)
+            accepted &= at.send("AT", 1000, &on_done, &q[i]);
+        const bool refused = !at.send("AT", 1000, &on_done, &q[AT_QUEUE]);
+        run();
+        bool allDone = true;
+        for (int i = 0; i < AT_QUEUE; i++)
+            allDone &= q[i].done && q[i].result == AT_RESULT::OK;
+        check("queue full", accepted && refused && allDone && !q[AT_QUEUE].done);
+
+        check("script consumed", modem.script.empty() && modem.unexpected == 0 && at.lineOverflows() == 0);
+        check("poll never waits", pollsTakingTime == 0);
+        printf("%-6s completed %u  errors %u  timeouts %u  urcs %u  stray %u  cut %u  rejected %u  line queue high-water %u\n",
+            path, at.completed, at.errors, at.timeouts, at.urcs, at.strayLines, at.cutLines, at.rejected,
+            at.linesHighWater());
+    }
+};
+
+int main()
+{
+    stdio_init_all();
+    setupUart(uart0, &on_uart0_rx);
+    uart_dma_rx_init(&dma_rx, uart0, dma_buffer, 10, UART_DMA_RX_TRANSFERS);
+    engine0.attachDmaRx(&dma_rx);
+    setupUart(uart1, &on_uart1_rx);
+
+    AtEngine* engines[] = {&engine0, &engine1};
+    for (AtEngine* e : engines)
+    {
+        e->onUrc("RING", &on_urc);
+        e->onUrc("+CMTI:", &on_urc);
+        e->onUrc("+CPIN:", &on_urc);
+        e->onUrc("UNDER-VOLTAGE", &on_urc);
+    }
+    static Bench dma("dma", engine0, uart0);
+    dma.cases();
+    static Bench irq("irq", engine1, uart1);
+    irq.cases();
+    const int failures = dma.failures + irq.failures;
+
+    printf("%s\n", failures ? "FAIL" : "all cases pass");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,255 @@
+// Modem response parsing throughput: received characters through the
+// AtEngine line assembly (what the RX interrupt runs) and lines through
+// AtTokens, against the std::string handling the SIM800L driver used to
+// have. Counts heap allocations on the way and exits non-zero if the line
+// assembly or the tokenizer allocate or if a parsing check fails.
+//
+//   at_parse_bench [--passes N]
+
+#include "bench_util.h"
+
+#include "at_engine.h"
+#include "at_parse.h"
+#include "sim800l.h"
+
+#include <algorithm>
+#include <cstring>
+#include <new>
+#include <string>
+#include <vector>
+
+static uint64_t allocations;
+
+void* operator new(size_t size)
+{
+    allocations++;
+    void* p = malloc(size ? size : 1);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void* p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    free(p);
+}
+
+// what the module sends between commands of a report cycle
+static const char* const corpus[] = {
+    "AT+CSQ",
+    "+CSQ: 18,0",
+    "OK",
+    "+CBC: 0,82,4012",
+    "+CCLK: \"24/10/21,22:00:00+08\"",
+    "+CREG: 1,1",
+    "+CGATT: 1",
+    "+CIPSTATUS: 0,,\"TCP\",\"203.0.113.7\",\"1883\",\"CONNECTED\"",
+    "+COPS: 0,0,\"Telekom.de\"",
+    "+CMTI: \"SM\",3",
+    "RING",
+    "+CME ERROR: 16",
+    "SEND OK",
+    "ERROR",
+};
+
+static int failures;
+
+static void check(const char* name, bool ok)
+{
+    if (!ok)
+    {
+        printf("FAIL: %s\n", name);
+        failures++;
+    }
+}
+
+static void checks()
+{
+    AtTokens t;
+    int32_t a = 0, b = 0;
+    check("csq", t.parse("+CSQ: 18,99", "+CSQ") && t.count() == 2 && t.integer(0, &a) && t.integer(1, &b)
+        && a == 18 && b == 99);
+    check("wrong prefix", !t.parse("+CSQ: 18,99", "+CBC"));
+    check("spaces", t.parse("+CBC: 0, 82,4012", "+CBC") && t.integer(1, &a) && a == 82);
+    check("quoted comma", t.parse("+COPS: 0,0,\"a,b\"") && t.count() == 3 && t[2].quoted && t.equals(2, "a,b"));
+    check("empty field", t.parse("+CIPSTATUS: 0,,\"TCP\"") && t.count() == 3 && t[1].len == 0 && !t.integer(1, &a));
+    check("unterminated quote", !t.parse("+COPS: 0,0,\"abc"));
+    check("not a number", t.parse("+X: 12a") && !t.integer(0, &a));
+    check("int32 range", t.parse("+X: -2147483648,2147483648") && t.integer(0, &a) && a == INT32_MIN
+        && !t.integer(1, &a));
+    check("field overflow", t.parse("+X: 1,2,3,4,5,6,7,8,9,10,11,12,13") && t.overflow() && t.count() == AT_MAX_FIELDS);
+    char small[4], fits[5];
+    check("string too long", t.parse("+X: \"abcd\"") && !t.string(0, small, sizeof(small))
+        && t.string(0, fits, sizeof(fits)) && !strcmp(fits, "abcd"));
+    check("stops at the line end", t.parse("+CSQ: 5,0\nOK", "+CSQ") && t.count() == 2 && t.integer(1, &a) && a == 0);
+    check("find line", AtTokens::findLine("AT+CSQ\n+CSQ: 5,0\nOK", "+CSQ") != nullptr
+        && !AtTokens::findLine("OK", "+CSQ"));
+
+    SignalSample sig;
+    check("signal", SIM800L::parseSignal("AT+CSQ\n+CSQ: 18,0\nOK", &sig) && sig.rssi == 18 && sig.ber == 0
+        && sig.dbm == -78 && sig.known());
+    check("signal unknown", SIM800L::parseSignal("+CSQ: 99,99", &sig) && !sig.known() && sig.dbm == 0);
+    check("signal range", !SIM800L::parseSignal("+CSQ: 32,0", &sig) && !SIM800L::parseSignal("+CSQ: 18", &sig));
+    check("dbm", SIM800L::rssiToDbm(0) == -115 && SIM800L::rssiToDbm(1) == -111 && SIM800L::rssiToDbm(2) == -110
+        && SIM800L::rssiToDbm(30) == -54 && SIM800L::rssiToDbm(31) == -52);
+    BatterySample bat;
+    check("battery", SIM800L::parseBattery("+CBC: 1,82,4012\nOK", &bat) && bat.chargeState == 1 && bat.percent == 82
+        && bat.mv == 4012);
+    check("battery range", !SIM800L::parseBattery("+CBC: 0,101,4012", &bat) && !SIM800L::parseBattery("+CBC: 0,82", &bat));
+
+    datetime_t dt;
+    int zone;
+    check("cclk", SIM800L::parseNetworkTime("+CCLK: \"24/10/21,22:01:02-16\"\nOK", &dt, &zone) && dt.year == 2024
+        && dt.month == 10 && dt.day == 21 && dt.hour == 22 && dt.min == 1 && dt.sec == 2 && zone == -16);
+    check("cclk unset", !SIM800L::parseNetworkTime("+CCLK: \"04/01/01,00:00:12+00\"\nOK", &dt, &zone));
+    check("cclk garbage", !SIM800L::parseNetworkTime("+CCLK: \"24/10/21 22:01:02+08\"\nOK", &dt, &zone));
+    check("cclk range", !SIM800L::parseNetworkTime("+CCLK: \"24/00/21,22:01:02+08\"", &dt, &zone)
+        && !SIM800L::parseNetworkTime("+CCLK: \"24/13/21,22:01:02+08\"", &dt, &zone)
+        && !SIM800L::parseNetworkTime("+CCLK: \"24/10/00,22:01:02+08\"", &dt, &zone)
+        && !SIM800L::parseNetworkTime("+CCLK: \"24/10/32,22:01:02+08\"", &dt, &zone)
+        && !SIM800L::parseNetworkTime("+CCLK: \"24/10/21,25:01:02+08\"", &dt, &zone)
+        && !SIM800L::parseNetworkTime("+CCLK: \"24/10/21,22:60:02+08\"", &dt, &zone)
+        && !SIM800L::parseNetworkTime("+CCLK: \"24/10/21,22:01:60+08\"", &dt, &zone)
+        && !SIM800L::parseNetworkTime("+CCLK: \"24/10/21,22:01:02+57\"", &dt, &zone)
+        && !SIM800L::parseNetworkTime("+CCLK: \"24/10/21,22:01:02-57\"", &dt, &zone)
+        && SIM800L::parseNetworkTime("+CCLK: \"24/12/31,23:59:59+56\"", &dt, &zone));
+
+    // overlong lines are cut and counted, not overrun
+    AtEngine at(uart1);
+    for (int i = 0; i < 300; i++)
+        at.rxChar('x');
+    at.rxChar('\n');
+    check("cut line", at.cutLines == 1);
+}
+
+// The old SIM800L::processChar / processResponse / handleStateChange path
+static size_t legacyParse(std::string& response, const std::string& rx, size_t& parsed)
+{
+    size_t answers = 0;
+    for (char c : rx)
+    {
+        response += c;
+        if (c == '\n' && (response.find("OK\r\n") != std::string::npos
+            || response.find("CME ERROR") != std::string::npos || response.find("CMS ERROR") != std::string::npos))
+        {
+            while (response.back() == '\r' || response.back() == '\n')
+                response.pop_back();
+            while (response.front() == '\r' || response.front() == '\n')
+                response.erase(0, 1);
+            std::string copy = response;
+            copy.erase(std::remove_if(copy.begin(), copy.end(), [](char ch) -> bool
+                {
+                    return ('A' < ch && ch < 'Z') || ('a' < ch && ch < 'z') || ch == '\r' || ch == '\n';
+                }), copy.end());
+            bench_keep(copy);
+            response.clear();
+            answers++;
+        }
+    }
+    parsed += answers;
+    return answers;
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t passes = 20000;
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        if (!strcmp(argv[i], "--passes"))
+            passes = strtoul(argv[i + 1], nullptr, 10);
+        else
+        {
+            fprintf(stderr, "unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    checks();
+
+    const size_t lines = sizeof(corpus) / sizeof(corpus[0]);
+    std::vector<std::string> framed;
+    std::string rx;
+    size_t chars = 0;
+    for (const char* l : corpus)
+    {
+        framed.push_back(std::string("\r\n") + l + "\r\n");
+        rx += framed.back();
+        chars += framed.back().size();
+    }
+
+    // RX interrupt line assembly, then the main loop taking the lines
+    AtEngine at(uart1);
+    BenchTimer timer;
+    uint64_t allocsBefore = allocations;
+    timer.start();
+    for (uint32_t p = 0; p < passes; p++)
+        for (const std::string& f : framed)
+        {
+            for (char c : f)
+                at.rxChar(c);
+            at.poll();
+        }
+    double secs = timer.seconds();
+    uint64_t cycles = timer.cycles();
+    const uint64_t assemblyAllocs = allocations - allocsBefore;
+    printf("--- line assembly (AtEngine::rxChar, poll)\n");
+    printf("lines/sec           %.0f\n", (double)lines * passes / secs);
+    printf("chars/sec           %.0f\n", (double)chars * passes / secs);
+    if (BENCH_HAVE_CYCLES)
+        printf("cycles/char         %.2f\n", (double)cycles / ((double)chars * passes));
+    printf("heap allocations    %" PRIu64 "\n", assemblyAllocs);
+    printf("stray lines         %u  cut %u  queue overflows %u\n", at.strayLines, at.cutLines, at.lineOverflows());
+
+    AtTokens tokens;
+    uint64_t fields = 0;
+    int64_t sum = 0;
+    allocsBefore = allocations;
+    timer.start();
+    for (uint32_t p = 0; p < passes; p++)
+        for (const char* l : corpus)
+        {
+            if (!tokens.parse(l))
+                continue;
+            fields += tokens.count();
+            for (size_t i = 0; i < tokens.count(); i++)
+            {
+                int32_t v;
+                if (tokens.integer(i, &v))
+                    sum += v;
+            }
+        }
+    secs = timer.seconds();
+    cycles = timer.cycles();
+    bench_keep(sum);
+    const uint64_t tokenAllocs = allocations - allocsBefore;
+    printf("--- tokenizer (AtTokens::parse, integer)\n");
+    printf("lines/sec           %.0f\n", (double)lines * passes / secs);
+    printf("fields/line         %.2f\n", (double)fields / ((double)lines * passes));
+    if (BENCH_HAVE_CYCLES)
+        printf("cycles/line         %.0f\n", (double)cycles / ((double)lines * passes));
+    printf("heap allocations    %" PRIu64 "\n", tokenAllocs);
+
+    std::string response;
+    size_t answers = 0;
+    allocsBefore = allocations;
+    timer.start();
+    for (uint32_t p = 0; p < passes; p++)
+        legacyParse(response, rx, answers);
+    secs = timer.seconds();
+    cycles = timer.cycles();
+    printf("--- std::string response (the old driver)\n");
+    printf("lines/sec           %.0f\n", (double)lines * passes / secs);
+    if (BENCH_HAVE_CYCLES)
+        printf("cycles/char         %.2f\n", (double)cycles / ((double)chars * passes));
+    printf("heap allocations    %.2f per line\n", (double)(allocations - allocsBefore) / ((double)lines * passes));
+
+    check("no heap in the line assembly", assemblyAllocs == 0);
+    check("no heap in the tokenizer", tokenAllocs == 0);
+    printf("%s\n", failures ? "FAIL" : "no heap, all checks pass");
+    return failures ? 1 : 0;
+}
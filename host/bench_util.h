@@ -0,0 +1,60 @@
+#ifndef __bench_util_H__
+#define __bench_util_H__
+
+// Timing helpers shared by the host benchmarks. Cycle counts come from the
+// TSC on x86 and are only comparable between runs on the same machine.
+
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_HAVE_CYCLES 1
+static inline uint64_t bench_cycles() { return __rdtsc(); }
+#else
+#define BENCH_HAVE_CYCLES 0
+static inline uint64_t bench_cycles() { return 0; }
+#endif
+
+struct BenchTimer
+{
+    std::chrono::steady_clock::time_point t0;
+    uint64_t c0;
+
+    void start()
+    {
+        t0 = std::chrono::steady_clock::now();
+        c0 = bench_cycles();
+    }
+    // seconds and cycles since start()
+    double seconds() const
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    }
+    uint64_t cycles() const { return bench_cycles() - c0; }
+};
+
+// Keeps the optimiser from dropping a result.
+template <typename T>
+static inline void bench_keep(const T& v)
+{
+    __asm__ __volatile__("" : : "g"(&v) : "memory");
+}
+
+static inline bool bench_read_file(const char* path, std::string& out)
+{
+    FILE* f = fopen(path, "rb");
+    if (!f)
+        return false;
+    char buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+        out.append(buf, n);
+    fclose(f);
+    return true;
+}
+
+#endif
@@ -0,0 +1,304 @@
+// Binary position reports (fix_codec.h) on synthetic tracks.
+//
+// Drives, walks and a parked tracker with GPS noise, reported every 30 s
+// (parked: 120 s). Checks that the decoder gives back the quantised fixes,
+// fed whole or a byte at a time, that it skips a corrupted frame and noise
+// between frames, and that a full frame refuses a fix. Prints bytes per fix
+// by frame size next to the CSV records used before, and encode and decode
+// time per fix. Exits non-zero if a check fails or a typical fix (steady
+// driving or walking, POLICY_BATCH to a frame as the firmware stores them)
+// takes 8 bytes or more. Stop and go
+// city driving is the worst case: a turn or a change of pace between two
+// reports is what the prediction cannot know.
+//
+//   fix_bench [--passes N]
+
+#include "bench_util.h"
+
+#include "fix_codec.h"
+#include "report_policy.h"
+
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+static uint32_t rng = 12345;
+static uint32_t nextRandom()
+{
+    rng = rng * 1664525 + 1013904223;
+    return rng;
+}
+
+// uniform in [-r, r]
+static double noise(double r)
+{
+    return ((nextRandom() >> 8) / 8388608.0 - 1.0) * r;
+}
+
+struct Track
+{
+    const char* name;
+    double speedKmph;
+    double speedJitter;     // km/h from report to report
+    double turnEvery;       // reports between turns, 0 for none
+    uint32_t periodS;
+};
+
+static std::vector<FixRecord> makeTrack(const Track& t, size_t n)
+{
+    std::vector<FixRecord> fixes(n);
+    double north = 0, east = 0, course = 70, speed = t.speedKmph, alt = 240;
+    const double lat0 = 47.4986683, lng0 = 19.0424492;
+    uint32_t time = 1714000000;
+    int sats = 8;
+    for (size_t i = 0; i < n; i++)
+    {
+        if (t.turnEvery && nextRandom() % (uint32_t)t.turnEvery == 0)
+            course = fmod(course + (nextRandom() & 1 ? 90 : 270) + noise(20) + 360, 360);
+        else
+            course = fmod(course + noise(4) + 360, 360);
+        speed = std::max(0.0, speed + noise(t.speedJitter));
+        if (t.speedKmph && speed < t.speedKmph / 3)
+            speed = t.speedKmph / 3;
+        const double dist = speed / 3.6 * t.periodS;
+        north += dist * cos(course * M_PI / 180);
+        east += dist * sin(course * M_PI / 180);
+        alt += noise(1.5);
+        if (nextRandom() % 10 == 0)
+            sats = std::min(12, std::max(4, sats + (nextRandom() & 1 ? 1 : -1)));
+        time += t.periodS;
+
+        // 2.5 m of receiver noise on top
+        const double lat = lat0 + (north + noise(2.5)) / 111320.0;
+        const double lng = lng0 + (east + noise(2.5)) / (111320.0 * cos(lat0 * M_PI / 180));
+        FixRecord& f = fixes[i];
+        f.time = time;
+        f.latE7 = (int32_t)lround(lat * 1e7);
+        f.lngE7 = (int32_t)lround(lng * 1e7);
+        f.altitudeCm = (int32_t)lround(alt * 100);
+        f.speedKmph100 = t.speedKmph ? (int32_t)lround(speed * 100) : (int32_t)(nextRandom() % 60);
+        f.courseCdeg = (int32_t)lround(course * 100) % 36000;
+        f.sats = (uint8_t)sats;
+        f.fields = FIX_HAS_ALT | FIX_HAS_SPEED | FIX_HAS_COURSE | FIX_HAS_SATS;
+    }
+    return fixes;
+}
+
+static int32_t quantised(int32_t v, int32_t unit)
+{
+    return (v >= 0 ? (v + unit / 2) / unit : -((-v + unit / 2) / unit)) * unit;
+}
+
+// The fix as it comes out of the decoder
+static FixRecord expected(const FixRecord& f)
+{
+    FixRecord e = f;
+    e.latE7 = quantised(f.latE7, FIX_POS_UNIT_E7);
+    e.lngE7 = quantised(f.lngE7, FIX_POS_UNIT_E7);
+    e.altitudeCm = quantised(f.altitudeCm, FIX_ALT_UNIT_CM);
+    e.speedKmph100 = quantised(f.speedKmph100, FIX_SPEED_UNIT);
+    e.courseCdeg = quantised(f.courseCdeg, FIX_COURSE_UNIT) % 36000;
+    return e;
+}
+
+static bool same(const FixRecord& a, const FixRecord& b)
+{
+    return a.time == b.time && a.latE7 == b.latE7 && a.lngE7 == b.lngE7 && a.fields == b.fields
+        && (!(a.fields & FIX_HAS_ALT) || a.altitudeCm == b.altitudeCm)
+        && (!(a.fields & FIX_HAS_SPEED) || a.speedKmph100 == b.speedKmph100)
+        && (!(a.fields & FIX_HAS_COURSE) || a.courseCdeg == b.courseCdeg)
+        && (!(a.fields & FIX_HAS_SATS) || a.sats == b.sats);
+}
+
+static void collect(const FixRecord& fix, void* ctx)
+{
+    ((std::vector<FixRecord>*)ctx)->push_back(fix);
+}
+
+// The fixes in frames of up to perFrame, back to back
+static std::string encode(const std::vector<FixRecord>& fixes, size_t perFrame)
+{
+    static uint8_t buffer[FIX_FRAME_OVERHEAD + FIX_FRAME_MAX];
+    FixEncoder enc(buffer, sizeof(buffer));
+    std::string out;
+    for (size_t i = 0; i < fixes.size(); i++)
+    {
+        if (!enc.add(fixes[i]))
+        {
+            out.append((const char*)enc.data(), enc.finish());
+            enc.begin();
+            enc.add(fixes[i]);
+        }
+        if (enc.count() == perFrame || i + 1 == fixes.size())
+        {
+            out.append((const char*)enc.data(), enc.finish());
+            enc.begin();
+        }
+    }
+    return out;
+}
+
+static bool roundTrip(const std::vector<FixRecord>& fixes, const std::string& stream, size_t chunk)
+{
+    std::vector<FixRecord> out;
+    FixDecoder dec(&collect, &out);
+    for (size_t i = 0; i < stream.size(); i += chunk)
+        dec.push((const uint8_t*)stream.data() + i, std::min(chunk, stream.size() - i));
+    if (out.size() != fixes.size() || dec.badFrames || dec.skipped)
+        return false;
+    for (size_t i = 0; i < fixes.size(); i++)
+        if (!same(out[i], expected(fixes[i])))
+            return false;
+    return true;
+}
+
+static size_t csvBytes(const std::vector<FixRecord>& fixes)
+{
+    size_t n = 0;
+    for (const FixRecord& f : fixes)
+    {
+        char record[96];
+        n += (size_t)snprintf(record, sizeof(record), "%06lu,%08lu,%ld,%ld,%ld,%ld,%ld,%ld\n", 250424ul,
+            (unsigned long)(f.time % 86400) * 100, (long)f.latE7, (long)f.lngE7, (long)f.altitudeCm,
+            (long)f.speedKmph100, (long)f.courseCdeg, (long)f.sats);
+    }
+    return n;
+}
+
+static int failures;
+
+static void check(const char* name, bool ok)
+{
+    printf("%-44s %s\n", name, ok ? "ok" : "FAIL");
+    failures += !ok;
+}
+
+int main(int argc, char** argv)
+{
+    int passes = 200;
+    for (int i = 1; i + 1 < argc; i += 2)
+        if (!strcmp(argv[i], "--passes"))
+            passes = atoi(argv[i + 1]);
+
+    const Track tracks[] = {
+        {"city", 30, 8, 8, 30},
+        {"highway", 110, 4, 0, 30},
+        {"walk", 5, 1, 0, 30},
+        {"parked", 0, 0, 0, 120},
+    };
+    const size_t fixCount = 1200;
+    const size_t frameSizes[] = {1, 5, POLICY_BATCH, 30};
+
+    printf("track     csv B/fix  binary B/fix by fixes per frame:");
+    for (size_t f : frameSizes)
+        printf(" %5zu", f);
+    printf("\n");
+    double typical = 0, worstRatio = 0;
+    bool allRoundTrip = true;
+    std::vector<std::vector<FixRecord>> all;
+    for (const Track& t : tracks)
+    {
+        all.push_back(makeTrack(t, fixCount));
+        const std::vector<FixRecord>& fixes = all.back();
+        printf("%-8s  %9.1f  %33s", t.name, (double)csvBytes(fixes) / fixCount, "");
+        for (size_t f : frameSizes)
+        {
+            const std::string stream = encode(fixes, f);
+            allRoundTrip &= roundTrip(fixes, stream, stream.size());
+            const double perFix = (double)stream.size() / fixCount;
+            printf(" %5.2f", perFix);
+            if (f == POLICY_BATCH && t.speedKmph && !t.turnEvery)
+                typical = std::max(typical, perFix);
+            if (f == POLICY_BATCH)
+                worstRatio = std::max(worstRatio, perFix * fixCount / csvBytes(fixes));
+        }
+        printf("\n");
+    }
+    check("decoded fixes are the quantised input", allRoundTrip);
+    check("typical fix under 8 bytes", typical > 0 && typical < 8);
+    check("a fifth of the CSV size or less", worstRatio < 0.2);
+
+    const std::vector<FixRecord>& city = all[0];
+    const std::string stream = encode(city, 10);
+    check("fed a byte at a time", roundTrip(city, stream, 1));
+    check("fed in 7 byte pieces", roundTrip(city, stream, 7));
+
+    // one bit flipped in the second of three frames, noise in between
+    {
+        const std::vector<FixRecord> part(city.begin(), city.begin() + 30);
+        std::string s = encode(part, 10);
+        const size_t frameLen = encode(std::vector<FixRecord>(part.begin(), part.begin() + 10), 10).size();
+        s[frameLen + 6] ^= 0x10;
+        s.insert(2 * frameLen, "xyF\x03");
+        std::vector<FixRecord> out;
+        FixDecoder dec(&collect, &out);
+        dec.push((const uint8_t*)s.data(), s.size());
+        bool ok = out.size() == 20 && dec.frames == 2 && dec.badFrames >= 1;
+        for (size_t i = 0; ok && i < 10; i++)
+            ok = same(out[i], expected(part[i])) && same(out[10 + i], expected(part[20 + i]));
+        check("corrupted frame skipped, next one decodes", ok);
+    }
+
+    // optional fields going away and time going back start key records
+    {
+        std::vector<FixRecord> fixes(city.begin(), city.begin() + 6);
+        fixes[2].fields &= (uint8_t)~FIX_HAS_SATS;
+        fixes[4].time = fixes[3].time - 5;
+        check("field changes and time steps back", roundTrip(fixes, encode(fixes, 10), 3));
+    }
+
+    {
+        uint8_t small[40];
+        FixEncoder enc(small, sizeof(small));
+        size_t added = 0;
+        while (added < 20 && enc.add(city[added]))
+            added++;
+        const size_t before = enc.size();
+        const bool refused = !enc.add(city[added]) && enc.size() == before;
+        std::vector<FixRecord> out;
+        FixDecoder dec(&collect, &out);
+        dec.push(enc.data(), enc.finish());
+        check("full frame refuses a fix", added > 1 && refused && enc.finish() <= sizeof(small)
+            && out.size() == added);
+    }
+
+    // time per fix, ten to a frame
+    static uint8_t buffer[FIX_FRAME_OVERHEAD + FIX_FRAME_MAX];
+    FixEncoder enc(buffer, sizeof(buffer));
+    BenchTimer timer;
+    timer.start();
+    size_t bytes = 0;
+    for (int p = 0; p < passes; p++)
+    {
+        for (size_t i = 0; i < city.size(); i++)
+        {
+            enc.add(city[i]);
+            if (enc.count() == 10)
+            {
+                bytes += enc.finish();
+                enc.begin();
+            }
+        }
+    }
+    bench_keep(bytes);
+    const double encodeNs = timer.seconds() * 1e9 / ((double)passes * city.size());
+    const double encodeCycles = (double)timer.cycles() / ((double)passes * city.size());
+
+    std::vector<FixRecord> sink;
+    sink.reserve(city.size());
+    FixDecoder dec(&collect, &sink);
+    timer.start();
+    for (int p = 0; p < passes; p++)
+    {
+        sink.clear();
+        dec.push((const uint8_t*)stream.data(), stream.size());
+    }
+    const double decodeNs = timer.seconds() * 1e9 / ((double)passes * city.size());
+    printf("encode %.0f ns/fix", encodeNs);
+    if (BENCH_HAVE_CYCLES)
+        printf(" (%.0f cycles, CRC included)", encodeCycles);
+    printf("  decode %.0f ns/fix\n", decodeNs);
+
+    printf("%s\n", failures ? "FAIL" : "all checks pass");
+    return failures ? 1 : 0;
+}
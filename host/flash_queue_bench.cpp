@@ -0,0 +1,298 @@
+// The flash store and forward queue (flash_queue.h) on the simulated flash,
+// mapped from an image file.
+//
+// Checks that records come out in order and unchanged through several laps
+// of the region, that the sectors wear evenly, that head and tail are found
+// again after a reset and in the reopened image, that a full queue drops
+// its oldest records, and, over many power failures cut into random flash
+// operations, that every record whose append() returned is still there, in
+// order, and that removed records only come back when the failure hit their
+// commit(). Prints records per second appended and drained, on the host and
+// as the flash's busy time allows, and the time recover() takes. Exits
+// non-zero if a check fails.
+//
+//   flash_queue_bench [--image FILE] [--trials N]
+
+#include "bench_util.h"
+#include "sim_hal.h"
+
+#include "flash_queue.h"
+
+#include <cstring>
+#include <deque>
+#include <vector>
+
+#include <unistd.h>
+
+static uint32_t rng = 12345;
+static uint32_t nextRandom()
+{
+    rng = rng * 1664525 + 1013904223;
+    return rng >> 8;
+}
+
+static int failures;
+
+static void check(const char* name, bool ok)
+{
+    printf("%-50s %s\n", name, ok ? "ok" : "FAIL");
+    failures += !ok;
+}
+
+// Record id with filler derived from it, 20 to 219 bytes
+static size_t makeRecord(uint32_t id, uint8_t* buf, size_t len = 0)
+{
+    if (!len)
+        len = 20 + id * 7 % 200;
+    memcpy(buf, &id, 4);
+    for (size_t i = 4; i < len; i++)
+        buf[i] = (uint8_t)(id * 31 + i);
+    return len;
+}
+
+struct Drain
+{
+    std::vector<uint32_t> ids;
+    bool intact = true;
+    size_t max = SIZE_MAX;
+};
+
+static bool collect(const uint8_t* data, size_t len, void* ctx)
+{
+    Drain* d = (Drain*)ctx;
+    if (d->ids.size() >= d->max)
+        return false;
+    uint32_t id;
+    uint8_t expected[FLASH_QUEUE_RECORD_MAX];
+    memcpy(&id, data, 4);
+    d->intact &= len >= 4 && makeRecord(id, expected, len) == len && !memcmp(expected, data, len);
+    d->ids.push_back(id);
+    return true;
+}
+
+// Everything from the oldest record on, without removing it
+static std::vector<uint32_t> peekAll(FlashQueue& q, bool* intact)
+{
+    Drain d;
+    q.rewind();
+    while (q.read(&collect, &d, 64) > 0)
+        ;
+    q.rewind();
+    *intact &= d.intact;
+    return d.ids;
+}
+
+static bool append(FlashQueue& q, uint32_t id)
+{
+    uint8_t buf[FLASH_QUEUE_RECORD_MAX];
+    return q.append(buf, makeRecord(id, buf));
+}
+
+int main(int argc, char** argv)
+{
+    const char* image = "flash_queue_bench.img";
+    int trials = 2000;
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        if (!strcmp(argv[i], "--image"))
+            image = argv[i + 1];
+        else if (!strcmp(argv[i], "--trials"))
+            trials = atoi(argv[i + 1]);
+    }
+    unlink(image);
+    if (!sim_flash_open(image))
+    {
+        fprintf(stderr, "cannot map %s\n", image);
+        return 1;
+    }
+
+    // small regions for the checks, so that they wrap often
+    const uint32_t small = 8 * FLASH_SECTOR_SIZE;
+    const uint32_t smallAt = 0x100000;
+
+    // laps with reads and commits in between
+    {
+        FlashQueue q(smallAt, 2 * small);
+        q.recover();
+        std::deque<uint32_t> model;
+        uint32_t next = 0;
+        bool ordered = true, intact = true;
+        while (q.erases < 6 * 16)
+        {
+            for (uint32_t n = nextRandom() % 20; n > 0; n--)
+            {
+                append(q, next);
+                model.push_back(next++);
+            }
+            Drain d;
+            d.max = nextRandom() % 24;
+            q.read(&collect, &d, SIZE_MAX);
+            q.commit();
+            intact &= d.intact;
+            for (uint32_t id : d.ids)
+            {
+                ordered &= !model.empty() && model.front() == id;
+                model.pop_front();
+            }
+        }
+        const std::vector<uint32_t> rest = peekAll(q, &intact);
+        ordered &= rest.size() == model.size() && std::equal(rest.begin(), rest.end(), model.begin());
+        check("in order and unchanged through six laps", ordered && intact && q.dropped == 0);
+
+        uint32_t least = UINT32_MAX, most = 0;
+        for (uint32_t off = smallAt; off < smallAt + 2 * small; off += FLASH_SECTOR_SIZE)
+        {
+            least = std::min(least, sim_flash_erase_count(off));
+            most = std::max(most, sim_flash_erase_count(off));
+        }
+        check("sectors erased evenly", most - least <= 1);
+
+        // a batch read and not committed comes back after a reset
+        Drain d;
+        d.max = 5;
+        q.read(&collect, &d, SIZE_MAX);
+        FlashQueue again(smallAt, 2 * small);
+        again.recover();
+        check("head and tail found after a reset", peekAll(again, &intact) == rest && intact);
+
+        sim_flash_close();
+        sim_flash_open(image);
+        FlashQueue reopened(smallAt, 2 * small);
+        reopened.recover();
+        check("and in the reopened image file", peekAll(reopened, &intact) == rest && intact);
+    }
+
+    // power failures in random flash operations
+    {
+        const uint32_t at = smallAt + 2 * small;
+        FlashQueue* q = new FlashQueue(at, small);
+        q->recover();
+        std::deque<uint32_t> model;
+        uint32_t next = 0;
+        int bad = 0, tornAppends = 0, tornCommits = 0;
+        uint32_t erases = 0;
+        for (int t = 0; t < trials && bad < 5; t++)
+        {
+            sim_flash_power_fail_after(nextRandom() % 30);
+            // what the failure may or may not have done
+            uint32_t maybeAppended = UINT32_MAX;
+            size_t maybeCommitted = 0;
+            while (sim_flash_powered())
+            {
+                if (nextRandom() % 5 < 3 && model.size() < 60)
+                {
+                    append(*q, next);
+                    if (sim_flash_powered())
+                        model.push_back(next);
+                    else
+                        maybeAppended = next;
+                    next++;
+                }
+                else
+                {
+                    Drain d;
+                    d.max = nextRandom() % 10;
+                    q->read(&collect, &d, SIZE_MAX);
+                    q->commit();
+                    if (sim_flash_powered())
+                        model.erase(model.begin(), model.begin() + d.ids.size());
+                    else
+                        maybeCommitted = d.ids.size();
+                }
+            }
+            sim_flash_power_on();
+            erases += q->erases;
+            delete q;
+            q = new FlashQueue(at, small);
+            q->recover();
+
+            bool intact = true;
+            std::vector<uint32_t> found = peekAll(*q, &intact);
+            // what may be missing at the front and extra at the end
+            size_t skip = 0;
+            if (maybeCommitted && found.size() + maybeCommitted >= model.size() && model.size() >= maybeCommitted
+                && (found.empty() || found.front() != model.front()))
+                skip = maybeCommitted;
+            const bool extra = maybeAppended != UINT32_MAX && !found.empty() && found.back() == maybeAppended;
+            const std::vector<uint32_t> expected(model.begin() + skip, model.end());
+            const std::vector<uint32_t> got(found.begin(), found.end() - extra);
+            if (!intact || got != expected)
+            {
+                if (bad++ == 0)
+                    printf("trial %d: expected %zu records, found %zu\n", t, expected.size(), found.size());
+                continue;
+            }
+            tornAppends += maybeAppended != UINT32_MAX;
+            tornCommits += maybeCommitted != 0;
+            model.assign(found.begin(), found.end());
+        }
+        erases += q->erases;
+        delete q;
+        printf("%d power failures: %d in an append, %d in a commit, %u sector erases\n", trials, tornAppends,
+            tornCommits, erases);
+        check("appended records survive power failures", bad == 0 && erases > 3 * 8);
+    }
+
+    // full: the oldest sectors go
+    {
+        const uint32_t at = smallAt + 3 * small;
+        FlashQueue q(at, small);
+        q.recover();
+        uint32_t n = 0;
+        while (q.erases < 3 * 8)
+            append(q, n++);
+        bool intact = true;
+        const std::vector<uint32_t> kept = peekAll(q, &intact);
+        bool newest = !kept.empty() && kept.back() == n - 1;
+        for (size_t i = 1; i < kept.size(); i++)
+            newest &= kept[i] == kept[i - 1] + 1;
+        check("a full queue drops its oldest records", intact && newest && q.dropped > 0
+            && kept.size() + q.dropped == n);
+
+        uint8_t big[FLASH_QUEUE_RECORD_MAX + 1] = {};
+        check("a record over FLASH_QUEUE_RECORD_MAX is refused", !q.append(big, sizeof(big)));
+    }
+
+    // throughput in the default region, 64 byte records
+    {
+        FlashQueue q;
+        q.recover();
+        const uint32_t records = 3000;
+        uint8_t buf[64];
+        const uint64_t busy0 = sim_flash_stats().busyUs;
+        BenchTimer timer;
+        timer.start();
+        for (uint32_t i = 0; i < records; i++)
+        {
+            makeRecord(i, buf, sizeof(buf));
+            q.append(buf, sizeof(buf));
+        }
+        const double appendS = timer.seconds();
+        const uint64_t appendBusy = sim_flash_stats().busyUs - busy0;
+
+        FlashQueue fresh;
+        timer.start();
+        fresh.recover();
+        const double recoverUs = timer.seconds() * 1e6;
+
+        Drain d;
+        const uint64_t busy1 = sim_flash_stats().busyUs;
+        timer.start();
+        while (fresh.read(&collect, &d, 8) > 0)
+            fresh.commit();
+        const double drainS = timer.seconds();
+        const uint64_t drainBusy = sim_flash_stats().busyUs - busy1;
+        check("drained what was appended", d.ids.size() == records && d.intact && fresh.empty());
+
+        printf("append   %9.0f records/s host, %6.0f records/s flash bound (%.2f ms/record)\n", records / appendS,
+            records * 1e6 / appendBusy, appendBusy / 1000.0 / records);
+        printf("drain    %9.0f records/s host, %6.0f records/s flash bound, batches of 8\n", records / drainS,
+            records * 1e6 / drainBusy);
+        printf("recover  %9.1f us host for %u sectors\n", recoverUs, FLASH_QUEUE_SIZE / FLASH_SECTOR_SIZE);
+    }
+
+    sim_flash_close();
+    unlink(image);
+    printf("%s\n", failures ? "FAIL" : "all checks pass");
+    return failures ? 1 : 0;
+}
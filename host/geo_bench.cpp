@@ -0,0 +1,165 @@
+// Fixed-point geodesy against the double versions in GPSPlus.
+//
+// Draws deterministic random point pairs at several separations, reports the
+// worst distance and course error of distanceBetweenFixed/courseToFixed
+// against distanceBetween/courseTo and the time per call of both. Exits
+// non-zero if an error exceeds the bound neo6m.h gives (2.5 m on the fast
+// path, 20 m beyond it, 0.06 degree of course at 10 m and 0.02 beyond 1 km)
+// or if cardinalFixed() names another direction than cardinal().
+//
+//   geo_bench [--pairs N] [--passes N]
+
+#include "bench_util.h"
+
+#include "neo6m.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+struct Pair
+{
+    int32_t lat1, lng1, lat2, lng2;
+    double dlat1, dlng1, dlat2, dlng2;
+};
+
+static uint32_t rng = 12345;
+static uint32_t nextRandom()
+{
+    rng = rng * 1664525 + 1013904223;
+    return rng;
+}
+
+// both points within maxDeltaE7 of each other, latitudes within +-80 degrees
+static std::vector<Pair> makePairs(uint32_t n, int32_t maxDeltaE7)
+{
+    std::vector<Pair> pairs(n);
+    for (Pair& p : pairs)
+    {
+        p.lat1 = (int32_t)(nextRandom() % 1600000000u) - 800000000;
+        p.lng1 = (int32_t)(nextRandom() % 3600000000u - 1800000000u);
+        int64_t lat2 = p.lat1 + (int64_t)(nextRandom() % (2u * maxDeltaE7 + 1)) - maxDeltaE7;
+        int64_t lng2 = p.lng1 + (int64_t)(nextRandom() % (2u * maxDeltaE7 + 1)) - maxDeltaE7;
+        if (lat2 > 850000000)
+            lat2 = 850000000;
+        if (lat2 < -850000000)
+            lat2 = -850000000;
+        if (lng2 >= 1800000000)
+            lng2 -= 3600000000LL;
+        if (lng2 < -1800000000)
+            lng2 += 3600000000LL;
+        p.lat2 = (int32_t)lat2;
+        p.lng2 = (int32_t)lng2;
+        p.dlat1 = p.lat1 / 1e7;
+        p.dlng1 = p.lng1 / 1e7;
+        p.dlat2 = p.lat2 / 1e7;
+        p.dlng2 = p.lng2 / 1e7;
+    }
+    return pairs;
+}
+
+static int failures;
+
+static void check(const char* name, bool ok)
+{
+    printf("%-50s %s\n", name, ok ? "ok" : "FAIL");
+    failures += !ok;
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t n = 100000;
+    uint32_t passes = 20;
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        const uint32_t v = strtoul(argv[i + 1], nullptr, 10);
+        if (!strcmp(argv[i], "--pairs"))
+            n = v ? v : 1;
+        else if (!strcmp(argv[i], "--passes"))
+            passes = v ? v : 1;
+        else
+        {
+            fprintf(stderr, "unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    // with the distance error neo6m.h promises for the separation
+    static const struct { const char* name; int32_t maxDeltaE7; double maxErrM; } classes[] = {
+        {"< 100 m", 9000, 2.5},
+        {"< 10 km", 900000, 2.5},
+        {"fast path limit", _GPS_FAST_DISTANCE_E7 - 1, 2.5},
+        {"< 200 km", 18000000, 20},
+        {"any", 1800000000, 20},
+    };
+    bool distanceOk = true;
+    double worstCourse = 0, worstCourseFar = 0;
+
+    printf("%-16s %12s %12s %10s %12s %10s %10s %10s\n", "separation", "max dist m", "max rel", "max crs", "mean dist m", "ns dbl", "ns fixed", "speedup");
+    for (const auto& c : classes)
+    {
+        std::vector<Pair> pairs = makePairs(n, c.maxDeltaE7);
+
+        double maxErr = 0, maxRel = 0, maxCourse = 0, maxCourseFar = 0, sum = 0;
+        for (const Pair& p : pairs)
+        {
+            const double d = GPSPlus::distanceBetween(p.dlat1, p.dlng1, p.dlat2, p.dlng2);
+            const double err = fabs(GPSPlus::distanceBetweenFixed(p.lat1, p.lng1, p.lat2, p.lng2) - d);
+            sum += d;
+            if (err > maxErr)
+                maxErr = err;
+            if (d > 1000 && err / d > maxRel)
+                maxRel = err / d;
+            // bearings of points closer than 10 m are not meaningful at 1e-7 degrees
+            if (d > 10)
+            {
+                double e = fabs(GPSPlus::courseToFixed(p.lat1, p.lng1, p.lat2, p.lng2) / 100.0 - GPSPlus::courseTo(p.dlat1, p.dlng1, p.dlat2, p.dlng2));
+                if (e > 180)
+                    e = 360 - e;
+                if (e > maxCourse)
+                    maxCourse = e;
+                if (d > 1000 && e > maxCourseFar)
+                    maxCourseFar = e;
+            }
+        }
+        distanceOk &= maxErr <= c.maxErrM;
+        worstCourse = std::max(worstCourse, maxCourse);
+        worstCourseFar = std::max(worstCourseFar, maxCourseFar);
+
+        BenchTimer timer;
+        timer.start();
+        for (uint32_t i = 0; i < passes; i++)
+            for (const Pair& p : pairs)
+            {
+                bench_keep(GPSPlus::distanceBetween(p.dlat1, p.dlng1, p.dlat2, p.dlng2));
+                bench_keep(GPSPlus::courseTo(p.dlat1, p.dlng1, p.dlat2, p.dlng2));
+            }
+        const double nsDouble = timer.seconds() * 1e9 / ((double)n * passes);
+
+        timer.start();
+        for (uint32_t i = 0; i < passes; i++)
+            for (const Pair& p : pairs)
+            {
+                bench_keep(GPSPlus::distanceBetweenFixed(p.lat1, p.lng1, p.lat2, p.lng2));
+                bench_keep(GPSPlus::courseToFixed(p.lat1, p.lng1, p.lat2, p.lng2));
+            }
+        const double nsFixed = timer.seconds() * 1e9 / ((double)n * passes);
+
+        printf("%-16s %12.2f %12.2e %10.4f %12.0f %10.1f %10.1f %9.2fx\n", c.name, maxErr, maxRel, maxCourse, sum / n,
+            nsDouble, nsFixed, nsDouble / nsFixed);
+    }
+    printf("times are distance + course per pair on the host FPU; on the RP2040 the doubles are soft-float\n");
+
+    // every hundredth of a degree
+    bool sameCardinal = true;
+    for (uint32_t course = 0; course < 36000; course++)
+        sameCardinal &= !strcmp(GPSPlus::cardinalFixed(course), GPSPlus::cardinal(course / 100.0));
+
+    check("distance within 2.5 m fast, 20 m otherwise", distanceOk);
+    check("course within 0.06 degree at 10 m", worstCourse <= 0.06);
+    check("course within 0.02 degree beyond 1 km", worstCourseFar <= 0.02);
+    check("cardinalFixed matches cardinal", sameCardinal);
+    printf("%s\n", failures ? "FAIL" : "all checks pass");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,288 @@
+// GprsSession against the simulated SIM800L, whose TCP connection goes to
+// a server in this process on 127.0.0.1. Checks that the records arrive
+// complete and in order, that the connection is reused between flushes and
+// reopened on the same PDP context when the server closes it, that a
+// server that is down or a network without coverage leads to a growing
+// backoff and no lost records, and that a full queue drops. Reports the
+// virtual modem time per record for a range of batch sizes against a
+// connection set up for every report. Exits non-zero if a check fails.
+//
+//   gprs_bench
+
+#include "sim_hal.h"
+#include "sim_devices.h"
+
+#include "pico/stdlib.h"
+#include "gprs_session.h"
+#include "sim800l.h"
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#define BENCH_POLL_MS 10
+// as the modem task (MODEM_TX_POLL_US), a character per poll without the FIFO
+#define BENCH_TX_POLL_US 2000
+#define RECORD_LEN    40
+
+// Non-blocking, pumped from the bench loop, so virtual time decides when
+// the data is looked at
+struct TestServer
+{
+    int listener = -1;
+    std::vector<int> clients;
+    uint16_t port = 0;
+    uint32_t accepts = 0;
+    std::string received;
+
+    bool start()
+    {
+        listener = socket(AF_INET, SOCK_STREAM, 0);
+        const int one = 1;
+        setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t len = sizeof(addr);
+        if (bind(listener, (sockaddr*)&addr, sizeof(addr)) || listen(listener, 4)
+            || getsockname(listener, (sockaddr*)&addr, &len))
+            return false;
+        port = ntohs(addr.sin_port);
+        fcntl(listener, F_SETFL, O_NONBLOCK);
+        return true;
+    }
+
+    // connections are refused from now on
+    void stop()
+    {
+        close(listener);
+        listener = -1;
+    }
+
+    void dropClients()
+    {
+        for (int c : clients)
+            close(c);
+        clients.clear();
+    }
+
+    void pump()
+    {
+        int c;
+        while (listener >= 0 && (c = accept(listener, nullptr, nullptr)) >= 0)
+        {
+            fcntl(c, F_SETFL, O_NONBLOCK);
+            clients.push_back(c);
+            accepts++;
+        }
+        char buf[2048];
+        for (int fd : clients)
+        {
+            ssize_t n;
+            while ((n = recv(fd, buf, sizeof(buf), 0)) > 0)
+                received.append(buf, (size_t)n);
+        }
+    }
+};
+
+static SIM800L sim800l;
+static GprsSession uplink(sim800l);
+static TestServer server;
+static std::string queued;
+static uint32_t recordSeq;
+static int failures;
+
+static void on_sim800_rx()
+{
+    while (uart_is_readable(SIM800L_UART_ID))
+        sim800l.processChar(uart_getc(SIM800L_UART_ID));
+}
+
+static void check(const char* name, bool ok)
+{
+    printf("%-44s %s\n", name, ok ? "ok" : "FAIL");
+    failures += !ok;
+}
+
+// Like the modem task, with the server looking at its sockets in between
+static void step()
+{
+    sim800l.poll();
+    uplink.poll();
+    sim800l.poll();
+    server.pump();
+    if (sim800l.transmitting())
+        sleep_us(BENCH_TX_POLL_US);
+    else
+        sleep_ms(BENCH_POLL_MS);
+}
+
+static void run(uint32_t ms)
+{
+    const uint64_t end = sim_now_us() + 1000ull * ms;
+    while (sim_now_us() < end)
+        step();
+}
+
+// Virtual ms until the queue is empty, or 0 if it is not within maxMs
+static uint32_t runUntilSent(uint32_t maxMs)
+{
+    const uint64_t start = sim_now_us();
+    while (uplink.pending() && sim_now_us() - start < 1000ull * maxMs)
+        step();
+    // the last bytes are on the socket by SEND OK
+    server.pump();
+    return uplink.pending() ? 0 : (uint32_t)((sim_now_us() - start) / 1000);
+}
+
+static bool queueRecords(uint32_t n)
+{
+    bool ok = true;
+    for (uint32_t i = 0; i < n; i++)
+    {
+        // room for a sequence number of up to 10 digits
+        char r[RECORD_LEN + 5];
+        snprintf(r, sizeof(r), "%06u,474986683,190424492,11240,2315,63", (unsigned)recordSeq++);
+        const bool accepted = uplink.queue((const uint8_t*)r, RECORD_LEN);
+        if (accepted)
+            queued.append(r, RECORD_LEN);
+        ok &= accepted;
+    }
+    return ok;
+}
+
+int main()
+{
+    stdio_init_all();
+    static SIM800LModel modem(SIM800L_UART_ID);
+    uart_init(SIM800L_UART_ID, SIM800L_BAUD_RATE);
+    uart_set_format(SIM800L_UART_ID, SIM800L_DATA_BITS, SIM800L_STOP_BITS, SIM800L_PARITY);
+    uart_set_fifo_enabled(SIM800L_UART_ID, false);
+    irq_set_exclusive_handler(UART1_IRQ, &on_sim800_rx);
+    irq_set_enabled(UART1_IRQ, true);
+    uart_set_irq_enables(SIM800L_UART_ID, true, false);
+
+    if (!server.start())
+    {
+        fprintf(stderr, "cannot listen on 127.0.0.1\n");
+        return 1;
+    }
+    modem.serverPort = server.port;
+
+    sim800l.begin();
+    run(5000);
+    check("sim ready", sim800l.state == SIM_STATE::READY);
+
+    queueRecords(5);
+    uplink.flush();
+    const uint32_t firstMs = runUntilSent(60000);
+    check("first flush attaches and connects", firstMs && uplink.contexts == 1 && uplink.connects == 1
+        && server.accepts == 1 && modem.contexts == 1);
+    check("records arrive", server.received == queued);
+
+    queueRecords(5);
+    uplink.flush();
+    const uint32_t reuseMs = runUntilSent(60000);
+    check("second flush reuses the connection", reuseMs && uplink.connects == 1 && server.accepts == 1
+        && uplink.sends == 2 && reuseMs * 3 < firstMs);
+
+    // the same 60 records in batches of different size
+    printf("--- 60 records of %d bytes on an open connection\n", RECORD_LEN);
+    printf("batch  sends  modem ms  ms/record\n");
+    const uint32_t batches[] = {1, 5, 20, 60};
+    double perRecord[4];
+    for (int b = 0; b < 4; b++)
+    {
+        const uint32_t sendsBefore = uplink.sends;
+        uint32_t busyMs = 0;
+        for (uint32_t n = 0; n < 60; n += batches[b])
+        {
+            queueRecords(batches[b]);
+            uplink.flush();
+            busyMs += runUntilSent(60000);
+        }
+        perRecord[b] = busyMs / 60.0;
+        printf("%5u  %5u  %8u  %9.1f\n", batches[b], uplink.sends - sendsBefore, busyMs, perRecord[b]);
+    }
+    // the first flush minus the same flush on the open connection
+    const uint32_t setupMs = firstMs - reuseMs;
+    printf("connection setup (AT+CIPSHUT to CONNECT OK) %u ms, with one per report %.1f ms/record\n", setupMs,
+        setupMs + perRecord[0]);
+    check("batching amortises the send", perRecord[1] * 2 < perRecord[0] && perRecord[2] < perRecord[1]
+        && perRecord[3] <= perRecord[2]);
+    check("60 records go in few sends", uplink.connects == 1 && server.received == queued);
+
+    // the server hangs up: CLOSED, then a new connection on the same context
+    server.dropClients();
+    run(500);
+    queueRecords(3);
+    uplink.flush();
+    check("reconnect after CLOSED keeps the context", runUntilSent(60000) && uplink.closed == 1
+        && uplink.connects == 2 && uplink.contexts == 1 && server.received == queued);
+
+    // server down: the retries back off, the records wait
+    server.dropClients();
+    server.stop();
+    run(500);
+    const uint32_t failuresBefore = uplink.failures;
+    queueRecords(3);
+    uplink.flush();
+    std::vector<uint32_t> delays;
+    const uint64_t downUntil = sim_now_us() + 200000000ull;
+    while (sim_now_us() < downUntil)
+    {
+        const uint32_t f = uplink.failures;
+        step();
+        if (uplink.failures != f)
+            delays.push_back(uplink.backoffMs());
+    }
+    bool growing = delays.size() >= 3;
+    for (size_t i = 1; i < delays.size(); i++)
+        growing &= delays[i] == std::min<uint32_t>(delays[i - 1] * 2, GPRS_BACKOFF_MAX_MS);
+    printf("backoff while the server is down:");
+    for (uint32_t d : delays)
+        printf(" %u", d);
+    printf(" ms\n");
+    check("backoff doubles", growing && delays[0] == GPRS_BACKOFF_MIN_MS
+        && uplink.failures - failuresBefore == delays.size());
+    check("records kept while down", uplink.pending() == 3);
+    // the context is set up anew after GPRS_TCP_RETRIES failed connects
+    check("context renewed after failed connects", uplink.contexts > 1);
+    server.start();
+    check("delivered once the server is back", runUntilSent(GPRS_BACKOFF_MAX_MS + 60000) && uplink.backoffMs() == 0
+        && server.received == queued);
+
+    // the network drops the context and coverage is gone for a while
+    const uint32_t contextsBefore = uplink.contexts;
+    modem.rssi = 99;
+    modem.deactivate();
+    run(500);
+    queueRecords(2);
+    uplink.flush();
+    run(30000);
+    const bool failing = uplink.pending() == 2 && uplink.state() == GPRS_STATE::BACKOFF;
+    modem.rssi = 18;
+    check("no coverage: backoff, then a new context", failing && runUntilSent(GPRS_BACKOFF_MAX_MS + 60000)
+        && uplink.contexts == contextsBefore + 1 && server.received == queued);
+
+    const uint32_t droppedBefore = uplink.dropped;
+    const bool fits = queueRecords(GPRS_MAX_RECORDS);
+    const bool over = !queueRecords(1);
+    check("full queue drops", fits && over && uplink.dropped == droppedBefore + 1);
+    uplink.flush();
+    check("full queue is sent", runUntilSent(60000) && server.received == queued);
+
+    printf("contexts %u  connections %u  sends %u  records %u  bytes %" PRIu64 "  failures %u  closed %u\n",
+        uplink.contexts, uplink.connects, uplink.sends, uplink.recordsSent, uplink.bytesSent, uplink.failures,
+        uplink.closed);
+    printf("%s\n", failures ? "FAIL" : "all checks pass");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,230 @@
+// NMEA replay throughput of GPSPlus::encode.
+//
+// Feeds a NEO-6M log (or a generated one with the receiver's default
+// GGA/RMC/GSV/GSA/VTG/GLL mix, corrupted checksums and truncated sentences)
+// through the parser one character at a time, through the bulk
+// encode(data, len) in chunks the size of the GPS RX buffer, and through the
+// bulk path with skipUnusedSentences(), and reports all three. The same
+// track is then generated as UBX NAV-POSLLH/SOL/VELNED/TIMEUTC and decoded by
+// GPSUbx for comparison. millis() runs off the simulated clock, which stays at
+// zero here.
+//
+//   gps_bench [--log FILE] [--save-log FILE] [--epochs N] [--passes N] [--chunk N]
+//             [--bad-checksum-every N] [--truncate-every N]
+
+#include "bench_util.h"
+#include "sim_devices.h"
+
+#include "neo6m.h"
+
+#include <cstring>
+
+struct PassResult
+{
+    uint32_t committed;
+    uint32_t fixes;
+    uint32_t passed;
+    uint32_t failed;
+    uint32_t skipped;
+};
+
+// chunk == 0 feeds one character at a time
+static PassResult runPass(const std::string& log, size_t chunk, bool skip)
+{
+    GPSPlus gps;
+    gps.skipUnusedSentences(skip);
+    PassResult r = {};
+    const char* p = log.data();
+    const char* end = p + log.size();
+    if (chunk == 0)
+    {
+        for (; p != end; ++p)
+            if (gps.encode(*p))
+                r.committed++;
+    }
+    else
+        for (; p != end; )
+        {
+            const size_t n = (size_t)(end - p) < chunk ? (size_t)(end - p) : chunk;
+            r.committed += gps.encode(p, n);
+            p += n;
+        }
+    r.fixes = gps.sentencesWithFix();
+    r.passed = gps.passedChecksum();
+    r.failed = gps.failedChecksum();
+    r.skipped = gps.sentencesSkipped();
+    bench_keep(gps.location);
+    return r;
+}
+
+static PassResult runUbxPass(const std::string& log, size_t chunk)
+{
+    GPSPlus gps;
+    GPSUbx ubx(gps);
+    PassResult r = {};
+    const uint8_t* p = (const uint8_t*)log.data();
+    const uint8_t* end = p + log.size();
+    for (; p != end; )
+    {
+        const size_t n = (size_t)(end - p) < chunk ? (size_t)(end - p) : chunk;
+        r.committed += ubx.encode(p, n);
+        p += n;
+    }
+    r.fixes = ubx.messagesWithFix();
+    r.passed = ubx.passedChecksum();
+    r.failed = ubx.failedChecksum();
+    bench_keep(gps.location);
+    return r;
+}
+
+int main(int argc, char** argv)
+{
+    const char* logPath = nullptr;
+    const char* savePath = nullptr;
+    uint32_t epochs = 2000;
+    uint32_t passes = 20;
+    size_t chunk = 240;
+    GpsTrackGenerator gen;
+    gen.fixAfterEpochs = 30;
+    GpsTrackGenerator ubxGen = gen;
+    ubxGen.nmeaOutput = false;
+    ubxGen.ubxNavEnabled = 1ull << UBX_NAV_POSLLH | 1ull << UBX_NAV_SOL | 1ull << UBX_NAV_VELNED | 1ull << UBX_NAV_TIMEUTC;
+    gen.badChecksumEvery = 23;
+    gen.truncateEvery = 41;
+
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        const char* a = argv[i];
+        const uint32_t v = strtoul(argv[i + 1], nullptr, 10);
+        if (!strcmp(a, "--log"))
+            logPath = argv[i + 1];
+        else if (!strcmp(a, "--save-log"))
+            savePath = argv[i + 1];
+        else if (!strcmp(a, "--epochs"))
+            epochs = v;
+        else if (!strcmp(a, "--passes"))
+            passes = v ? v : 1;
+        else if (!strcmp(a, "--chunk"))
+            chunk = v ? v : 1;
+        else if (!strcmp(a, "--bad-checksum-every"))
+            gen.badChecksumEvery = v;
+        else if (!strcmp(a, "--truncate-every"))
+            gen.truncateEvery = v;
+        else
+        {
+            fprintf(stderr, "unknown option %s\n", a);
+            return 1;
+        }
+    }
+
+    std::string log;
+    if (logPath)
+    {
+        if (!bench_read_file(logPath, log))
+        {
+            fprintf(stderr, "cannot read %s\n", logPath);
+            return 1;
+        }
+    }
+    else
+        for (uint32_t e = 0; e < epochs; e++)
+            gen.nextEpoch(log);
+
+    if (savePath)
+    {
+        FILE* f = fopen(savePath, "wb");
+        if (!f || fwrite(log.data(), 1, log.size(), f) != log.size())
+        {
+            fprintf(stderr, "cannot write %s\n", savePath);
+            return 1;
+        }
+        fclose(f);
+    }
+
+    uint32_t sentences = 0;
+    for (size_t i = 0; i < log.size(); i++)
+        sentences += log[i] == '$';
+
+    printf("input               %zu bytes, %u sentences (%s)\n", log.size(), sentences, logPath ? logPath : "generated");
+    printf("passes              %u\n", passes);
+
+    const size_t modes[3] = {0, chunk, chunk};
+    for (int m = 0; m < 3; m++)
+    {
+        const bool skip = m == 2;
+        PassResult r = runPass(log, modes[m], skip); // warm up, and the counts every pass repeats
+
+        BenchTimer timer;
+        timer.start();
+        for (uint32_t i = 0; i < passes; i++)
+            bench_keep(runPass(log, modes[m], skip));
+        const double secs = timer.seconds();
+        const uint64_t cycles = timer.cycles();
+
+        const double chars = (double)log.size() * passes;
+        if (skip)
+            printf("--- encode(data, len), %zu byte chunks, skipping unused sentences\n", modes[m]);
+        else if (modes[m])
+            printf("--- encode(data, len), %zu byte chunks\n", modes[m]);
+        else
+            printf("--- encode(char)\n");
+        printf("chars/sec           %.0f\n", chars / secs);
+        printf("sentences/sec       %.0f\n", (double)sentences * passes / secs);
+        printf("ns/char             %.2f\n", secs * 1e9 / chars);
+        if (BENCH_HAVE_CYCLES)
+        {
+            printf("cycles/char         %.2f\n", cycles / chars);
+            if (r.fixes)
+                printf("cycles/fix          %.0f\n", (double)cycles / ((double)r.fixes * passes));
+        }
+        printf("sentences committed %u\n", r.committed);
+        printf("sentencesWithFix()  %u\n", r.fixes);
+        printf("passedChecksum()    %u\n", r.passed);
+        printf("failedChecksum()    %u\n", r.failed);
+        printf("sentencesSkipped()  %u\n", r.skipped);
+        if (r.fixes)
+            printf("bytes/fix           %.1f\n", (double)log.size() / r.fixes);
+    }
+
+    if (logPath)
+        return 0;
+
+    std::string ubxLog;
+    for (uint32_t e = 0; e < epochs; e++)
+        ubxGen.nextEpoch(ubxLog);
+    PassResult r = runUbxPass(ubxLog, chunk);
+    BenchTimer timer;
+    timer.start();
+    for (uint32_t i = 0; i < passes; i++)
+        bench_keep(runUbxPass(ubxLog, chunk));
+    const double secs = timer.seconds();
+    const uint64_t cycles = timer.cycles();
+    const double chars = (double)ubxLog.size() * passes;
+    printf("--- GPSUbx::encode(data, len), %zu byte chunks, %zu bytes, %u messages\n", chunk, ubxLog.size(), ubxGen.ubxMessages());
+    printf("chars/sec           %.0f\n", chars / secs);
+    printf("ns/char             %.2f\n", secs * 1e9 / chars);
+    if (BENCH_HAVE_CYCLES)
+    {
+        printf("cycles/char         %.2f\n", cycles / chars);
+        if (r.fixes)
+            printf("cycles/fix          %.0f\n", (double)cycles / ((double)r.fixes * passes));
+    }
+    printf("messages committed  %u\n", r.committed);
+    printf("messagesWithFix()   %u\n", r.fixes);
+    printf("passedChecksum()    %u\n", r.passed);
+    printf("failedChecksum()    %u\n", r.failed);
+    if (r.fixes)
+        printf("bytes/fix           %.1f\n", (double)ubxLog.size() / r.fixes);
+
+    // a corrupt length costs that message only, not the next 64 kB
+    std::string corrupt = ubxLog;
+    const size_t at = corrupt.find("\xb5\x62\x01");
+    if (at != std::string::npos)
+        corrupt[at + 5] = (char)0xff;
+    GPSPlus gps;
+    GPSUbx ubx(gps);
+    ubx.encode((const uint8_t*)corrupt.data(), corrupt.size());
+    const bool resynced = at != std::string::npos && ubx.badLengths() == 1 && ubx.passedChecksum() + 1 == r.passed;
+    printf("corrupt length      %s\n", resynced ? "resynced" : "FAIL");
+    return resynced ? 0 : 1;
+}
@@ -0,0 +1,65 @@
+#ifndef _HARDWARE_DMA_H
+#define _HARDWARE_DMA_H
+
+// Host simulation of the RP2040 DMA, enough for paced transfers from a UART
+// RX FIFO into a (ring) buffer. Transfers complete as soon as their DREQ
+// has data; everything else about the channel is bookkeeping.
+
+#include "pico.h"
+#include "hardware/regs/dreq.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define NUM_DMA_CHANNELS 12
+
+enum dma_channel_transfer_size {
+    DMA_SIZE_8 = 0,
+    DMA_SIZE_16 = 1,
+    DMA_SIZE_32 = 2
+};
+
+typedef struct {
+    uint8_t transfer_size;
+    bool read_increment;
+    bool write_increment;
+    bool ring_write;
+    uint8_t ring_size_bits;
+    uint8_t dreq;
+    bool enable;
+} dma_channel_config;
+
+// Register view of a channel. On the chip the addresses are 32 bit; here
+// they hold host pointers.
+typedef struct {
+    volatile uintptr_t read_addr;
+    volatile uintptr_t write_addr;
+    volatile uint32_t transfer_count;
+    volatile uint32_t ctrl_trig;
+} dma_channel_hw_t;
+
+int dma_claim_unused_channel(bool required);
+void dma_channel_unclaim(uint channel);
+dma_channel_config dma_channel_get_default_config(uint channel);
+dma_channel_hw_t *dma_channel_hw_addr(uint channel);
+
+static inline void channel_config_set_transfer_data_size(dma_channel_config *c, enum dma_channel_transfer_size size) { c->transfer_size = (uint8_t)size; }
+static inline void channel_config_set_read_increment(dma_channel_config *c, bool incr) { c->read_increment = incr; }
+static inline void channel_config_set_write_increment(dma_channel_config *c, bool incr) { c->write_increment = incr; }
+static inline void channel_config_set_ring(dma_channel_config *c, bool write, uint size_bits) { c->ring_write = write; c->ring_size_bits = (uint8_t)size_bits; }
+static inline void channel_config_set_dreq(dma_channel_config *c, uint dreq) { c->dreq = (uint8_t)dreq; }
+static inline void channel_config_set_enable(dma_channel_config *c, bool enable) { c->enable = enable; }
+
+void dma_channel_configure(uint channel, const dma_channel_config *config, volatile void *write_addr,
+                           const volatile void *read_addr, uint transfer_count, bool trigger);
+void dma_channel_set_trans_count(uint channel, uint32_t trans_count, bool trigger);
+void dma_channel_start(uint channel);
+void dma_channel_abort(uint channel);
+bool dma_channel_is_busy(uint channel);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
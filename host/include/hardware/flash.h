@@ -0,0 +1,24 @@
+#ifndef _HARDWARE_FLASH_H
+#define _HARDWARE_FLASH_H
+
+#include "pico.h"
+
+#define FLASH_PAGE_SIZE (1u << 8)
+#define FLASH_SECTOR_SIZE (1u << 12)
+#define FLASH_BLOCK_SIZE (1u << 16)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// On the simulated flash image (sim_flash_open). Like the SDK, offsets are
+// from the start of flash, erases whole sectors and programs whole pages;
+// programming only clears bits. Both take the flash's time.
+void flash_range_erase(uint32_t flash_offs, size_t count);
+void flash_range_program(uint32_t flash_offs, const uint8_t *data, size_t count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
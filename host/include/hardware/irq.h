@@ -0,0 +1,21 @@
+#ifndef _HARDWARE_IRQ_H
+#define _HARDWARE_IRQ_H
+
+#include "pico.h"
+#include "hardware/regs/intctrl.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef void (*irq_handler_t)(void);
+
+void irq_set_exclusive_handler(uint num, irq_handler_t handler);
+void irq_set_enabled(uint num, bool enabled);
+bool irq_is_enabled(uint num);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef _HARDWARE_PLL_H
+#define _HARDWARE_PLL_H
+
+#include "pico.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct pll_inst {
+    uint8_t index;
+} pll_inst_t;
+
+extern pll_inst_t pll_sys_inst;
+extern pll_inst_t pll_usb_inst;
+
+#define pll_sys (&pll_sys_inst)
+#define pll_usb (&pll_usb_inst)
+
+void pll_init(pll_inst_t *pll, uint ref_div, uint vco_freq, uint post_div1, uint post_div2);
+void pll_deinit(pll_inst_t *pll);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,19 @@
+#ifndef _HARDWARE_REGS_ADDRESSMAP_H
+#define _HARDWARE_REGS_ADDRESSMAP_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// The simulated flash image stands in for the XIP window
+extern uint8_t *sim_flash_xip;
+
+#ifdef __cplusplus
+}
+#endif
+
+#define XIP_BASE ((uintptr_t)sim_flash_xip)
+
+#endif
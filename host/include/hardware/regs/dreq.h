@@ -0,0 +1,11 @@
+#ifndef _HARDWARE_REGS_DREQ_H
+#define _HARDWARE_REGS_DREQ_H
+
+// RP2040 DMA request numbers (only the UARTs are simulated)
+#define DREQ_UART0_TX 20
+#define DREQ_UART0_RX 21
+#define DREQ_UART1_TX 22
+#define DREQ_UART1_RX 23
+#define DREQ_FORCE    63
+
+#endif
@@ -0,0 +1,9 @@
+#ifndef _HARDWARE_REGS_IO_BANK0_H
+#define _HARDWARE_REGS_IO_BANK0_H
+
+#define IO_BANK0_DORMANT_WAKE_INTE0_GPIO0_LEVEL_LOW_BITS  0x00000001u
+#define IO_BANK0_DORMANT_WAKE_INTE0_GPIO0_LEVEL_HIGH_BITS 0x00000002u
+#define IO_BANK0_DORMANT_WAKE_INTE0_GPIO0_EDGE_LOW_BITS   0x00000004u
+#define IO_BANK0_DORMANT_WAKE_INTE0_GPIO0_EDGE_HIGH_BITS  0x00000008u
+
+#endif
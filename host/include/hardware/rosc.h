@@ -0,0 +1,18 @@
+#ifndef _HARDWARE_ROSC_H
+#define _HARDWARE_ROSC_H
+
+#include "pico.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void rosc_set_dormant(void);
+void rosc_disable(void);
+void rosc_enable(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
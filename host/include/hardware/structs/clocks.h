@@ -0,0 +1,30 @@
+#ifndef _HARDWARE_STRUCTS_CLOCKS_H
+#define _HARDWARE_STRUCTS_CLOCKS_H
+
+#include "pico.h"
+
+#define CLOCKS_SLEEP_EN0_CLK_RTC_RTC_BITS 0x00800000u
+
+// Only the clock gating registers used around sleep.
+typedef struct {
+    volatile uint32_t wake_en0;
+    volatile uint32_t wake_en1;
+    volatile uint32_t sleep_en0;
+    volatile uint32_t sleep_en1;
+    volatile uint32_t enabled0;
+    volatile uint32_t enabled1;
+} clocks_hw_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern clocks_hw_t sim_clocks_hw;
+
+#ifdef __cplusplus
+}
+#endif
+
+#define clocks_hw (&sim_clocks_hw)
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef _HARDWARE_STRUCTS_SCB_H
+#define _HARDWARE_STRUCTS_SCB_H
+
+#include "pico.h"
+
+#define M0PLUS_SCR_SLEEPDEEP_BITS 0x00000004u
+
+typedef struct {
+    volatile uint32_t cpuid;
+    volatile uint32_t icsr;
+    volatile uint32_t vtor;
+    volatile uint32_t aircr;
+    volatile uint32_t scr;
+} armv6m_scb_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern armv6m_scb_t sim_scb;
+
+#ifdef __cplusplus
+}
+#endif
+
+#define scb_hw (&sim_scb)
+
+#endif
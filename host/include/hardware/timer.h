@@ -0,0 +1,34 @@
+#ifndef _HARDWARE_TIMER_H
+#define _HARDWARE_TIMER_H
+
+#include "pico.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+uint64_t time_us_64(void);
+static inline uint32_t time_us_32(void) { return (uint32_t)time_us_64(); }
+
+void busy_wait_us(uint64_t delay_us);
+static inline void busy_wait_us_32(uint32_t delay_us) { busy_wait_us(delay_us); }
+static inline void busy_wait_ms(uint32_t delay_ms) { busy_wait_us(1000ull * delay_ms); }
+
+// The four timer alarms, raising TIMER_IRQ_0..3.
+#define NUM_TIMERS 4
+
+typedef void (*hardware_alarm_callback_t)(uint alarm_num);
+
+void hardware_alarm_claim(uint alarm_num);
+int hardware_alarm_claim_unused(bool required);
+void hardware_alarm_unclaim(uint alarm_num);
+void hardware_alarm_set_callback(uint alarm_num, hardware_alarm_callback_t callback);
+// Returns true (and does not arm) if t has already passed.
+bool hardware_alarm_set_target(uint alarm_num, absolute_time_t t);
+void hardware_alarm_cancel(uint alarm_num);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
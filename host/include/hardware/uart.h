@@ -0,0 +1,68 @@
+#ifndef _HARDWARE_UART_H
+#define _HARDWARE_UART_H
+
+#include "pico.h"
+#include "hardware/irq.h"
+#include "hardware/regs/dreq.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define NUM_UARTS 2
+
+typedef struct uart_inst {
+    uint8_t index;
+} uart_inst_t;
+
+extern uart_inst_t uart0_inst;
+extern uart_inst_t uart1_inst;
+
+#define uart0 (&uart0_inst)
+#define uart1 (&uart1_inst)
+
+typedef enum {
+    UART_PARITY_NONE,
+    UART_PARITY_EVEN,
+    UART_PARITY_ODD
+} uart_parity_t;
+
+// Register block, only the data register exists (as a DMA read address)
+typedef struct {
+    volatile uint32_t dr;
+} uart_hw_t;
+
+extern uart_hw_t sim_uart_hw[NUM_UARTS];
+
+static inline uint uart_get_index(uart_inst_t *uart) { return uart->index; }
+static inline uart_hw_t *uart_get_hw(uart_inst_t *uart) { return &sim_uart_hw[uart->index]; }
+static inline uint uart_get_dreq(uart_inst_t *uart, bool is_tx)
+{
+    return uart->index ? (is_tx ? DREQ_UART1_TX : DREQ_UART1_RX) : (is_tx ? DREQ_UART0_TX : DREQ_UART0_RX);
+}
+
+uint uart_init(uart_inst_t *uart, uint baudrate);
+void uart_deinit(uart_inst_t *uart);
+uint uart_set_baudrate(uart_inst_t *uart, uint baudrate);
+void uart_set_hw_flow(uart_inst_t *uart, bool cts, bool rts);
+void uart_set_format(uart_inst_t *uart, uint data_bits, uint stop_bits, uart_parity_t parity);
+void uart_set_irq_enables(uart_inst_t *uart, bool rx_has_data, bool tx_needs_data);
+void uart_set_fifo_enabled(uart_inst_t *uart, bool enabled);
+
+bool uart_is_writable(uart_inst_t *uart);
+bool uart_is_readable(uart_inst_t *uart);
+void uart_tx_wait_blocking(uart_inst_t *uart);
+void uart_write_blocking(uart_inst_t *uart, const uint8_t *src, size_t len);
+void uart_read_blocking(uart_inst_t *uart, uint8_t *dst, size_t len);
+char uart_getc(uart_inst_t *uart);
+bool uart_is_readable_within_us(uart_inst_t *uart, uint32_t us);
+
+static inline void uart_putc_raw(uart_inst_t *uart, char c) { uart_write_blocking(uart, (const uint8_t *) &c, 1); }
+static inline void uart_putc(uart_inst_t *uart, char c) { uart_putc_raw(uart, c); }
+static inline void uart_puts(uart_inst_t *uart, const char *s) { while (*s) uart_putc(uart, *s++); }
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,18 @@
+#ifndef _HARDWARE_XOSC_H
+#define _HARDWARE_XOSC_H
+
+#include "pico.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void xosc_init(void);
+void xosc_disable(void);
+void xosc_dormant(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
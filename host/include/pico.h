@@ -0,0 +1,51 @@
+#ifndef _PICO_H
+#define _PICO_H
+
+// Host simulation stand-in for the Pico SDK base header. Only what the
+// tracker firmware uses is provided; behaviour lives in host/sim_hal.cpp.
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <assert.h>
+
+#include "pico/types.h"
+
+#define _u(x) x ## u
+
+#define count_of(a) (sizeof(a)/sizeof((a)[0]))
+
+#ifndef __unused
+#define __unused __attribute__((unused))
+#endif
+
+#define __not_in_flash_func(func_name) func_name
+#define __time_critical_func(func_name) func_name
+#define __no_inline_not_in_flash_func(func_name) func_name
+
+#define NUM_CORES 2
+
+// the Pico board's W25Q16JV
+#ifndef PICO_FLASH_SIZE_BYTES
+#define PICO_FLASH_SIZE_BYTES (2 * 1024 * 1024)
+#endif
+
+#define PICO_OK 0
+#define PICO_ERROR_NONE 0
+#define PICO_ERROR_TIMEOUT -1
+#define PICO_ERROR_GENERIC -2
+
+static inline void tight_loop_contents(void) {}
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// 0 or 1, the core running the caller
+uint get_core_num(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,12 @@
+#ifndef _PICO_BINARY_INFO_H
+#define _PICO_BINARY_INFO_H
+
+// Binary info only matters to picotool; swallow the declarations on the host.
+#define bi_decl(_decl)
+#define bi_decl_if_func_used(_decl)
+#define bi_1pin_with_func(p0, func)
+#define bi_2pins_with_func(p0, p1, func)
+#define bi_program_description(str)
+#define bi_1pin_with_name(p0, name)
+
+#endif
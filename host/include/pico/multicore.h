@@ -0,0 +1,25 @@
+#ifndef _PICO_MULTICORE_H
+#define _PICO_MULTICORE_H
+
+#include "pico.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Core1 runs on a host thread of its own, interleaved with core0 in virtual
+// time: only one core executes at a time and they switch at blocking calls.
+void multicore_launch_core1(void (*entry)(void));
+
+// The SIO inter-core FIFOs, 8 words deep in each direction.
+bool multicore_fifo_rvalid(void);
+bool multicore_fifo_wready(void);
+void multicore_fifo_push_blocking(uint32_t data);
+uint32_t multicore_fifo_pop_blocking(void);
+void multicore_fifo_drain(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
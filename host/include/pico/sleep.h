@@ -0,0 +1,32 @@
+#ifndef _PICO_SLEEP_H_
+#define _PICO_SLEEP_H_
+
+#include "pico.h"
+#include "hardware/rtc.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    DORMANT_SOURCE_NONE,
+    DORMANT_SOURCE_XOSC,
+    DORMANT_SOURCE_ROSC
+} dormant_source_t;
+
+void sleep_run_from_dormant_source(dormant_source_t dormant_source);
+
+static inline void sleep_run_from_xosc(void) { sleep_run_from_dormant_source(DORMANT_SOURCE_XOSC); }
+static inline void sleep_run_from_rosc(void) { sleep_run_from_dormant_source(DORMANT_SOURCE_ROSC); }
+
+void sleep_goto_sleep_until(datetime_t *t, rtc_callback_t callback);
+
+void sleep_goto_dormant_until_pin(uint gpio_pin, bool edge, bool high);
+
+static inline void sleep_goto_dormant_until_edge_high(uint gpio_pin) { sleep_goto_dormant_until_pin(gpio_pin, true, true); }
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
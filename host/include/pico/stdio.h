@@ -0,0 +1,21 @@
+#ifndef _PICO_STDIO_H
+#define _PICO_STDIO_H
+
+#include <stdio.h>
+
+#include "pico.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+bool stdio_init_all(void);
+
+#define PICO_ERROR_TIMEOUT_CHAR PICO_ERROR_TIMEOUT
+int getchar_timeout_us(uint32_t timeout_us);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
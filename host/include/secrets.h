@@ -0,0 +1,8 @@
+#ifndef __secrets_H__
+#define __secrets_H__
+
+// Placeholder for the untracked secrets.h of a device build. Must match the
+// PIN the simulated SIM800L expects.
+#define SIM_PIN_CODE "1234"
+
+#endif
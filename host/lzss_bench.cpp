@@ -0,0 +1,244 @@
+// LZSS (lzss.h) on the kinds of data the tracker sends, in upload batches
+// of a few sizes, each batch a stream of its own as it would be on the
+// link. The data: NMEA as the receiver outputs it (GpsTrackGenerator), the
+// CSV reports the uplink used to send, the binary fix frames it sends now
+// (fix_codec.h) and modem diagnostics lines. Checks the round trip, fed
+// and drained in small pieces as well as whole, the worst case expansion
+// on random bytes and an empty stream. Prints compressed / original size
+// and encode and decode time per input byte. Exits non-zero if a check
+// fails.
+//
+//   lzss_bench [--passes N]
+//
+// The window is a build option, e.g. -DCMAKE_CXX_FLAGS=-DLZSS_WINDOW_BITS=10.
+
+#include "bench_util.h"
+#include "sim_devices.h"
+
+#include "fix_codec.h"
+#include "lzss.h"
+
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+static uint32_t rng = 12345;
+static uint32_t nextRandom()
+{
+    rng = rng * 1664525 + 1013904223;
+    return rng;
+}
+
+static int failures;
+
+static void check(const char* name, bool ok)
+{
+    printf("%-44s %s\n", name, ok ? "ok" : "FAIL");
+    failures += !ok;
+}
+
+// sinks in pieces of inStep, drains into room of outStep
+static std::string compress(const std::string& in, size_t inStep = 4096, size_t outStep = 4096)
+{
+    static LzssEncoder enc;
+    enc.reset();
+    std::string out;
+    uint8_t room[4096];
+    size_t taken = 0;
+    while (!enc.done())
+    {
+        if (taken < in.size())
+            taken += enc.sink((const uint8_t*)in.data() + taken, std::min(inStep, in.size() - taken));
+        else
+            enc.finish();
+        size_t n;
+        while ((n = enc.poll(room, outStep)) > 0)
+            out.append((const char*)room, n);
+    }
+    return out;
+}
+
+static void append(const uint8_t* data, size_t len, void* ctx)
+{
+    ((std::string*)ctx)->append((const char*)data, len);
+}
+
+static std::string decompress(const std::string& in, size_t step = 4096)
+{
+    std::string out;
+    LzssDecoder dec(&append, &out);
+    for (size_t i = 0; i < in.size(); i += step)
+        dec.push((const uint8_t*)in.data() + i, std::min(step, in.size() - i));
+    return out;
+}
+
+static std::string nmeaData(size_t bytes)
+{
+    GpsTrackGenerator track;
+    std::string out;
+    while (out.size() < bytes)
+        track.nextEpoch(out);
+    out.resize(bytes);
+    return out;
+}
+
+// a drive with GPS noise, one fix every 30 s
+static std::vector<FixRecord> drive(size_t n)
+{
+    std::vector<FixRecord> fixes(n);
+    double north = 0, east = 0, course = 70, speed = 50;
+    for (size_t i = 0; i < n; i++)
+    {
+        course = fmod(course + (nextRandom() % 9) - 4 + 360, 360);
+        speed = std::max(10.0, speed + (double)(nextRandom() % 9) - 4);
+        north += speed / 3.6 * 30 * cos(course * M_PI / 180);
+        east += speed / 3.6 * 30 * sin(course * M_PI / 180);
+        FixRecord& f = fixes[i];
+        f.time = 1714000000 + 30 * (uint32_t)i;
+        f.latE7 = 474986683 + (int32_t)((north + nextRandom() % 5) / 111320.0 * 1e7);
+        f.lngE7 = 190424492 + (int32_t)((east + nextRandom() % 5) / 75200.0 * 1e7);
+        f.altitudeCm = 24000 + (int32_t)(nextRandom() % 300);
+        f.speedKmph100 = (int32_t)(speed * 100);
+        f.courseCdeg = (int32_t)(course * 100);
+        f.sats = (uint8_t)(7 + nextRandom() % 3);
+        f.fields = FIX_HAS_ALT | FIX_HAS_SPEED | FIX_HAS_COURSE | FIX_HAS_SATS;
+    }
+    return fixes;
+}
+
+static std::string csvData(size_t bytes)
+{
+    std::string out;
+    for (const FixRecord& f : drive(bytes / 40 + 1))
+    {
+        char record[96];
+        snprintf(record, sizeof(record), "%06lu,%08lu,%ld,%ld,%ld,%ld,%ld,%ld\n", 250424ul,
+            (unsigned long)(f.time % 86400) * 100, (long)f.latE7, (long)f.lngE7, (long)f.altitudeCm,
+            (long)f.speedKmph100, (long)f.courseCdeg, (long)f.sats);
+        out += record;
+    }
+    out.resize(bytes);
+    return out;
+}
+
+// fix frames of ten, back to back
+static std::string frameData(size_t bytes)
+{
+    static uint8_t buffer[FIX_FRAME_OVERHEAD + FIX_FRAME_MAX];
+    FixEncoder enc(buffer, sizeof(buffer));
+    std::string out;
+    for (const FixRecord& f : drive(bytes / 4 + 10))
+    {
+        enc.add(f);
+        if (enc.count() == 10)
+        {
+            out.append((const char*)enc.data(), enc.finish());
+            enc.begin();
+        }
+    }
+    out.resize(bytes);
+    return out;
+}
+
+static std::string diagnosticsData(size_t bytes)
+{
+    std::string out;
+    for (uint32_t t = 0; out.size() < bytes; t += 60)
+    {
+        char line[160];
+        snprintf(line, sizeof(line), "%u,csq %u,ber 0,cbc %u mV %u%%,gprs connected,sends %u,failures %u,"
+            "mqtt connected,pings %u,sleeps %u\n", t, 14 + nextRandom() % 6, 3900 + nextRandom() % 40,
+            80 + (t / 3600) % 10, t / 150, (t / 3000) % 3, t / 180, t / 20);
+        out += line;
+    }
+    out.resize(bytes);
+    return out;
+}
+
+int main(int argc, char** argv)
+{
+    int passes = 20;
+    for (int i = 1; i + 1 < argc; i += 2)
+        if (!strcmp(argv[i], "--passes"))
+            passes = atoi(argv[i + 1]);
+
+    struct Data
+    {
+        const char* name;
+        std::string bytes;
+    };
+    const size_t total = 64 * 1024;
+    const Data sets[] = {
+        {"nmea", nmeaData(total)},
+        {"csv reports", csvData(total)},
+        {"fix frames", frameData(total)},
+        {"diagnostics", diagnosticsData(total)},
+    };
+    const size_t batches[] = {128, 512, 2048};
+
+    printf("window %d bytes, matches %d to %d bytes, encoder state %zu bytes\n", LZSS_WINDOW, LZSS_MIN_MATCH,
+        LZSS_MAX_MATCH, sizeof(LzssEncoder));
+    printf("data          size by batch:  %5zu  %5zu  %5zu   encode       decode\n", batches[0], batches[1],
+        batches[2]);
+    bool roundTrip = true;
+    for (const Data& d : sets)
+    {
+        printf("%-12s  %14s", d.name, "");
+        double encodeNs = 0, decodeNs = 0, encodeCycles = 0;
+        for (size_t b : batches)
+        {
+            size_t packed = 0;
+            std::vector<std::string> streams;
+            for (size_t i = 0; i < d.bytes.size(); i += b)
+            {
+                const std::string batch = d.bytes.substr(i, b);
+                streams.push_back(compress(batch));
+                packed += streams.back().size();
+                roundTrip &= decompress(streams.back()) == batch;
+            }
+            printf("  %4.0f%%", 100.0 * packed / d.bytes.size());
+            if (b != 512)
+                continue;
+            BenchTimer timer;
+            timer.start();
+            for (int p = 0; p < passes; p++)
+                for (size_t i = 0; i < d.bytes.size(); i += b)
+                    bench_keep(compress(d.bytes.substr(i, b)));
+            encodeNs = timer.seconds() * 1e9 / ((double)passes * d.bytes.size());
+            encodeCycles = (double)timer.cycles() / ((double)passes * d.bytes.size());
+            timer.start();
+            for (int p = 0; p < passes; p++)
+                for (const std::string& s : streams)
+                    bench_keep(decompress(s));
+            decodeNs = timer.seconds() * 1e9 / ((double)passes * d.bytes.size());
+        }
+        printf("   %4.0f ns/B", encodeNs);
+        if (BENCH_HAVE_CYCLES)
+            printf(" (%4.0f cycles)", encodeCycles);
+        printf("  %3.0f ns/B\n", decodeNs);
+    }
+    printf("(times for 512 byte batches)\n");
+    check("round trip", roundTrip);
+
+    const std::string& nmea = sets[0].bytes;
+    const std::string piece = nmea.substr(1000, 3000);
+    const std::string whole = compress(piece);
+    bool pieces = true;
+    for (size_t inStep : {1, 5, 300})
+        for (size_t outStep : {1, 3, 64})
+            pieces &= compress(piece, inStep, outStep) == whole;
+    check("fed and drained in pieces", pieces && decompress(whole, 1) == piece && decompress(whole, 7) == piece);
+
+    std::string noise(4096, 0);
+    for (char& c : noise)
+        c = (char)nextRandom();
+    const std::string packedNoise = compress(noise);
+    check("random bytes grow by an eighth at most", packedNoise.size() <= noise.size() * 9 / 8 + 1
+        && decompress(packedNoise) == noise);
+    const std::string run(5000, 'a');
+    check("a run shrinks", compress(run).size() < 5000 / LZSS_MAX_MATCH * 2 && decompress(compress(run)) == run);
+    check("empty stream", compress(std::string()).empty());
+
+    printf("%s\n", failures ? "FAIL" : "all checks pass");
+    return failures ? 1 : 0;
+}
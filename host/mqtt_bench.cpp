@@ -0,0 +1,274 @@
+// MqttClient on GprsSession against the simulated SIM800L, connected to the
+// scripted broker in this process. Checks the persistent session (clean
+// session 0, resumed on reconnect), the QoS 1 in-flight window, that
+// unacknowledged publishes go again with DUP after the connection drops and
+// arrive once, the keep-alive ping and a reconnect when it goes unanswered,
+// QoS 0, a refused CONNACK, a subscription sent once per broker session and
+// publishes delivered by it, and a full outbox.
+// Reports the virtual modem time per report for a connection and CONNECT
+// per report against the persistent session, with and without batching.
+// Exits non-zero if a check fails.
+//
+//   mqtt_bench
+
+#include "sim_hal.h"
+#include "sim_devices.h"
+#include "sim_broker.h"
+
+#include "pico/stdlib.h"
+#include "gprs_session.h"
+#include "mqtt_client.h"
+#include "sim800l.h"
+
+#include <cstring>
+#include <functional>
+#include <string>
+
+#define BENCH_POLL_MS 10
+// as the modem task (MODEM_TX_POLL_US), a character per poll without the FIFO
+#define BENCH_TX_POLL_US 2000
+#define REPORT_LEN 40
+#define TOPIC "trackers/" MQTT_CLIENT_ID "/fix"
+#define CMD_TOPIC "trackers/" MQTT_CLIENT_ID "/cmd"
+
+static SIM800L sim800l;
+static GprsSession uplink(sim800l);
+static MqttClient mqtt(uplink);
+static SimMqttBroker broker;
+static uint32_t reportSeq;
+static std::string received;
+static int failures;
+
+static void on_sim800_rx()
+{
+    while (uart_is_readable(SIM800L_UART_ID))
+        sim800l.processChar(uart_getc(SIM800L_UART_ID));
+}
+
+static void on_message(const char* topic, size_t topicLen, const uint8_t* payload, size_t len, void*)
+{
+    received.assign(topic, topicLen);
+    received += '=';
+    received.append((const char*)payload, len);
+}
+
+static void check(const char* name, bool ok)
+{
+    printf("%-44s %s\n", name, ok ? "ok" : "FAIL");
+    failures += !ok;
+}
+
+// Like the modem task
+static void step()
+{
+    sim800l.poll();
+    uplink.poll();
+    mqtt.poll();
+    sim800l.poll();
+    if (sim800l.transmitting())
+        sleep_us(BENCH_TX_POLL_US);
+    else
+        sleep_ms(BENCH_POLL_MS);
+}
+
+static void run(uint32_t ms)
+{
+    const uint64_t end = sim_now_us() + 1000ull * ms;
+    while (sim_now_us() < end)
+        step();
+}
+
+// Virtual ms until done() holds, or 0 if it does not within maxMs
+static uint32_t runUntil(const std::function<bool()>& done, uint32_t maxMs)
+{
+    const uint64_t start = sim_now_us();
+    while (!done() && sim_now_us() - start < 1000ull * maxMs)
+        step();
+    return done() ? (uint32_t)((sim_now_us() - start) / 1000) + 1 : 0;
+}
+
+static uint32_t runUntilAcked(uint32_t maxMs)
+{
+    return runUntil([]() { return mqtt.queued() == 0 && uplink.pending() == 0; }, maxMs);
+}
+
+static bool publishReports(uint32_t n, uint8_t qos)
+{
+    bool ok = true;
+    for (uint32_t i = 0; i < n; i++)
+    {
+        // room for a sequence number of up to 10 digits
+        char r[REPORT_LEN + 5];
+        snprintf(r, sizeof(r), "%06u,474986683,190424492,11240,2315,63", (unsigned)reportSeq++);
+        ok &= mqtt.publish(TOPIC, (const uint8_t*)r, REPORT_LEN, qos);
+    }
+    return ok;
+}
+
+// Every report published so far arrived once and in order
+static bool allArrived()
+{
+    if (broker.messages.size() != reportSeq)
+        return false;
+    for (uint32_t i = 0; i < reportSeq; i++)
+    {
+        char r[12];
+        snprintf(r, sizeof(r), "%06u,", (unsigned)i);
+        if (broker.messages[i].topic != TOPIC || broker.messages[i].payload.compare(0, 7, r))
+            return false;
+    }
+    return true;
+}
+
+int main()
+{
+    stdio_init_all();
+    static SIM800LModel modem(SIM800L_UART_ID);
+    uart_init(SIM800L_UART_ID, SIM800L_BAUD_RATE);
+    uart_set_format(SIM800L_UART_ID, SIM800L_DATA_BITS, SIM800L_STOP_BITS, SIM800L_PARITY);
+    uart_set_fifo_enabled(SIM800L_UART_ID, false);
+    irq_set_exclusive_handler(UART1_IRQ, &on_sim800_rx);
+    irq_set_enabled(UART1_IRQ, true);
+    uart_set_irq_enables(SIM800L_UART_ID, true, false);
+    mqtt.onMessage(&on_message, nullptr);
+    mqtt.subscribe(CMD_TOPIC, 1);
+
+    if (!broker.start())
+    {
+        fprintf(stderr, "cannot listen on 127.0.0.1\n");
+        return 1;
+    }
+    modem.serverPort = broker.port;
+
+    sim800l.begin();
+    run(5000);
+    check("sim ready", sim800l.state == SIM_STATE::READY);
+
+    publishReports(3, 1);
+    mqtt.flush();
+    const uint32_t firstMs = runUntilAcked(60000);
+    check("first flush connects", firstMs && mqtt.connects == 1 && broker.connects == 1
+        && mqtt.state() == MQTT_STATE::CONNECTED);
+    check("persistent session requested", !broker.lastCleanSession && broker.lastKeepAliveS == MQTT_KEEPALIVE_S
+        && mqtt.sessionsResumed == 0);
+    check("qos 1 acknowledged", allArrived() && mqtt.published == 3 && mqtt.inFlight() == 0);
+    check("subscribed after the connack", mqtt.subscribes == 1 && broker.subscribes == 1
+        && mqtt.subscribeRefusals == 0);
+
+    // no PUBACKs: the window fills and the rest waits
+    broker.ackPublishes = false;
+    publishReports(MQTT_OUTBOX, 1);
+    mqtt.flush();
+    run(10000);
+    check("in-flight window", mqtt.inFlight() == MQTT_INFLIGHT && mqtt.maxInFlight == MQTT_INFLIGHT
+        && broker.messages.size() == 3 + MQTT_INFLIGHT && mqtt.queued() == MQTT_OUTBOX);
+
+    // the connection goes, the unacknowledged ones go again with DUP
+    broker.dropClients();
+    broker.ackPublishes = true;
+    run(500);
+    check("drop noticed", mqtt.state() == MQTT_STATE::DISCONNECTED);
+    mqtt.flush();
+    check("session resumed", runUntilAcked(60000) && mqtt.connects == 2 && mqtt.sessionsResumed == 1
+        && broker.sessionsResumed == 1);
+    check("no subscribe on a resumed session", mqtt.subscribes == 1 && broker.subscribes == 1);
+    check("unacknowledged sent again with DUP", mqtt.retransmits == MQTT_INFLIGHT
+        && broker.dupFlags == MQTT_INFLIGHT && broker.duplicates == MQTT_INFLIGHT);
+    check("every report arrives once", allArrived() && mqtt.published == 3 + MQTT_OUTBOX);
+
+    // idle: the keep-alive ping holds the connection
+    const uint32_t pingsBefore = broker.pings;
+    run(3 * MQTT_KEEPALIVE_S * 1000 + 5000);
+    check("keep-alive pings when idle", mqtt.pings == 3 && broker.pings - pingsBefore == 3
+        && mqtt.pingTimeouts == 0 && mqtt.state() == MQTT_STATE::CONNECTED && mqtt.connects == 2);
+
+    // a dead broker: the unanswered ping closes the connection
+    broker.answerPings = false;
+    run(MQTT_KEEPALIVE_S * 1000 + MQTT_PING_TIMEOUT_MS + 5000);
+    check("unanswered ping closes", mqtt.pingTimeouts == 1 && mqtt.state() == MQTT_STATE::DISCONNECTED
+        && uplink.state() == GPRS_STATE::IDLE);
+    broker.answerPings = true;
+
+    publishReports(2, 0);
+    mqtt.flush();
+    check("qos 0 after a reconnect", runUntilAcked(60000) && allArrived() && broker.messages.back().qos == 0
+        && mqtt.connects == 3 && mqtt.sessionsResumed == 2);
+
+    broker.deliver(CMD_TOPIC, "interval=60", 1);
+    check("incoming qos 1 acknowledged", runUntil([]() { return broker.pubacksIn == 1; }, 10000)
+        && mqtt.received == 1 && received == CMD_TOPIC "=interval=60");
+    broker.deliver("trackers/" MQTT_CLIENT_ID "/other", "x", 1);
+    run(1000);
+    check("nothing without a subscription", broker.undelivered == 1 && mqtt.received == 1);
+
+    // a broker that lost the session: subscribed again after the connack
+    broker.dropClients();
+    broker.forgetSessions();
+    run(500);
+    publishReports(1, 1);
+    mqtt.flush();
+    check("subscribed again for a new session", runUntilAcked(60000) && mqtt.subscribes == 2
+        && broker.subscribes == 2 && allArrived());
+    broker.deliver(CMD_TOPIC, "interval=30", 1);
+    check("delivered by the new subscription", runUntil([]() { return broker.pubacksIn == 2; }, 10000)
+        && received == CMD_TOPIC "=interval=30");
+
+    // refused: nothing more on the connection, the outbox waits
+    broker.dropClients();
+    broker.connackCode = 5;
+    run(500);
+    publishReports(1, 1);
+    mqtt.flush();
+    runUntil([]() { return mqtt.refused == 1; }, 60000);
+    run(1000);
+    check("refused connack", mqtt.refused == 1 && mqtt.state() == MQTT_STATE::DISCONNECTED
+        && mqtt.queued() == 1);
+    broker.connackCode = 0;
+    mqtt.flush();
+    check("accepted again", runUntilAcked(60000) && allArrived());
+
+    const uint32_t rejectedBefore = mqtt.rejected;
+    broker.dropClients();
+    run(500);
+    const bool fits = publishReports(MQTT_OUTBOX, 1);
+    const bool over = !mqtt.publish(TOPIC, (const uint8_t*)"x", 1, 1);
+    const uint8_t big[MQTT_PACKET_MAX] = {};
+    const bool tooLong = !mqtt.publish(TOPIC, big, sizeof(big), 1);
+    check("full outbox and long packets refused", fits && over && tooLong && mqtt.rejected == rejectedBefore + 2);
+    mqtt.flush();
+    check("full outbox sent", runUntilAcked(60000) && allArrived());
+
+    // 24 reports, connection and CONNECT for each against the session
+    // kept open, one report or eight to a flush
+    printf("--- 24 reports of %d bytes, QoS 1\n", REPORT_LEN);
+    printf("mode                      sends  modem ms  ms/report\n");
+    const char* modes[] = {"connect per report", "persistent, 1 per flush", "persistent, 8 per flush"};
+    double perReport[3];
+    for (int mode = 0; mode < 3; mode++)
+    {
+        const uint32_t sendsBefore = uplink.sends;
+        const uint32_t batch = mode == 2 ? 8 : 1;
+        uint32_t busyMs = 0;
+        for (uint32_t n = 0; n < 24; n += batch)
+        {
+            if (mode == 0)
+            {
+                uplink.close();
+                run(500);
+            }
+            publishReports(batch, 1);
+            mqtt.flush();
+            busyMs += runUntilAcked(60000);
+        }
+        perReport[mode] = busyMs / 24.0;
+        printf("%-24s  %5u  %8u  %9.1f\n", modes[mode], uplink.sends - sendsBefore, busyMs, perReport[mode]);
+    }
+    check("session reuse saves airtime", perReport[1] * 3 < perReport[0] && perReport[2] * 2 < perReport[1]
+        && allArrived());
+
+    printf("connects %u  resumed %u  published %u  retransmits %u  pings %u  ping timeouts %u  max in flight %u\n",
+        mqtt.connects, mqtt.sessionsResumed, mqtt.published, mqtt.retransmits, mqtt.pings, mqtt.pingTimeouts,
+        mqtt.maxInFlight);
+    printf("%s\n", failures ? "FAIL" : "all checks pass");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,171 @@
+// SpscRing throughput, and a consistency check of its ordering between a
+// producer and a consumer thread standing in for the UART IRQ and the main
+// loop. Exits non-zero if data arrives out of order or the counters are off.
+//
+//   ring_bench [--mbytes N]
+
+#include "bench_util.h"
+
+#include "spsc_ring.h"
+
+#include <atomic>
+#include <cstring>
+#include <thread>
+
+typedef SpscRing<char, 256> Ring;
+
+static int failures = 0;
+static void check(bool ok, const char* what)
+{
+    if (!ok)
+    {
+        printf("FAIL: %s\n", what);
+        failures++;
+    }
+}
+
+// wrap-around, bulk and peek/skip behaviour on a small ring
+static void checkSemantics()
+{
+    SpscRing<uint16_t, 8> r;
+    uint16_t v = 0, buf[16];
+    for (uint16_t i = 0; i < 8; i++)
+        check(r.push(i), "push into free slot");
+    check(!r.push(8), "push into full ring");
+    check(r.overflows() == 1 && r.highWater() == 8, "overflow and high-water after filling");
+    check(r.pop(v) && v == 0, "pop oldest");
+
+    for (uint16_t i = 0; i < 16; i++)
+        buf[i] = 100 + i;
+    check(r.push(buf, 4) == 1 && r.overflows() == 4, "bulk push truncated to free space");
+    check(r.size() == 8, "size when full");
+
+    const uint16_t* p;
+    size_t n = r.peek(&p);
+    check(n == 7 && p[0] == 1 && p[6] == 7, "peek stops at the end of the buffer");
+    r.skip(n);
+    n = r.peek(&p);
+    check(n == 1 && p[0] == 100, "peek continues at the start");
+    r.skip(1);
+    check(r.empty() && r.peek(&p) == 0, "empty after skipping everything");
+
+    for (int round = 0; round < 5; round++)
+    {
+        check(r.push(buf, 5) == 5, "bulk push across the wrap");
+        uint16_t out[8] = {};
+        check(r.pop(out, 8) == 5 && memcmp(out, buf, 5 * sizeof(uint16_t)) == 0, "bulk pop across the wrap");
+    }
+    check(r.overflows() == 4 && r.highWater() == 8, "counters unchanged by later traffic");
+}
+
+int main(int argc, char** argv)
+{
+    uint64_t total = 64ull << 20;
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        if (!strcmp(argv[i], "--mbytes"))
+            total = strtoull(argv[i + 1], nullptr, 10) << 20;
+        else
+        {
+            fprintf(stderr, "unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    checkSemantics();
+
+    // one thread: the cost of the ring itself
+    {
+        static Ring r;
+        char chunk[64], out[64];
+        for (size_t i = 0; i < sizeof(chunk); i++)
+            chunk[i] = (char)i;
+        BenchTimer timer;
+        timer.start();
+        for (uint64_t done = 0; done < total; done += sizeof(chunk))
+        {
+            r.push(chunk, sizeof(chunk));
+            r.pop(out, sizeof(out));
+            bench_keep(out);
+        }
+        const double secs = timer.seconds();
+        printf("bulk 64 byte push/pop   %8.0f MB/s", total / secs / 1e6);
+        if (BENCH_HAVE_CYCLES)
+            printf("  %.2f cycles/byte", (double)timer.cycles() / total);
+        printf("\n");
+
+        timer.start();
+        const uint64_t singles = total / 16;
+        char c = 0;
+        for (uint64_t done = 0; done < singles; done++)
+        {
+            r.push((char)done);
+            r.pop(c);
+            bench_keep(c);
+        }
+        const double secs1 = timer.seconds();
+        printf("push/pop(char)          %8.0f MB/s", singles / secs1 / 1e6);
+        if (BENCH_HAVE_CYCLES)
+            printf("  %.2f cycles/byte", (double)timer.cycles() / singles);
+        printf("\n");
+    }
+
+    // two threads: the producer writes a running byte sequence, the consumer
+    // parses it in place through peek()/skip() and checks every byte
+    {
+        static Ring r;
+        std::atomic<bool> done(false);
+        uint64_t received = 0, mismatches = 0;
+        BenchTimer timer;
+        timer.start();
+        std::thread consumer([&]() {
+            uint8_t expect = 0;
+            for (;;)
+            {
+                const char* p;
+                const size_t n = r.peek(&p);
+                if (n == 0)
+                {
+                    if (done.load(std::memory_order_acquire) && r.empty())
+                        break;
+                    std::this_thread::yield();
+                    continue;
+                }
+                for (size_t i = 0; i < n; i++, expect++)
+                    mismatches += (uint8_t)p[i] != expect;
+                received += n;
+                r.skip(n);
+            }
+        });
+        char chunk[37];
+        uint8_t next = 0;
+        for (uint64_t sent = 0; sent < total; )
+        {
+            for (size_t i = 0; i < sizeof(chunk); i++)
+                chunk[i] = (char)(uint8_t)(next + i);
+            // a real UART would drop here, the benchmark waits for space
+            size_t want = sizeof(chunk);
+            if (want > total - sent)
+                want = total - sent;
+            if (want > r.capacity() - r.size())
+                want = r.capacity() - r.size();
+            const size_t n = r.push(chunk, want);
+            if (n == 0)
+                std::this_thread::yield();
+            next += n;
+            sent += n;
+        }
+        done.store(true, std::memory_order_release);
+        consumer.join();
+        const double secs = timer.seconds();
+        printf("two threads, peek/skip  %8.0f MB/s  high-water %u/%zu\n", received / secs / 1e6, r.highWater(), r.capacity());
+        check(received == total, "consumer received everything");
+        check(mismatches == 0, "bytes arrive in order");
+        check(r.overflows() == 0, "no overflow when the producer waits for space");
+    }
+
+    if (failures)
+        return 1;
+    printf("all checks passed\n");
+    return 0;
+}
@@ -0,0 +1,299 @@
+// Scripted MQTT broker, see sim_broker.h.
+
+#include "sim_broker.h"
+#include "sim_hal.h"
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+SimMqttBroker::SimMqttBroker()
+    : port(0), pollMs(20), ackPublishes(true), answerPings(true), connackCode(0), accepts(0), connects(0),
+      sessionsResumed(0), publishes(0), duplicates(0), dupFlags(0), pings(0), pubacksIn(0), subscribes(0),
+      undelivered(0), bytesIn(0),
+      lastKeepAliveS(0), lastCleanSession(false), listener(-1), nextId(1), generation(0)
+{
+}
+
+SimMqttBroker::~SimMqttBroker()
+{
+    stop();
+}
+
+bool SimMqttBroker::start(uint16_t p)
+{
+    listener = socket(AF_INET, SOCK_STREAM, 0);
+    const int one = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(p);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    if (bind(listener, (sockaddr*)&addr, sizeof(addr)) || listen(listener, 4)
+        || getsockname(listener, (sockaddr*)&addr, &len))
+    {
+        close(listener);
+        listener = -1;
+        return false;
+    }
+    port = ntohs(addr.sin_port);
+    fcntl(listener, F_SETFL, O_NONBLOCK);
+    generation++;
+    poll();
+    return true;
+}
+
+void SimMqttBroker::stop()
+{
+    dropClients();
+    if (listener >= 0)
+        close(listener);
+    listener = -1;
+    generation++;
+}
+
+void SimMqttBroker::dropClients()
+{
+    for (Client& c : clients)
+        close(c.fd);
+    clients.clear();
+}
+
+void SimMqttBroker::poll()
+{
+    const uint32_t g = generation;
+    sim_schedule_at(sim_now_us() + 1000ull * pollMs, [this, g]() {
+        if (g != generation)
+            return;
+        pump();
+        poll();
+    });
+}
+
+void SimMqttBroker::pump()
+{
+    int fd;
+    while (listener >= 0 && (fd = accept(listener, nullptr, nullptr)) >= 0)
+    {
+        fcntl(fd, F_SETFL, O_NONBLOCK);
+        // Nagle would hold back a second small packet for the ACK, which
+        // comes in host time while the virtual clock races ahead
+        const int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        clients.push_back(Client{fd, std::string(), std::string()});
+        accepts++;
+    }
+    for (size_t i = 0; i < clients.size();)
+    {
+        Client& c = clients[i];
+        char buf[2048];
+        ssize_t n;
+        bool open = true;
+        while ((n = recv(c.fd, buf, sizeof(buf), 0)) > 0)
+        {
+            c.in.append(buf, (size_t)n);
+            bytesIn += (uint64_t)n;
+        }
+        if (n == 0)
+            open = false;
+        // whole packets: header, remaining length, body
+        while (open && c.in.size() >= 2)
+        {
+            uint32_t len = 0;
+            size_t pos = 1;
+            bool complete = false;
+            for (int shift = 0; pos < c.in.size() && shift <= 21; shift += 7)
+            {
+                const uint8_t b = (uint8_t)c.in[pos++];
+                len |= (uint32_t)(b & 0x7F) << shift;
+                if (!(b & 0x80))
+                {
+                    complete = true;
+                    break;
+                }
+            }
+            if (!complete || c.in.size() < pos + len)
+                break;
+            const uint8_t header = (uint8_t)c.in[0];
+            const std::string body = c.in.substr(pos, len);
+            c.in.erase(0, pos + len);
+            open = packet(c, header, body);
+        }
+        if (open)
+            i++;
+        else
+        {
+            close(c.fd);
+            clients.erase(clients.begin() + i);
+        }
+    }
+}
+
+static std::string mqttString(const std::string& body, size_t pos)
+{
+    if (pos + 2 > body.size())
+        return std::string();
+    const size_t len = (size_t)((uint8_t)body[pos] << 8 | (uint8_t)body[pos + 1]);
+    return body.substr(pos + 2, len);
+}
+
+static void putLength(std::string& out, size_t len)
+{
+    do
+    {
+        uint8_t b = len & 0x7F;
+        len >>= 7;
+        out += (char)(len ? b | 0x80 : b);
+    } while (len);
+}
+
+// false closes the connection
+bool SimMqttBroker::packet(Client& c, uint8_t header, const std::string& body)
+{
+    switch (header & 0xF0)
+    {
+    case 0x10:
+    {
+        // CONNECT: "MQTT", level, flags, keep-alive, client id
+        if (body.size() < 12 || mqttString(body, 0) != "MQTT")
+            return false;
+        const uint8_t flags = (uint8_t)body[7];
+        lastCleanSession = flags & 0x02;
+        lastKeepAliveS = (uint32_t)((uint8_t)body[8] << 8 | (uint8_t)body[9]);
+        c.clientId = mqttString(body, 10);
+        connects++;
+        bool present = false;
+        if (lastCleanSession)
+            sessions.erase(c.clientId);
+        else
+        {
+            present = sessions.count(c.clientId) != 0;
+            sessions[c.clientId];
+        }
+        if (present && connackCode == 0)
+            sessionsResumed++;
+        std::string connack("\x20\x02", 2);
+        connack += (char)(present && connackCode == 0);
+        connack += (char)connackCode;
+        send(c, connack);
+        return connackCode == 0;
+    }
+
+    case 0x30:
+    {
+        const uint8_t qos = (header >> 1) & 0x03;
+        Message m;
+        m.clientId = c.clientId;
+        m.topic = mqttString(body, 0);
+        m.qos = qos;
+        m.id = 0;
+        size_t pos = 2 + m.topic.size();
+        if (qos)
+        {
+            if (pos + 2 > body.size())
+                return false;
+            m.id = (uint16_t)((uint8_t)body[pos] << 8 | (uint8_t)body[pos + 1]);
+            pos += 2;
+        }
+        m.payload = body.substr(pos);
+        publishes++;
+        if (header & 0x08)
+            dupFlags++;
+        bool duplicate = false;
+        if (qos)
+        {
+            Session& s = sessions[c.clientId];
+            duplicate = !s.received.insert(m.id).second;
+            duplicates += duplicate;
+        }
+        if (!duplicate)
+            messages.push_back(m);
+        if (qos == 1 && ackPublishes)
+        {
+            const char puback[4] = {0x40, 2, (char)(m.id >> 8), (char)m.id};
+            send(c, std::string(puback, 4));
+        }
+        return true;
+    }
+
+    case 0x40:
+        pubacksIn++;
+        return true;
+
+    case 0x80:
+    {
+        // SUBSCRIBE: packet id, then filters with their QoS
+        if ((header & 0x0F) != 0x02 || body.size() < 5)
+            return false;
+        subscribes++;
+        std::string suback("\x90", 1);
+        std::string codes = body.substr(0, 2);
+        Session& s = sessions[c.clientId];
+        for (size_t pos = 2; pos + 2 < body.size();)
+        {
+            const std::string filter = mqttString(body, pos);
+            pos += 2 + filter.size();
+            if (pos >= body.size())
+                return false;
+            const uint8_t qos = (uint8_t)body[pos++];
+            s.subscriptions.insert(filter);
+            codes += (char)(qos < 1 ? qos : 1);
+        }
+        putLength(suback, codes.size());
+        send(c, suback + codes);
+        return true;
+    }
+
+    case 0xC0:
+        pings++;
+        if (answerPings)
+            send(c, std::string("\xD0\x00", 2));
+        return true;
+
+    case 0xE0:
+        // DISCONNECT
+        return false;
+
+    default:
+        return true;
+    }
+}
+
+void SimMqttBroker::deliver(const std::string& topic, const std::string& payload, uint8_t qos)
+{
+    std::string body;
+    body += (char)(topic.size() >> 8);
+    body += (char)topic.size();
+    body += topic;
+    if (qos)
+    {
+        body += (char)(nextId >> 8);
+        body += (char)nextId;
+        nextId++;
+    }
+    body += payload;
+    std::string out;
+    out += (char)(0x30 | qos << 1);
+    putLength(out, body.size());
+    out += body;
+    bool sent = false;
+    for (Client& c : clients)
+    {
+        auto s = sessions.find(c.clientId);
+        if (s != sessions.end() && s->second.subscriptions.count(topic))
+        {
+            send(c, out);
+            sent = true;
+        }
+    }
+    undelivered += !sent;
+}
+
+void SimMqttBroker::send(Client& c, const std::string& data)
+{
+    ::send(c.fd, data.data(), data.size(), MSG_NOSIGNAL);
+}
@@ -0,0 +1,93 @@
+#ifndef __sim_broker_H__
+#define __sim_broker_H__
+
+// Scripted MQTT 3.1.1 broker for the host simulation, on a TCP port of
+// 127.0.0.1 that the simulated SIM800L connects to (SIM800LModel's
+// serverPort). Its sockets are looked at from a simulator event every
+// pollMs, so virtual time decides when a packet is seen. Sessions are kept
+// by client id: with clean session 0 the CONNACK says whether one was
+// present, and the packet ids of the QoS 1 publishes received in it tell
+// a retransmission from a new message. The session also keeps the topic
+// filters subscribed to, matched exactly, and deliver() goes by them.
+
+#include <cinttypes>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+struct SimMqttBroker
+{
+    struct Message
+    {
+        std::string clientId;
+        std::string topic;
+        std::string payload;
+        uint8_t qos;
+        uint16_t id;
+    };
+
+    SimMqttBroker();
+    ~SimMqttBroker();
+
+    // Listens on port, or on a free one with port 0; starts polling
+    bool start(uint16_t port = 0);
+    // Connections are refused from now on, the open ones closed
+    void stop();
+    // Closes the open connections, as a NAT forgetting them would
+    void dropClients();
+    // Sends a PUBLISH to the connected clients subscribed to topic
+    void deliver(const std::string& topic, const std::string& payload, uint8_t qos);
+    // Forgets every session, as a broker restarted without persistence
+    void forgetSessions() { sessions.clear(); }
+    // Looks at the sockets, also called from the polling event
+    void pump();
+
+    uint16_t port;
+    uint32_t pollMs;
+    bool ackPublishes;          // PUBACK for QoS 1
+    bool answerPings;           // PINGRESP
+    uint8_t connackCode;        // 0 accepts
+
+    // statistics
+    uint32_t accepts;
+    uint32_t connects;          // CONNECT packets
+    uint32_t sessionsResumed;   // ... answered with the session present
+    uint32_t publishes;         // PUBLISH packets, duplicates included
+    uint32_t duplicates;        // QoS 1 ids already received in the session
+    uint32_t dupFlags;          // PUBLISH with the DUP flag
+    uint32_t pings;
+    uint32_t pubacksIn;         // from the client, for deliver()
+    uint32_t subscribes;        // SUBSCRIBE packets
+    uint32_t undelivered;       // deliver() without a subscribed client
+    uint64_t bytesIn;
+    uint32_t lastKeepAliveS;
+    bool lastCleanSession;
+    // every message once, in order of arrival
+    std::vector<Message> messages;
+
+private:
+    struct Session
+    {
+        std::set<uint16_t> received;
+        std::set<std::string> subscriptions;
+    };
+    struct Client
+    {
+        int fd;
+        std::string clientId;
+        std::string in;
+    };
+
+    void poll();
+    bool packet(Client& c, uint8_t header, const std::string& body);
+    void send(Client& c, const std::string& data);
+
+    int listener;
+    std::vector<Client> clients;
+    std::map<std::string, Session> sessions;
+    uint16_t nextId;
+    uint32_t generation;
+};
+
+#endif
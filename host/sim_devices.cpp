@@ -0,0 +1,1080 @@
+#include "sim_devices.h"
+
+#include "neo6m.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static const double DEG_TO_RAD = 3.14159265358979323846 / 180.0;
+static const double METERS_PER_DEG_LAT = 111320.0;
+
+GpsTrackGenerator::GpsTrackGenerator()
+  :  lat(47.497913)
+  ,  lng(19.040236)
+  ,  speedKnots(12.5)
+  ,  courseDeg(63.2)
+  ,  altitude(112.4)
+  ,  startEpoch(1729540800) // 2024-10-21 20:00:00 UTC
+  ,  fixAfterEpochs(0)
+  ,  satellites(8)
+  ,  badChecksumEvery(0)
+  ,  truncateEvery(0)
+  ,  disabledSentences(0)
+  ,  nmeaOutput(true)
+  ,  ubxNavEnabled(0)
+  ,  ubxCount(0)
+  ,  epochCount(0)
+  ,  sentenceCount(0)
+{
+}
+
+// civil date of unix seconds
+static void civilDate(uint32_t t, uint32_t& year, uint32_t& month, uint32_t& day)
+{
+    const uint32_t z = t / 86400 + 719468;
+    const uint32_t era = z / 146097;
+    const uint32_t doe = z - era * 146097;
+    const uint32_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    const uint32_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    const uint32_t mp = (5 * doy + 2) / 153;
+    day = doy - (153 * mp + 2) / 5 + 1;
+    month = mp < 10 ? mp + 3 : mp - 9;
+    year = yoe + era * 400 + (month <= 2);
+}
+
+// ddmm.mmmmm or dddmm.mmmmm, in 1e-5 minutes so that a minute never rounds
+// up to 60
+static void formatDegrees(char* out, size_t size, double v, int degDigits)
+{
+    const uint32_t units = (uint32_t)lround(fmin(fabs(v), 180.0) * 6e6);
+    const uint32_t deg = units / 6000000, minutes = units % 6000000;
+    snprintf(out, size, "%0*u%02u.%05u", degDigits, (unsigned)deg, (unsigned)(minutes / 100000),
+        (unsigned)(minutes % 100000));
+}
+
+void GpsTrackGenerator::sentence(std::string& out, const char* body)
+{
+    sentenceCount++;
+    uint8_t parity = 0;
+    for (const char* p = body; *p; p++)
+        parity ^= (uint8_t)*p;
+    if (badChecksumEvery && sentenceCount % badChecksumEvery == 0)
+        parity ^= 0x5A;
+
+    char text[128];
+    int len = snprintf(text, sizeof(text), "$%s*%02X\r\n", body, parity);
+    if (truncateEvery && sentenceCount % truncateEvery == 0)
+        len /= 2; // receiver dropped the rest, the next '$' starts over
+    out.append(text, len);
+}
+
+void GpsTrackGenerator::nextEpoch(std::string& out)
+{
+    const bool fix = epochCount >= fixAfterEpochs;
+    const uint32_t t = startEpoch + epochCount;
+    const uint32_t secs = t % 86400;
+    uint32_t year, month, day;
+    civilDate(t, year, month, day);
+
+    char hms[16], dmy[8], la[16], lo[16];
+    sprintf(hms, "%02u%02u%02u.00", secs / 3600, secs / 60 % 60, secs % 60);
+    sprintf(dmy, "%02u%02u%02u", day, month, year % 100);
+    formatDegrees(la, sizeof(la), lat, 2);
+    formatDegrees(lo, sizeof(lo), lng, 3);
+    const char ns = lat < 0 ? 'S' : 'N';
+    const char ew = lng < 0 ? 'W' : 'E';
+
+    char body[128];
+    const uint32_t off = nmeaOutput ? disabledSentences : ~0u;
+    if (fix)
+        sprintf(body, "GPRMC,%s,A,%s,%c,%s,%c,%.3f,%.2f,%s,,,A", hms, la, ns, lo, ew, speedKnots, courseDeg, dmy);
+    else
+        sprintf(body, "GPRMC,%s,V,,,,,,,%s,,,N", hms, dmy);
+    if (!(off & (1u << UBX_NMEA_RMC)))
+        sentence(out, body);
+
+    if (fix)
+        sprintf(body, "GPVTG,%.2f,T,,M,%.3f,N,%.3f,K,A", courseDeg, speedKnots, speedKnots * 1.852);
+    else
+        sprintf(body, "GPVTG,,,,,,,,,N");
+    if (!(off & (1u << UBX_NMEA_VTG)))
+        sentence(out, body);
+
+    if (fix)
+        sprintf(body, "GPGGA,%s,%s,%c,%s,%c,1,%02u,1.01,%.1f,M,39.7,M,,", hms, la, ns, lo, ew, satellites, altitude);
+    else
+        sprintf(body, "GPGGA,%s,,,,,0,00,99.99,,,,,,", hms);
+    if (!(off & (1u << UBX_NMEA_GGA)))
+        sentence(out, body);
+
+    if (fix)
+        sprintf(body, "GPGSA,A,3,04,05,09,12,17,20,25,29,,,,,2.52,1.01,2.31");
+    else
+        sprintf(body, "GPGSA,A,1,,,,,,,,,,,,,99.99,99.99,99.99");
+    if (!(off & (1u << UBX_NMEA_GSA)))
+        sentence(out, body);
+
+    static const uint8_t prn[12] = {4, 5, 9, 12, 17, 20, 25, 29, 2, 13, 15, 31};
+    const int inView = 11;
+    const int msgs = (inView + 3) / 4;
+    for (int m = 0; m < msgs && !(off & (1u << UBX_NMEA_GSV)); m++)
+    {
+        int n = sprintf(body, "GPGSV,%d,%d,%02d", msgs, m + 1, inView);
+        for (int i = m * 4; i < inView && i < m * 4 + 4; i++)
+            n += sprintf(body + n, ",%02u,%02d,%03d,%02d", prn[i], 10 + (i * 7) % 75,
+                (i * 37 + (int)epochCount) % 360, fix ? 20 + (i * 3) % 25 : 0);
+        sentence(out, body);
+    }
+
+    if (fix)
+        sprintf(body, "GPGLL,%s,%c,%s,%c,%s,A,A", la, ns, lo, ew, hms);
+    else
+        sprintf(body, "GPGLL,,,,,%s,V,N", hms);
+    if (!(off & (1u << UBX_NMEA_GLL)))
+        sentence(out, body);
+
+    ubxNav(out, t);
+
+    // move along the track for the next epoch
+    const double meters = speedKnots * 0.514444;
+    lat += meters * cos(courseDeg * DEG_TO_RAD) / METERS_PER_DEG_LAT;
+    lng += meters * sin(courseDeg * DEG_TO_RAD) / (METERS_PER_DEG_LAT * cos(lat * DEG_TO_RAD));
+    epochCount++;
+}
+
+void GpsTrackGenerator::ubxFrame(std::string& out, uint8_t msgClass, uint8_t msgId, const uint8_t* payload, uint16_t len)
+{
+    const size_t start = out.size();
+    out += (char)UBX_SYNC_1;
+    out += (char)UBX_SYNC_2;
+    out += (char)msgClass;
+    out += (char)msgId;
+    out += (char)(len & 0xFF);
+    out += (char)(len >> 8);
+    out.append((const char*)payload, len);
+    uint8_t ckA = 0, ckB = 0;
+    for (size_t i = start + 2; i < out.size(); i++)
+    {
+        ckA += (uint8_t)out[i];
+        ckB += ckA;
+    }
+    out += (char)ckA;
+    out += (char)ckB;
+}
+
+static void putLE(uint8_t* p, uint32_t v, int bytes)
+{
+    for (int i = 0; i < bytes; i++)
+        p[i] = (uint8_t)(v >> (8 * i));
+}
+
+void GpsTrackGenerator::ubxNav(std::string& out, uint32_t t)
+{
+    if (!ubxNavEnabled)
+        return;
+    const bool fix = epochCount >= fixAfterEpochs;
+    // GPS time of week: GPS epoch 1980-01-06, 18 leap seconds ahead of UTC
+    const uint32_t iTOW = ((t - 315964800u + 18) % 604800u) * 1000u;
+    const double groundCms = speedKnots * 51.4444;
+    const double rad = courseDeg * DEG_TO_RAD;
+    uint8_t p[52];
+
+    if (ubxNavEnabled & (1ull << UBX_NAV_POSLLH))
+    {
+        memset(p, 0, 28);
+        putLE(p, iTOW, 4);
+        putLE(p + 4, (uint32_t)(int32_t)lround(lng * 1e7), 4);
+        putLE(p + 8, (uint32_t)(int32_t)lround(lat * 1e7), 4);
+        putLE(p + 12, (uint32_t)(int32_t)lround((altitude + 39.7) * 1000), 4);
+        putLE(p + 16, (uint32_t)(int32_t)lround(altitude * 1000), 4);
+        putLE(p + 20, fix ? 2500 : 0xFFFFFFFF, 4);
+        putLE(p + 24, fix ? 3800 : 0xFFFFFFFF, 4);
+        ubxFrame(out, UBX_CLASS_NAV, UBX_NAV_POSLLH, p, 28);
+        ubxCount++;
+    }
+    if (ubxNavEnabled & (1ull << UBX_NAV_SOL))
+    {
+        memset(p, 0, 52);
+        putLE(p, iTOW, 4);
+        putLE(p + 8, (t - 315964800u + 18) / 604800u, 2);
+        p[10] = fix ? 3 : 0;
+        p[11] = fix ? 0x0D : 0x0C; // gpsFixOk, WKNSET, TOWSET
+        putLE(p + 44, fix ? 252 : 9999, 2);
+        p[47] = fix ? satellites : 0;
+        ubxFrame(out, UBX_CLASS_NAV, UBX_NAV_SOL, p, 52);
+        ubxCount++;
+    }
+    if (ubxNavEnabled & (1ull << UBX_NAV_VELNED))
+    {
+        memset(p, 0, 36);
+        putLE(p, iTOW, 4);
+        putLE(p + 4, (uint32_t)(int32_t)lround(groundCms * cos(rad)), 4);
+        putLE(p + 8, (uint32_t)(int32_t)lround(groundCms * sin(rad)), 4);
+        putLE(p + 16, (uint32_t)lround(groundCms), 4);
+        putLE(p + 20, (uint32_t)lround(groundCms), 4);
+        putLE(p + 24, (uint32_t)(int32_t)lround(courseDeg * 1e5), 4);
+        ubxFrame(out, UBX_CLASS_NAV, UBX_NAV_VELNED, p, 36);
+        ubxCount++;
+    }
+    if (ubxNavEnabled & (1ull << UBX_NAV_TIMEUTC))
+    {
+        const uint32_t days = t / 86400, secs = t % 86400;
+        uint32_t z = days + 719468;
+        const uint32_t era = z / 146097;
+        const uint32_t doe = z - era * 146097;
+        const uint32_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+        const uint32_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+        const uint32_t mp = (5 * doy + 2) / 153;
+        const uint32_t month = mp < 10 ? mp + 3 : mp - 9;
+        memset(p, 0, 20);
+        putLE(p, iTOW, 4);
+        putLE(p + 4, 50, 4);
+        putLE(p + 12, yoe + era * 400 + (month <= 2), 2);
+        p[14] = (uint8_t)month;
+        p[15] = (uint8_t)(doy - (153 * mp + 2) / 5 + 1);
+        p[16] = (uint8_t)(secs / 3600);
+        p[17] = (uint8_t)(secs / 60 % 60);
+        p[18] = (uint8_t)(secs % 60);
+        p[19] = 0x07;
+        ubxFrame(out, UBX_CLASS_NAV, UBX_NAV_TIMEUTC, p, 20);
+        ubxCount++;
+    }
+}
+
+NEO6MModel::NEO6MModel(uart_inst_t* _uart)
+  :  epochPeriodMs(1000)
+  ,  hotStartEpochs(1)
+  ,  measurementMs(1000)
+  ,  bytesSent(0)
+  ,  ubxReceived(0)
+  ,  backup(false)
+  ,  backups(0)
+  ,  uart(_uart)
+  ,  logPos(0)
+  ,  sinceOutputMs(0)
+{
+    sim_uart_attach(uart, this);
+}
+
+bool NEO6MModel::loadLog(const char* path)
+{
+    std::ifstream in(path);
+    if (!in)
+        return false;
+    std::string l;
+    while (std::getline(in, l))
+    {
+        while (!l.empty() && (l.back() == '\r' || l.back() == '\n'))
+            l.pop_back();
+        if (!l.empty())
+            log.push_back(l + "\r\n");
+    }
+    return !log.empty();
+}
+
+void NEO6MModel::start(uint64_t firstEpochUs)
+{
+    sim_schedule_at(firstEpochUs, [this, firstEpochUs]() {
+        epoch();
+        start(firstEpochUs + 1000ull * epochPeriodMs);
+    });
+}
+
+void NEO6MModel::epoch()
+{
+    std::string out;
+    if (backup)
+    {
+        // the track goes on, nothing is sent
+        if (log.empty())
+            track.nextEpoch(out);
+        return;
+    }
+    if (log.empty())
+    {
+        track.nextEpoch(out);
+        sinceOutputMs += epochPeriodMs;
+        if (sinceOutputMs < measurementMs)
+            return;
+        sinceOutputMs = 0;
+    }
+    else
+    {
+        // one epoch lasts until the next RMC
+        do
+        {
+            out += log[logPos];
+            logPos = (logPos + 1) % log.size();
+        } while (log[logPos].find("RMC,") == std::string::npos && logPos != 0);
+    }
+    bytesSent += out.size();
+    sim_uart_inject(uart, (const uint8_t*)out.data(), out.size());
+}
+
+void NEO6MModel::onRx(uint8_t c)
+{
+    if (backup)
+    {
+        // RX activity wakes the receiver, the byte itself is lost
+        backup = false;
+        track.fixAfterEpochs = track.epochs() + hotStartEpochs;
+        rxFrame.clear();
+        return;
+    }
+    // collect UBX frames: sync, class, id, length, payload, checksum
+    if ((rxFrame.size() == 0 && c != UBX_SYNC_1) || (rxFrame.size() == 1 && c != UBX_SYNC_2))
+    {
+        rxFrame.clear();
+        return;
+    }
+    rxFrame.push_back(c);
+    if (rxFrame.size() < 6)
+        return;
+    const uint16_t len = rxFrame[4] | rxFrame[5] << 8;
+    if (rxFrame.size() < 8u + len)
+        return;
+
+    uint8_t ckA = 0, ckB = 0;
+    for (size_t i = 2; i < 6u + len; i++)
+    {
+        ckA += rxFrame[i];
+        ckB += ckA;
+    }
+    if (ckA == rxFrame[6 + len] && ckB == rxFrame[7 + len])
+    {
+        ubxReceived++;
+        ubxMessage(rxFrame[2], rxFrame[3], &rxFrame[6], len);
+    }
+    rxFrame.clear();
+}
+
+void NEO6MModel::ubxSend(uint8_t msgClass, uint8_t msgId, const uint8_t* payload, uint16_t len)
+{
+    std::string frame;
+    GpsTrackGenerator::ubxFrame(frame, msgClass, msgId, payload, len);
+    bytesSent += frame.size();
+    sim_uart_inject(uart, (const uint8_t*)frame.data(), frame.size());
+}
+
+void NEO6MModel::ubxMessage(uint8_t msgClass, uint8_t msgId, const uint8_t* payload, uint16_t len)
+{
+    if (msgClass == UBX_CLASS_RXM && msgId == UBX_RXM_PMREQ && len == 8)
+    {
+        // not acknowledged, the receiver just goes
+        if (payload[4] & 0x02)
+        {
+            backup = true;
+            backups++;
+        }
+        return;
+    }
+    bool ack = false;
+    if (msgClass == UBX_CLASS_CFG && msgId == UBX_CFG_MSG && (len == 3 || len == 8) && payload[1] < 64)
+    {
+        // the 8 byte form carries a rate per port, UART1 is the second one
+        const uint8_t rate = len == 3 ? payload[2] : payload[3];
+        if (payload[0] == UBX_CLASS_NMEA)
+        {
+            if (rate)
+                track.disabledSentences &= ~(1u << payload[1]);
+            else
+                track.disabledSentences |= 1u << payload[1];
+            ack = true;
+        }
+        else if (payload[0] == UBX_CLASS_NAV)
+        {
+            if (rate)
+                track.ubxNavEnabled |= 1ull << payload[1];
+            else
+                track.ubxNavEnabled &= ~(1ull << payload[1]);
+            ack = true;
+        }
+    }
+    else if (msgClass == UBX_CLASS_CFG && msgId == UBX_CFG_PRT && len == 20 && payload[0] == 1)
+    {
+        track.nmeaOutput = payload[14] & 0x02;
+        ack = true;
+    }
+    else if (msgClass == UBX_CLASS_CFG && msgId == UBX_CFG_RATE && len == 6)
+    {
+        const uint16_t rate = payload[0] | payload[1] << 8;
+        // the receiver's limits: 5 Hz, and a measurement a minute
+        if (rate >= 200 && rate <= 60000)
+        {
+            measurementMs = rate;
+            sinceOutputMs = 0;
+            ack = true;
+        }
+    }
+    const uint8_t ackPayload[2] = {msgClass, msgId};
+    ubxSend(UBX_CLASS_ACK, ack ? UBX_ACK_ACK : UBX_ACK_NAK, ackPayload, sizeof(ackPayload));
+}
+
+SIM800LModel::SIM800LModel(uart_inst_t* _uart)
+  :  pin("1234")
+  ,  simLocked(true)
+  ,  echo(true)
+  ,  rssi(18)
+  ,  ber(0)
+  ,  chargeState(0)
+  ,  batteryPercent(82)
+  ,  batteryMv(4012)
+  ,  responseDelayMs(15)
+  ,  pinCheckDelayMs(400)
+  ,  sleepIdleMs(5000)
+  ,  commands(0)
+  ,  slowClock(0)
+  ,  asleep(false)
+  ,  sleeps(0)
+  ,  nitz(true)
+  ,  networkTime(0)
+  ,  profileWrites(0)
+  ,  networkEpochAtZero(1729540799)  // 1 s before the GPS track's first epoch
+  ,  zoneQuarters(8)
+  ,  serverPort(0)
+  ,  attachDelayMs(2500)
+  ,  connectDelayMs(1800)
+  ,  sendDelayMs(400)
+  ,  uplinkBps(20000)
+  ,  ipState("IP INITIAL")
+  ,  contexts(0)
+  ,  tcpConnects(0)
+  ,  ipBytesSent(0)
+  ,  uart(_uart)
+  ,  lastActivityUs(0)
+  ,  sock(-1)
+  ,  tcpUp(false)
+  ,  dataExpected(0)
+  ,  rxNotified(false)
+{
+    sim_uart_attach(uart, this);
+}
+
+SIM800LModel::~SIM800LModel()
+{
+    if (sock >= 0)
+        close(sock);
+}
+
+void SIM800LModel::setBattery(int mv)
+{
+    batteryMv = mv;
+    batteryPercent = std::min(100, std::max(0, (mv - 3300) * 100 / (4200 - 3300)));
+}
+
+void SIM800LModel::onRx(uint8_t c)
+{
+    lastActivityUs = sim_now_us();
+    if (asleep)
+    {
+        asleep = false;
+        line.clear();
+        sleepCheck();
+        return;
+    }
+    if (echo)
+        sim_uart_inject(uart, &c, 1);
+    if (dataExpected)
+    {
+        // AT+CIPSEND data, exactly as many bytes as announced
+        data += (char)c;
+        if (--dataExpected)
+            return;
+        bool sent = tcpUp;
+        if (sent && sock >= 0)
+            sent = send(sock, data.data(), data.size(), MSG_NOSIGNAL) == (ssize_t)data.size();
+        if (sent)
+            ipBytesSent += data.size();
+        reply(sent ? "SEND OK" : "SEND FAIL", sendDelayMs + (uint32_t)(data.size() * 8000 / uplinkBps));
+        data.clear();
+        return;
+    }
+    if (c == '\n')
+        return;
+    if (c != '\r')
+    {
+        line += (char)c;
+        return;
+    }
+    std::string cmd;
+    cmd.swap(line);
+    if (cmd.empty())
+        return;
+    commands++;
+    if (!command(cmd))
+        final(false, responseDelayMs);
+}
+
+void SIM800LModel::reply(const std::string& text, uint32_t delayMs)
+{
+    const std::string framed = "\r\n" + text + "\r\n";
+    uart_inst_t* u = uart;
+    sim_schedule_at(sim_now_us() + 1000ull * delayMs, [u, framed]() {
+        sim_uart_inject(u, (const uint8_t*)framed.data(), framed.size());
+    });
+}
+
+void SIM800LModel::final(bool ok, uint32_t delayMs)
+{
+    reply(ok ? "OK" : "ERROR", delayMs);
+}
+
+bool SIM800LModel::command(const std::string& cmd)
+{
+    char text[64];
+    if (cmd == "AT")
+        final(true, responseDelayMs);
+    else if (cmd == "ATE0" || cmd == "ATE1")
+    {
+        echo = cmd[3] == '1';
+        final(true, responseDelayMs);
+    }
+    else if (cmd == "AT+CPIN?")
+    {
+        reply(simLocked ? "+CPIN: SIM PIN" : "+CPIN: READY", responseDelayMs);
+        final(true, responseDelayMs);
+    }
+    else if (cmd.compare(0, 8, "AT+CPIN=") == 0)
+    {
+        std::string given = cmd.substr(8);
+        given.erase(std::remove(given.begin(), given.end(), '"'), given.end());
+        if (!simLocked)
+            reply("+CME ERROR: 3", responseDelayMs);
+        else if (given != pin)
+            reply("+CME ERROR: 16", pinCheckDelayMs);
+        else
+        {
+            simLocked = false;
+            final(true, pinCheckDelayMs);
+            reply("+CPIN: READY", pinCheckDelayMs + 200);
+            reply("Call Ready", pinCheckDelayMs + 2000);
+            reply("SMS Ready", pinCheckDelayMs + 2500);
+        }
+    }
+    else if (cmd == "AT+CSQ")
+    {
+        sprintf(text, "+CSQ: %d,%d", rssi, ber);
+        reply(text, responseDelayMs);
+        final(true, responseDelayMs);
+    }
+    else if (cmd == "AT+CBC")
+    {
+        sprintf(text, "+CBC: %d,%d,%d", chargeState, batteryPercent, batteryMv);
+        reply(text, responseDelayMs);
+        final(true, responseDelayMs);
+    }
+    else if (cmd.compare(0, 8, "AT+CLTS=") == 0)
+    {
+        networkTime = atoi(cmd.c_str() + 8);
+        final(true, responseDelayMs);
+    }
+    else if (cmd == "AT+CLTS?")
+    {
+        sprintf(text, "+CLTS: %d", networkTime);
+        reply(text, responseDelayMs);
+        final(true, responseDelayMs);
+    }
+    else if (cmd == "AT&W")
+    {
+        profileWrites++;
+        final(true, responseDelayMs);
+    }
+    else if (cmd == "AT+CCLK?")
+    {
+        const uint64_t up = sim_now_us() / 1000000;
+        const bool network = nitz && networkTime && !simLocked;
+        const int zone = network ? zoneQuarters : 0;
+        // local time: UTC shifted by the zone
+        const uint32_t t = network ? networkEpochAtZero + (uint32_t)up + zone * 900 : 1072915200 + (uint32_t)up;
+        const uint32_t secs = t % 86400;
+        uint32_t year, month, day;
+        civilDate(t, year, month, day);
+        sprintf(text, "+CCLK: \"%02u/%02u/%02u,%02u:%02u:%02u%+03d\"", year % 100, month, day,
+            secs / 3600, secs / 60 % 60, secs % 60, zone);
+        reply(text, responseDelayMs);
+        final(true, responseDelayMs);
+    }
+    else if (cmd.compare(0, 9, "AT+CSCLK=") == 0)
+    {
+        slowClock = atoi(cmd.c_str() + 9);
+        final(true, responseDelayMs);
+        sleepCheck();
+    }
+    else
+        return ipCommand(cmd);
+    return true;
+}
+
+bool SIM800LModel::ipCommand(const std::string& cmd)
+{
+    char text[48];
+    if (cmd == "AT+CIPSHUT")
+    {
+        tcpClose(false);
+        ipState = "IP INITIAL";
+        reply("SHUT OK", responseDelayMs);
+    }
+    else if (cmd == "AT+CIPMUX=0" || cmd == "AT+CIPRXGET=1")
+        final(true, responseDelayMs);
+    else if (cmd == "AT+CGATT=1")
+        final(!simLocked, responseDelayMs);
+    else if (cmd == "AT+CGATT?")
+    {
+        reply(simLocked ? "+CGATT: 0" : "+CGATT: 1", responseDelayMs);
+        final(true, responseDelayMs);
+    }
+    else if (cmd.compare(0, 8, "AT+CSTT=") == 0)
+    {
+        const bool ok = ipState == "IP INITIAL" && !simLocked;
+        if (ok)
+            ipState = "IP START";
+        final(ok, responseDelayMs);
+    }
+    else if (cmd == "AT+CIICR")
+    {
+        if (ipState != "IP START")
+            final(false, responseDelayMs);
+        else if (coverage())
+        {
+            ipState = "IP GPRSACT";
+            contexts++;
+            final(true, attachDelayMs);
+        }
+        else
+        {
+            ipState = "PDP DEACT";
+            final(false, attachDelayMs);
+        }
+    }
+    else if (cmd == "AT+CIFSR")
+    {
+        const bool active = ipState == "IP GPRSACT" || ipState == "IP STATUS" || ipState == "TCP CLOSED"
+            || ipState == "CONNECT OK";
+        if (ipState == "IP GPRSACT")
+            ipState = "IP STATUS";
+        if (active)
+            reply("10.64.12.7", responseDelayMs);
+        else
+            final(false, responseDelayMs);
+    }
+    else if (cmd.compare(0, 12, "AT+CIPSTART=") == 0)
+    {
+        if (tcpUp)
+        {
+            final(true, responseDelayMs);
+            reply("ALREADY CONNECT", responseDelayMs);
+        }
+        else if (ipState != "IP STATUS" && ipState != "TCP CLOSED")
+            final(false, responseDelayMs);
+        else
+        {
+            ipState = "TCP CONNECTING";
+            final(true, responseDelayMs);
+            sim_schedule_at(sim_now_us() + 1000ull * connectDelayMs, [this]() { tcpOpen(); });
+        }
+    }
+    else if (cmd.compare(0, 14, "AT+CIPRXGET=3,") == 0)
+    {
+        // hex mode, at most 730 bytes a read
+        const size_t want = std::min(730, atoi(cmd.c_str() + 14));
+        if (!tcpUp)
+        {
+            final(false, responseDelayMs);
+            return true;
+        }
+        std::vector<uint8_t> buf(want);
+        ssize_t n = sock >= 0 && want ? recv(sock, buf.data(), want, MSG_DONTWAIT) : 0;
+        if (n < 0)
+            n = 0;
+        int rest = 0;
+        if (sock >= 0)
+            ioctl(sock, FIONREAD, &rest);
+        if (rest == 0)
+            rxNotified = false;
+        sprintf(text, "+CIPRXGET: 3,%d,%d", (int)n, rest);
+        reply(text, responseDelayMs);
+        std::string hex;
+        for (ssize_t i = 0; i < n; i++)
+        {
+            char h[3];
+            sprintf(h, "%02X", buf[i]);
+            hex += h;
+        }
+        if (n)
+            reply(hex, responseDelayMs);
+        final(true, responseDelayMs);
+    }
+    else if (cmd.compare(0, 11, "AT+CIPSEND=") == 0)
+    {
+        const int len = atoi(cmd.c_str() + 11);
+        if (!tcpUp || len < 1 || len > 1460)
+            final(false, responseDelayMs);
+        else
+        {
+            const std::string prompt = "\r\n> ";
+            sim_uart_inject(uart, (const uint8_t*)prompt.data(), prompt.size());
+            dataExpected = (size_t)len;
+        }
+    }
+    else if (cmd == "AT+CIPCLOSE")
+    {
+        if (!tcpUp)
+            final(false, responseDelayMs);
+        else
+        {
+            tcpClose(false);
+            ipState = "TCP CLOSED";
+            reply("CLOSE OK", responseDelayMs);
+        }
+    }
+    else if (cmd == "AT+CIPSTATUS")
+    {
+        final(true, responseDelayMs);
+        reply("STATE: " + ipState, responseDelayMs);
+    }
+    else
+        return false;
+    return true;
+}
+
+void SIM800LModel::tcpOpen()
+{
+    if (ipState != "TCP CONNECTING")
+        return;
+    bool ok = coverage();
+    if (ok && serverPort)
+    {
+        sock = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons((uint16_t)serverPort);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        ok = sock >= 0 && ::connect(sock, (const sockaddr*)&addr, sizeof(addr)) == 0;
+        // each CIPSEND goes out as it is: Nagle would hold one back for the
+        // ACK of the last, which takes host time the virtual clock outruns
+        const int one = 1;
+        if (ok)
+            setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        if (!ok && sock >= 0)
+        {
+            close(sock);
+            sock = -1;
+        }
+    }
+    if (!ok)
+    {
+        ipState = "TCP CLOSED";
+        reply("CONNECT FAIL", 0);
+        return;
+    }
+    tcpUp = true;
+    rxNotified = false;
+    tcpConnects++;
+    ipState = "CONNECT OK";
+    reply("CONNECT OK", 0);
+    tcpWatch();
+}
+
+void SIM800LModel::tcpClose(bool remote)
+{
+    if (sock >= 0)
+        close(sock);
+    sock = -1;
+    if (tcpUp && remote)
+    {
+        ipState = "TCP CLOSED";
+        reply("CLOSED", 0);
+    }
+    tcpUp = false;
+}
+
+// Notices the server closing the connection
+void SIM800LModel::tcpWatch()
+{
+    const uint32_t connection = tcpConnects;
+    sim_schedule_at(sim_now_us() + 100000, [this, connection]() {
+        if (!tcpUp || sock < 0 || tcpConnects != connection)
+            return;
+        char c;
+        const ssize_t n = recv(sock, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+        if (n == 0)
+        {
+            tcpClose(true);
+            return;
+        }
+        if (n > 0 && !rxNotified)
+        {
+            rxNotified = true;
+            reply("+CIPRXGET: 1", 0);
+        }
+        tcpWatch();
+    });
+}
+
+void SIM800LModel::deactivate()
+{
+    tcpClose(false);
+    ipState = "PDP DEACT";
+    reply("+PDP: DEACT", 0);
+}
+
+void SIM800LModel::sleepCheck()
+{
+    if (slowClock != 2)
+        return;
+    sim_schedule_at(lastActivityUs + 1000ull * sleepIdleMs, [this]() {
+        if (slowClock != 2 || asleep)
+            return;
+        if (sim_now_us() - lastActivityUs >= 1000ull * sleepIdleMs)
+        {
+            asleep = true;
+            sleeps++;
+        }
+        else
+            sleepCheck();
+    });
+}
+
+MPU6050Model::MPU6050Model()
+  :  sampleReads(0)
+  ,  motionInts(0)
+  ,  ptr(0)
+  ,  intPin(-1)
+  ,  movingUntil(0)
+{
+    reset();
+}
+
+void MPU6050Model::reset()
+{
+    memset(regs, 0, sizeof(regs));
+    regs[0x6B] = 0x40; // PWR_MGMT_1: sleep
+    regs[0x75] = 0x68; // WHO_AM_I
+    releaseInt();
+}
+
+void MPU6050Model::attachInt(uint gpio)
+{
+    intPin = (int)gpio;
+    releaseInt();
+}
+
+void MPU6050Model::motion(uint64_t atUs, uint32_t durationMs)
+{
+    const uint64_t end = atUs + 1000ull * durationMs;
+    for (uint64_t t = atUs; t < end; t += 100000)
+        sim_schedule_at(t, [this, end]() {
+            movingUntil = end;
+            if (regs[0x38] & 0x40)
+                interrupt();
+        });
+}
+
+void MPU6050Model::interrupt()
+{
+    motionInts++;
+    regs[0x3A] |= 0x40;
+    if (intPin < 0)
+        return;
+    // INT_PIN_CFG bit 7: active low, bit 5: held until INT_STATUS is read
+    sim_gpio_drive(intPin, !(regs[0x37] & 0x80));
+    if (!(regs[0x37] & 0x20))
+        sim_schedule_at(sim_now_us() + 50, [this]() { releaseInt(); });
+}
+
+void MPU6050Model::releaseInt()
+{
+    if (intPin >= 0)
+        sim_gpio_drive(intPin, regs[0x37] & 0x80);
+}
+
+void MPU6050Model::write(const uint8_t* data, size_t len, bool nostop)
+{
+    (void)nostop;
+    if (!len)
+        return;
+    ptr = data[0] & 0x7F;
+    for (size_t i = 1; i < len; i++)
+    {
+        if (ptr == 0x6B && (data[i] & 0x80))
+            reset();
+        else
+        {
+            regs[ptr] = data[i];
+            if (ptr == 0x37)
+                releaseInt();
+        }
+        ptr = (ptr + 1) & 0x7F;
+    }
+}
+
+static void putBE16(uint8_t* p, double v)
+{
+    if (v > 32767) v = 32767;
+    if (v < -32768) v = -32768;
+    const int16_t s = (int16_t)lround(v);
+    p[0] = (uint8_t)((uint16_t)s >> 8);
+    p[1] = (uint8_t)s;
+}
+
+void MPU6050Model::sample()
+{
+    const double t = sim_now_us() / 1e6;
+    const double accelLsb = 16384.0 / (1 << ((regs[0x1C] >> 3) & 3));
+    const double gyroLsb = 131.0 / (1 << ((regs[0x1B] >> 3) & 3));
+    const double shake = sim_now_us() < movingUntil ? 0.4 * sin(2 * M_PI * 3.1 * t) : 0.0;
+    putBE16(&regs[0x3B], (0.02 * sin(2 * M_PI * 1.3 * t) + shake) * accelLsb);
+    putBE16(&regs[0x3D], 0.01 * cos(2 * M_PI * 0.7 * t) * accelLsb);
+    putBE16(&regs[0x3F], 1.0 * accelLsb);
+    putBE16(&regs[0x41], (25.0 - 36.53) * 340.0);
+    putBE16(&regs[0x43], 0.5 * sin(2 * M_PI * 0.2 * t) * gyroLsb);
+    putBE16(&regs[0x45], -0.3 * gyroLsb);
+    putBE16(&regs[0x47], 3.0 * gyroLsb);
+}
+
+void MPU6050Model::read(uint8_t* data, size_t len, bool nostop)
+{
+    (void)nostop;
+    if (ptr >= 0x3B && ptr <= 0x48)
+    {
+        sample();
+        sampleReads++;
+    }
+    for (size_t i = 0; i < len; i++)
+    {
+        data[i] = regs[ptr];
+        if (ptr == 0x3A)
+        {
+            regs[0x3A] = 0; // INT_STATUS clears on read
+            if (regs[0x37] & 0x20)
+                releaseInt();
+        }
+        ptr = (ptr + 1) & 0x7F;
+    }
+}
+
+SSD1306Model::SSD1306Model()
+  :  displayOn(false)
+  ,  commands(0)
+  ,  dataBytes(0)
+  ,  frames(0)
+  ,  pendingLen(0)
+  ,  pendingNeed(0)
+  ,  colStart(0), colEnd(127), pageStart(0), pageEnd(7), col(0), page(0)
+{
+    memset(ram, 0, sizeof(ram));
+}
+
+static uint8_t ssd1306ArgCount(uint8_t c)
+{
+    switch (c)
+    {
+    case 0x20: case 0x81: case 0x8D: case 0xA8: case 0xD3:
+    case 0xD5: case 0xD9: case 0xDA: case 0xDB:
+        return 1;
+    case 0x21: case 0x22: case 0xA3:
+        return 2;
+    case 0x29: case 0x2A:
+        return 5;
+    case 0x26: case 0x27:
+        return 6;
+    default:
+        return 0;
+    }
+}
+
+void SSD1306Model::command(uint8_t c)
+{
+    if (pendingLen == 0)
+        pendingNeed = ssd1306ArgCount(c);
+    pending[pendingLen++] = c;
+    if (pendingLen <= pendingNeed)
+        return;
+    pendingLen = 0;
+    commands++;
+
+    switch (pending[0])
+    {
+    case 0x21:
+        colStart = col = pending[1] & 0x7F;
+        colEnd = pending[2] & 0x7F;
+        break;
+    case 0x22:
+        pageStart = page = pending[1] & 7;
+        pageEnd = pending[2] & 7;
+        break;
+    case 0xAE:
+        displayOn = false;
+        break;
+    case 0xAF:
+        displayOn = true;
+        break;
+    }
+}
+
+void SSD1306Model::data(uint8_t d)
+{
+    dataBytes++;
+    ram[page][col] = d;
+    if (++col > colEnd)
+    {
+        col = colStart;
+        if (++page > pageEnd)
+            page = pageStart;
+    }
+}
+
+void SSD1306Model::write(const uint8_t* buf, size_t len, bool nostop)
+{
+    (void)nostop;
+    size_t i = 0;
+    bool sawData = false;
+    while (i < len)
+    {
+        const uint8_t ctrl = buf[i++];
+        const bool isData = ctrl & 0x40;
+        if (ctrl & 0x80)
+        {
+            // continuation bit: exactly one byte follows, then another control byte
+            if (i < len)
+            {
+                if (isData) data(buf[i]); else command(buf[i]);
+                sawData |= isData;
+                i++;
+            }
+            continue;
+        }
+        for (; i < len; i++)
+            if (isData) data(buf[i]); else command(buf[i]);
+        sawData |= isData;
+    }
+    if (sawData)
+        frames++;
+}
+
+void SSD1306Model::read(uint8_t* data, size_t len, bool nostop)
+{
+    (void)nostop;
+    memset(data, displayOn ? 0x00 : 0x40, len);
+}
+
+void SSD1306Model::dump(FILE* out) const
+{
+    for (int y = 0; y < 32; y++)
+    {
+        for (int x = 0; x < 128; x++)
+            fputc(ram[y / 8][x] & (1 << (y % 8)) ? '#' : '.', out);
+        fputc('\n', out);
+    }
+}
@@ -0,0 +1,216 @@
+#ifndef __sim_devices_H__
+#define __sim_devices_H__
+
+// Scripted models of the tracker peripherals for the host simulation.
+
+#include "sim_hal.h"
+
+#include <cinttypes>
+#include <string>
+#include <vector>
+
+// Produces the output of a NEO-6M following a straight-line track, one epoch
+// per call. NMEA sentence order and formatting follow the receiver's default
+// output: RMC, VTG, GGA, GSA, GSV..., GLL. Enabled UBX NAV messages follow in
+// message id order.
+struct GpsTrackGenerator
+{
+    GpsTrackGenerator();
+
+    // track
+    double lat, lng;          // signed decimal degrees
+    double speedKnots;
+    double courseDeg;
+    double altitude;          // meters
+    uint32_t startEpoch;      // unix seconds of the first epoch
+    uint32_t fixAfterEpochs;  // epochs without a fix after power up
+    uint8_t satellites;
+
+    // Injected faults: every Nth sentence gets a wrong checksum or is cut in
+    // half (0 disables).
+    uint32_t badChecksumEvery;
+    uint32_t truncateEvery;
+
+    // Sentences switched off by UBX-CFG-MSG, one bit per NMEA message id
+    // (UBX_NMEA_GGA, ...).
+    uint32_t disabledSentences;
+    bool nmeaOutput;
+    // UBX NAV messages switched on by UBX-CFG-MSG, one bit per message id
+    uint64_t ubxNavEnabled;
+
+    // Append the sentences of the next epoch to out.
+    void nextEpoch(std::string& out);
+    uint32_t epochs() const { return epochCount; }
+    uint32_t sentences() const { return sentenceCount; }
+    uint32_t ubxMessages() const { return ubxCount; }
+
+    // Append a UBX frame with checksum.
+    static void ubxFrame(std::string& out, uint8_t msgClass, uint8_t msgId, const uint8_t* payload, uint16_t len);
+
+private:
+    void sentence(std::string& out, const char* body);
+    void ubxNav(std::string& out, uint32_t t);
+    uint32_t ubxCount;
+    uint32_t epochCount;
+    uint32_t sentenceCount;
+};
+
+// NEO-6M on a UART: emits one epoch of NMEA every second, either generated
+// or replayed from a log (lines are sent back to back, one epoch per RMC).
+// A generated track keeps its one second epochs under CFG-RATE, only every
+// measurementMs worth of them is sent.
+struct NEO6MModel : SimUartDevice
+{
+    explicit NEO6MModel(uart_inst_t* uart);
+    void start(uint64_t firstEpochUs);
+    bool loadLog(const char* path);
+    void onRx(uint8_t c);
+
+    GpsTrackGenerator track;
+    uint32_t epochPeriodMs;
+    uint32_t hotStartEpochs;  // epochs without a fix after leaving backup mode
+    uint32_t measurementMs;   // CFG-RATE
+    uint64_t bytesSent;
+    uint64_t ubxReceived;
+    // In backup mode after RXM-PMREQ: silent until a byte arrives
+    bool backup;
+    uint32_t backups;
+
+private:
+    void epoch();
+    void ubxMessage(uint8_t msgClass, uint8_t msgId, const uint8_t* payload, uint16_t len);
+    void ubxSend(uint8_t msgClass, uint8_t msgId, const uint8_t* payload, uint16_t len);
+    std::vector<uint8_t> rxFrame;
+    uart_inst_t* uart;
+    std::vector<std::string> log;
+    size_t logPos;
+    uint32_t sinceOutputMs;
+};
+
+// SIM800L on a UART: line-based AT command interpreter with echo, SIM PIN
+// state and canned CSQ/CBC answers. With AT+CSCLK=2 it falls asleep after
+// sleepIdleMs without serial traffic; the character that wakes it is lost.
+// AT+CCLK? reports the network time once AT+CLTS=1 is set and the SIM is
+// unlocked (registered), else the module's own clock from 2004-01-01.
+// The TCP/IP commands (single connection, AT+CIPRXGET=1) follow the
+// module's IP states. The connection AT+CIPSTART asks for goes to
+// 127.0.0.1:serverPort on the host instead, or with serverPort 0 to a sink
+// that takes everything. Without coverage (rssi 0 or 99) AT+CIICR and
+// AT+CIPSTART fail.
+struct SIM800LModel : SimUartDevice
+{
+    explicit SIM800LModel(uart_inst_t* uart);
+    ~SIM800LModel();
+    void onRx(uint8_t c);
+    // Battery voltage, with the charge level a Li-ion cell has at it
+    void setBattery(int mv);
+    // The network takes the PDP context away (+PDP: DEACT)
+    void deactivate();
+
+    std::string pin;
+    bool simLocked;
+    bool echo;
+    int rssi, ber;
+    int chargeState, batteryPercent, batteryMv;
+    uint32_t responseDelayMs;
+    uint32_t pinCheckDelayMs;
+    uint32_t sleepIdleMs;
+    uint64_t commands;
+    int slowClock;
+    bool asleep;
+    uint32_t sleeps;
+    bool nitz;                   // the network sends its time
+    int networkTime;             // AT+CLTS, in the profile AT&W saves
+    uint32_t profileWrites;      // AT&W, NVRAM wear
+    uint32_t networkEpochAtZero; // UTC unix seconds at virtual time 0
+    int zoneQuarters;            // local time zone, quarter hours east of UTC
+
+    int serverPort;
+    uint32_t attachDelayMs;      // AT+CIICR
+    uint32_t connectDelayMs;     // AT+CIPSTART to CONNECT OK
+    uint32_t sendDelayMs;        // AT+CIPSEND data to SEND OK, plus the airtime
+    uint32_t uplinkBps;
+    std::string ipState;         // AT+CIPSTATUS
+    uint32_t contexts;           // AT+CIICR that succeeded
+    uint32_t tcpConnects;
+    uint64_t ipBytesSent;
+
+protected:
+    // Handles one command line (without the trailing CR). Returns false for
+    // unknown commands.
+    virtual bool command(const std::string& cmd);
+    void reply(const std::string& text, uint32_t delayMs);
+    void final(bool ok, uint32_t delayMs);
+
+    void sleepCheck();
+    bool coverage() const { return rssi != 0 && rssi != 99; }
+    bool ipCommand(const std::string& cmd);
+    void tcpOpen();
+    void tcpClose(bool remote);
+    void tcpWatch();
+
+    uart_inst_t* uart;
+    std::string line;
+    uint64_t lastActivityUs;
+    int sock;                    // -1, or the host socket of the connection
+    bool tcpUp;
+    size_t dataExpected;         // AT+CIPSEND data still to come
+    bool rxNotified;             // +CIPRXGET: 1 sent, not read empty since
+    std::string data;
+};
+
+// MPU6050 register file on I2C. Acceleration is gravity on Z plus a small
+// vibration, gyro a slow yaw, temperature constant. Scripted motion adds a
+// shake and, with the motion interrupt enabled, pulses the INT pin (level
+// and latching as set in INT_PIN_CFG) every 100 ms while it lasts.
+struct MPU6050Model : SimI2cDevice
+{
+    MPU6050Model();
+    uint8_t address() const { return 0x68; }
+    void write(const uint8_t* data, size_t len, bool nostop);
+    void read(uint8_t* data, size_t len, bool nostop);
+
+    void attachInt(uint gpio);
+    void motion(uint64_t atUs, uint32_t durationMs);
+
+    uint8_t regs[128];
+    uint64_t sampleReads;
+    uint32_t motionInts;
+
+private:
+    void reset();
+    void sample();
+    void interrupt();
+    void releaseInt();
+    uint8_t ptr;
+    int intPin;
+    uint64_t movingUntil;
+};
+
+// SSD1306 controller on I2C: decodes the command stream, keeps the GDDRAM
+// and counts frame updates.
+struct SSD1306Model : SimI2cDevice
+{
+    SSD1306Model();
+    uint8_t address() const { return 0x3C; }
+    void write(const uint8_t* data, size_t len, bool nostop);
+    void read(uint8_t* data, size_t len, bool nostop);
+
+    // Render the display RAM as ASCII art, one character per pixel.
+    void dump(FILE* out) const;
+
+    uint8_t ram[8][128];
+    bool displayOn;
+    uint64_t commands;
+    uint64_t dataBytes;
+    uint64_t frames;
+
+private:
+    void command(uint8_t c);
+    void data(uint8_t d);
+    uint8_t pending[8];
+    uint8_t pendingLen, pendingNeed;
+    uint8_t colStart, colEnd, pageStart, pageEnd, col, page;
+};
+
+#endif
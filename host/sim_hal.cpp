@@ -0,0 +1,1588 @@
+#include "sim_hal.h"
+
+#include "pico/stdlib.h"
+#include "pico/multicore.h"
+#include "pico/sleep.h"
+#include "hardware/clocks.h"
+#include "hardware/dma.h"
+#include "hardware/flash.h"
+#include "hardware/regs/addressmap.h"
+#include "hardware/pll.h"
+#include "hardware/rosc.h"
+#include "hardware/rtc.h"
+#include "hardware/structs/clocks.h"
+#include "hardware/structs/scb.h"
+#include "hardware/sync.h"
+#include "hardware/xosc.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+extern "C" {
+uart_inst_t uart0_inst = {0};
+uart_inst_t uart1_inst = {1};
+i2c_inst_t i2c0_inst = {0};
+i2c_inst_t i2c1_inst = {1};
+pll_inst_t pll_sys_inst = {0};
+pll_inst_t pll_usb_inst = {1};
+armv6m_scb_t sim_scb;
+clocks_hw_t sim_clocks_hw;
+uart_hw_t sim_uart_hw[NUM_UARTS];
+}
+
+namespace {
+
+struct Event
+{
+    uint64_t t;
+    uint64_t seq;
+    std::function<void()> fn;
+    bool operator<(const Event& o) const { return t != o.t ? t > o.t : seq > o.seq; }
+};
+
+struct Uart
+{
+    uint32_t baud = 0;
+    uint32_t periHz = 0;  // clk_peri the divisors were computed for
+    uint8_t bitsPerChar = 10;
+    bool fifo = true;
+    bool rxIrq = false;
+    bool rxTimeout = false;
+    std::deque<uint8_t> rx;
+    uint64_t rxLineFreeAt = 0;
+    uint64_t txLineFreeAt = 0;
+    uint64_t lastRxAt = 0;
+    SimUartDevice* dev = nullptr;
+    SimUartStats stats = {};
+
+    uint64_t charTimeUs() const { return baud ? (uint64_t)bitsPerChar * 1000000 / baud : 0; }
+    size_t depth() const { return fifo ? 32 : 1; }
+};
+
+struct I2c
+{
+    uint32_t baud = 100000;
+    std::vector<SimI2cDevice*> devs;
+    SimI2cStats stats = {};
+};
+
+struct Gpio
+{
+    uint8_t func = GPIO_FUNC_NULL;
+    bool out = false;
+    bool value = false;
+    bool input = false;
+    bool pullUp = false;
+    uint32_t irqMask = 0;
+    uint32_t toggles = 0;
+};
+
+constexpr uint64_t NO_DEADLINE = UINT64_MAX;
+// assumed time for clocks_init() to bring the PLLs up
+constexpr uint64_t SIM_PLL_LOCK_US = 300;
+
+uint64_t now = 0;
+uint64_t seq = 0;
+uint64_t deadline = NO_DEADLINE;
+std::priority_queue<Event> events;
+std::vector<std::function<void()>> finishHooks;
+
+Uart uarts[NUM_UARTS];
+I2c i2cs[2];
+Gpio gpios[NUM_BANK0_GPIOS];
+gpio_irq_callback_t gpioCallback = nullptr;
+uint32_t gpioPendingEvents[NUM_BANK0_GPIOS];
+
+struct DmaChannel
+{
+    bool claimed = false;
+    bool busy = false;
+    dma_channel_config cfg = {};
+};
+
+DmaChannel dmaChannels[NUM_DMA_CHANNELS];
+
+struct Alarm
+{
+    bool claimed = false;
+    bool fired = false;
+    uint64_t generation = 0;
+    hardware_alarm_callback_t callback = nullptr;
+};
+
+Alarm alarms[NUM_TIMERS];
+uint64_t alarmFires = 0;
+dma_channel_hw_t dmaHw[NUM_DMA_CHANNELS];
+
+irq_handler_t irqHandlers[NUM_IRQS];
+bool irqEnabled[NUM_IRQS];
+uint32_t irqPending = 0;
+uint32_t irqMasked = 0;
+bool inIrq = false;
+uint64_t irqsTaken = 0;
+
+// RTC
+bool rtcRunning = false;
+int64_t rtcEpochAtSet = 0;
+uint64_t rtcSetAt = 0;
+bool rtcAlarmArmed = false;
+bool rtcAlarmFired = false;
+uint64_t rtcAlarmGeneration = 0;
+datetime_t rtcAlarm;
+rtc_callback_t rtcCallback = nullptr;
+
+uint32_t clockHz[CLK_COUNT] = {0, 0, 0, 0, 12000000, 125000000, 125000000, 48000000, 48000000, 46875};
+
+// sleep accounting
+uint64_t sleepCount = 0;
+uint64_t sleepUs = 0;
+uint64_t dormantCount = 0;
+uint64_t dormantUs = 0;
+int dormantPin = -1;
+bool dormantEdge = false;
+bool dormantHigh = false;
+bool dormantWoken = false;
+bool clocksGated = false;  // asleep or dormant: no clk_peri
+
+// Cores. core1 gets a host thread when launched; the cores pass a baton so
+// that exactly one runs at a time, always the one whose blocking call ends
+// first in virtual time. Nothing else in the simulation needs locking.
+struct Baton
+{
+    std::mutex mutex;
+    std::condition_variable cv;
+    int core = 0;
+};
+// never destroyed, core1 may still be waiting on it when the process exits
+Baton& baton = *new Baton;
+thread_local int simCore = 0;
+bool coreActive[2] = {true, false};
+uint64_t coreWake[2];
+std::deque<uint32_t> coreFifo[2];  // words waiting for core n
+constexpr size_t CORE_FIFO_DEPTH = 8;
+uint64_t core1Launches = 0;
+uint64_t fifoWords = 0;
+uint64_t coreSwitches = 0;
+
+uint64_t otherCoreWake()
+{
+    const int other = 1 - simCore;
+    return coreActive[other] ? coreWake[other] : NO_DEADLINE;
+}
+
+// Lets the other core run and returns once it has handed control back.
+void runOtherCore()
+{
+    const int self = simCore;
+    std::unique_lock<std::mutex> lock(baton.mutex);
+    baton.core = 1 - self;
+    coreSwitches++;
+    baton.cv.notify_all();
+    baton.cv.wait(lock, [self]() { return baton.core == self; });
+}
+
+// host CPU time spent in firmware code between blocking calls
+typedef std::chrono::steady_clock HostClock;
+HostClock::time_point lastReturn = HostClock::now();
+uint64_t busyHostNs = 0;
+
+Uart& uartOf(uart_inst_t* u) { return uarts[u->index]; }
+
+bool uartIrqAsserted(const Uart& u)
+{
+    if (!u.rxIrq || u.rx.empty())
+        return false;
+    return !u.fifo || u.rx.size() >= 4 || u.rxTimeout;
+}
+
+bool irqAsserted(uint num)
+{
+    if (num == UART0_IRQ || num == UART1_IRQ)
+        return uartIrqAsserted(uarts[num - UART0_IRQ]);
+    return irqPending & (1u << num);
+}
+
+void serviceIrqs();
+
+void runIrq(uint num)
+{
+    if (!irqEnabled[num] || !irqHandlers[num] || irqMasked || inIrq)
+    {
+        irqPending |= 1u << num;
+        return;
+    }
+    irqPending &= ~(1u << num);
+    if (num == UART0_IRQ || num == UART1_IRQ)
+        uarts[num - UART0_IRQ].stats.irqs++;
+    irqsTaken++;
+    inIrq = true;
+    irqHandlers[num]();
+    inIrq = false;
+    serviceIrqs();
+}
+
+bool enabledIrqPending()
+{
+    for (uint num = 0; num < NUM_IRQS; num++)
+        if ((irqPending & (1u << num)) && irqEnabled[num] && irqAsserted(num))
+            return true;
+    return false;
+}
+
+void serviceIrqs()
+{
+    if (irqMasked || inIrq)
+        return;
+    for (uint num = 0; num < NUM_IRQS; num++)
+        if ((irqPending & (1u << num)) && irqAsserted(num) && irqEnabled[num] && irqHandlers[num])
+            runIrq(num);
+}
+
+void uartRaise(Uart& u)
+{
+    if (uartIrqAsserted(u))
+        runIrq(UART0_IRQ + (&u - uarts));
+}
+
+// Lets a running DMA channel paced by the UART's RX DREQ drain the FIFO.
+// The bus is far faster than any baud rate, so this happens at once.
+void dmaService(Uart& u)
+{
+    const uint dreq = (&u - uarts) ? DREQ_UART1_RX : DREQ_UART0_RX;
+    for (uint ch = 0; ch < NUM_DMA_CHANNELS && !u.rx.empty(); ch++)
+    {
+        DmaChannel& d = dmaChannels[ch];
+        dma_channel_hw_t& hw = dmaHw[ch];
+        if (!d.busy || d.cfg.dreq != dreq)
+            continue;
+        while (d.busy && !u.rx.empty())
+        {
+            *(uint8_t*)hw.write_addr = u.rx.front();
+            u.rx.pop_front();
+            u.stats.dmaBytes++;
+            if (d.cfg.write_increment)
+            {
+                uintptr_t next = hw.write_addr + 1;
+                if (d.cfg.ring_write && d.cfg.ring_size_bits)
+                {
+                    const uintptr_t mask = ((uintptr_t)1 << d.cfg.ring_size_bits) - 1;
+                    next = (hw.write_addr & ~mask) | (next & mask);
+                }
+                hw.write_addr = next;
+            }
+            if (--hw.transfer_count == 0)
+                d.busy = false;
+        }
+    }
+    if (u.rx.empty())
+        u.rxTimeout = false;
+}
+
+void dmaServiceAll()
+{
+    for (int i = 0; i < NUM_UARTS; i++)
+        dmaService(uarts[i]);
+}
+
+// A UART only works at the clk_peri its baud rate divisors were set up for
+bool uartClocked(const Uart& u)
+{
+    return !clocksGated && clockHz[clk_peri] == u.periHz;
+}
+
+void uartDeliver(Uart& u, uint8_t c)
+{
+    u.stats.rxBytes++;
+    if (!uartClocked(u))
+    {
+        u.stats.garbled++;
+        return;
+    }
+    if (u.rx.size() >= u.depth())
+    {
+        u.stats.overruns++;
+        return;
+    }
+    u.rx.push_back(c);
+    u.lastRxAt = now;
+    u.rxTimeout = false;
+    dmaService(u);
+    if (u.fifo)
+    {
+        // receive timeout: 32 bit periods without a new character
+        const uint64_t at = now + 32 * u.charTimeUs() / u.bitsPerChar;
+        Uart* pu = &u;
+        const uint64_t stamp = now;
+        sim_schedule_at(at, [pu, stamp]() {
+            if (pu->lastRxAt == stamp && !pu->rx.empty())
+            {
+                pu->rxTimeout = true;
+                uartRaise(*pu);
+            }
+        });
+    }
+    uartRaise(u);
+}
+
+// Epoch seconds <-> datetime, proleptic Gregorian, UTC.
+int64_t daysFromCivil(int y, unsigned m, unsigned d)
+{
+    y -= m <= 2;
+    const int64_t era = (y >= 0 ? y : y - 399) / 400;
+    const unsigned yoe = (unsigned)(y - era * 400);
+    const unsigned doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    const unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + (int64_t)doe - 719468;
+}
+
+int64_t toEpoch(const datetime_t& t)
+{
+    return daysFromCivil(t.year, t.month, t.day) * 86400 + t.hour * 3600 + t.min * 60 + t.sec;
+}
+
+datetime_t fromEpoch(int64_t s)
+{
+    int64_t z = s / 86400;
+    int64_t rem = s % 86400;
+    datetime_t t;
+    t.dotw = (int8_t)((z + 4) % 7); // 1970-01-01 was a Thursday
+    z += 719468;
+    const int64_t era = (z >= 0 ? z : z - 146096) / 146097;
+    const unsigned doe = (unsigned)(z - era * 146097);
+    const unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    const unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    const unsigned mp = (5 * doy + 2) / 153;
+    const unsigned d = doy - (153 * mp + 2) / 5 + 1;
+    const unsigned m = mp < 10 ? mp + 3 : mp - 9;
+    t.year = (int16_t)(yoe + era * 400 + (m <= 2));
+    t.month = (int8_t)m;
+    t.day = (int8_t)d;
+    t.hour = (int8_t)(rem / 3600);
+    t.min = (int8_t)(rem / 60 % 60);
+    t.sec = (int8_t)(rem % 60);
+    return t;
+}
+
+int64_t rtcEpochNow()
+{
+    return rtcEpochAtSet + (int64_t)((now - rtcSetAt) / 1000000);
+}
+
+bool alarmMatches(const datetime_t& a, const datetime_t& t)
+{
+    return (a.year < 0 || a.year == t.year) && (a.month < 0 || a.month == t.month)
+        && (a.day < 0 || a.day == t.day) && (a.dotw < 0 || a.dotw == t.dotw)
+        && (a.hour < 0 || a.hour == t.hour) && (a.min < 0 || a.min == t.min)
+        && (a.sec < 0 || a.sec == t.sec);
+}
+
+void rtcScheduleAlarm()
+{
+    if (!rtcAlarmArmed || !rtcRunning)
+        return;
+    int64_t at = -1;
+    const int64_t from = rtcEpochNow() + 1;
+    if (rtcAlarm.year >= 0 && rtcAlarm.month >= 0 && rtcAlarm.day >= 0 && rtcAlarm.hour >= 0
+        && rtcAlarm.min >= 0 && rtcAlarm.sec >= 0)
+    {
+        datetime_t a = rtcAlarm;
+        a.dotw = 0;
+        at = toEpoch(a);
+        if (at < from)
+            return; // in the past, never fires
+    }
+    else
+    {
+        for (int64_t s = from; s < from + 7 * 86400; s++)
+            if (alarmMatches(rtcAlarm, fromEpoch(s)))
+            {
+                at = s;
+                break;
+            }
+        if (at < 0)
+            return;
+    }
+    const uint64_t when = rtcSetAt + (uint64_t)(at - rtcEpochAtSet) * 1000000;
+    const uint64_t generation = ++rtcAlarmGeneration;
+    sim_schedule_at(when, [generation]() {
+        if (generation != rtcAlarmGeneration || !rtcAlarmArmed)
+            return;
+        rtcAlarmFired = true;
+        irqPending |= 1u << RTC_IRQ;
+        if (rtcCallback && irqEnabled[RTC_IRQ])
+            runIrq(RTC_IRQ);
+        // repeating alarms (wildcards) re-arm for the next match
+        rtcScheduleAlarm();
+    });
+}
+
+void rtcIrq()
+{
+    if (rtcCallback)
+        rtcCallback();
+}
+
+void gpioIrq()
+{
+    for (uint pin = 0; pin < NUM_BANK0_GPIOS; pin++)
+    {
+        const uint32_t ev = gpioPendingEvents[pin];
+        if (!ev)
+            continue;
+        gpioPendingEvents[pin] = 0;
+        if (gpioCallback)
+            gpioCallback(pin, ev);
+    }
+}
+
+void alarmIrq(uint num)
+{
+    Alarm& a = alarms[num];
+    if (!a.fired)
+        return;
+    a.fired = false;
+    if (a.callback)
+        a.callback(num);
+}
+
+const irq_handler_t alarmHandlers[NUM_TIMERS] = {
+    []() { alarmIrq(0); }, []() { alarmIrq(1); }, []() { alarmIrq(2); }, []() { alarmIrq(3); }
+};
+
+// Blocks until the next event has run, or the other core has had a turn
+// (it may be what the caller waits for); returns false if nothing can ever
+// happen.
+bool waitForEvent()
+{
+    uint64_t t;
+    if (!sim_next_event_us(&t))
+        t = deadline;
+    const uint64_t other = otherCoreWake();
+    if (other != NO_DEADLINE && other <= t)
+    {
+        if (other > now)
+            sim_advance_to_us(other);
+        coreWake[simCore] = now;
+        runOtherCore();
+        return true;
+    }
+    if (t == NO_DEADLINE)
+        return false;
+    sim_advance_to_us(t > now ? t : now);
+    return true;
+}
+
+void blockUntil(bool* flag, const char* what)
+{
+    while (!*flag)
+        if (!waitForEvent())
+        {
+            fprintf(stderr, "sim: deadlock waiting for %s at %" PRIu64 " us\n", what, now);
+            sim_finish(2);
+        }
+}
+
+// Flash, the Pico's W25Q16JV: typical sector erase and page program times
+constexpr uint64_t SIM_FLASH_ERASE_US = 45000;
+constexpr uint64_t SIM_FLASH_PAGE_US = 400;
+
+uint8_t* flashImage = nullptr;
+bool flashMapped = false;
+SimFlashStats flashStats = {};
+size_t flashSize = PICO_FLASH_SIZE_BYTES;
+std::vector<uint32_t> flashEraseCounts(PICO_FLASH_SIZE_BYTES / FLASH_SECTOR_SIZE);
+uint64_t flashOpsToFail = UINT64_MAX;
+bool flashPowered = true;
+uint32_t flashRng = 1;
+
+uint8_t* flashMemory()
+{
+    if (!flashImage)
+    {
+        flashImage = (uint8_t*)malloc(PICO_FLASH_SIZE_BYTES);
+        memset(flashImage, 0xff, PICO_FLASH_SIZE_BYTES);
+    }
+    return flashImage;
+}
+
+// How much of an operation of n units gets done: all of it, none after the
+// power failed, a random part of the one it fails in
+size_t flashOp(size_t n)
+{
+    if (!flashPowered)
+        return 0;
+    if (flashOpsToFail == 0)
+    {
+        flashPowered = false;
+        flashStats.torn++;
+        flashRng = flashRng * 1664525 + 1013904223;
+        return (flashRng >> 8) % n;
+    }
+    if (flashOpsToFail != UINT64_MAX)
+        flashOpsToFail--;
+    return n;
+}
+
+} // namespace
+
+uint8_t* sim_flash_xip = flashMemory();
+
+uint64_t sim_now_us()
+{
+    return now;
+}
+
+void sim_advance_to_us(uint64_t target)
+{
+    const HostClock::time_point entry = HostClock::now();
+    if (!inIrq)
+        busyHostNs += std::chrono::duration_cast<std::chrono::nanoseconds>(entry - lastReturn).count();
+
+    coreWake[simCore] = target;
+    for (;;)
+    {
+        // the other core runs first if its own blocking call ends earlier
+        const uint64_t other = otherCoreWake();
+        const uint64_t limit = other < target ? other : target;
+        while (!events.empty() && events.top().t <= limit)
+        {
+            if (events.top().t >= deadline)
+                break;
+            Event ev = events.top();
+            events.pop();
+            if (ev.t > now)
+                now = ev.t;
+            ev.fn();
+        }
+        if (limit >= deadline)
+        {
+            now = deadline;
+            sim_finish(0);
+        }
+        if (limit > now)
+            now = limit;
+        if (other >= target)
+            break;
+        runOtherCore();
+    }
+
+    lastReturn = HostClock::now();
+}
+
+void sim_advance_us(uint64_t us)
+{
+    sim_advance_to_us(now + us);
+}
+
+void sim_schedule_at(uint64_t t, std::function<void()> fn)
+{
+    events.push(Event{t < now ? now : t, seq++, fn});
+}
+
+bool sim_next_event_us(uint64_t* t)
+{
+    if (events.empty())
+        return false;
+    *t = events.top().t;
+    return true;
+}
+
+void sim_set_deadline_us(uint64_t t)
+{
+    deadline = t;
+}
+
+void sim_on_finish(std::function<void()> fn)
+{
+    finishHooks.push_back(fn);
+}
+
+void sim_finish(int status)
+{
+    static bool finishing = false;
+    if (finishing)
+        return;
+    finishing = true;
+    for (size_t i = 0; i < finishHooks.size(); i++)
+        finishHooks[i]();
+    fflush(stdout);
+    exit(status);
+}
+
+void sim_uart_attach(uart_inst_t* uart, SimUartDevice* dev)
+{
+    uartOf(uart).dev = dev;
+}
+
+void sim_uart_inject(uart_inst_t* uart, const uint8_t* data, size_t len)
+{
+    Uart& u = uartOf(uart);
+    const uint64_t ct = u.charTimeUs() ? u.charTimeUs() : 1;
+    uint64_t t = u.rxLineFreeAt > now ? u.rxLineFreeAt : now;
+    for (size_t i = 0; i < len; i++)
+    {
+        t += ct;
+        const uint8_t c = data[i];
+        Uart* pu = &u;
+        sim_schedule_at(t, [pu, c]() { uartDeliver(*pu, c); });
+    }
+    u.rxLineFreeAt = t;
+}
+
+uint32_t sim_uart_baudrate(uart_inst_t* uart)
+{
+    return uartOf(uart).baud;
+}
+
+const SimUartStats& sim_uart_stats(uart_inst_t* uart)
+{
+    return uartOf(uart).stats;
+}
+
+void sim_i2c_attach(i2c_inst_t* i2c, SimI2cDevice* dev)
+{
+    i2cs[i2c->index].devs.push_back(dev);
+}
+
+const SimI2cStats& sim_i2c_stats(i2c_inst_t* i2c)
+{
+    return i2cs[i2c->index].stats;
+}
+
+bool sim_gpio_output(uint gpio)
+{
+    return gpios[gpio].value;
+}
+
+uint32_t sim_gpio_toggles(uint gpio)
+{
+    return gpios[gpio].toggles;
+}
+
+void sim_gpio_drive(uint gpio, bool level)
+{
+    Gpio& g = gpios[gpio];
+    const bool old = g.input;
+    g.input = level;
+    uint32_t ev = level ? GPIO_IRQ_LEVEL_HIGH : GPIO_IRQ_LEVEL_LOW;
+    if (old != level)
+        ev |= level ? GPIO_IRQ_EDGE_RISE : GPIO_IRQ_EDGE_FALL;
+
+    if ((int)gpio == dormantPin && !dormantWoken)
+    {
+        if (dormantEdge ? (old != level && level == dormantHigh) : level == dormantHigh)
+            dormantWoken = true;
+    }
+
+    ev &= g.irqMask;
+    if (ev)
+    {
+        gpioPendingEvents[gpio] |= ev;
+        runIrq(IO_IRQ_BANK0);
+    }
+}
+
+void sim_report(FILE* out)
+{
+    const double seconds = now / 1e6;
+    fprintf(out, "virtual time        %12.3f ms\n", now / 1000.0);
+    fprintf(out, "firmware busy       %12.3f ms host CPU (%.1f us per virtual second)\n",
+        busyHostNs / 1e6, seconds > 0 ? busyHostNs / 1e3 / seconds : 0.0);
+    for (int i = 0; i < NUM_UARTS; i++)
+    {
+        const Uart& u = uarts[i];
+        fprintf(out, "uart%d %6u baud    rx %8" PRIu64 "  tx %8" PRIu64 "  irqs %8" PRIu64 "  overruns %" PRIu64,
+            i, u.baud, u.stats.rxBytes, u.stats.txBytes, u.stats.irqs, u.stats.overruns);
+        if (u.stats.dmaBytes)
+            fprintf(out, "  dma %" PRIu64, u.stats.dmaBytes);
+        if (u.stats.garbled)
+            fprintf(out, "  garbled %" PRIu64, u.stats.garbled);
+        fprintf(out, "\n");
+    }
+    for (int i = 0; i < 2; i++)
+    {
+        const I2c& b = i2cs[i];
+        fprintf(out, "i2c%d  %6u baud    transfers %8" PRIu64 "  bytes %9" PRIu64 "  nacks %" PRIu64 "  bus time %.3f ms\n",
+            i, b.baud, b.stats.transfers, b.stats.bytes, b.stats.nacks, b.stats.busTimeUs / 1000.0);
+    }
+    for (int i = 0; i < NUM_BANK0_GPIOS; i++)
+        if (gpios[i].toggles)
+            fprintf(out, "gpio%-2d toggles      %8u\n", i, gpios[i].toggles);
+    if (sleepCount)
+        fprintf(out, "rtc sleeps          %8" PRIu64 "  (%.3f ms asleep)\n", sleepCount, sleepUs / 1000.0);
+    if (dormantCount)
+        fprintf(out, "dormant sleeps      %8" PRIu64 "  (%.3f ms dormant)\n", dormantCount, dormantUs / 1000.0);
+    if (alarmFires)
+        fprintf(out, "timer alarms        %8" PRIu64 "\n", alarmFires);
+    if (core1Launches)
+        fprintf(out, "core1 launches      %8" PRIu64 "  switches %" PRIu64 "  fifo words %" PRIu64 "\n",
+            core1Launches, coreSwitches, fifoWords);
+    if (flashStats.erases || flashStats.programs)
+        fprintf(out, "flash erases        %8" PRIu64 "  pages %" PRIu64 "  busy %.3f ms\n", flashStats.erases,
+            flashStats.programs, flashStats.busyUs / 1000.0);
+}
+
+bool sim_flash_open(const char* path, size_t bytes)
+{
+    sim_flash_close();
+    const int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || ((size_t)st.st_size < bytes && ftruncate(fd, bytes) != 0))
+    {
+        close(fd);
+        return false;
+    }
+    void* image = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (image == MAP_FAILED)
+        return false;
+    // what the file did not have yet is erased
+    if ((size_t)st.st_size < bytes)
+        memset((uint8_t*)image + st.st_size, 0xff, bytes - st.st_size);
+    free(flashImage);
+    flashImage = (uint8_t*)image;
+    flashMapped = true;
+    flashSize = bytes;
+    flashEraseCounts.assign(bytes / FLASH_SECTOR_SIZE, 0);
+    sim_flash_xip = flashImage;
+    return true;
+}
+
+void sim_flash_close()
+{
+    if (!flashMapped)
+        return;
+    munmap(flashImage, flashSize);
+    flashImage = nullptr;
+    flashMapped = false;
+    flashSize = PICO_FLASH_SIZE_BYTES;
+    flashEraseCounts.assign(flashSize / FLASH_SECTOR_SIZE, 0);
+    sim_flash_xip = flashMemory();
+}
+
+void sim_flash_power_fail_after(uint64_t ops)
+{
+    flashOpsToFail = ops;
+}
+
+void sim_flash_power_on()
+{
+    flashOpsToFail = UINT64_MAX;
+    flashPowered = true;
+}
+
+bool sim_flash_powered()
+{
+    return flashPowered;
+}
+
+uint32_t sim_flash_erase_count(uint32_t offset)
+{
+    return flashEraseCounts[offset / FLASH_SECTOR_SIZE % flashEraseCounts.size()];
+}
+
+const SimFlashStats& sim_flash_stats()
+{
+    return flashStats;
+}
+
+// ---------------------------------------------------------------------------
+// SDK functions
+
+extern "C" {
+
+bool stdio_init_all(void)
+{
+    return true;
+}
+
+int getchar_timeout_us(uint32_t timeout_us)
+{
+    sim_advance_us(timeout_us);
+    return PICO_ERROR_TIMEOUT;
+}
+
+uint64_t time_us_64(void)
+{
+    return now;
+}
+
+void busy_wait_us(uint64_t delay_us)
+{
+    sim_advance_us(delay_us);
+}
+
+void sleep_us(uint64_t us)
+{
+    sim_advance_us(us);
+}
+
+void sleep_ms(uint32_t ms)
+{
+    sim_advance_us(1000ull * ms);
+}
+
+void sleep_until(absolute_time_t target)
+{
+    if (target > now)
+        sim_advance_to_us(target);
+}
+
+// Like the core, wakes up for an enabled interrupt only, taken or (with
+// interrupts masked) left pending; UART bytes moved by DMA do not count.
+void __wfi(void)
+{
+    if (irqPending && !irqMasked)
+    {
+        serviceIrqs();
+        return;
+    }
+    const uint64_t taken = irqsTaken;
+    do
+    {
+        if (!waitForEvent())
+        {
+            fprintf(stderr, "sim: __wfi with nothing left to wake up at %" PRIu64 " us\n", now);
+            sim_finish(2);
+        }
+    } while (irqsTaken == taken && !enabledIrqPending());
+}
+
+void hardware_alarm_claim(uint alarm_num)
+{
+    if (alarms[alarm_num].claimed)
+    {
+        fprintf(stderr, "sim: hardware alarm %u already claimed\n", alarm_num);
+        sim_finish(2);
+    }
+    alarms[alarm_num].claimed = true;
+}
+
+int hardware_alarm_claim_unused(bool required)
+{
+    for (uint i = 0; i < NUM_TIMERS; i++)
+        if (!alarms[i].claimed)
+        {
+            alarms[i].claimed = true;
+            return (int)i;
+        }
+    if (required)
+    {
+        fprintf(stderr, "sim: no free hardware alarm\n");
+        sim_finish(2);
+    }
+    return -1;
+}
+
+void hardware_alarm_unclaim(uint alarm_num)
+{
+    hardware_alarm_cancel(alarm_num);
+    alarms[alarm_num].claimed = false;
+}
+
+void hardware_alarm_set_callback(uint alarm_num, hardware_alarm_callback_t callback)
+{
+    alarms[alarm_num].callback = callback;
+    irq_set_exclusive_handler(TIMER_IRQ_0 + alarm_num, callback ? alarmHandlers[alarm_num] : nullptr);
+    irq_set_enabled(TIMER_IRQ_0 + alarm_num, callback != nullptr);
+}
+
+bool hardware_alarm_set_target(uint alarm_num, absolute_time_t t)
+{
+    Alarm& a = alarms[alarm_num];
+    const uint64_t generation = ++a.generation;
+    if (t <= now)
+        return true;
+    sim_schedule_at(t, [alarm_num, generation]() {
+        Alarm& a = alarms[alarm_num];
+        if (generation != a.generation)
+            return;
+        a.fired = true;
+        alarmFires++;
+        irqPending |= 1u << (TIMER_IRQ_0 + alarm_num);
+        runIrq(TIMER_IRQ_0 + alarm_num);
+    });
+    return false;
+}
+
+void hardware_alarm_cancel(uint alarm_num)
+{
+    alarms[alarm_num].generation++;
+}
+
+uint get_core_num(void)
+{
+    return simCore;
+}
+
+void multicore_launch_core1(void (*entry)(void))
+{
+    if (coreActive[1])
+    {
+        fprintf(stderr, "sim: core1 launched twice\n");
+        sim_finish(2);
+    }
+    coreActive[1] = true;
+    coreWake[1] = now;
+    core1Launches++;
+    coreFifo[0].clear();
+    coreFifo[1].clear();
+    std::thread([entry]() {
+        simCore = 1;
+        {
+            std::unique_lock<std::mutex> lock(baton.mutex);
+            baton.cv.wait(lock, []() { return baton.core == 1; });
+        }
+        lastReturn = HostClock::now();
+        entry();
+        // on the board core1 would go back to the bootrom, here it is done
+        std::lock_guard<std::mutex> lock(baton.mutex);
+        coreActive[1] = false;
+        baton.core = 0;
+        baton.cv.notify_all();
+    }).detach();
+}
+
+bool multicore_fifo_rvalid(void)
+{
+    return !coreFifo[simCore].empty();
+}
+
+bool multicore_fifo_wready(void)
+{
+    return coreFifo[1 - simCore].size() < CORE_FIFO_DEPTH;
+}
+
+void multicore_fifo_push_blocking(uint32_t data)
+{
+    std::deque<uint32_t>& fifo = coreFifo[1 - simCore];
+    while (fifo.size() >= CORE_FIFO_DEPTH)
+        if (!waitForEvent())
+        {
+            fprintf(stderr, "sim: deadlock pushing to the core%d FIFO at %" PRIu64 " us\n", 1 - simCore, now);
+            sim_finish(2);
+        }
+    fifo.push_back(data);
+    fifoWords++;
+}
+
+uint32_t multicore_fifo_pop_blocking(void)
+{
+    std::deque<uint32_t>& fifo = coreFifo[simCore];
+    while (fifo.empty())
+        if (!waitForEvent())
+        {
+            fprintf(stderr, "sim: deadlock popping the core%d FIFO at %" PRIu64 " us\n", simCore, now);
+            sim_finish(2);
+        }
+    const uint32_t data = fifo.front();
+    fifo.pop_front();
+    return data;
+}
+
+void multicore_fifo_drain(void)
+{
+    coreFifo[simCore].clear();
+}
+
+void __wfe(void)
+{
+    __wfi();
+}
+
+void __sev(void)
+{
+}
+
+uint32_t save_and_disable_interrupts(void)
+{
+    const uint32_t status = irqMasked;
+    irqMasked = 1;
+    return status;
+}
+
+void restore_interrupts(uint32_t status)
+{
+    irqMasked = status;
+    serviceIrqs();
+}
+
+void irq_set_exclusive_handler(uint num, irq_handler_t handler)
+{
+    irqHandlers[num] = handler;
+}
+
+void irq_set_enabled(uint num, bool enabled)
+{
+    irqEnabled[num] = enabled;
+    if (enabled)
+        serviceIrqs();
+}
+
+bool irq_is_enabled(uint num)
+{
+    return irqEnabled[num];
+}
+
+// A pin has one function: giving it a second one takes it from the first,
+// which on the board silently cuts that peripheral off
+static void claimGpio(uint gpio, uint8_t fn)
+{
+    if (gpios[gpio].func != GPIO_FUNC_NULL && gpios[gpio].func != fn)
+    {
+        fprintf(stderr, "sim: gpio %u set to function %u, it already has function %u\n", gpio, fn,
+            gpios[gpio].func);
+        sim_finish(2);
+    }
+    gpios[gpio].func = fn;
+}
+
+void gpio_init(uint gpio)
+{
+    claimGpio(gpio, GPIO_FUNC_SIO);
+    gpios[gpio].out = false;
+    gpios[gpio].value = false;
+}
+
+void gpio_set_function(uint gpio, enum gpio_function fn)
+{
+    claimGpio(gpio, (uint8_t)fn);
+}
+
+void gpio_set_dir(uint gpio, bool out)
+{
+    gpios[gpio].out = out;
+}
+
+void gpio_put(uint gpio, bool value)
+{
+    Gpio& g = gpios[gpio];
+    if (g.value != value)
+        g.toggles++;
+    g.value = value;
+}
+
+bool gpio_get(uint gpio)
+{
+    const Gpio& g = gpios[gpio];
+    return g.out ? g.value : g.input;
+}
+
+void gpio_set_pulls(uint gpio, bool up, bool down)
+{
+    Gpio& g = gpios[gpio];
+    g.pullUp = up;
+    (void)down;
+}
+
+void gpio_set_irq_enabled(uint gpio, uint32_t event_mask, bool enabled)
+{
+    if (enabled)
+        gpios[gpio].irqMask |= event_mask;
+    else
+        gpios[gpio].irqMask &= ~event_mask;
+}
+
+void gpio_set_irq_enabled_with_callback(uint gpio, uint32_t event_mask, bool enabled, gpio_irq_callback_t callback)
+{
+    gpio_set_irq_enabled(gpio, event_mask, enabled);
+    gpioCallback = callback;
+    irq_set_exclusive_handler(IO_IRQ_BANK0, &gpioIrq);
+    irq_set_enabled(IO_IRQ_BANK0, true);
+}
+
+uint uart_init(uart_inst_t *uart, uint baudrate)
+{
+    Uart& u = uartOf(uart);
+    u.fifo = true;
+    u.rxIrq = false;
+    u.rx.clear();
+    return uart_set_baudrate(uart, baudrate);
+}
+
+void uart_deinit(uart_inst_t *uart)
+{
+    uartOf(uart).baud = 0;
+}
+
+uint uart_set_baudrate(uart_inst_t *uart, uint baudrate)
+{
+    uartOf(uart).baud = baudrate;
+    uartOf(uart).periHz = clockHz[clk_peri];
+    return baudrate;
+}
+
+void uart_set_hw_flow(uart_inst_t *uart, bool cts, bool rts)
+{
+    (void)uart; (void)cts; (void)rts;
+}
+
+void uart_set_format(uart_inst_t *uart, uint data_bits, uint stop_bits, uart_parity_t parity)
+{
+    uartOf(uart).bitsPerChar = (uint8_t)(1 + data_bits + stop_bits + (parity != UART_PARITY_NONE));
+}
+
+void uart_set_irq_enables(uart_inst_t *uart, bool rx_has_data, bool tx_needs_data)
+{
+    Uart& u = uartOf(uart);
+    (void)tx_needs_data;
+    u.rxIrq = rx_has_data;
+    uartRaise(u);
+}
+
+void uart_set_fifo_enabled(uart_inst_t *uart, bool enabled)
+{
+    Uart& u = uartOf(uart);
+    u.fifo = enabled;
+    while (u.rx.size() > u.depth())
+        u.rx.pop_back();
+}
+
+bool uart_is_writable(uart_inst_t *uart)
+{
+    const Uart& u = uartOf(uart);
+    return u.txLineFreeAt <= now + (u.fifo ? 31 * u.charTimeUs() : 0);
+}
+
+bool uart_is_readable(uart_inst_t *uart)
+{
+    return !uartOf(uart).rx.empty();
+}
+
+void uart_tx_wait_blocking(uart_inst_t *uart)
+{
+    const Uart& u = uartOf(uart);
+    if (u.txLineFreeAt > now)
+        sim_advance_to_us(u.txLineFreeAt);
+}
+
+void uart_write_blocking(uart_inst_t *uart, const uint8_t *src, size_t len)
+{
+    Uart& u = uartOf(uart);
+    const uint64_t ct = u.charTimeUs();
+    // Characters leave back to back; the caller only blocks while the
+    // transmit FIFO (or the single holding register) is full.
+    const uint64_t room = u.fifo ? 31 * ct : 0;
+    for (size_t i = 0; i < len; i++)
+    {
+        if (u.txLineFreeAt > now + room)
+            sim_advance_to_us(u.txLineFreeAt - room);
+        const uint64_t t = (u.txLineFreeAt > now ? u.txLineFreeAt : now) + ct;
+        u.txLineFreeAt = t;
+        u.stats.txBytes++;
+        if (!uartClocked(u))
+        {
+            u.stats.garbled++;
+            continue;
+        }
+        const uint8_t c = src[i];
+        Uart* pu = &u;
+        sim_schedule_at(t, [pu, c]() {
+            if (pu->dev)
+                pu->dev->onRx(c);
+        });
+    }
+}
+
+char uart_getc(uart_inst_t *uart)
+{
+    Uart& u = uartOf(uart);
+    while (u.rx.empty())
+        if (!waitForEvent())
+        {
+            fprintf(stderr, "sim: uart%u read with no data left at %" PRIu64 " us\n", uart->index, now);
+            sim_finish(2);
+        }
+    const char c = (char)u.rx.front();
+    u.rx.pop_front();
+    if (u.rx.empty())
+        u.rxTimeout = false;
+    return c;
+}
+
+void uart_read_blocking(uart_inst_t *uart, uint8_t *dst, size_t len)
+{
+    for (size_t i = 0; i < len; i++)
+        dst[i] = (uint8_t)uart_getc(uart);
+}
+
+bool uart_is_readable_within_us(uart_inst_t *uart, uint32_t us)
+{
+    const uint64_t until = now + us;
+    while (!uart_is_readable(uart))
+    {
+        uint64_t t;
+        if (!sim_next_event_us(&t) || t > until)
+        {
+            sim_advance_to_us(until);
+            return uart_is_readable(uart);
+        }
+        sim_advance_to_us(t);
+    }
+    return true;
+}
+
+int dma_claim_unused_channel(bool required)
+{
+    for (uint ch = 0; ch < NUM_DMA_CHANNELS; ch++)
+        if (!dmaChannels[ch].claimed)
+        {
+            dmaChannels[ch].claimed = true;
+            return (int)ch;
+        }
+    if (required)
+    {
+        fprintf(stderr, "sim: no free DMA channel\n");
+        sim_finish(2);
+    }
+    return -1;
+}
+
+void dma_channel_unclaim(uint channel)
+{
+    dmaChannels[channel] = DmaChannel();
+}
+
+dma_channel_config dma_channel_get_default_config(uint channel)
+{
+    (void)channel;
+    dma_channel_config c = {};
+    c.transfer_size = DMA_SIZE_32;
+    c.read_increment = true;
+    c.write_increment = false;
+    c.dreq = DREQ_FORCE;
+    c.enable = true;
+    return c;
+}
+
+dma_channel_hw_t *dma_channel_hw_addr(uint channel)
+{
+    return &dmaHw[channel];
+}
+
+void dma_channel_configure(uint channel, const dma_channel_config *config, volatile void *write_addr,
+                           const volatile void *read_addr, uint transfer_count, bool trigger)
+{
+    DmaChannel& d = dmaChannels[channel];
+    if (config->transfer_size != DMA_SIZE_8 || config->read_increment)
+    {
+        fprintf(stderr, "sim: DMA channel %u: only 8 bit transfers from a fixed address are simulated\n", channel);
+        sim_finish(2);
+    }
+    d.cfg = *config;
+    dmaHw[channel].write_addr = (uintptr_t)write_addr;
+    dmaHw[channel].read_addr = (uintptr_t)read_addr;
+    dmaHw[channel].transfer_count = transfer_count;
+    if (trigger)
+        dma_channel_start(channel);
+}
+
+void dma_channel_set_trans_count(uint channel, uint32_t trans_count, bool trigger)
+{
+    dmaHw[channel].transfer_count = trans_count;
+    if (trigger)
+        dma_channel_start(channel);
+}
+
+void dma_channel_start(uint channel)
+{
+    DmaChannel& d = dmaChannels[channel];
+    d.busy = d.cfg.enable && dmaHw[channel].transfer_count != 0;
+    dmaServiceAll();
+}
+
+void dma_channel_abort(uint channel)
+{
+    dmaChannels[channel].busy = false;
+}
+
+bool dma_channel_is_busy(uint channel)
+{
+    return dmaChannels[channel].busy;
+}
+
+uint i2c_init(i2c_inst_t *i2c, uint baudrate)
+{
+    return i2c_set_baudrate(i2c, baudrate);
+}
+
+void i2c_deinit(i2c_inst_t *i2c)
+{
+    (void)i2c;
+}
+
+uint i2c_set_baudrate(i2c_inst_t *i2c, uint baudrate)
+{
+    i2cs[i2c->index].baud = baudrate;
+    return baudrate;
+}
+
+static SimI2cDevice* i2cFind(I2c& bus, uint8_t addr)
+{
+    for (size_t i = 0; i < bus.devs.size(); i++)
+        if (bus.devs[i]->address() == addr)
+            return bus.devs[i];
+    return nullptr;
+}
+
+static void i2cBusTime(I2c& bus, size_t bytes)
+{
+    // address byte plus payload, 9 clocks each, plus start/stop
+    const uint64_t us = ((bytes + 1) * 9 + 2) * 1000000ull / bus.baud;
+    bus.stats.busTimeUs += us;
+    sim_advance_us(us);
+}
+
+int i2c_write_blocking(i2c_inst_t *i2c, uint8_t addr, const uint8_t *src, size_t len, bool nostop)
+{
+    I2c& bus = i2cs[i2c->index];
+    bus.stats.transfers++;
+    SimI2cDevice* dev = i2cFind(bus, addr);
+    if (!dev)
+    {
+        bus.stats.nacks++;
+        i2cBusTime(bus, 0);
+        return PICO_ERROR_GENERIC;
+    }
+    bus.stats.bytes += len;
+    dev->write(src, len, nostop);
+    i2cBusTime(bus, len);
+    return (int)len;
+}
+
+int i2c_read_blocking(i2c_inst_t *i2c, uint8_t addr, uint8_t *dst, size_t len, bool nostop)
+{
+    I2c& bus = i2cs[i2c->index];
+    bus.stats.transfers++;
+    SimI2cDevice* dev = i2cFind(bus, addr);
+    if (!dev)
+    {
+        bus.stats.nacks++;
+        i2cBusTime(bus, 0);
+        return PICO_ERROR_GENERIC;
+    }
+    bus.stats.bytes += len;
+    i2cBusTime(bus, len);
+    dev->read(dst, len, nostop);
+    return (int)len;
+}
+
+void rtc_init(void)
+{
+    rtcRunning = false;
+    rtcAlarmArmed = false;
+    irq_set_exclusive_handler(RTC_IRQ, &rtcIrq);
+}
+
+bool rtc_set_datetime(datetime_t *t)
+{
+    if (t->month < 1 || t->month > 12 || t->day < 1 || t->day > 31 || t->hour > 23 || t->min > 59 || t->sec > 59)
+        return false;
+    rtcEpochAtSet = toEpoch(*t);
+    rtcSetAt = now;
+    rtcRunning = true;
+    rtcScheduleAlarm();
+    return true;
+}
+
+bool rtc_get_datetime(datetime_t *t)
+{
+    if (!rtcRunning)
+        return false;
+    *t = fromEpoch(rtcEpochNow());
+    return true;
+}
+
+bool rtc_running(void)
+{
+    return rtcRunning;
+}
+
+void rtc_set_alarm(datetime_t *t, rtc_callback_t user_callback)
+{
+    rtcAlarm = *t;
+    rtcCallback = user_callback;
+    irq_set_enabled(RTC_IRQ, user_callback != nullptr);
+    rtc_enable_alarm();
+}
+
+void rtc_enable_alarm(void)
+{
+    rtcAlarmArmed = true;
+    rtcAlarmFired = false;
+    rtcScheduleAlarm();
+}
+
+void rtc_disable_alarm(void)
+{
+    rtcAlarmArmed = false;
+}
+
+void sleep_run_from_dormant_source(dormant_source_t dormant_source)
+{
+    const uint32_t hz = dormant_source == DORMANT_SOURCE_XOSC ? 12000000 : 6500000;
+    clockHz[clk_ref] = hz;
+    clockHz[clk_sys] = hz;
+    clockHz[clk_peri] = hz;
+    clockHz[clk_usb] = 0;
+    clockHz[clk_adc] = 0;
+}
+
+void sleep_goto_sleep_until(datetime_t *t, rtc_callback_t callback)
+{
+    const uint64_t start = now;
+    sleepCount++;
+    // as the SDK leaves them: deep sleep, everything but the RTC gated
+    scb_hw->scr |= M0PLUS_SCR_SLEEPDEEP_BITS;
+    clocks_hw->sleep_en0 = CLOCKS_SLEEP_EN0_CLK_RTC_RTC_BITS;
+    clocks_hw->sleep_en1 = 0;
+    rtc_set_alarm(t, callback);
+    clocksGated = true;
+    blockUntil(&rtcAlarmFired, "rtc alarm");
+    clocksGated = false;
+    sleepUs += now - start;
+}
+
+void sleep_goto_dormant_until_pin(uint gpio_pin, bool edge, bool high)
+{
+    const uint64_t start = now;
+    dormantCount++;
+    dormantPin = (int)gpio_pin;
+    dormantEdge = edge;
+    dormantHigh = high;
+    dormantWoken = !edge && gpio_get(gpio_pin) == high;
+    clocksGated = true;
+    blockUntil(&dormantWoken, "dormant wake pin");
+    clocksGated = false;
+    // no XOSC, no clk_rtc: the RTC carries on from where it stopped
+    rtcSetAt += now - start;
+    rtcScheduleAlarm();
+    dormantPin = -1;
+    dormantUs += now - start;
+}
+
+void clocks_init(void)
+{
+    // XOSC already stable, both PLLs have to lock
+    sim_advance_us(SIM_PLL_LOCK_US);
+    clockHz[clk_ref] = 12000000;
+    clockHz[clk_sys] = 125000000;
+    clockHz[clk_peri] = 125000000;
+    clockHz[clk_usb] = 48000000;
+    clockHz[clk_adc] = 48000000;
+    clockHz[clk_rtc] = 46875;
+}
+
+bool clock_configure(enum clock_index clk_index, uint32_t src, uint32_t auxsrc, uint32_t src_freq, uint32_t freq)
+{
+    (void)src; (void)auxsrc;
+    if (freq > src_freq)
+        return false;
+    clockHz[clk_index] = freq;
+    return true;
+}
+
+void clock_stop(enum clock_index clk_index)
+{
+    clockHz[clk_index] = 0;
+}
+
+uint32_t clock_get_hz(enum clock_index clk_index)
+{
+    return clockHz[clk_index];
+}
+
+bool set_sys_clock_khz(uint32_t freq_khz, bool required)
+{
+    (void)required;
+    clockHz[clk_sys] = freq_khz * 1000;
+    return true;
+}
+
+void pll_init(pll_inst_t *pll, uint ref_div, uint vco_freq, uint post_div1, uint post_div2)
+{
+    (void)pll; (void)ref_div; (void)vco_freq; (void)post_div1; (void)post_div2;
+}
+
+void pll_deinit(pll_inst_t *pll)
+{
+    (void)pll;
+}
+
+void xosc_init(void)
+{
+}
+
+void xosc_disable(void)
+{
+}
+
+void xosc_dormant(void)
+{
+}
+
+void rosc_set_dormant(void)
+{
+}
+
+void rosc_disable(void)
+{
+}
+
+void rosc_enable(void)
+{
+}
+
+void flash_range_erase(uint32_t flash_offs, size_t count)
+{
+    if (flash_offs % FLASH_SECTOR_SIZE || count % FLASH_SECTOR_SIZE || flash_offs + count > flashSize)
+    {
+        fprintf(stderr, "sim: flash_range_erase(0x%x, %zu) not on sectors\n", (unsigned)flash_offs, count);
+        sim_finish(2);
+    }
+    uint8_t* image = flashMemory();
+    for (size_t i = 0; i < count; i += FLASH_SECTOR_SIZE)
+    {
+        memset(image + flash_offs + i, 0xff, flashOp(FLASH_SECTOR_SIZE));
+        flashEraseCounts[(flash_offs + i) / FLASH_SECTOR_SIZE]++;
+        flashStats.erases++;
+        flashStats.busyUs += SIM_FLASH_ERASE_US;
+        sim_advance_us(SIM_FLASH_ERASE_US);
+    }
+}
+
+void flash_range_program(uint32_t flash_offs, const uint8_t *data, size_t count)
+{
+    if (flash_offs % FLASH_PAGE_SIZE || count % FLASH_PAGE_SIZE || flash_offs + count > flashSize)
+    {
+        fprintf(stderr, "sim: flash_range_program(0x%x, %zu) not on pages\n", (unsigned)flash_offs, count);
+        sim_finish(2);
+    }
+    uint8_t* image = flashMemory();
+    for (size_t i = 0; i < count; i += FLASH_PAGE_SIZE)
+    {
+        // NOR flash: programming clears bits, only an erase sets them
+        const size_t done = flashOp(FLASH_PAGE_SIZE);
+        for (size_t j = 0; j < done; j++)
+            image[flash_offs + i + j] &= data[i + j];
+        flashStats.programs++;
+        flashStats.busyUs += SIM_FLASH_PAGE_US;
+        sim_advance_us(SIM_FLASH_PAGE_US);
+    }
+}
+
+}
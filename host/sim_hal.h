@@ -0,0 +1,108 @@
+#ifndef __sim_hal_H__
+#define __sim_hal_H__
+
+// Host simulation of the Pico SDK pieces the tracker firmware uses.
+//
+// Everything runs on one virtual clock. Time only moves when the firmware
+// blocks (sleep_ms, busy_wait_us, UART transmit, I2C transfers, __wfi);
+// computation itself takes zero virtual time. Device models hook into the
+// simulated UARTs and I2C buses and schedule their output on the clock, and
+// UART RX interrupts fire while the firmware is blocked, like on the board.
+
+#include <cinttypes>
+#include <cstddef>
+#include <cstdio>
+#include <functional>
+
+#include "hardware/uart.h"
+#include "hardware/i2c.h"
+
+// A peer on the far side of a simulated UART (GPS receiver, modem).
+struct SimUartDevice
+{
+    virtual ~SimUartDevice() {}
+    // A byte sent by the firmware has arrived at the device.
+    virtual void onRx(uint8_t c) = 0;
+};
+
+// A slave on a simulated I2C bus.
+struct SimI2cDevice
+{
+    virtual ~SimI2cDevice() {}
+    virtual uint8_t address() const = 0;
+    virtual void write(const uint8_t* data, size_t len, bool nostop) = 0;
+    virtual void read(uint8_t* data, size_t len, bool nostop) = 0;
+};
+
+struct SimUartStats
+{
+    uint64_t rxBytes;
+    uint64_t txBytes;
+    uint64_t overruns;
+    uint64_t irqs;
+    uint64_t dmaBytes;  // RX bytes taken from the FIFO by a DMA channel
+    uint64_t garbled;   // bytes lost to a clk_peri other than the baud rate was set for, or gated
+};
+
+struct SimFlashStats
+{
+    uint64_t erases;        // sectors
+    uint64_t programs;      // pages
+    uint64_t busyUs;        // virtual time the flash was busy
+    uint64_t torn;          // operations cut short by sim_flash_power_fail_after()
+};
+
+struct SimI2cStats
+{
+    uint64_t transfers;
+    uint64_t bytes;
+    uint64_t nacks;
+    uint64_t busTimeUs;
+};
+
+// virtual clock
+uint64_t sim_now_us();
+void sim_advance_us(uint64_t us);
+void sim_advance_to_us(uint64_t t);
+void sim_schedule_at(uint64_t t, std::function<void()> fn);
+bool sim_next_event_us(uint64_t* t);
+
+// The simulation ends when virtual time reaches the deadline: the finish
+// hooks run, the report is printed and the process exits.
+void sim_set_deadline_us(uint64_t t);
+void sim_on_finish(std::function<void()> fn);
+void sim_finish(int status);
+
+// peripherals
+void sim_uart_attach(uart_inst_t* uart, SimUartDevice* dev);
+// Queue bytes from a device into the firmware's RX line, paced at the baud rate.
+void sim_uart_inject(uart_inst_t* uart, const uint8_t* data, size_t len);
+uint32_t sim_uart_baudrate(uart_inst_t* uart);
+const SimUartStats& sim_uart_stats(uart_inst_t* uart);
+
+void sim_i2c_attach(i2c_inst_t* i2c, SimI2cDevice* dev);
+const SimI2cStats& sim_i2c_stats(i2c_inst_t* i2c);
+
+bool sim_gpio_output(uint gpio);
+uint32_t sim_gpio_toggles(uint gpio);
+void sim_gpio_drive(uint gpio, bool level);
+
+// Flash: an image of PICO_FLASH_SIZE_BYTES, erased at start. With a file
+// the image is mapped from it (created erased if missing), so it outlasts
+// the process; without, it lives in memory. A file may stand in for a
+// larger part than the board's, for benchmarks.
+bool sim_flash_open(const char* path, size_t bytes = PICO_FLASH_SIZE_BYTES);
+void sim_flash_close();
+// The power fails in the middle of the operation after the next ops ones:
+// it is done up to a random byte, the ones after it are not done at all
+// until sim_flash_power_on().
+void sim_flash_power_fail_after(uint64_t ops);
+void sim_flash_power_on();
+bool sim_flash_powered();
+// how often the sector at this flash offset was erased
+uint32_t sim_flash_erase_count(uint32_t offset);
+const SimFlashStats& sim_flash_stats();
+
+void sim_report(FILE* out);
+
+#endif
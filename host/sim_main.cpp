@@ -0,0 +1,331 @@
+// Runs the tracker firmware on the host against the simulated HAL and the
+// scripted NEO-6M, SIM800L, MPU6050 and SSD1306 models, then prints where
+// virtual time went. Everything is deterministic: the same arguments give
+// the same report (apart from the host CPU line).
+//
+//   tracker_sim [--loop default|all|sim800|sleep|dual|tasks] [--duration-ms N]
+//               [--nmea LOG] [--gps-fix-after N] [--bad-checksum-every N]
+//               [--truncate-every N] [--sim-pin PIN] [--motion-at MS]...
+//               [--no-nitz] [--rssi-at MS:CSQ]... [--battery-at MS:MV]...
+//               [--server PORT] [--trace FILE] [--dump-display]
+//
+// --server sends the GPRS uplink to an MQTT broker on 127.0.0.1:PORT,
+// without it the scripted broker in sim_broker.h takes the reports.
+
+#include "sim_hal.h"
+#include "sim_devices.h"
+#include "sim_broker.h"
+
+#include "fix_codec.h"
+#include "flash_queue.h"
+#include "gprs_session.h"
+#include "mqtt_client.h"
+#include "mpu6050_i2c.h"
+#include "neo6m.h"
+#include "report_policy.h"
+#include "sim800l.h"
+#include "sleep_control.h"
+#include "task_scheduler.h"
+#include "time_sync.h"
+#include "timing.h"
+#include "trace.h"
+#include "track_log.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+// main.cpp is built with main renamed, see host/CMakeLists.txt
+int firmware_main();
+void init();
+void main_loop_all();
+void main_loop_sim800();
+void main_loop_sleep();
+void main_loop_dual();
+void main_loop_tasks();
+extern uint32_t core1_published, core1_dropped, core1_max_poll_gap_us;
+extern uint32_t park_count, wake_to_fix_ms, wake_to_fix_max_ms, wake_to_report_ms, wake_to_report_max_ms;
+extern TimeSync time_sync;
+extern SIM800L sim800l;
+extern ReportPolicy report_policy;
+extern GprsSession uplink;
+extern MqttClient mqtt;
+extern uint32_t reports_taken;
+extern FlashQueue report_queue;
+extern uint64_t report_bytes;
+extern TrackLog track_log;
+extern uint32_t track_queries, track_sent;
+
+// how often --trace empties the trace rings
+#define TRACE_FLUSH_MS 20
+
+// "MS:VALUE" of the scripted modem options
+static bool timedValue(const char* v, uint64_t* atUs, int* value)
+{
+    char* end;
+    *atUs = strtoull(v, &end, 10) * 1000;
+    if (*end != ':')
+        return false;
+    *value = (int)strtol(end + 1, &end, 10);
+    return *end == '\0';
+}
+
+static void usage(const char* argv0)
+{
+    fprintf(stderr, "usage: %s [--loop default|all|sim800|sleep|dual|tasks] [--duration-ms N] [--nmea LOG]\n"
+        "          [--gps-fix-after N] [--bad-checksum-every N] [--truncate-every N]\n"
+        "          [--sim-pin PIN] [--motion-at MS]... [--no-nitz] [--rssi-at MS:CSQ]...\n"
+        "          [--battery-at MS:MV]... [--query-at MS]... [--server PORT] [--flash IMAGE] [--trace FILE]\n"
+        "          [--dump-display]\n", argv0);
+    exit(1);
+}
+
+int main(int argc, char** argv)
+{
+    std::string loop = "default";
+    uint64_t durationMs = 30000;
+    bool dumpDisplay = false;
+    FILE* traceFile = nullptr;
+
+    static NEO6MModel gps(GPS_UART_ID);
+    static SIM800LModel modem(SIM800L_UART_ID);
+    static MPU6050Model imu;
+    static SSD1306Model display;
+    static SimMqttBroker broker;
+
+    for (int i = 1; i < argc; i++)
+    {
+        const char* a = argv[i];
+        const char* v = i + 1 < argc ? argv[i + 1] : nullptr;
+        if (!strcmp(a, "--dump-display"))
+        {
+            dumpDisplay = true;
+            continue;
+        }
+        if (!strcmp(a, "--no-nitz"))
+        {
+            modem.nitz = false;
+            continue;
+        }
+        if (!v)
+            usage(argv[0]);
+        i++;
+        if (!strcmp(a, "--loop"))
+            loop = v;
+        else if (!strcmp(a, "--duration-ms"))
+            durationMs = strtoull(v, nullptr, 10);
+        else if (!strcmp(a, "--nmea"))
+        {
+            if (!gps.loadLog(v))
+            {
+                fprintf(stderr, "cannot read NMEA log %s\n", v);
+                return 1;
+            }
+        }
+        else if (!strcmp(a, "--gps-fix-after"))
+            gps.track.fixAfterEpochs = strtoul(v, nullptr, 10);
+        else if (!strcmp(a, "--bad-checksum-every"))
+            gps.track.badChecksumEvery = strtoul(v, nullptr, 10);
+        else if (!strcmp(a, "--truncate-every"))
+            gps.track.truncateEvery = strtoul(v, nullptr, 10);
+        else if (!strcmp(a, "--sim-pin"))
+            modem.pin = v;
+        else if (!strcmp(a, "--server"))
+            modem.serverPort = atoi(v);
+        else if (!strcmp(a, "--flash"))
+        {
+            if (!sim_flash_open(v))
+            {
+                fprintf(stderr, "cannot map %s\n", v);
+                return 1;
+            }
+        }
+        else if (!strcmp(a, "--trace"))
+        {
+            traceFile = fopen(v, "w");
+            if (!traceFile)
+            {
+                fprintf(stderr, "cannot write %s\n", v);
+                return 1;
+            }
+        }
+        else if (!strcmp(a, "--query-at"))
+        {
+            // the whole track, as the backend would ask for it
+            sim_schedule_at(strtoull(v, nullptr, 10) * 1000, []() {
+                broker.deliver("trackers/" MQTT_CLIENT_ID "/query", "0 4294967295", 1);
+            });
+        }
+        else if (!strcmp(a, "--motion-at"))
+            imu.motion(strtoull(v, nullptr, 10) * 1000, 3000);
+        else if (!strcmp(a, "--rssi-at") || !strcmp(a, "--battery-at"))
+        {
+            uint64_t atUs;
+            int value;
+            if (!timedValue(v, &atUs, &value))
+                usage(argv[0]);
+            if (a[2] == 'r')
+                sim_schedule_at(atUs, [value]() { modem.rssi = value; });
+            else
+                sim_schedule_at(atUs, [value]() { modem.setBattery(value); });
+        }
+        else
+            usage(argv[0]);
+    }
+
+    sim_i2c_attach(i2c0, &imu);
+    imu.attachInt(MPU_INT_PIN);
+    sim_i2c_attach(i2c1, &display);
+    gps.start(1000000);
+    if (modem.serverPort == 0)
+    {
+        if (!broker.start())
+        {
+            fprintf(stderr, "cannot listen on 127.0.0.1\n");
+            return 1;
+        }
+        modem.serverPort = broker.port;
+    }
+    // the network and the GPS track agree on UTC
+    modem.networkEpochAtZero = gps.track.startEpoch - 1;
+    sim_set_deadline_us(durationMs * 1000);
+
+    // what a host reading the USB serial port would capture
+    static std::function<void()> flushTrace;
+    if (traceFile)
+    {
+        flushTrace = [traceFile]() {
+            trace_flush(&trace_text_sink, traceFile);
+            sim_schedule_at(sim_now_us() + TRACE_FLUSH_MS * 1000, flushTrace);
+        };
+        sim_schedule_at(TRACE_FLUSH_MS * 1000, flushTrace);
+    }
+
+    sim_on_finish([&]() {
+        if (traceFile)
+        {
+            trace_flush(&trace_text_sink, traceFile);
+            fclose(traceFile);
+        }
+        printf("--- tracker_sim: loop %s, %" PRIu64 " ms ---\n", loop.c_str(), durationMs);
+        sim_report(stdout);
+        printf("neo6m   epochs %u  sentences %u  ubx out %u  bytes %" PRIu64 "  ubx in %" PRIu64 "  nmea %s off 0x%02x  backups %u\n",
+            gps.track.epochs(), gps.track.sentences(), gps.track.ubxMessages(), gps.bytesSent, gps.ubxReceived,
+            gps.track.nmeaOutput ? "on" : "off", gps.track.disabledSentences, gps.backups);
+        printf("sim800l commands %" PRIu64 "  sim %s  sleeps %u  profile writes %u\n", modem.commands,
+            modem.simLocked ? "locked" : "unlocked", modem.sleeps, modem.profileWrites);
+        const AtEngine& at = sim800l.at;
+        printf("at      commands %u  errors %u  timeouts %u  urcs %u  stray lines %u  rings %u  sms %u  under-voltage %u\n",
+            at.completed, at.errors, at.timeouts, at.urcs, at.strayLines, sim800l.rings, sim800l.smsReceived,
+            sim800l.underVoltage);
+        printf("at      cut lines %u  cut responses %u  line queue overflows %u\n",
+            at.cutLines, at.responseCuts, at.lineOverflows());
+        if (sim800l.signal.count() && sim800l.battery.count())
+            printf("modem   csq %u (%d dBm) ber %u  battery %u mV %u%%  samples %u\n", sim800l.signal[0].rssi,
+                sim800l.signal[0].dbm, sim800l.signal[0].ber, sim800l.battery[0].mv, sim800l.battery[0].percent,
+                (unsigned)sim800l.signal.count());
+        if (loop == "tasks" || loop == "default")
+        {
+            printf("policy  battery %s  signal %d dBm %s  gps %u ms  reports %u  deferred %u  recovered %u\n",
+                ReportPolicy::tierName(report_policy.tier()), report_policy.signalDbm(),
+                report_policy.signalGood() ? "good" : "poor", gps.measurementMs, reports_taken,
+                report_policy.deferrals, report_policy.recoveries);
+            printf("queue   stored %u  forwarded %u  %s  dropped %u  erases %u  corrupt %u\n", report_queue.appended,
+                report_queue.committed, report_queue.empty() ? "empty" : "pending", report_queue.dropped,
+                report_queue.erases, report_queue.corrupt);
+            printf("track   logged %u  from %u to %u  refused %u  erases %u  corrupt %u  queries %u  sent %u\n",
+                track_log.appended, track_log.firstTime(), track_log.lastTime(), track_log.refused, track_log.erases,
+                track_log.corrupt, track_queries, track_sent);
+            printf("gprs    %s  contexts %u  connections %u  sends %u  records %u  bytes %" PRIu64 "  pending %u  "
+                "failures %u  closed %u  dropped %u\n", GprsSession::stateName(uplink.state()), uplink.contexts,
+                uplink.connects, uplink.sends, uplink.recordsSent, uplink.bytesSent, (unsigned)uplink.pending(),
+                uplink.failures, uplink.closed, uplink.dropped);
+            printf("mqtt    %s  connects %u  resumed %u  published %u  queued %u  retransmits %u  pings %u  "
+                "ping timeouts %u\n", MqttClient::stateName(mqtt.state()), mqtt.connects, mqtt.sessionsResumed,
+                mqtt.published, (unsigned)mqtt.queued(), mqtt.retransmits, mqtt.pings, mqtt.pingTimeouts);
+            if (broker.port == modem.serverPort)
+            {
+                printf("broker  connects %u  resumed %u  messages %u  duplicates %u  pings %u  subscribes %u  "
+                    "undelivered %u\n", broker.connects, broker.sessionsResumed, (unsigned)broker.messages.size(),
+                    broker.duplicates, broker.pings, broker.subscribes, broker.undelivered);
+                // what the backend makes of the published frames
+                FixDecoder decoder(nullptr, nullptr), history(nullptr, nullptr);
+                size_t bytes = 0;
+                for (const SimMqttBroker::Message& m : broker.messages)
+                {
+                    const bool answer = m.topic == "trackers/" MQTT_CLIENT_ID "/track";
+                    (answer ? history : decoder).push((const uint8_t*)m.payload.data(), m.payload.size());
+                    bytes += answer ? 0 : m.payload.size();
+                }
+                printf("fixes   frames %u  fixes %u  bad frames %u  bytes %u  bytes/fix %.1f  encoded %" PRIu64 "\n",
+                    decoder.frames, decoder.fixes, decoder.badFrames, (unsigned)bytes,
+                    decoder.fixes ? (double)bytes / decoder.fixes : 0.0, report_bytes);
+                if (history.frames || history.badFrames)
+                    printf("history frames %u  fixes %u  bad frames %u\n", history.frames, history.fixes,
+                        history.badFrames);
+            }
+        }
+        printf("mpu6050 samples %" PRIu64 "  motion interrupts %u\n", imu.sampleReads, imu.motionInts);
+        const rpi_sleep_stats_t *ss = rpi_sleep_stats();
+        if (ss->sleeps || ss->dormant)
+            printf("rpi     sleeps %u  dormant %u  wake latency %u us, worst %u us\n",
+                ss->sleeps, ss->dormant, ss->last_wake_latency_us, ss->max_wake_latency_us);
+        if (park_count)
+        {
+            printf("parked  %u times  wake to first fix %u ms, worst %u ms\n", park_count, wake_to_fix_ms,
+                wake_to_fix_max_ms);
+            printf("        wake to first report %u ms, worst %u ms\n", wake_to_report_ms, wake_to_report_max_ms);
+        }
+        printf("ssd1306 frames %" PRIu64 "  data bytes %" PRIu64 "  commands %" PRIu64 "\n",
+            display.frames, display.dataBytes, display.commands);
+        if (loop == "dual")
+            printf("core1   snapshots %u  dropped %u  max gps poll gap %.3f ms\n",
+                core1_published, core1_dropped, core1_max_poll_gap_us / 1000.0);
+        if (loop == "tasks" || loop == "default")
+        {
+            printf("sched   sleeps %u\n", sched_sleeps());
+            sched_print_stats();
+        }
+        if (time_sync.synced())
+        {
+            // the generated track's epochs start on the second at 1 s
+            datetime_t rtc;
+            rtc_get_datetime(&rtc);
+            const int64_t utc = gps.track.startEpoch + ((int64_t)sim_now_us() - 1000000) / 1000000;
+            printf("time    rtc from %s  gps syncs %u  network syncs %u  last step %d s  rtc - utc %d s\n",
+                TimeSync::sourceName(time_sync.source), time_sync.gpsSyncs, time_sync.networkSyncs,
+                (int)time_sync.lastStepS, (int)(rpi_datetime_to_seconds(&rtc) - utc));
+        }
+#if TRACKER_TIMING
+        timing_print();
+#endif
+        if (traceFile)
+            printf("trace   lost %u\n", trace_lost());
+        if (dumpDisplay)
+            display.dump(stdout);
+    });
+
+    if (loop == "default")
+        firmware_main();
+    else
+    {
+        init();
+        if (loop == "all")
+            main_loop_all();
+        else if (loop == "sim800")
+            main_loop_sim800();
+        else if (loop == "sleep")
+            main_loop_sleep();
+        else if (loop == "dual")
+            main_loop_dual();
+        else if (loop == "tasks")
+            main_loop_tasks();
+        else
+            usage(argv[0]);
+    }
+
+    // the firmware loops only return on the board if something went wrong
+    sim_finish(3);
+    return 3;
+}
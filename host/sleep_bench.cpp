@@ -0,0 +1,98 @@
+// RTC sleep across calendar rollovers in the simulated HAL: sets the RTC
+// just before a minute, hour, day, month, year and leap day edge, sleeps
+// with rpi_sleep_for() and rpi_sleep_until() and checks the time slept,
+// the RTC afterwards and that the clocks came back. Exits non-zero if any
+// case fails.
+//
+//   sleep_bench
+
+#include "sim_hal.h"
+
+#include "pico/stdlib.h"
+#include "hardware/clocks.h"
+#include "hardware/rtc.h"
+#include "sleep_control.h"
+
+#include <cstdlib>
+
+static uint32_t wakes;
+
+static void on_wake(void)
+{
+    wakes++;
+}
+
+static datetime_t dt(int16_t year, int8_t month, int8_t day, int8_t hour, int8_t min, int8_t sec)
+{
+    datetime_t t;
+    t.year = year;
+    t.month = month;
+    t.day = day;
+    t.dotw = 0;
+    t.hour = hour;
+    t.min = min;
+    t.sec = sec;
+    return t;
+}
+
+static bool same(const datetime_t& a, const datetime_t& b)
+{
+    return a.year == b.year && a.month == b.month && a.day == b.day && a.hour == b.hour && a.min == b.min
+        && a.sec == b.sec;
+}
+
+struct Case
+{
+    const char* name;
+    datetime_t from;
+    uint32_t sleepMs;  // rpi_sleep_for() if non-zero, else rpi_sleep_until(to)
+    datetime_t to;     // RTC after waking, or the target to refuse
+    bool sleeps;
+};
+
+int main()
+{
+    stdio_init_all();
+    rpi_sleep_init();
+
+    const Case cases[] = {
+        {"minute", dt(2024, 10, 21, 20, 0, 58), 3000, dt(2024, 10, 21, 20, 1, 1), true},
+        {"hour", dt(2024, 10, 21, 20, 59, 59), 1000, dt(2024, 10, 21, 21, 0, 0), true},
+        {"day", dt(2024, 10, 21, 23, 59, 30), 45000, dt(2024, 10, 22, 0, 0, 15), true},
+        {"month", dt(2024, 4, 30, 23, 59, 59), 2500, dt(2024, 5, 1, 0, 0, 2), true},
+        {"year", dt(2024, 12, 31, 23, 59, 59), 1000, dt(2025, 1, 1, 0, 0, 0), true},
+        {"leap day", dt(2024, 2, 28, 23, 59, 58), 5000, dt(2024, 2, 29, 0, 0, 3), true},
+        {"no leap day", dt(2023, 2, 28, 23, 59, 58), 5000, dt(2023, 3, 1, 0, 0, 3), true},
+        {"until", dt(2024, 12, 31, 23, 58, 0), 0, dt(2025, 1, 1, 0, 2, 30), true},
+        {"until past", dt(2024, 6, 1, 12, 0, 0), 0, dt(2024, 6, 1, 11, 59, 59), false},
+    };
+
+    int failures = 0;
+    for (const Case& c : cases)
+    {
+        datetime_t from = c.from;
+        rtc_set_datetime(&from);
+        sleep_us(64);
+        const uint64_t start = sim_now_us();
+        const uint32_t wakesBefore = wakes;
+        const bool slept = c.sleepMs ? rpi_sleep_for(c.sleepMs, &on_wake) : rpi_sleep_until(&c.to, &on_wake);
+
+        datetime_t now;
+        rtc_get_datetime(&now);
+        const double sleptS = (sim_now_us() - start) / 1e6;
+        bool ok;
+        if (!c.sleeps)
+            ok = !slept && wakes == wakesBefore && same(now, c.from);
+        else
+            ok = slept && wakes == wakesBefore + 1 && same(now, c.to) && clock_get_hz(clk_sys) == 125000000
+                && clock_get_hz(clk_peri) == 125000000 && clock_get_hz(clk_usb) == 48000000;
+        printf("%-12s %04d-%02d-%02d %02d:%02d:%02d  slept %8.3f s  %s\n", c.name, now.year, now.month, now.day,
+            now.hour, now.min, now.sec, sleptS, ok ? "ok" : "FAIL");
+        failures += !ok;
+    }
+
+    const rpi_sleep_stats_t* s = rpi_sleep_stats();
+    printf("%u sleeps, wake latency %u us, worst %u us\n", s->sleeps, s->last_wake_latency_us, s->max_wake_latency_us);
+    printf("%s\n", failures ? "FAIL: RTC sleep" : "RTC sleep ok");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,206 @@
+// Turns a capture of the firmware's "trace:" lines (USB serial log or
+// tracker_sim --trace) into Chrome trace event JSON for chrome://tracing or
+// ui.perfetto.dev. Other lines in the capture are ignored. One thread per
+// core; interrupt handlers nest inside whatever they interrupted.
+//
+//   trace_decode [CAPTURE] [-o OUT.json]
+
+#include "trace.h"
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+static int hexDigit(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+static uint16_t get16(const uint8_t* p)
+{
+    return (uint16_t)(p[0] | p[1] << 8);
+}
+
+static uint32_t get32(const uint8_t* p)
+{
+    return get16(p) | (uint32_t)get16(p + 2) << 16;
+}
+
+static void jsonString(FILE* out, const std::string& s)
+{
+    fputc('"', out);
+    for (char c : s)
+    {
+        if (c == '"' || c == '\\')
+            fputc('\\', out);
+        if ((unsigned char)c >= 0x20)
+            fputc(c, out);
+    }
+    fputc('"', out);
+}
+
+struct Decoder
+{
+    std::map<std::pair<int, int>, std::string> labels;
+    // 64 bit time per core from the wrapping time_us_32() stamps
+    uint64_t base[NUM_CORES] = {};
+    uint32_t last[NUM_CORES] = {};
+    bool seen[NUM_CORES] = {};
+    uint32_t lost[NUM_CORES] = {};  // the device counts per core
+    uint64_t records = 0;
+    uint64_t badLines = 0;
+    FILE* out;
+    bool first = true;
+
+    explicit Decoder(FILE* o) : out(o) {}
+
+    std::string name(const trace_record_t& r) const
+    {
+        auto it = labels.find(std::make_pair((int)r.event, (int)r.a));
+        if (it != labels.end())
+            return it->second;
+        // the labels went out with the first flush, before the capture started
+        if (r.event == TRACE_TASK)
+            return "task " + std::to_string(r.a);
+        return trace_event_name((trace_event_t)r.event);
+    }
+
+    void event(int core, const trace_record_t& r)
+    {
+        if (seen[core] && r.ts < last[core])
+            base[core] += 1ull << 32;
+        seen[core] = true;
+        last[core] = r.ts;
+        const uint64_t ts = base[core] + r.ts;
+
+        fprintf(out, "%s\n{\"name\":", first ? "" : ",");
+        first = false;
+        jsonString(out, name(r));
+        fprintf(out, ",\"cat\":");
+        jsonString(out, trace_event_name((trace_event_t)r.event));
+        fprintf(out, ",\"ph\":\"%c\",\"ts\":%" PRIu64 ",\"pid\":1,\"tid\":%d", (char)r.phase, ts, core);
+        if (r.phase == TRACE_PH_INSTANT)
+            fprintf(out, ",\"s\":\"t\"");
+        if (r.phase != TRACE_PH_BEGIN)
+            fprintf(out, ",\"args\":{\"a\":%u,\"b\":%u}", r.a, r.b);
+        fputc('}', out);
+        records++;
+    }
+
+    bool block(const uint8_t* p, size_t len)
+    {
+        if (len < 4 || p[0] != 'T' || p[1] != 'R')
+            return false;
+        if (p[2] == TRACE_BLOCK_LABEL_TYPE)
+        {
+            if (len < 8 || len != 8u + get16(p + 6))
+                return false;
+            labels[std::make_pair((int)p[3], (int)get16(p + 4))] = std::string((const char*)p + 8, get16(p + 6));
+            return true;
+        }
+        if (p[2] != TRACE_BLOCK_RECORDS_TYPE || len < 10 || p[3] >= NUM_CORES)
+            return false;
+        const size_t n = get16(p + 4);
+        if (len != 10 + n * sizeof(trace_record_t))
+            return false;
+        lost[p[3]] = get32(p + 6);
+        for (size_t i = 0; i < n; i++)
+        {
+            const uint8_t* q = p + 10 + i * sizeof(trace_record_t);
+            trace_record_t r;
+            r.ts = get32(q);
+            r.event = q[4];
+            r.phase = q[5];
+            r.a = get16(q + 6);
+            r.b = get32(q + 8);
+            event(p[3], r);
+        }
+        return true;
+    }
+
+    void line(const char* s)
+    {
+        const char* hex = strstr(s, "trace:");
+        if (!hex)
+            return;
+        hex += 6;
+        std::vector<uint8_t> data;
+        while (hexDigit(hex[0]) >= 0 && hexDigit(hex[1]) >= 0)
+        {
+            data.push_back((uint8_t)(hexDigit(hex[0]) << 4 | hexDigit(hex[1])));
+            hex += 2;
+        }
+        if (!block(data.data(), data.size()))
+            badLines++;
+    }
+};
+
+int main(int argc, char** argv)
+{
+    const char* inPath = nullptr;
+    const char* outPath = nullptr;
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-o") && i + 1 < argc)
+            outPath = argv[++i];
+        else if (!inPath && argv[i][0] != '-')
+            inPath = argv[i];
+        else
+        {
+            fprintf(stderr, "usage: %s [CAPTURE] [-o OUT.json]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    FILE* in = inPath ? fopen(inPath, "r") : stdin;
+    if (!in)
+    {
+        fprintf(stderr, "cannot read %s\n", inPath);
+        return 1;
+    }
+    FILE* out = outPath ? fopen(outPath, "w") : stdout;
+    if (!out)
+    {
+        fprintf(stderr, "cannot write %s\n", outPath);
+        return 1;
+    }
+
+    Decoder d(out);
+    fprintf(out, "{\"traceEvents\":[");
+    for (int core = 0; core < NUM_CORES; core++)
+    {
+        fprintf(out, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"core%d\"}}",
+            d.first ? "" : ",", core, core);
+        d.first = false;
+    }
+    std::string line;
+    char buf[1024];
+    while (fgets(buf, sizeof(buf), in))
+    {
+        line += buf;
+        if (line.back() != '\n' && !feof(in))
+            continue;
+        d.line(line.c_str());
+        line.clear();
+    }
+    uint32_t lost = 0;
+    for (int core = 0; core < NUM_CORES; core++)
+        lost += d.lost[core];
+    fprintf(out, "\n],\"displayTimeUnit\":\"ms\",\"otherData\":{\"lost\":%u}}\n", lost);
+
+    fprintf(stderr, "%" PRIu64 " records, %u lost on the device, %" PRIu64 " bad trace lines\n", d.records, lost,
+        d.badLines);
+    if (outPath)
+        fclose(out);
+    return d.badLines ? 2 : 0;
+}
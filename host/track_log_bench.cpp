@@ -0,0 +1,359 @@
+// The track log (track_log.h) on a simulated flash part large enough for a
+// million fixes, mapped from an image file.
+//
+// Checks random time range queries against the times kept in RAM, that the
+// records are handed out in place in flash, that the same queries answer
+// the same after a reset, that a full log drops its oldest sectors, that
+// fixes out of order are refused, that a query streams into report frames
+// which decode back, and, over many power failures cut into random flash
+// operations, that every fix whose append() returned is still there. Prints
+// the time a query takes to find its range, against scanning the log from
+// the start, and the time recover() takes. Exits non-zero if a check fails.
+//
+//   track_log_bench [--image FILE] [--records N] [--queries N] [--trials N]
+
+#include "bench_util.h"
+#include "sim_hal.h"
+
+#include "track_log.h"
+
+#include "hardware/regs/addressmap.h"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include <unistd.h>
+
+static uint32_t rng = 12345;
+static uint32_t nextRandom()
+{
+    rng = rng * 1664525 + 1013904223;
+    return rng >> 8;
+}
+
+static int failures;
+
+static void check(const char* name, bool ok)
+{
+    printf("%-50s %s\n", name, ok ? "ok" : "FAIL");
+    failures += !ok;
+}
+
+// A drive: a fix every 10 s, parked now and then for up to a day
+struct Track
+{
+    uint32_t time = 1700000000;
+    int32_t lat = 520000000, lng = 130000000;
+
+    FixRecord next()
+    {
+        time += nextRandom() % 500 == 0 ? 600 + nextRandom() % 86400 : 10;
+        lat += (int32_t)(nextRandom() % 2001) - 1000;
+        lng += (int32_t)(nextRandom() % 2001) - 1000;
+        FixRecord fix = {};
+        fix.time = time;
+        fix.latE7 = lat;
+        fix.lngE7 = lng;
+        fix.altitudeCm = 3400 + (int32_t)(time % 700);
+        fix.speedKmph100 = 5000;
+        fix.courseCdeg = (int32_t)(time % 36000);
+        fix.sats = 8;
+        fix.fields = FIX_HAS_ALT | FIX_HAS_SPEED | FIX_HAS_COURSE | FIX_HAS_SATS;
+        return fix;
+    }
+};
+
+struct Collect
+{
+    std::vector<uint32_t> times;
+    bool inFlash = true;
+};
+
+static size_t flashBytes;
+
+static bool collect(const FixRecord& fix, void* ctx)
+{
+    Collect* c = (Collect*)ctx;
+    const uint8_t* p = (const uint8_t*)&fix;
+    c->inFlash &= p >= sim_flash_xip && p + sizeof(fix) <= sim_flash_xip + flashBytes;
+    c->times.push_back(fix.time);
+    return true;
+}
+
+static std::vector<uint32_t> query(const TrackLog& log, uint32_t from, uint32_t to, bool* inFlash)
+{
+    Collect c;
+    TrackLog::Cursor cursor;
+    if (log.find(from, to, cursor))
+        while (log.read(cursor, &collect, &c, 256) > 0)
+            ;
+    *inFlash &= c.inFlash;
+    return c.times;
+}
+
+static std::vector<uint32_t> expected(const std::vector<uint32_t>& times, uint32_t from, uint32_t to)
+{
+    if (from > to)
+        return {};
+    return std::vector<uint32_t>(std::lower_bound(times.begin(), times.end(), from),
+        std::upper_bound(times.begin(), times.end(), to));
+}
+
+// A range around the track: a minute, an hour or a day, from a fix's time or
+// between fixes
+static void randomRange(const std::vector<uint32_t>& times, uint32_t* from, uint32_t* to)
+{
+    static const uint32_t spans[] = {60, 3600, 86400};
+    const uint32_t i = nextRandom() % times.size();
+    *from = times[i] - (nextRandom() % 2 ? 0 : nextRandom() % 20);
+    *to = *from + spans[nextRandom() % 3];
+}
+
+static bool addToFrame(const FixRecord& fix, void* ctx)
+{
+    return ((FixEncoder*)ctx)->add(fix);
+}
+
+static void decoded(const FixRecord& fix, void* ctx)
+{
+    ((std::vector<uint32_t>*)ctx)->push_back(fix.time);
+}
+
+int main(int argc, char** argv)
+{
+    const char* image = "track_log_bench.img";
+    uint32_t records = 1000000;
+    int queries = 1000;
+    int trials = 1000;
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        if (!strcmp(argv[i], "--image"))
+            image = argv[i + 1];
+        else if (!strcmp(argv[i], "--records"))
+            records = (uint32_t)atoi(argv[i + 1]);
+        else if (!strcmp(argv[i], "--queries"))
+            queries = atoi(argv[i + 1]);
+        else if (!strcmp(argv[i], "--trials"))
+            trials = atoi(argv[i + 1]);
+    }
+
+    // the big log with a spare sector, then small regions for the checks
+    const uint32_t bigSize = (records / TRACK_LOG_PER_SECTOR + 2) * FLASH_SECTOR_SIZE;
+    const uint32_t small = 16 * FLASH_SECTOR_SIZE;
+    flashBytes = bigSize + 2 * small;
+    unlink(image);
+    if (!sim_flash_open(image, flashBytes))
+    {
+        fprintf(stderr, "cannot map %s\n", image);
+        return 1;
+    }
+
+    TrackLog log(0, bigSize);
+    log.recover();
+    std::vector<uint32_t> times;
+    times.reserve(records);
+    Track track;
+    BenchTimer timer;
+    timer.start();
+    for (uint32_t i = 0; i < records; i++)
+    {
+        const FixRecord fix = track.next();
+        log.append(fix);
+        times.push_back(fix.time);
+    }
+    const double appendS = timer.seconds();
+    printf("%u fixes over %.0f days in %u sectors, appended in %.2f s host, %.1f s flash busy\n", records,
+        (times.back() - times.front()) / 86400.0, log.erases, appendS, sim_flash_stats().busyUs / 1e6);
+    check("every fix appended", log.appended == records && log.firstTime() == times.front()
+        && log.lastTime() == times.back());
+
+    FixRecord late = track.next();
+    late.time = times.back();
+    check("a fix not later than the last is refused", !log.append(late) && log.refused == 1);
+
+    // queries against the times in RAM
+    {
+        bool match = true, inFlash = true;
+        double findSum = 0, findMax = 0, querySum = 0;
+        std::vector<double> findUsAll;
+        size_t found = 0;
+        for (int q = 0; q < queries; q++)
+        {
+            uint32_t from, to;
+            randomRange(times, &from, &to);
+            TrackLog::Cursor cursor;
+            timer.start();
+            log.find(from, to, cursor);
+            const double findUs = timer.seconds() * 1e6;
+            findSum += findUs;
+            findMax = std::max(findMax, findUs);
+            findUsAll.push_back(findUs);
+
+            timer.start();
+            const std::vector<uint32_t> got = query(log, from, to, &inFlash);
+            querySum += timer.seconds() * 1e6;
+            match &= got == expected(times, from, to);
+            found += got.size();
+        }
+        // the edges: before the first fix, after the last, everything, an empty range
+        const uint32_t first = times.front(), last = times.back();
+        match &= query(log, 0, first - 1, &inFlash).empty();
+        match &= query(log, last + 1, UINT32_MAX, &inFlash).empty();
+        match &= query(log, last, last, &inFlash).size() == 1;
+        match &= query(log, first + 1, first, &inFlash).empty();
+        check("random ranges match the fixes in RAM", match);
+        check("records handed out in place in flash", inFlash);
+
+        Collect all;
+        TrackLog::Cursor cursor;
+        timer.start();
+        log.find(0, UINT32_MAX, cursor);
+        while (log.read(cursor, &collect, &all, 256) > 0)
+            ;
+        const double scanMs = timer.seconds() * 1e3;
+        check("a full scan returns every fix", all.times == times);
+
+        // a host preempting the bench shows in the max, not in the 99th percentile
+        std::sort(findUsAll.begin(), findUsAll.end());
+        const double findP99 = findUsAll.empty() ? 0 : findUsAll[findUsAll.size() * 99 / 100];
+        printf("find     %7.2f us mean, %7.2f us 99th percentile, %7.2f us max over %d ranges\n",
+            findSum / queries, findP99, findMax, queries);
+        printf("query    %7.2f us mean with %.0f fixes read each\n", querySum / queries,
+            (double)found / queries);
+        printf("scan     %7.2f ms for all %u fixes\n", scanMs, records);
+        // a full scan is what finding a range without the index would take
+        check("finding a range is quick", findP99 < 1000 && findSum / queries * 100 < scanMs * 1000);
+    }
+
+    // after a reset
+    {
+        TrackLog again(0, bigSize);
+        timer.start();
+        again.recover();
+        const double recoverUs = timer.seconds() * 1e6;
+        bool match = again.firstTime() == times.front() && again.lastTime() == times.back(), inFlash = true;
+        for (int q = 0; q < queries / 10; q++)
+        {
+            uint32_t from, to;
+            randomRange(times, &from, &to);
+            match &= query(again, from, to, &inFlash) == expected(times, from, to);
+        }
+        check("the same answers after a reset", match);
+        printf("recover  %7.1f us host for %u sectors\n", recoverUs, bigSize / FLASH_SECTOR_SIZE);
+
+        // carries on after the last fix
+        const FixRecord fix = track.next();
+        times.push_back(fix.time);
+        check("and appends after it", again.append(fix) && again.lastTime() == fix.time);
+    }
+
+    // a query streamed into report frames
+    {
+        uint32_t from, to;
+        randomRange(times, &from, &to);
+        to = from + 86400 * 3;
+        std::vector<uint32_t> frameTimes;
+        FixDecoder decoder(&decoded, &frameTimes);
+        uint8_t buf[FIX_FRAME_OVERHEAD + 512];
+        FixEncoder enc(buf, sizeof(buf));
+        TrackLog::Cursor cursor;
+        TrackLog reader(0, bigSize);
+        reader.recover();
+        reader.find(from, to, cursor);
+        size_t frames = 0;
+        while (!cursor.done)
+        {
+            enc.begin();
+            reader.read(cursor, &addToFrame, &enc, SIZE_MAX);
+            const size_t len = enc.finish();
+            decoder.push(enc.data(), len);
+            frames += len > 0;
+        }
+        check("a range streams into frames that decode", frameTimes == expected(times, from, to)
+            && decoder.badFrames == 0 && frames > 1);
+    }
+
+    // full: the oldest sectors go
+    {
+        const uint32_t at = bigSize;
+        TrackLog full(at, small);
+        full.recover();
+        std::vector<uint32_t> kept;
+        Track t;
+        while (full.erases < 3 * 16)
+        {
+            const FixRecord fix = t.next();
+            full.append(fix);
+            kept.push_back(fix.time);
+        }
+        bool inFlash = true;
+        const std::vector<uint32_t> got = query(full, 0, UINT32_MAX, &inFlash);
+        check("a full log drops its oldest sectors", got.size() >= 15 * TRACK_LOG_PER_SECTOR
+            && got.size() < 16 * TRACK_LOG_PER_SECTOR && std::equal(got.begin(), got.end(), kept.end() - got.size())
+            && full.firstTime() == got.front());
+    }
+
+    // power failures in random flash operations
+    {
+        const uint32_t at = bigSize + small;
+        TrackLog* t = new TrackLog(at, small);
+        t->recover();
+        std::vector<uint32_t> model;
+        Track track;
+        int bad = 0, kept = 0;
+        uint32_t erases = 0;
+        for (int n = 0; n < trials && bad < 5; n++)
+        {
+            sim_flash_power_fail_after(nextRandom() % 40);
+            uint32_t maybe = 0;
+            while (sim_flash_powered())
+            {
+                const FixRecord fix = track.next();
+                t->append(fix);
+                if (sim_flash_powered())
+                    model.push_back(fix.time);
+                else
+                    maybe = fix.time;
+            }
+            sim_flash_power_on();
+            const uint32_t erased = t->erases;
+            erases += erased;
+            delete t;
+            t = new TrackLog(at, small);
+            t->recover();
+
+            bool inFlash = true;
+            std::vector<uint32_t> got = query(*t, 0, UINT32_MAX, &inFlash);
+            const bool extra = !got.empty() && got.back() == maybe;
+            if (extra)
+            {
+                got.pop_back();
+                model.push_back(maybe);
+            }
+            // the newest fixes, all of them unless a sector was erased for room
+            const bool ok = got.size() + extra <= model.size() && !got.empty()
+                && std::equal(got.begin(), got.end(), model.end() - got.size() - extra)
+                && (got.size() + extra == model.size() || erased > 0);
+            if (!ok)
+            {
+                if (bad++ == 0)
+                    printf("trial %d: %zu fixes appended, %zu found\n", n, model.size(), got.size());
+                continue;
+            }
+            kept += extra;
+            if (extra)
+                got.push_back(maybe);
+            model = got;
+        }
+        erases += t->erases;
+        delete t;
+        printf("%d power failures in an append, %d of the fixes kept, %u sector erases\n", trials, kept, erases);
+        check("appended fixes survive power failures", bad == 0 && erases > 2 * 16);
+    }
+
+    sim_flash_close();
+    unlink(image);
+    printf("%s\n", failures ? "FAIL" : "all checks pass");
+    return failures ? 1 : 0;
+}
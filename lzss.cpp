@@ -0,0 +1,153 @@
+#include "lzss.h"
+
+#include <cstring>
+
+#define LZSS_MATCH_BITS (1 + LZSS_WINDOW_BITS + LZSS_LENGTH_BITS)
+
+void LzssEncoder::reset()
+{
+    pos = end = 0;
+    bits = 0;
+    bitCount = 0;
+    finishing = false;
+}
+
+size_t LzssEncoder::sink(const uint8_t *data, size_t len)
+{
+    if (finishing)
+        return 0;
+    // drop what fell out of the window behind the next byte
+    if (end + len > sizeof(buf) && pos > LZSS_WINDOW)
+    {
+        const size_t shift = pos - LZSS_WINDOW;
+        memmove(buf, buf + shift, end - shift);
+        pos -= shift;
+        end -= shift;
+    }
+    if (len > sizeof(buf) - end)
+        len = sizeof(buf) - end;
+    memcpy(buf + end, data, len);
+    end += len;
+    return len;
+}
+
+size_t LzssEncoder::poll(uint8_t *out, size_t size)
+{
+    size_t n = 0;
+    for (;;)
+    {
+        while (bitCount >= 8 && n < size)
+        {
+            bitCount -= 8;
+            out[n++] = (uint8_t)(bits >> bitCount);
+        }
+        if (bitCount >= 8)
+            break;
+        if (pos == end || (!finishing && end - pos < LZSS_MAX_MATCH))
+        {
+            if (finishing && pos == end && bitCount && n < size)
+            {
+                out[n++] = (uint8_t)(bits << (8 - bitCount));
+                bitCount = 0;
+            }
+            break;
+        }
+        token();
+    }
+    return n;
+}
+
+// Encodes the byte at pos, alone or as the start of the longest match
+void LzssEncoder::token()
+{
+    const size_t avail = end - pos;
+    const size_t maxLen = avail < LZSS_MAX_MATCH ? avail : LZSS_MAX_MATCH;
+    const size_t first = pos > LZSS_WINDOW ? pos - LZSS_WINDOW : 0;
+    const uint8_t *p = buf + pos;
+    size_t bestLen = 0, bestOffset = 0;
+    for (size_t cand = pos; cand-- > first;)
+    {
+        const uint8_t *c = buf + cand;
+        if (c[0] != p[0] || c[bestLen] != p[bestLen])
+            continue;
+        size_t len = 1;
+        while (len < maxLen && c[len] == p[len])
+            len++;
+        if (len > bestLen)
+        {
+            bestLen = len;
+            bestOffset = pos - cand;
+            if (len == maxLen)
+                break;
+        }
+    }
+    if (bestLen >= LZSS_MIN_MATCH)
+    {
+        bits = bits << LZSS_MATCH_BITS | (uint32_t)(bestOffset - 1) << LZSS_LENGTH_BITS
+            | (uint32_t)(bestLen - LZSS_MIN_MATCH);
+        bitCount += LZSS_MATCH_BITS;
+        pos += bestLen;
+    }
+    else
+    {
+        bits = bits << 9 | 0x100 | p[0];
+        bitCount += 9;
+        pos++;
+    }
+}
+
+void LzssDecoder::reset()
+{
+    head = 0;
+    bits = 0;
+    bitCount = 0;
+}
+
+void LzssDecoder::push(const uint8_t *data, size_t len)
+{
+    uint8_t out[64];
+    size_t n = 0;
+    for (size_t i = 0; i < len; i++)
+    {
+        bits = bits << 8 | data[i];
+        bitCount += 8;
+        for (;;)
+        {
+            if (bitCount < 9)
+                break;
+            size_t count, offset;
+            if (bits >> (bitCount - 1) & 1)
+            {
+                bitCount -= 9;
+                count = 1;
+                offset = 0;
+                window[head] = (uint8_t)(bits >> bitCount);
+            }
+            else
+            {
+                if (bitCount < LZSS_MATCH_BITS)
+                    break;
+                bitCount -= LZSS_MATCH_BITS;
+                const uint32_t token = bits >> bitCount;
+                offset = (token >> LZSS_LENGTH_BITS & (LZSS_WINDOW - 1)) + 1;
+                count = (token & ((1 << LZSS_LENGTH_BITS) - 1)) + LZSS_MIN_MATCH;
+            }
+            bits &= (1u << bitCount) - 1;
+            // byte by byte, a match may overlap what it produces
+            while (count--)
+            {
+                const uint8_t c = window[(head - offset) & (LZSS_WINDOW - 1)];
+                window[head] = c;
+                head = (head + 1) & (LZSS_WINDOW - 1);
+                out[n++] = c;
+                if (n == sizeof(out))
+                {
+                    fn(out, n, ctx);
+                    n = 0;
+                }
+            }
+        }
+    }
+    if (n)
+        fn(out, n, ctx);
+}
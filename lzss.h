@@ -0,0 +1,82 @@
+#ifndef __lzss_H__
+#define __lzss_H__
+
+#include <cinttypes>
+#include <cstddef>
+
+// LZSS with a sliding window, in the manner of heatshrink: a bit stream,
+// most significant bit first, of
+//
+//   1, 8 bit literal
+//   0, offset - 1 (LZSS_WINDOW_BITS), length - LZSS_MIN_MATCH (LZSS_LENGTH_BITS)
+//
+// padded with zero bits to a whole byte, which are too few to be a token.
+// The encoder keeps the window and as much input again in
+// 2 << LZSS_WINDOW_BITS bytes and nothing else: matches are searched
+// without an index, nearest first, so the cost per byte grows with the
+// window. Nothing is allocated.
+#ifndef LZSS_WINDOW_BITS
+#define LZSS_WINDOW_BITS 8
+#endif
+#ifndef LZSS_LENGTH_BITS
+#define LZSS_LENGTH_BITS 4
+#endif
+
+#define LZSS_WINDOW     (1 << LZSS_WINDOW_BITS)
+// a match costs 1 + LZSS_WINDOW_BITS + LZSS_LENGTH_BITS bits, two
+// literals 18
+#define LZSS_MIN_MATCH  2
+#define LZSS_MAX_MATCH  (LZSS_MIN_MATCH + (1 << LZSS_LENGTH_BITS) - 1)
+
+static_assert(LZSS_WINDOW_BITS >= 6 && LZSS_WINDOW_BITS <= 10, "window of 64 to 1024 bytes");
+static_assert(LZSS_LENGTH_BITS >= 2 && LZSS_LENGTH_BITS <= 6, "matches of up to 5 to 65 bytes");
+
+// Streaming encoder. Work happens in poll(), as much as the output room
+// allows, so it can be spread over several calls.
+class LzssEncoder {
+public:
+    LzssEncoder() { reset(); }
+
+    // Starts a new stream
+    void reset();
+    // Takes as much of data as there is room for, returns the bytes taken
+    size_t sink(const uint8_t *data, size_t len);
+    // No more input; poll() then encodes the rest and pads the last byte
+    void finish() { finishing = true; }
+    // Writes compressed bytes to out, returns how many. Without finish()
+    // it keeps the last LZSS_MAX_MATCH input bytes back for a match.
+    size_t poll(uint8_t *out, size_t size);
+    // finish() was called and everything is out
+    bool done() const { return finishing && pos == end && bitCount == 0; }
+
+private:
+    void token();
+
+    uint8_t buf[2 * LZSS_WINDOW];
+    size_t pos, end;        // next byte to encode, end of the input
+    uint32_t bits;          // pending output bits, the low bitCount of them
+    uint8_t bitCount;
+    bool finishing;
+};
+
+// Streaming decoder, the window in a ring. Hands the decoded bytes to fn
+// in pieces as they come.
+typedef void (*lzss_output_fn)(const uint8_t *data, size_t len, void *ctx);
+
+class LzssDecoder {
+public:
+    LzssDecoder(lzss_output_fn fn, void *ctx) : fn(fn), ctx(ctx) { reset(); }
+
+    void reset();
+    void push(const uint8_t *data, size_t len);
+
+private:
+    lzss_output_fn fn;
+    void *ctx;
+    uint8_t window[LZSS_WINDOW];
+    size_t head;
+    uint32_t bits;
+    uint8_t bitCount;
+};
+
+#endif
@@ -1,9 +1,11 @@
 #include <cstdio>
+#include <cstring>
 #include <string>
 
 #include "pico/stdlib.h"
 #include "pico/stdlib.h"
 #include "pico/sleep.h"
+#include "pico/multicore.h"
 
 #include "hardware/rtc.h"
 #include "hardware/pll.h"
@@ -19,67 +21,129 @@
 
 #include "ssd1306_i2c.h"
 #include "mpu6050_i2c.h"
+#include "fix_codec.h"
+#include "flash_queue.h"
+#include "gprs_session.h"
+#include "mqtt_client.h"
 #include "neo6m.h"
+#include "report_policy.h"
 #include "sim800l.h"
 #include "sleep_control.h"
+#include "spsc_ring.h"
+#include "task_scheduler.h"
+#include "time_sync.h"
+#include "timing.h"
+#include "trace.h"
+#include "track_log.h"
+#include "uart_dma_rx.h"
 
 #define LED_PIN 29
 
-struct circ_bbuf_t {
-    const static int maxlen = 240;
-    char buffer[maxlen];
-    int head;
-    int tail;
-};
-int circ_bbuf_push(circ_bbuf_t *c, char data)
-{
-    int next;
-
-    next = c->head + 1;  // next is where head will point to after this write.
-    if (next >= c->maxlen)
-        next = 0;
-
-    if (next == c->tail)  // if the head + 1 == tail, circular buffer is full
-        return -1;
-
-    c->buffer[c->head] = data;  // Load data and then move
-    c->head = next;             // head to next data offset.
-    return 0;  // return success to indicate successful push.
-}
-int circ_bbuf_pop(circ_bbuf_t *c, char *data)
-{
-    int next;
-
-    if (c->head == c->tail)  // if the head == tail, we don't have any data
-        return -1;
-
-    next = c->tail + 1;  // next is where tail will point to after this read.
-    if(next >= c->maxlen)
-        next = 0;
-
-    *data = c->buffer[c->tail];  // Read data and then move
-    c->tail = next;              // tail to next offset.
-    return 0;  // return success to indicate successful push.
-}
-
-circ_bbuf_t circ_buff_gps;
+#define GPS_DMA_RX_SIZE_BITS     12
+#define SIM800L_DMA_RX_SIZE_BITS 12
+
+// Run GPS decoding and IMU sampling on core1 (main_loop_dual)
+#ifndef TRACKER_DUAL_CORE
+#define TRACKER_DUAL_CORE 0
+#endif
+
+#define CORE1_POLL_MS        10
+#define CORE1_IMU_PERIOD_MS  100
+#define MODEM_INFO_PERIOD_MS 10000
+// AT engine polling; lines received through the interrupt also signal the
+// modem task at once
+#define MODEM_POLL_MS        50
+// while a command is still going out (a character takes 1 ms at 9600 baud)
+#define MODEM_TX_POLL_US     2000
+
+// main_loop_tasks() rates
+#define GPS_TASK_PERIOD_MS     100
+#define IMU_TASK_PERIOD_MS     100
+#define DISPLAY_TASK_PERIOD_MS 500
+#define LED_TASK_PERIOD_MS     500
+#define PARK_TASK_PERIOD_MS    1000
+#define CONSOLE_TASK_PERIOD_MS 200
+// how often a GPS fix is compared with the RTC
+#define TIME_SYNC_PERIOD_MS    60000
+
+// main_loop_sleep() RTC wake interval
+#define SLEEP_LOOP_MS 3000
+
+// Without motion for this long main_loop_tasks() parks: GPS in backup mode,
+// modem in slow clock mode and the chip dormant until the MPU6050 motion
+// interrupt. 0 never parks.
+#ifndef PARK_AFTER_MS
+#define PARK_AFTER_MS 60000
+#endif
+
+#if UART_RX_DMA
+UART_DMA_RX_BUFFER(gps_dma_buffer, GPS_DMA_RX_SIZE_BITS);
+uart_dma_rx_t gps_dma_rx;
+#else
+SpscRing<char, 256> gps_rx;
+#endif
 uint32_t chrs_gps = 0;
+sched_task_t gps_task;
 // RX interrupt handler
 void on_gps_rx() {
+    TRACE_BEGIN(TRACE_GPS_RX_IRQ, 0);
+    TIMING_BEGIN(t0);
     chrs_gps++;
+#if UART_RX_DMA
+    uart_dma_rx_irq(&gps_dma_rx);
+#else
     while (uart_is_readable(GPS_UART_ID)) {
         char c = uart_getc(GPS_UART_ID);
-        circ_bbuf_push(&circ_buff_gps, c);
+        gps_rx.push(c);
+        // a whole sentence is in, no need to wait for the next period
+        if (c == '\n')
+            sched_signal(&gps_task);
     }
+#endif
+    TIMING_END(TIMING_GPS_RX_IRQ, t0);
+    TRACE_END(TRACE_GPS_RX_IRQ, 0, 0);
+}
+
+// Received GPS data not parsed yet, readable in place up to the buffer end
+size_t gps_rx_peek(const char **data)
+{
+#if UART_RX_DMA
+    return uart_dma_rx_peek(&gps_dma_rx, (const uint8_t **)data);
+#else
+    return gps_rx.peek(data);
+#endif
+}
+
+void gps_rx_skip(size_t len)
+{
+#if UART_RX_DMA
+    uart_dma_rx_skip(&gps_dma_rx, len);
+#else
+    gps_rx.skip(len);
+#endif
 }
 
 SIM800L sim800l;
+sched_task_t modem_task;
+#if UART_RX_DMA
+UART_DMA_RX_BUFFER(sim800_dma_buffer, SIM800L_DMA_RX_SIZE_BITS);
+uart_dma_rx_t sim800_dma_rx;
+#endif
 
 void on_sim800_rx() {
+    TRACE_BEGIN(TRACE_SIM800_RX_IRQ, 0);
+    TIMING_BEGIN(t0);
+#if UART_RX_DMA
+    uart_dma_rx_irq(&sim800_dma_rx);
+#else
     while (uart_is_readable(SIM800L_UART_ID)) {
         char c = uart_getc(SIM800L_UART_ID);
-        sim800l.processChar(c);
+        if (sim800l.processChar(c))
+            sched_signal(&modem_task);
     }
+#endif
+    TIMING_END(TIMING_SIM800_RX_IRQ, t0);
+    TRACE_END(TRACE_SIM800_RX_IRQ, 0, 0);
 }
 
 void uart_init(uart_inst_t* uart_id, uint32_t uart_tx_pin, uint32_t uart_rx_pin, uint32_t baud_rate, uint32_t data_bits, uint32_t stop_bits, uart_parity_t parity, void(*irq_handler)(void))
@@ -130,6 +194,12 @@ void init() {
 
     uart_init(GPS_UART_ID, GPS_UART_TX_PIN, GPS_UART_RX_PIN, GPS_BAUD_RATE, GPS_DATA_BITS, GPS_STOP_BITS, GPS_PARITY, &on_gps_rx);
     uart_init(SIM800L_UART_ID, SIM800L_UART_TX_PIN, SIM800L_UART_RX_PIN, SIM800L_BAUD_RATE, SIM800L_DATA_BITS, SIM800L_STOP_BITS, SIM800L_PARITY, &on_sim800_rx);
+#if UART_RX_DMA
+    // Re-enables the FIFOs and takes over from the per-character interrupt
+    uart_dma_rx_init(&gps_dma_rx, GPS_UART_ID, gps_dma_buffer, GPS_DMA_RX_SIZE_BITS, UART_DMA_RX_TRANSFERS);
+    uart_dma_rx_init(&sim800_dma_rx, SIM800L_UART_ID, sim800_dma_buffer, SIM800L_DMA_RX_SIZE_BITS, UART_DMA_RX_TRANSFERS);
+    sim800l.attachDmaRx(&sim800_dma_rx);
+#endif
 
     SSD1306_Init();
     //mpu6050_init();
@@ -144,7 +214,17 @@ void main_loop_all()
     " far far away");
 
     GPSPlus gps;
-    char c;
+#if GPS_USE_UBX
+    GPSUbx ubx(gps);
+    GPSUbx::configureUbxOnly(GPS_UART_ID, GPS_BAUD_RATE);
+#else
+    gps.skipUnusedSentences(true);
+#if GPS_DISABLE_UNUSED_NMEA
+    GPSPlus::disableUnusedSentences(GPS_UART_ID);
+#endif
+#endif
+    const char *gpsData;
+    size_t gpsLen;
     uint16_t ledCntr = 0;
 
     float acceleration[3], gyro[3], temp;
@@ -157,9 +237,15 @@ void main_loop_all()
     int32_t sats = -1;
 
     while (true) {
-        while(0 == circ_bbuf_pop(&circ_buff_gps, &c))
+        while((gpsLen = gps_rx_peek(&gpsData)) > 0)
         {
-            if (gps.encode(c))
+#if GPS_USE_UBX
+            size_t committed = ubx.encode((const uint8_t *)gpsData, gpsLen);
+#else
+            size_t committed = gps.encode(gpsData, gpsLen);
+#endif
+            gps_rx_skip(gpsLen);
+            if (committed)
             {
                 if (gps.location.isValid())
                 {
@@ -216,7 +302,7 @@ void main_loop_sleep()
     bool pinState = false;
     while (true)
     {
-        rpi_sleep(&sleep_callback);
+        rpi_sleep_for(SLEEP_LOOP_MS, &sleep_callback);
 
         pinState = !pinState;
         gpio_put(LED_PIN, pinState);
@@ -225,7 +311,12 @@ void main_loop_sleep()
 
 void main_loop_sim800()
 {
-    sim800l.init();
+    sim800l.begin();
+    while (sim800l.state == SIM_STATE::INVALID && sim800l.busy())
+    {
+        sim800l.poll();
+        sleep_ms(MODEM_POLL_MS);
+    }
 
     std::string s = sim800l.state == SIM_STATE::INVALID ? "invalid" : (
         sim800l.state == SIM_STATE::READY ? "ready" : (
@@ -237,11 +328,12 @@ void main_loop_sim800()
         //return;
     }
 
-    //sim800l.info();
+    //sim800l.requestInfo();
 
     bool pinState = false;
     while (true)
     {
+        sim800l.poll();
         /*
         std::string resp = sim800l.processResponse(cc);
         if (!resp.empty())
@@ -256,14 +348,601 @@ void main_loop_sim800()
     }
 }
 
+// Consolidated GPS and IMU state, handed from core1 to core0 in dual core
+// mode and shared by the tasks in main_loop_tasks().
+struct FixSnapshot {
+    uint32_t seq;
+    uint32_t publishedUs;   // time_us_32() of the last update
+    bool locValid, dateValid, timeValid, imuValid;
+    int32_t latE7, lngE7;
+    int32_t altitudeCm;
+    int32_t speedKmph100;
+    int32_t courseCdeg;
+    uint32_t date;          // ddmmyy
+    uint32_t time;          // hhmmsscc
+    int32_t sats;
+    uint32_t fixes;         // location updates
+    float accel[3], gyro[3], temp;
+};
+
+// Statics rather than locals, the core1 stack is only 2 kB
+GPSPlus fix_gps;
+#if GPS_USE_UBX
+GPSUbx fix_ubx(fix_gps);
+#endif
+
+static void gps_setup()
+{
+#if GPS_USE_UBX
+    GPSUbx::configureUbxOnly(GPS_UART_ID, GPS_BAUD_RATE);
+#else
+    fix_gps.skipUnusedSentences(true);
+#if GPS_DISABLE_UNUSED_NMEA
+    GPSPlus::disableUnusedSentences(GPS_UART_ID);
+#endif
+#endif
+}
+
+static void snapshot_gps(GPSPlus &gps, FixSnapshot &snap)
+{
+    if (gps.location.isUpdated())
+        snap.fixes++;
+    if (gps.location.isValid())
+    {
+        snap.locValid = true;
+        snap.latE7 = gps.location.latE7();
+        snap.lngE7 = gps.location.lngE7();
+    }
+    if (gps.altitude.isValid())
+        snap.altitudeCm = gps.altitude.centimeters();
+    if (gps.speed.isValid())
+        snap.speedKmph100 = gps.speed.kmph100();
+    if (gps.course.isValid())
+        snap.courseCdeg = gps.course.value();
+    if (gps.date.isValid())
+    {
+        snap.dateValid = true;
+        snap.date = gps.date.value();
+    }
+    if (gps.time.isValid())
+    {
+        snap.timeValid = true;
+        snap.time = gps.time.value();
+    }
+    if (gps.satellites.isValid())
+        snap.sats = gps.satellites.value();
+}
+
+// Decodes what the GPS sent so far, returns true if a sentence was committed
+static bool gps_poll(FixSnapshot &snap)
+{
+    const char *gpsData;
+    size_t gpsLen;
+    bool changed = false;
+    while((gpsLen = gps_rx_peek(&gpsData)) > 0)
+    {
+        TRACE_BEGIN(TRACE_GPS_DECODE, 0);
+        TIMING_BEGIN(t0);
+#if GPS_USE_UBX
+        size_t committed = fix_ubx.encode((const uint8_t *)gpsData, gpsLen);
+#else
+        size_t committed = fix_gps.encode(gpsData, gpsLen);
+#endif
+        TIMING_END_N(TIMING_GPS_SENTENCE, t0, committed);
+        TRACE_END(TRACE_GPS_DECODE, (uint16_t)committed, gpsLen);
+        gps_rx_skip(gpsLen);
+        if (committed)
+        {
+            snapshot_gps(fix_gps, snap);
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+// The snapshot as a fix record, false without a position, date and time
+static bool snapshot_record(const FixSnapshot &snap, FixRecord &fix)
+{
+    if (!snap.locValid || !snap.dateValid || !snap.timeValid)
+        return false;
+    datetime_t utc;
+    utc.year = (int16_t)(2000 + snap.date % 100);
+    utc.month = (int8_t)(snap.date / 100 % 100);
+    utc.day = (int8_t)(snap.date / 10000);
+    utc.hour = (int8_t)(snap.time / 1000000);
+    utc.min = (int8_t)(snap.time / 10000 % 100);
+    utc.sec = (int8_t)(snap.time / 100 % 100);
+    fix.time = (uint32_t)rpi_datetime_to_seconds(&utc);
+    fix.latE7 = snap.latE7;
+    fix.lngE7 = snap.lngE7;
+    fix.altitudeCm = snap.altitudeCm;
+    fix.speedKmph100 = snap.speedKmph100;
+    fix.courseCdeg = snap.courseCdeg;
+    fix.sats = (uint8_t)(snap.sats > 0 ? snap.sats : 0);
+    fix.fields = FIX_HAS_ALT | FIX_HAS_SPEED | FIX_HAS_COURSE | (snap.sats >= 0 ? FIX_HAS_SATS : 0);
+    return true;
+}
+
+// USB stdio console: 't' prints the timing report, 'r' clears it, 'd'
+// dumps the event trace
+static void console_poll()
+{
+#if TRACKER_TIMING || TRACKER_TRACE
+    int c;
+    while ((c = getchar_timeout_us(0)) != PICO_ERROR_TIMEOUT)
+    {
+#if TRACKER_TIMING
+        if (c == 't')
+            timing_print();
+        else if (c == 'r')
+            timing_reset();
+#endif
+#if TRACKER_TRACE
+        if (c == 'd')
+            trace_flush(&trace_text_sink, nullptr);
+#endif
+    }
+#endif
+}
+
+static void show_fix(const FixSnapshot &fix)
+{
+    char text[240];
+    const uint32_t ageMs = fix.seq ? (time_us_32() - fix.publishedUs) / 1000 : 0;
+    sprintf(text, "l %5.2f %5.2f %d\nd %06lu %d\nt %08lu %d\nS %d age %lu",
+    fix.latE7 / 1e7, fix.lngE7 / 1e7, fix.locValid, (unsigned long)fix.date, fix.dateValid,
+    (unsigned long)fix.time, fix.timeValid, (int)fix.sats, (unsigned long)ageMs);
+    showString(text);
+}
+
+// Dual core mode: core1 owns the GPS receive path and the IMU and publishes
+// a snapshot after every committed sentence or IMU sample. core0 keeps the
+// display and the modem, which can no longer hold up GPS decoding.
+
+// core1 -> core0 without locks; core0 only uses the newest snapshot
+SpscRing<FixSnapshot, 8> fix_snapshots;
+
+uint32_t core1_published = 0;
+uint32_t core1_dropped = 0;
+uint32_t core1_max_poll_gap_us = 0;
+
+void core1_main()
+{
+    gps_setup();
+    mpu6050_init();
+
+    FixSnapshot snap = {};
+    snap.sats = -1;
+    absolute_time_t nextImu = get_absolute_time();
+    uint32_t lastPoll = time_us_32();
+
+    while (true) {
+        const uint32_t pollAt = time_us_32();
+        if (pollAt - lastPoll > core1_max_poll_gap_us)
+            core1_max_poll_gap_us = pollAt - lastPoll;
+        lastPoll = pollAt;
+
+        bool changed = gps_poll(snap);
+
+        if (time_reached(nextImu))
+        {
+            mpu6050_read_raw(snap.accel, snap.gyro, &snap.temp);
+            snap.imuValid = true;
+            nextImu = delayed_by_ms(nextImu, CORE1_IMU_PERIOD_MS);
+            changed = true;
+        }
+
+        if (changed)
+        {
+            snap.seq++;
+            snap.publishedUs = time_us_32();
+            // full while core0 sits in a display update, it catches up after
+            if (fix_snapshots.push(snap))
+                core1_published++;
+            else
+                core1_dropped++;
+        }
+        sleep_ms(CORE1_POLL_MS);
+    }
+}
+
+void main_loop_dual()
+{
+    multicore_launch_core1(core1_main);
+
+    sim800l.begin();
+
+    FixSnapshot fix = {};
+    fix.sats = -1;
+    absolute_time_t nextInfo = make_timeout_time_ms(MODEM_INFO_PERIOD_MS);
+    uint16_t ledCntr = 0;
+
+    while (true) {
+        while (fix_snapshots.pop(fix))
+            ;
+        show_fix(fix);
+
+        if (time_reached(nextInfo) && sim800l.state == SIM_STATE::READY)
+        {
+            sim800l.requestInfo();
+            nextInfo = make_timeout_time_ms(MODEM_INFO_PERIOD_MS);
+        }
+        sim800l.poll();
+        console_poll();
+
+        ledCntr++;
+        if (ledCntr == 5)
+        {
+            gpio_put(LED_PIN, 1);
+            ledCntr = 0;
+        }
+        sleep_ms(200);
+        gpio_put(LED_PIN, 0);
+    }
+}
+
+// Single core, scheduler driven: GPS, IMU, display, LED and modem each run
+// at their own rate and the core sleeps in between. The modem task only
+// queues AT commands and polls the engine, it never waits for an answer.
+FixSnapshot task_fix;
+sched_task_t imu_task, display_task, led_task, park_task, console_task, report_task;
+
+// power management
+volatile uint32_t last_motion_us = 0;
+uint32_t park_count = 0;
+uint64_t park_wake_us = 0;
+uint32_t park_fixes_at_wake = 0;
+bool park_awaiting_fix = false;
+bool park_awaiting_report = false;
+uint32_t wake_to_fix_ms = 0;
+uint32_t wake_to_fix_max_ms = 0;
+uint32_t wake_to_report_ms = 0;
+uint32_t wake_to_report_max_ms = 0;
+
+// RTC on UTC from GPS, or from the network until there is a fix
+TimeSync time_sync;
+uint64_t time_checked_us = 0;
+
+static void time_sync_report(const char *from)
+{
+    printf("rtc set from %s, step %ld s\n", from, (long)time_sync.lastStepS);
+}
+
+static void on_gpio_irq(uint gpio, uint32_t)
+{
+    if (gpio == MPU_INT_PIN)
+        last_motion_us = time_us_32();
+}
+
+// Track history in flash (see track_log.h): the location, date and time the
+// receiver committed, every TRACK_LOG_PERIOD_S while there is a fix
+TrackLog track_log;
+static uint32_t track_log_fixes = 0;
+
+static void log_track()
+{
+    FixRecord fix;
+    if (task_fix.fixes == track_log_fixes || !snapshot_record(task_fix, fix))
+        return;
+    track_log_fixes = task_fix.fixes;
+    if (track_log.empty() || fix.time >= track_log.lastTime() + TRACK_LOG_PERIOD_S)
+        track_log.append(fix);
+}
+
+static void gps_task_run(void *)
+{
+    if (gps_poll(task_fix))
+    {
+        task_fix.seq++;
+        task_fix.publishedUs = time_us_32();
+        log_track();
+    }
+    if (park_awaiting_fix && task_fix.locValid && task_fix.fixes != park_fixes_at_wake)
+    {
+        park_awaiting_fix = false;
+        wake_to_fix_ms = (uint32_t)((time_us_64() - park_wake_us) / 1000);
+        if (wake_to_fix_ms > wake_to_fix_max_ms)
+            wake_to_fix_max_ms = wake_to_fix_ms;
+        printf("wake to first fix %lu ms\n", (unsigned long)wake_to_fix_ms);
+        // report it now rather than a report period after the wake
+        sched_signal(&report_task);
+    }
+    // only with a current fix, the receiver's time before one can be off
+    const bool timeDue = time_sync.source != TIME_SOURCE::GPS
+        || time_us_64() - time_checked_us >= TIME_SYNC_PERIOD_MS * 1000ull;
+    if (timeDue && fix_gps.location.age() < TIME_SYNC_MAX_GPS_AGE_MS)
+    {
+        time_checked_us = time_us_64();
+        if (time_sync.fromGps(fix_gps.date, fix_gps.time))
+            time_sync_report("gps");
+    }
+}
+
+static void imu_task_run(void *)
+{
+    mpu6050_read_raw(task_fix.accel, task_fix.gyro, &task_fix.temp);
+    task_fix.imuValid = true;
+}
+
+static void display_task_run(void *)
+{
+    show_fix(task_fix);
+}
+
+static void led_task_run(void *)
+{
+    static bool pinState = false;
+    pinState = !pinState;
+    gpio_put(LED_PIN, pinState);
+}
+
+static void on_network_time(const datetime_t &local, int zoneQuarters, void *)
+{
+    if (time_sync.fromNetwork(local, zoneQuarters))
+        time_sync_report("network");
+}
+
+// Position reports are taken every report period into a binary frame (see
+// fix_codec.h), the period set by the battery tier. The frame is stored in
+// the flash queue (see flash_queue.h) once it holds POLICY_BATCH fixes, once
+// its oldest has waited POLICY_MAX_WAIT_MS, or when the signal comes back.
+// Stored frames are forwarded oldest first, one QoS 1 PUBLISH each on the
+// MQTT session that stays open between uploads, while the signal is good.
+// They leave the flash once the broker has acknowledged everything
+// forwarded, so neither a network outage nor a reset loses them.
+#define REPORT_TOPIC        "trackers/" MQTT_CLIENT_ID "/fix"
+// A query, "from to" in unix seconds, is answered from the track log with
+// frames like the reports', streamed out of flash as the outbox has room
+#define TRACK_QUERY_TOPIC   "trackers/" MQTT_CLIENT_ID "/query"
+#define TRACK_TOPIC         "trackers/" MQTT_CLIENT_ID "/track"
+#define REPORT_FRAME_BYTES  960
+
+ReportPolicy report_policy;
+GprsSession uplink(sim800l);
+MqttClient mqtt(uplink);
+FlashQueue report_queue;
+uint32_t reports_taken = 0;
+uint64_t report_bytes = 0;
+
+static uint8_t report_frame_buffer[REPORT_FRAME_BYTES];
+static FixEncoder report_frame(report_frame_buffer, sizeof(report_frame_buffer));
+static uint32_t report_frame_ms = 0;
+static uint8_t track_frame_buffer[REPORT_FRAME_BYTES];
+static FixEncoder track_frame(track_frame_buffer, sizeof(track_frame_buffer));
+static TrackLog::Cursor track_query = {0, 0, 0, true};
+uint32_t track_queries = 0;
+uint32_t track_sent = 0;
+
+// Moves the frame into the flash queue
+static void store_reports()
+{
+    const size_t len = report_frame.finish();
+    if (len == 0)
+        return;
+    report_queue.append(report_frame.data(), len);
+    report_bytes += len;
+    report_frame.begin();
+}
+
+static bool publish_stored(const uint8_t *data, size_t len, void *)
+{
+    return mqtt.publish(REPORT_TOPIC, data, len, 1);
+}
+
+// Fills the MQTT outbox from the flash queue, straight out of flash
+static void forward_reports()
+{
+    report_queue.read(&publish_stored, nullptr, MQTT_OUTBOX);
+}
+
+// Starts answering a query, in place of one going on
+static void start_track_query(const uint8_t *payload, size_t len)
+{
+    char text[24];
+    len = len < sizeof(text) - 1 ? len : sizeof(text) - 1;
+    memcpy(text, payload, len);
+    text[len] = '\0';
+    unsigned long from, to;
+    if (sscanf(text, "%lu %lu", &from, &to) != 2)
+        return;
+    track_log.find((uint32_t)from, (uint32_t)to, track_query);
+    track_queries++;
+    printf("track query %lu to %lu\n", from, to);
+}
+
+static bool add_track(const FixRecord &fix, void *)
+{
+    return track_frame.add(fix);
+}
+
+// Publishes the next frame of the query's answer, the fixes taken straight
+// from flash
+static bool send_track()
+{
+    if (track_query.done || mqtt.queued() >= MQTT_OUTBOX)
+        return false;
+    track_frame.begin();
+    track_log.read(track_query, &add_track, nullptr, SIZE_MAX);
+    const size_t len = track_frame.finish();
+    if (len == 0)
+        return false;
+    track_sent += track_frame.count();
+    return mqtt.publish(TRACK_TOPIC, track_frame.data(), len, 1);
+}
+
+static void on_mqtt_message(const char *topic, size_t topicLen, const uint8_t *payload, size_t len, void *)
+{
+    if (topicLen == sizeof(TRACK_QUERY_TOPIC) - 1 && !memcmp(topic, TRACK_QUERY_TOPIC, topicLen))
+        start_track_query(payload, len);
+    else
+        printf("mqtt: %.*s, %u bytes\n", (int)topicLen, topic, (unsigned)len);
+}
+
+static void apply_battery_tier()
+{
+    GPSPlus::setMeasurementRate(GPS_UART_ID, report_policy.gpsPeriodMs());
+    sched_set_period(&report_task, report_policy.reportPeriodMs());
+    printf("battery %s: gps every %lu ms, report every %lu ms\n", ReportPolicy::tierName(report_policy.tier()),
+        (unsigned long)report_policy.gpsPeriodMs(), (unsigned long)report_policy.reportPeriodMs());
+}
+
+static void report_task_run(void *)
+{
+    FixRecord fix;
+    if (!snapshot_record(task_fix, fix))
+        return;
+    if (!report_frame.add(fix))
+    {
+        store_reports();
+        report_frame.add(fix);
+    }
+    if (report_frame.count() == 1)
+        report_frame_ms = to_ms_since_boot(get_absolute_time());
+    reports_taken++;
+    // the first report with a fix from after the park, not one from before it
+    if (park_awaiting_report && task_fix.fixes != park_fixes_at_wake)
+    {
+        park_awaiting_report = false;
+        wake_to_report_ms = (uint32_t)((time_us_64() - park_wake_us) / 1000);
+        if (wake_to_report_ms > wake_to_report_max_ms)
+            wake_to_report_max_ms = wake_to_report_ms;
+        printf("wake to first report %lu ms\n", (unsigned long)wake_to_report_ms);
+    }
+    // kept through an outage and a reset from here on
+    if (report_frame.count() >= POLICY_BATCH)
+        store_reports();
+}
+
+static void modem_task_run(void *)
+{
+    static bool started = false;
+    static absolute_time_t nextInfo;
+    if (!started)
+    {
+        sim800l.begin();
+        nextInfo = get_absolute_time();
+        started = true;
+    }
+    else if (sim800l.state == SIM_STATE::READY && !sim800l.busy() && time_reached(nextInfo))
+    {
+        sim800l.requestInfo();
+        if (!time_sync.synced())
+            sim800l.requestNetworkTime(&on_network_time, nullptr);
+        nextInfo = make_timeout_time_ms(MODEM_INFO_PERIOD_MS);
+    }
+    sim800l.poll();
+
+    const uint32_t now = to_ms_since_boot(get_absolute_time());
+    if (report_policy.update(sim800l, now))
+        apply_battery_tier();
+    // the frame in RAM is closed once it holds a batch or has waited long enough
+    if (report_policy.uploadCount(report_frame.count(), report_frame_ms, now))
+        store_reports();
+    // stored frames go up, or again after a reconnect, while the signal holds
+    if (report_policy.sendStored(!report_queue.drained() || mqtt.queued() > 0))
+    {
+        forward_reports();
+        mqtt.flush();
+    }
+    uplink.poll();
+    mqtt.poll();
+    if (send_track())
+        mqtt.flush();
+    // everything forwarded is acknowledged
+    if (mqtt.queued() == 0)
+        report_queue.commit();
+    // the session may have queued a command
+    sim800l.poll();
+    if (sim800l.transmitting())
+        sched_wake_at(&modem_task, make_timeout_time_us(MODEM_TX_POLL_US));
+}
+
+static void console_task_run(void *)
+{
+    console_poll();
+}
+
+static void park()
+{
+    GPSPlus::powerDown(GPS_UART_ID);
+    sim800l.sleep();
+    gpio_put(LED_PIN, 0);
+    mpu6050_motion_int_clear();
+    // what the receiver sent before going down is stale by the wake up
+    const char *gpsData;
+    size_t gpsLen;
+    while ((gpsLen = gps_rx_peek(&gpsData)) > 0)
+        gps_rx_skip(gpsLen);
+
+    TRACE_BEGIN(TRACE_PARK, 0);
+    rpi_dormant_until_pin(MPU_INT_PIN, true, false);
+    TRACE_END(TRACE_PARK, 0, 0);
+
+    sched_rebase();
+    // the RTC stood still while dormant
+    time_sync.invalidate();
+    park_count++;
+    park_wake_us = time_us_64();
+    last_motion_us = time_us_32();
+    // the receiver's hot start takes longest, get it going first
+    GPSPlus::wakeUp(GPS_UART_ID);
+    sim800l.wake();
+    park_fixes_at_wake = task_fix.fixes;
+    park_awaiting_fix = true;
+    park_awaiting_report = true;
+}
+
+static void park_task_run(void *)
+{
+    if (time_us_32() - last_motion_us >= PARK_AFTER_MS * 1000u)
+        park();
+}
+
+void main_loop_tasks()
+{
+    gps_setup();
+    mpu6050_init();
+    task_fix.sats = -1;
+
+    // motion interrupt, also the dormant wake up source
+    gpio_init(MPU_INT_PIN);
+    gpio_set_dir(MPU_INT_PIN, GPIO_IN);
+    gpio_pull_up(MPU_INT_PIN);
+    gpio_set_irq_enabled_with_callback(MPU_INT_PIN, GPIO_IRQ_EDGE_FALL, true, &on_gpio_irq);
+    last_motion_us = time_us_32();
+
+    // what a reset or an outage left unsent, and the track so far
+    report_queue.recover();
+    track_log.recover();
+
+    sched_init();
+    sched_add(&gps_task, "gps", &gps_task_run, nullptr, GPS_TASK_PERIOD_MS, GPS_TASK_PERIOD_MS);
+    sched_add(&imu_task, "imu", &imu_task_run, nullptr, IMU_TASK_PERIOD_MS, IMU_TASK_PERIOD_MS);
+    sched_add(&display_task, "display", &display_task_run, nullptr, DISPLAY_TASK_PERIOD_MS, DISPLAY_TASK_PERIOD_MS);
+    sched_add(&led_task, "led", &led_task_run, nullptr, LED_TASK_PERIOD_MS, 0);
+    sched_add(&modem_task, "modem", &modem_task_run, nullptr, MODEM_POLL_MS, 0);
+    mqtt.onMessage(&on_mqtt_message, nullptr);
+    mqtt.subscribe(TRACK_QUERY_TOPIC, 1);
+    sched_add(&report_task, "report", &report_task_run, nullptr, report_policy.reportPeriodMs(), 0);
+    if (PARK_AFTER_MS)
+        sched_add(&park_task, "park", &park_task_run, nullptr, PARK_TASK_PERIOD_MS, 0);
+#if TRACKER_TIMING || TRACKER_TRACE
+    sched_add(&console_task, "console", &console_task_run, nullptr, CONSOLE_TASK_PERIOD_MS, 0);
+#endif
+
+    sched_run();
+}
+
 int main() {
 
     init();
     gpio_put(LED_PIN, 0);
 
-    //main_loop_sleep();
-    //main_loop_all();
-    main_loop_sim800();
+#if TRACKER_DUAL_CORE
+    main_loop_dual();
+#else
+    main_loop_tasks();
+#endif
 
     return 0;
 }
@@ -11,6 +11,8 @@
 #include "hardware/i2c.h"
 
 #include "mpu6050_i2c.h"
+#include "timing.h"
+#include "trace.h"
 
 /* Example code to talk to a MPU6050 MEMS accelerometer and gyroscope
 
@@ -26,8 +28,12 @@
 
    Connections on Raspberry Pi Pico board, other boards may vary.
 
-   GPIO PICO_DEFAULT_I2C_SDA_PIN (On Pico this is GP4 (pin 6)) -> SDA on MPU6050 board
-   GPIO PICO_DEFAULT_I2C_SCL_PIN (On Pico this is GP5 (pin 7)) -> SCL on MPU6050 board
+   GPIO i2c_MPU_SDA (GP4 (pin 6)) -> SDA on MPU6050 board
+   GPIO i2c_MPU_SCL (GP5 (pin 7)) -> SCL on MPU6050 board
+   GPIO MPU_INT_PIN (GP3 (pin 5)) -> INT on MPU6050 board
+
+   GP4/GP5 are also UART1's default pins: the SIM800L is on GP8/GP9 instead
+   (sim800l.h).
    3.3v (pin 36) -> VCC on MPU6050 board
    GND (pin 38)  -> GND on MPU6050 board
 */
@@ -99,7 +105,7 @@ static void mpu6050_reset_motion_detection() {
     i2c_write_blocking(i2c_MPU, addr, buf, 2, false);
     //write register 0x38, bit 6 (0x40), to enable motion detection interrupt.
     buf[0] = MPU_INT_ENABLE;
-    buf[1] = 0x40;
+    buf[1] = MPU_MOT_INT;
     i2c_write_blocking(i2c_MPU, addr, buf, 2, false);
     // 101000 - Cycle & disable TEMP SENSOR
     buf[0] = MPU_PWR_MGMT;
@@ -116,6 +122,8 @@ void mpu6050_read_raw(float accel[3], float gyro[3], float *temp) {
     // first, then subsequently read from the device. The register is auto incrementing
     // so we don't need to keep sending the register we want, just the first.
 
+    TRACE_BEGIN(TRACE_MPU6050_READ, 0);
+    TIMING_BEGIN(t0);
     uint8_t buffer[6];
 
     // Start reading acceleration registers from register 0x3B for 6 bytes
@@ -147,6 +155,16 @@ void mpu6050_read_raw(float accel[3], float gyro[3], float *temp) {
 
     int16_t t = buffer[0] << 8 | buffer[1];
     *temp = (t/ 340.0) + 36.53;
+    TIMING_END(TIMING_MPU6050_READ, t0);
+    TRACE_END(TRACE_MPU6050_READ, 0, 0);
+}
+
+bool mpu6050_motion_int_clear() {
+    uint8_t val = MPU_INT_STATUS;
+    uint8_t status = 0;
+    i2c_write_blocking(i2c_MPU, addr, &val, 1, true);
+    i2c_read_blocking(i2c_MPU, addr, &status, 1, false);
+    return status & MPU_MOT_INT;
 }
 
 void mpu6050_init() {
@@ -1,9 +1,18 @@
 #ifndef __mpu6050_i2c_H__
 #define __mpu6050_i2c_H__
 
+#include <stdbool.h>
+
+// I2C0 on GPIO 4/5; the SIM800L's UART1 is on GPIO 8/9 (sim800l.h), the
+// display's I2C1 on GPIO 6/7 (ssd1306_i2c.h)
 #define i2c_MPU_SDA 4
 #define i2c_MPU_SCL 5
 
+// GPIO wired to the INT pin, active low after mpu6050_init()
+#ifndef MPU_INT_PIN
+#define MPU_INT_PIN 3
+#endif
+
 #define MPU_PWR_MGMT_1_ADDR 0x6B
 
 #define MPU_DLPF_CFG_ADDR 0x1A
@@ -23,6 +32,7 @@
 #define MPU_INT_ENABLE         0x38
 #define MPU_PWR_MGMT           0x6B //SLEEPY TIME
 #define MPU_INT_STATUS 0x3A
+#define MPU_MOT_INT    0x40  // INT_STATUS / INT_ENABLE motion bit
 
 #ifdef __cplusplus
 extern "C"{
@@ -30,6 +40,8 @@ extern "C"{
 
     void mpu6050_init();
     void mpu6050_read_raw(float accel[3], float gyro[3], float* temp);
+    // Reads INT_STATUS, returns whether motion was detected since the last call
+    bool mpu6050_motion_int_clear();
 
 #ifdef __cplusplus
 }
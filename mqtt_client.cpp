@@ -0,0 +1,454 @@
+#include "mqtt_client.h"
+
+#include <cstring>
+
+// control packet types, in the high nibble of the first byte
+#define MQTT_CONNECT     0x10
+#define MQTT_CONNACK     0x20
+#define MQTT_PUBLISH     0x30
+#define MQTT_PUBACK      0x40
+#define MQTT_SUBSCRIBE   0x82   // with the reserved flags 0010
+#define MQTT_SUBACK      0x90
+#define MQTT_PINGREQ     0xC0
+#define MQTT_PINGRESP    0xD0
+#define MQTT_PUBLISH_DUP 0x08
+
+static uint32_t now_ms()
+{
+    return to_ms_since_boot(get_absolute_time());
+}
+
+// Remaining length, 7 bits a byte; returns the bytes used
+static size_t putLength(uint8_t *p, uint32_t len)
+{
+    size_t n = 0;
+    do
+    {
+        uint8_t b = len & 0x7F;
+        len >>= 7;
+        p[n++] = len ? b | 0x80 : b;
+    } while (len);
+    return n;
+}
+
+static size_t lengthSize(uint32_t len)
+{
+    return len < 128 ? 1 : len < 16384 ? 2 : len < 2097152 ? 3 : 4;
+}
+
+static uint8_t *putString(uint8_t *p, const char *s, size_t len)
+{
+    *p++ = (uint8_t)(len >> 8);
+    *p++ = (uint8_t)len;
+    memcpy(p, s, len);
+    return p + len;
+}
+
+MqttClient::MqttClient(GprsSession &transport)
+  : transport(transport)
+{
+    transport.setHandler(&onTransport, this);
+}
+
+bool MqttClient::publish(const char *topic, const uint8_t *payload, size_t len, uint8_t qos)
+{
+    const size_t topicLen = strlen(topic);
+    const uint32_t remaining = (uint32_t)(2 + topicLen + (qos ? 2 : 0) + len);
+    if (count == MQTT_OUTBOX || qos > 1 || 1 + lengthSize(remaining) + remaining > MQTT_PACKET_MAX)
+    {
+        rejected++;
+        return false;
+    }
+    Message &m = outbox[(head + count) % MQTT_OUTBOX];
+    m.state = MSG_STATE::QUEUED;
+    m.qos = qos;
+    m.id = 0;
+    uint8_t *p = m.packet;
+    *p++ = MQTT_PUBLISH | qos << 1;
+    p += putLength(p, remaining);
+    p = putString(p, topic, topicLen);
+    if (qos)
+    {
+        m.id = takeId();
+        *p++ = (uint8_t)(m.id >> 8);
+        *p++ = (uint8_t)m.id;
+    }
+    memcpy(p, payload, len);
+    m.len = (uint16_t)(p + len - m.packet);
+    count++;
+    return true;
+}
+
+bool MqttClient::subscribe(const char *topic, uint8_t qos)
+{
+    if (subscriptionCount == MQTT_SUBSCRIPTIONS || qos > 1 || strlen(topic) > MQTT_TOPIC_MAX)
+        return false;
+    subscriptions[subscriptionCount++] = {topic, qos, SUB_STATE::PENDING, 0};
+    sendOutbox();
+    return true;
+}
+
+void MqttClient::flush()
+{
+    if (st == MQTT_STATE::CONNECTED)
+        sendOutbox();
+    transport.flush();
+}
+
+void MqttClient::poll()
+{
+    const uint32_t now = now_ms();
+    if (st == MQTT_STATE::CONNECTING && now - connectMs >= MQTT_CONNACK_TIMEOUT_MS)
+    {
+        st = MQTT_STATE::DISCONNECTED;
+        transport.close();
+    }
+    if (st != MQTT_STATE::CONNECTED)
+        return;
+    if (pingOutstanding && now - pingMs >= MQTT_PING_TIMEOUT_MS)
+    {
+        // the connection is dead, or the broker is
+        pingTimeouts++;
+        st = MQTT_STATE::DISCONNECTED;
+        transport.close();
+        return;
+    }
+    if (!pingOutstanding && now - lastTxMs >= MQTT_KEEPALIVE_S * 1000u)
+    {
+        static const uint8_t pingreq[2] = {MQTT_PINGREQ, 0};
+        if (write(pingreq, sizeof(pingreq)))
+        {
+            pings++;
+            pingOutstanding = true;
+            pingMs = now;
+            transport.flush();
+        }
+    }
+    // the transport may have room again
+    sendOutbox();
+}
+
+void MqttClient::onTransport(GPRS_EVENT event, const uint8_t *data, size_t len, void *ctx)
+{
+    MqttClient *self = (MqttClient *)ctx;
+    switch (event)
+    {
+    case GPRS_EVENT::CONNECTED:
+        self->connected();
+        break;
+    case GPRS_EVENT::CLOSED:
+        self->closed();
+        break;
+    case GPRS_EVENT::DATA:
+        self->receive(data, len);
+        break;
+    }
+}
+
+void MqttClient::connected()
+{
+    // anything left over from the last connection is written again below
+    transport.clear();
+    rxInBody = false;
+    rxLenBytes = 0;
+    rxHeader = 0;
+
+    const size_t idLen = strlen(MQTT_CLIENT_ID);
+    const size_t userLen = strlen(MQTT_USER), passwordLen = strlen(MQTT_PASSWORD);
+    uint8_t flags = 0;  // clean session 0: a persistent session
+    uint32_t remaining = 10 + 2 + (uint32_t)idLen;
+    if (userLen)
+    {
+        flags |= 0x80;
+        remaining += 2 + (uint32_t)userLen;
+    }
+    if (passwordLen)
+    {
+        flags |= 0x40;
+        remaining += 2 + (uint32_t)passwordLen;
+    }
+    uint8_t packet[1 + 4 + 10 + 3 * 66];
+    if (5 + remaining > sizeof(packet))
+        return;
+    uint8_t *p = packet;
+    *p++ = MQTT_CONNECT;
+    p += putLength(p, remaining);
+    p = putString(p, "MQTT", 4);
+    *p++ = 4;   // protocol level 3.1.1
+    *p++ = flags;
+    *p++ = (uint8_t)(MQTT_KEEPALIVE_S >> 8);
+    *p++ = (uint8_t)MQTT_KEEPALIVE_S;
+    p = putString(p, MQTT_CLIENT_ID, idLen);
+    if (userLen)
+        p = putString(p, MQTT_USER, userLen);
+    if (passwordLen)
+        p = putString(p, MQTT_PASSWORD, passwordLen);
+    write(packet, (size_t)(p - packet));
+
+    // the unacknowledged publishes go again once the broker accepts
+    for (size_t i = 0; i < count; i++)
+    {
+        Message &m = outbox[(head + i) % MQTT_OUTBOX];
+        if (m.state == MSG_STATE::SENT)
+        {
+            m.state = MSG_STATE::QUEUED;
+            m.packet[0] |= MQTT_PUBLISH_DUP;
+            retransmits++;
+        }
+    }
+    unacked = 0;
+    // a SUBSCRIBE cut off with the connection is sent again
+    for (size_t i = 0; i < subscriptionCount; i++)
+        if (subscriptions[i].state == SUB_STATE::SENT)
+            subscriptions[i].state = SUB_STATE::PENDING;
+    pingOutstanding = false;
+    st = MQTT_STATE::CONNECTING;
+    connectMs = now_ms();
+    transport.flush();
+}
+
+void MqttClient::closed()
+{
+    st = MQTT_STATE::DISCONNECTED;
+    pingOutstanding = false;
+}
+
+void MqttClient::receive(const uint8_t *data, size_t len)
+{
+    for (size_t i = 0; i < len; i++)
+    {
+        const uint8_t b = data[i];
+        if (!rxInBody)
+        {
+            if (rxHeader == 0)
+            {
+                rxHeader = b;
+                rxLen = 0;
+                rxLenBytes = 0;
+                continue;
+            }
+            rxLen |= (uint32_t)(b & 0x7F) << (7 * rxLenBytes++);
+            if ((b & 0x80) && rxLenBytes < 4)
+                continue;
+            rxInBody = true;
+            rxPos = 0;
+            if (rxLen)
+                continue;
+        }
+        else
+        {
+            if (rxPos < MQTT_RX_MAX)
+                rx[rxPos] = b;
+            if (++rxPos < rxLen)
+                continue;
+        }
+        if (rxLen <= MQTT_RX_MAX)
+            handle(rxHeader, rx, rxLen);
+        else
+            skipped++;
+        rxHeader = 0;
+        rxInBody = false;
+    }
+}
+
+void MqttClient::handle(uint8_t header, const uint8_t *body, size_t len)
+{
+    switch (header & 0xF0)
+    {
+    case MQTT_CONNACK:
+        if (len < 2 || st != MQTT_STATE::CONNECTING)
+            break;
+        if (body[1] != 0)
+        {
+            // refused: protocol, identifier, credentials or authorisation
+            refused++;
+            st = MQTT_STATE::DISCONNECTED;
+            transport.close();
+            break;
+        }
+        connects++;
+        if (body[0] & 0x01)
+            sessionsResumed++;
+        else
+        {
+            // a new session has no subscriptions
+            for (size_t i = 0; i < subscriptionCount; i++)
+                subscriptions[i].state = SUB_STATE::PENDING;
+        }
+        st = MQTT_STATE::CONNECTED;
+        sendOutbox();
+        break;
+
+    case MQTT_PUBACK:
+    {
+        if (len < 2)
+            break;
+        const uint16_t id = (uint16_t)(body[0] << 8 | body[1]);
+        for (size_t i = 0; i < count; i++)
+        {
+            Message &m = outbox[(head + i) % MQTT_OUTBOX];
+            if (m.state == MSG_STATE::SENT && m.id == id)
+            {
+                m.state = MSG_STATE::DONE;
+                unacked--;
+                published++;
+                break;
+            }
+        }
+        trim();
+        sendOutbox();
+        break;
+    }
+
+    case MQTT_SUBACK:
+    {
+        if (len < 3)
+            break;
+        const uint16_t id = (uint16_t)(body[0] << 8 | body[1]);
+        for (size_t i = 0; i < subscriptionCount; i++)
+        {
+            Subscription &s = subscriptions[i];
+            if (s.state == SUB_STATE::SENT && s.id == id)
+            {
+                s.state = body[2] == 0x80 ? SUB_STATE::REFUSED : SUB_STATE::GRANTED;
+                subscribeRefusals += s.state == SUB_STATE::REFUSED;
+                break;
+            }
+        }
+        break;
+    }
+
+    case MQTT_PINGRESP:
+        pingOutstanding = false;
+        break;
+
+    case MQTT_PUBLISH:
+    {
+        const uint8_t qos = (header >> 1) & 0x03;
+        if (len < 2)
+            break;
+        const size_t topicLen = (size_t)(body[0] << 8 | body[1]);
+        const size_t idLen = qos ? 2 : 0;
+        if (2 + topicLen + idLen > len)
+            break;
+        received++;
+        if (messageFn)
+            messageFn((const char *)body + 2, topicLen, body + 2 + topicLen + idLen, len - 2 - topicLen - idLen,
+                      messageCtx);
+        // QoS 2 is never subscribed to
+        if (qos == 1)
+        {
+            const uint8_t puback[4] = {MQTT_PUBACK, 2, body[2 + topicLen], body[3 + topicLen]};
+            write(puback, sizeof(puback));
+            transport.flush();
+        }
+        break;
+    }
+
+    default:
+        break;
+    }
+}
+
+// In order, as far as the in-flight window and the transport queue allow
+void MqttClient::sendOutbox()
+{
+    if (st != MQTT_STATE::CONNECTED)
+        return;
+    // the subscriptions first, the answers to them may be waiting
+    bool wrote = sendSubscriptions();
+    for (size_t i = 0; i < count; i++)
+    {
+        Message &m = outbox[(head + i) % MQTT_OUTBOX];
+        if (m.state != MSG_STATE::QUEUED)
+            continue;
+        if (m.qos && unacked == MQTT_INFLIGHT)
+            break;
+        if (!write(m.packet, m.len))
+            break;
+        wrote = true;
+        if (m.qos)
+        {
+            m.state = MSG_STATE::SENT;
+            if (++unacked > maxInFlight)
+                maxInFlight = (uint32_t)unacked;
+        }
+        else
+        {
+            m.state = MSG_STATE::DONE;
+            published++;
+        }
+    }
+    trim();
+    if (wrote)
+        transport.flush();
+}
+
+// One SUBSCRIBE per pending filter, as far as the transport queue allows
+bool MqttClient::sendSubscriptions()
+{
+    bool wrote = false;
+    for (size_t i = 0; i < subscriptionCount; i++)
+    {
+        Subscription &s = subscriptions[i];
+        if (s.state != SUB_STATE::PENDING)
+            continue;
+        const size_t topicLen = strlen(s.topic);
+        const uint32_t remaining = (uint32_t)(2 + 2 + topicLen + 1);
+        uint8_t packet[1 + 1 + 2 + 2 + MQTT_TOPIC_MAX + 1];
+        const uint16_t id = takeId();
+        uint8_t *p = packet;
+        *p++ = MQTT_SUBSCRIBE;
+        p += putLength(p, remaining);
+        *p++ = (uint8_t)(id >> 8);
+        *p++ = (uint8_t)id;
+        p = putString(p, s.topic, topicLen);
+        *p++ = s.qos;
+        if (!write(packet, (size_t)(p - packet)))
+            break;
+        s.state = SUB_STATE::SENT;
+        s.id = id;
+        subscribes++;
+        wrote = true;
+    }
+    return wrote;
+}
+
+// Packet ids for PUBLISH and SUBSCRIBE, never 0
+uint16_t MqttClient::takeId()
+{
+    const uint16_t id = nextId;
+    nextId = nextId == UINT16_MAX ? 1 : nextId + 1;
+    return id;
+}
+
+// Frees the slots at the head that are done
+void MqttClient::trim()
+{
+    while (count && outbox[head].state == MSG_STATE::DONE)
+    {
+        head = (head + 1) % MQTT_OUTBOX;
+        count--;
+    }
+}
+
+bool MqttClient::write(const uint8_t *data, size_t len)
+{
+    if (!transport.queue(data, len))
+        return false;
+    lastTxMs = now_ms();
+    return true;
+}
+
+const char *MqttClient::stateName(MQTT_STATE s)
+{
+    switch (s)
+    {
+    case MQTT_STATE::CONNECTING:
+        return "connecting";
+    case MQTT_STATE::CONNECTED:
+        return "connected";
+    default:
+        return "disconnected";
+    }
+}
@@ -0,0 +1,160 @@
+#ifndef __mqtt_client_H__
+#define __mqtt_client_H__
+
+#include "gprs_session.h"
+#include "secrets.h"
+
+#include <cinttypes>
+#include <cstddef>
+
+// Normally from secrets.h, no user name and password if empty
+#ifndef MQTT_CLIENT_ID
+#define MQTT_CLIENT_ID "tracker-0001"
+#endif
+#ifndef MQTT_USER
+#define MQTT_USER ""
+#endif
+#ifndef MQTT_PASSWORD
+#define MQTT_PASSWORD ""
+#endif
+
+// Carrier NATs forget an idle TCP connection after a few minutes (often 5,
+// some less). A PINGREQ goes out when nothing else was sent for the
+// keep-alive, which keeps the mapping and the session alive.
+#define MQTT_KEEPALIVE_S        180
+#define MQTT_PING_TIMEOUT_MS    30000
+#define MQTT_CONNACK_TIMEOUT_MS 30000
+
+// Publishes kept until handed to the transport (QoS 0) or acknowledged
+// (QoS 1), each a complete PUBLISH that goes out in one AT+CIPSEND
+#define MQTT_OUTBOX      8
+#define MQTT_PACKET_MAX  GPRS_SEND_MAX
+// QoS 1 publishes on the wire without a PUBACK
+#define MQTT_INFLIGHT    4
+// Incoming packets up to this size, larger ones are skipped
+#define MQTT_RX_MAX      256
+// Topic filters subscribed to, and their longest
+#define MQTT_SUBSCRIPTIONS 2
+#define MQTT_TOPIC_MAX     64
+
+enum class MQTT_STATE {
+    DISCONNECTED,
+    CONNECTING,     // CONNECT sent, waiting for the CONNACK
+    CONNECTED
+};
+
+// An incoming PUBLISH, from a subscription of this or an earlier session
+typedef void (*mqtt_message_fn)(const char *topic, size_t topicLen, const uint8_t *payload, size_t len, void *ctx);
+
+// MQTT 3.1.1 client on a GprsSession, static buffers only. The session is
+// persistent (clean session 0): the broker keeps the subscriptions and the
+// QoS 1 messages across connections, and the client sends its unacknowledged
+// publishes again with DUP after a reconnect. Subscriptions are sent after a
+// CONNACK without a session present, so once unless the broker loses it. Publishes wait in the outbox
+// until flush(); whatever is ready then goes out together, several PUBLISH
+// packets to an AT+CIPSEND.
+class MqttClient {
+public:
+    explicit MqttClient(GprsSession &transport);
+
+    // Encodes a PUBLISH (QoS 0 or 1) into the outbox; false if it is full
+    // or the packet would be longer than MQTT_PACKET_MAX
+    bool publish(const char *topic, const uint8_t *payload, size_t len, uint8_t qos);
+    // Subscribes to a topic filter (kept, not copied) at QoS 0 or 1; false
+    // if the table is full or the filter longer than MQTT_TOPIC_MAX
+    bool subscribe(const char *topic, uint8_t qos);
+    // Connects if needed and sends the outbox
+    void flush();
+    // After the transport's poll()
+    void poll();
+    void onMessage(mqtt_message_fn fn, void *ctx) { messageFn = fn; messageCtx = ctx; }
+
+    MQTT_STATE state() const { return st; }
+    // publishes in the outbox, and of them sent and not acknowledged
+    size_t queued() const { return count; }
+    size_t inFlight() const { return unacked; }
+
+    static const char *stateName(MQTT_STATE s);
+
+    // statistics
+    uint32_t connects = 0;          // accepted CONNACKs
+    uint32_t sessionsResumed = 0;   // ... with the session present
+    uint32_t refused = 0;           // CONNACKs with an error code
+    uint32_t published = 0;         // QoS 0 handed over, QoS 1 acknowledged
+    uint32_t retransmits = 0;       // QoS 1 sent again after a reconnect
+    uint32_t pings = 0;
+    uint32_t pingTimeouts = 0;
+    uint32_t rejected = 0;          // publish() refused
+    uint32_t received = 0;          // incoming PUBLISH
+    uint32_t subscribes = 0;        // SUBSCRIBE packets sent
+    uint32_t subscribeRefusals = 0; // SUBACKs with the failure code
+    uint32_t skipped = 0;           // incoming packets over MQTT_RX_MAX
+    uint32_t maxInFlight = 0;
+
+private:
+    enum class MSG_STATE : uint8_t {
+        QUEUED,
+        SENT,       // QoS 1 waiting for the PUBACK
+        DONE
+    };
+
+    enum class SUB_STATE : uint8_t {
+        PENDING,    // to be sent after the next CONNACK
+        SENT,       // waiting for the SUBACK
+        GRANTED,
+        REFUSED     // not asked again in this session
+    };
+
+    struct Subscription {
+        const char *topic;
+        uint8_t qos;
+        SUB_STATE state;
+        uint16_t id;
+    };
+
+    struct Message {
+        MSG_STATE state;
+        uint8_t qos;
+        uint16_t id;
+        uint16_t len;
+        uint8_t packet[MQTT_PACKET_MAX];
+    };
+
+    static void onTransport(GPRS_EVENT event, const uint8_t *data, size_t len, void *ctx);
+    void connected();
+    void closed();
+    void receive(const uint8_t *data, size_t len);
+    void handle(uint8_t header, const uint8_t *body, size_t len);
+    void sendOutbox();
+    bool sendSubscriptions();
+    uint16_t takeId();
+    void trim();
+    bool write(const uint8_t *data, size_t len);
+
+    GprsSession &transport;
+    MQTT_STATE st = MQTT_STATE::DISCONNECTED;
+    mqtt_message_fn messageFn = nullptr;
+    void *messageCtx = nullptr;
+
+    Subscription subscriptions[MQTT_SUBSCRIPTIONS];
+    size_t subscriptionCount = 0;
+
+    Message outbox[MQTT_OUTBOX];
+    size_t head = 0, count = 0;
+    size_t unacked = 0;
+    uint16_t nextId = 1;
+
+    uint32_t lastTxMs = 0;
+    uint32_t connectMs = 0;
+    uint32_t pingMs = 0;
+    bool pingOutstanding = false;
+
+    // receive side: fixed header, remaining length, body
+    uint8_t rx[MQTT_RX_MAX];
+    uint8_t rxHeader = 0;
+    uint32_t rxLen = 0, rxPos = 0;
+    uint8_t rxLenBytes = 0;
+    bool rxInBody = false;
+};
+
+#endif
@@ -2,9 +2,6 @@
 
 #include <cmath>
 
-#define _RMCterm "RMC"
-#define _GGAterm "GGA"
-
 #define PI 3.1415926f
 #define TWO_PI 2*PI
 
@@ -22,20 +19,83 @@ GPSPlus::GPSPlus()
   ,  curTermNumber(0)
   ,  curTermOffset(0)
   ,  sentenceHasFix(false)
-  ,  customElts(0)
-  ,  customCandidates(0)
+  ,  skipUnused(false)
+  ,  skippingSentence(false)
+  ,  customCount(0)
   ,  encodedCharCount(0)
   ,  sentencesWithFixCount(0)
   ,  failedChecksumCount(0)
   ,  passedChecksumCount(0)
+  ,  skippedSentenceCount(0)
 {
   term[0] = '\0';
+  memset(customTerms, 0, sizeof(customTerms));
 }
 
 bool GPSPlus::encode(char c)
 {
     encodedCharCount++;
 
+    if (skippingSentence && c != '$')
+        return false;
+
+    if (isDelimiter(c))
+        return encodeDelimiter(c);
+
+    // ordinary characters
+    if (curTermOffset < sizeof(term) - 1)
+    term[curTermOffset++] = c;
+    if (!isChecksumTerm)
+    parity ^= c;
+    return false;
+}
+
+size_t GPSPlus::encode(const char *data, size_t len)
+{
+    size_t committed = 0;
+    const char *p = data;
+    const char *end = data + len;
+    encodedCharCount += len;
+
+    while (p != end)
+    {
+        // Nobody wants the rest of this sentence, jump to the next one
+        if (skippingSentence)
+        {
+            p = (const char *)memchr(p, '$', end - p);
+            if (p == NULL)
+                break;
+        }
+
+        // Scan the run of ordinary characters up to the next delimiter,
+        // folding the parity over it and copying what fits into term[].
+        const char *run = p;
+        uint8_t runParity = 0;
+        while (p != end && !isDelimiter(*p))
+            runParity ^= (uint8_t)*p++;
+
+        if (p != run)
+        {
+            if (curTermOffset < sizeof(term) - 1)
+            {
+                size_t n = p - run;
+                if (n > sizeof(term) - 1 - curTermOffset)
+                    n = sizeof(term) - 1 - curTermOffset;
+                memcpy(term + curTermOffset, run, n);
+                curTermOffset += n;
+            }
+            if (!isChecksumTerm)
+                parity ^= runParity;
+        }
+
+        if (p != end && encodeDelimiter(*p++))
+            ++committed;
+    }
+    return committed;
+}
+
+bool GPSPlus::encodeDelimiter(char c)
+{
     switch(c)
     {
     case ',': // term terminators
@@ -53,10 +113,8 @@ bool GPSPlus::encode(char c)
         ++curTermNumber;
         curTermOffset = 0;
         isChecksumTerm = c == '*';
-        encodedCharCount = 0;
         return isValidSentence;
         }
-        break;
 
     case '$': // sentence begin
         curTermNumber = curTermOffset = 0;
@@ -64,13 +122,7 @@ bool GPSPlus::encode(char c)
         curSentenceType = GPS_SENTENCE_OTHER;
         isChecksumTerm = false;
         sentenceHasFix = false;
-        return false;
-
-    default: // ordinary characters
-        if (curTermOffset < sizeof(term) - 1)
-        term[curTermOffset++] = c;
-        if (!isChecksumTerm)
-        parity ^= c;
+        skippingSentence = false;
         return false;
     }
 
@@ -129,7 +181,125 @@ void GPSPlus::parseDegrees(const char *term, RawDegrees &deg)
   deg.negative = false;
 }
 
-#define COMBINE(sentence_type, term_number) (((unsigned)(sentence_type) << 5) | term_number)
+// Sentence dispatch. The first term is hashed into sentenceSlots to find the
+// sentence id, and every later term looks up its built-in field in
+// termFields[id][term]. Both tables are generated at compile time from
+// _GPS_SENTENCES and termEntries below.
+enum
+{
+  FIELD_NONE, FIELD_TIME, FIELD_RMC_STATUS, FIELD_LAT, FIELD_NS, FIELD_LNG, FIELD_EW,
+  FIELD_SPEED, FIELD_COURSE, FIELD_DATE, FIELD_FIX_QUALITY, FIELD_SATELLITES, FIELD_HDOP,
+  FIELD_ALTITUDE, FIELD_FIX_MODE, FIELD_GSA_FIX_TYPE, FIELD_PDOP, FIELD_VDOP,
+  FIELD_VTG_COURSE, FIELD_VTG_SPEED, FIELD_VTG_MODE, FIELD_ZDA_DAY, FIELD_ZDA_MONTH, FIELD_ZDA_YEAR
+};
+
+struct TermEntry
+{
+  uint8_t sentence, term, field;
+};
+
+static constexpr TermEntry termEntries[] =
+{
+  {GPS_SENTENCE_RMC, 1, FIELD_TIME},
+  {GPS_SENTENCE_RMC, 2, FIELD_RMC_STATUS},
+  {GPS_SENTENCE_RMC, 3, FIELD_LAT},
+  {GPS_SENTENCE_RMC, 4, FIELD_NS},
+  {GPS_SENTENCE_RMC, 5, FIELD_LNG},
+  {GPS_SENTENCE_RMC, 6, FIELD_EW},
+  {GPS_SENTENCE_RMC, 7, FIELD_SPEED},
+  {GPS_SENTENCE_RMC, 8, FIELD_COURSE},
+  {GPS_SENTENCE_RMC, 9, FIELD_DATE},
+  {GPS_SENTENCE_RMC, 12, FIELD_FIX_MODE},
+  {GPS_SENTENCE_GGA, 1, FIELD_TIME},
+  {GPS_SENTENCE_GGA, 2, FIELD_LAT},
+  {GPS_SENTENCE_GGA, 3, FIELD_NS},
+  {GPS_SENTENCE_GGA, 4, FIELD_LNG},
+  {GPS_SENTENCE_GGA, 5, FIELD_EW},
+  {GPS_SENTENCE_GGA, 6, FIELD_FIX_QUALITY},
+  {GPS_SENTENCE_GGA, 7, FIELD_SATELLITES},
+  {GPS_SENTENCE_GGA, 8, FIELD_HDOP},
+  {GPS_SENTENCE_GGA, 9, FIELD_ALTITUDE},
+  {GPS_SENTENCE_GSA, 2, FIELD_GSA_FIX_TYPE},
+  {GPS_SENTENCE_GSA, 15, FIELD_PDOP},
+  {GPS_SENTENCE_GSA, 16, FIELD_HDOP},
+  {GPS_SENTENCE_GSA, 17, FIELD_VDOP},
+  {GPS_SENTENCE_VTG, 1, FIELD_VTG_COURSE},
+  {GPS_SENTENCE_VTG, 5, FIELD_VTG_SPEED},
+  {GPS_SENTENCE_VTG, 9, FIELD_VTG_MODE},
+  {GPS_SENTENCE_ZDA, 1, FIELD_TIME},
+  {GPS_SENTENCE_ZDA, 2, FIELD_ZDA_DAY},
+  {GPS_SENTENCE_ZDA, 3, FIELD_ZDA_MONTH},
+  {GPS_SENTENCE_ZDA, 4, FIELD_ZDA_YEAR},
+};
+#define _GPS_TERM_ENTRIES (sizeof(termEntries) / sizeof(termEntries[0]))
+
+static constexpr uint8_t termField(uint8_t sentence, uint8_t term, size_t i = 0)
+{
+  return i == _GPS_TERM_ENTRIES ? (uint8_t)FIELD_NONE
+       : termEntries[i].sentence == sentence && termEntries[i].term == term ? termEntries[i].field
+       : termField(sentence, term, i + 1);
+}
+
+static constexpr bool termEntriesFit(size_t i = 0)
+{
+  return i == _GPS_TERM_ENTRIES || (termEntries[i].term < _GPS_MAX_TERMS && termEntriesFit(i + 1));
+}
+static_assert(termEntriesFit(), "raise _GPS_MAX_TERMS");
+
+#define _GPS_TERM_ROW(s) { \
+  termField(s, 0), termField(s, 1), termField(s, 2), termField(s, 3), termField(s, 4), \
+  termField(s, 5), termField(s, 6), termField(s, 7), termField(s, 8), termField(s, 9), \
+  termField(s, 10), termField(s, 11), termField(s, 12), termField(s, 13), termField(s, 14), \
+  termField(s, 15), termField(s, 16), termField(s, 17), termField(s, 18), termField(s, 19) }
+static_assert(_GPS_MAX_TERMS == 20, "_GPS_TERM_ROW lists every term");
+
+#define _GPS_SENTENCE_ROW(s) _GPS_TERM_ROW(GPS_SENTENCE_##s),
+static constexpr uint8_t termFields[GPS_SENTENCE_COUNT][_GPS_MAX_TERMS] = { _GPS_SENTENCES(_GPS_SENTENCE_ROW) };
+#undef _GPS_SENTENCE_ROW
+
+// Sentences nobody reads without a GPSCustom have no entries
+static constexpr bool hasTermEntries(uint8_t sentence, size_t i = 0)
+{
+  return i != _GPS_TERM_ENTRIES && (termEntries[i].sentence == sentence || hasTermEntries(sentence, i + 1));
+}
+
+#define _GPS_SENTENCE_HAS_FIELDS(s) hasTermEntries(GPS_SENTENCE_##s),
+static constexpr bool sentenceHasFields[GPS_SENTENCE_COUNT] = { _GPS_SENTENCES(_GPS_SENTENCE_HAS_FIELDS) };
+#undef _GPS_SENTENCE_HAS_FIELDS
+
+static constexpr uint8_t sentenceHash(uint32_t code)
+{
+  return (uint8_t)(((code >> 16) * 4 + (code >> 8 & 0xFF) * 2 + (code & 0xFF)) & 15);
+}
+
+static constexpr uint8_t sentenceSlot(uint8_t hash, uint8_t id = 0)
+{
+  return id == GPS_SENTENCE_COUNT ? (uint8_t)GPS_SENTENCE_OTHER
+       : sentenceHash(gpsSentenceTypeCode(id)) == hash ? id
+       : sentenceSlot(hash, id + 1);
+}
+
+static constexpr bool sentenceHashIsPerfect(uint8_t id = 0)
+{
+  return id == GPS_SENTENCE_COUNT
+      || (sentenceSlot(sentenceHash(gpsSentenceTypeCode(id))) == id && sentenceHashIsPerfect(id + 1));
+}
+static_assert(sentenceHashIsPerfect(), "sentence types collide in sentenceHash()");
+
+static constexpr uint8_t sentenceSlots[16] =
+{
+  sentenceSlot(0), sentenceSlot(1), sentenceSlot(2), sentenceSlot(3),
+  sentenceSlot(4), sentenceSlot(5), sentenceSlot(6), sentenceSlot(7),
+  sentenceSlot(8), sentenceSlot(9), sentenceSlot(10), sentenceSlot(11),
+  sentenceSlot(12), sentenceSlot(13), sentenceSlot(14), sentenceSlot(15)
+};
+
+#define _GPS_SENTENCE_TYPE_CODE(s) gpsTypeCode(#s),
+static constexpr uint32_t sentenceCodes[GPS_SENTENCE_COUNT] = { _GPS_SENTENCES(_GPS_SENTENCE_TYPE_CODE) };
+#undef _GPS_SENTENCE_TYPE_CODE
+
+// Talkers accepted in front of the sentence type: GP, GN, GA, GB, GL
+#define _GPS_TALKERS ((1u << ('P' - 'A')) | (1u << ('N' - 'A')) | (1u << ('A' - 'A')) | (1u << ('B' - 'A')) | (1u << ('L' - 'A')))
 
 // Processes a just-completed term
 // Returns true if new sentence has just passed checksum test and is validated
@@ -167,11 +337,29 @@ bool GPSPlus::endOfTermHandler()
         satellites.commit();
         hdop.commit();
         break;
+      case GPS_SENTENCE_GSA:
+        pdop.commit();
+        hdop.commit();
+        vdop.commit();
+        break;
+      case GPS_SENTENCE_VTG:
+        if (sentenceHasFix)
+        {
+          speed.commit();
+          course.commit();
+        }
+        break;
+      case GPS_SENTENCE_ZDA:
+        date.commit();
+        time.commit();
+        break;
       }
 
       // Commit all custom listeners of this sentence type
-      for (GPSCustom *p = customCandidates; p != NULL && strcmp(p->sentenceName, customCandidates->sentenceName) == 0; p = p->next)
-         p->commit();
+      if (curSentenceType != GPS_SENTENCE_OTHER && customTerms[curSentenceType])
+        for (uint8_t i = 0; i < customCount; i++)
+          if (customElts[i]->sentence == curSentenceType)
+            customElts[i]->commit();
       return true;
     }
 
@@ -186,78 +374,110 @@ bool GPSPlus::endOfTermHandler()
   // the first term determines the sentence type
   if (curTermNumber == 0)
   {
-    if (term[0] == 'G' && strchr("PNABL", term[1]) != NULL && !strcmp(term + 2, _RMCterm))
-      curSentenceType = GPS_SENTENCE_RMC;
-    else if (term[0] == 'G' && strchr("PNABL", term[1]) != NULL && !strcmp(term + 2, _GGAterm))
-      curSentenceType = GPS_SENTENCE_GGA;
-    else
-      curSentenceType = GPS_SENTENCE_OTHER;
+    curSentenceType = GPS_SENTENCE_OTHER;
+    if (curTermOffset == 5 && term[0] == 'G' && (uint8_t)(term[1] - 'A') < 26 && (_GPS_TALKERS >> (term[1] - 'A') & 1))
+    {
+      const uint32_t code = gpsTypeCode(term + 2);
+      const uint8_t id = sentenceSlots[sentenceHash(code)];
+      if (id != GPS_SENTENCE_OTHER && sentenceCodes[id] == code)
+        curSentenceType = id;
+    }
 
-    // Any custom candidates of this sentence type?
-    for (customCandidates = customElts; customCandidates != NULL && strcmp(customCandidates->sentenceName, term) < 0; customCandidates = customCandidates->next);
-    if (customCandidates != NULL && strcmp(customCandidates->sentenceName, term) > 0)
-       customCandidates = NULL;
+    if (skipUnused && (curSentenceType == GPS_SENTENCE_OTHER ||
+        (!sentenceHasFields[curSentenceType] && !customTerms[curSentenceType])))
+    {
+       skippingSentence = true;
+       ++skippedSentenceCount;
+    }
 
     return false;
   }
 
-  if (curSentenceType != GPS_SENTENCE_OTHER && term[0])
-    switch(COMBINE(curSentenceType, curTermNumber))
+  if (curSentenceType == GPS_SENTENCE_OTHER)
+    return false;
+
+  if (term[0] && curTermNumber < _GPS_MAX_TERMS)
+    switch(termFields[curSentenceType][curTermNumber])
   {
-    case COMBINE(GPS_SENTENCE_RMC, 1): // Time in both sentences
-    case COMBINE(GPS_SENTENCE_GGA, 1):
+    case FIELD_TIME:
       time.setTime(term);
       break;
-    case COMBINE(GPS_SENTENCE_RMC, 2): // RMC validity
+    case FIELD_RMC_STATUS:
       sentenceHasFix = term[0] == 'A';
       break;
-    case COMBINE(GPS_SENTENCE_RMC, 3): // Latitude
-    case COMBINE(GPS_SENTENCE_GGA, 2):
+    case FIELD_LAT:
       location.setLatitude(term);
       break;
-    case COMBINE(GPS_SENTENCE_RMC, 4): // N/S
-    case COMBINE(GPS_SENTENCE_GGA, 3):
+    case FIELD_NS:
       location.rawNewLatData.negative = term[0] == 'S';
       break;
-    case COMBINE(GPS_SENTENCE_RMC, 5): // Longitude
-    case COMBINE(GPS_SENTENCE_GGA, 4):
+    case FIELD_LNG:
       location.setLongitude(term);
       break;
-    case COMBINE(GPS_SENTENCE_RMC, 6): // E/W
-    case COMBINE(GPS_SENTENCE_GGA, 5):
+    case FIELD_EW:
       location.rawNewLngData.negative = term[0] == 'W';
       break;
-    case COMBINE(GPS_SENTENCE_RMC, 7): // Speed (RMC)
+    case FIELD_SPEED:
       speed.set(term);
       break;
-    case COMBINE(GPS_SENTENCE_RMC, 8): // Course (RMC)
+    case FIELD_COURSE:
       course.set(term);
       break;
-    case COMBINE(GPS_SENTENCE_RMC, 9): // Date (RMC)
+    case FIELD_DATE:
       date.setDate(term);
       break;
-    case COMBINE(GPS_SENTENCE_GGA, 6): // Fix data (GGA)
+    case FIELD_FIX_QUALITY:
       sentenceHasFix = term[0] > '0';
       location.newFixQuality = (GPSLocation::Quality)term[0];
       break;
-    case COMBINE(GPS_SENTENCE_GGA, 7): // Satellites used (GGA)
+    case FIELD_SATELLITES:
       satellites.set(term);
       break;
-    case COMBINE(GPS_SENTENCE_GGA, 8): // HDOP
+    case FIELD_HDOP:
       hdop.set(term);
       break;
-    case COMBINE(GPS_SENTENCE_GGA, 9): // Altitude (GGA)
+    case FIELD_ALTITUDE:
       altitude.set(term);
       break;
-    case COMBINE(GPS_SENTENCE_RMC, 12):
+    case FIELD_FIX_MODE:
       location.newFixMode = (GPSLocation::Mode)term[0];
       break;
+    case FIELD_GSA_FIX_TYPE: // 1 = no fix, 2 = 2D, 3 = 3D
+      sentenceHasFix = term[0] >= '2';
+      break;
+    case FIELD_PDOP:
+      pdop.set(term);
+      break;
+    case FIELD_VDOP:
+      vdop.set(term);
+      break;
+    case FIELD_VTG_COURSE: // true course, fields are empty without a fix
+      course.set(term);
+      sentenceHasFix = true;
+      break;
+    case FIELD_VTG_SPEED: // knots
+      speed.set(term);
+      sentenceHasFix = true;
+      break;
+    case FIELD_VTG_MODE: // NMEA 2.3 and later
+      sentenceHasFix = term[0] != 'N';
+      break;
+    case FIELD_ZDA_DAY:
+      date.newDate = date.newDate % 10000 + 10000 * atol(term);
+      break;
+    case FIELD_ZDA_MONTH:
+      date.newDate = date.newDate / 10000 * 10000 + 100 * atol(term) + date.newDate % 100;
+      break;
+    case FIELD_ZDA_YEAR:
+      date.newDate = date.newDate / 100 * 100 + atol(term) % 100;
+      break;
   }
 
   // Set custom values as needed
-  for (GPSCustom *p = customCandidates; p != NULL && strcmp(p->sentenceName, customCandidates->sentenceName) == 0 && p->termNumber <= curTermNumber; p = p->next)
-    if (p->termNumber == curTermNumber)
-         p->set(term);
+  if (curTermNumber < 32 && (customTerms[curSentenceType] >> curTermNumber & 1))
+    for (uint8_t i = 0; i < customCount; i++)
+      if (customElts[i]->sentence == curSentenceType && customElts[i]->termNumber == curTermNumber)
+        customElts[i]->set(term);
 
   return false;
 }
@@ -315,6 +535,251 @@ const char *GPSPlus::cardinal(double course)
   return directions[direction % 16];
 }
 
+// Fixed-point geodesy. Angles are binary angles (2^32 per turn) so they wrap
+// for free, sines and cosines are Q30.
+
+// round(sin(i * pi / 512) * 2^30), a quarter wave
+static const int32_t sinTable[257] =
+{
+  0, 6588356, 13176464, 19764076, 26350943, 32936819, 39521455, 46104602,
+  52686014, 59265442, 65842639, 72417357, 78989349, 85558366, 92124163, 98686491,
+  105245103, 111799753, 118350194, 124896179, 131437462, 137973796, 144504935, 151030634,
+  157550647, 164064728, 170572633, 177074115, 183568930, 190056834, 196537583, 203010932,
+  209476638, 215934457, 222384147, 228825464, 235258165, 241682010, 248096755, 254502159,
+  260897982, 267283981, 273659918, 280025552, 286380643, 292724951, 299058239, 305380268,
+  311690799, 317989595, 324276419, 330551034, 336813204, 343062693, 349299266, 355522689,
+  361732726, 367929144, 374111709, 380280190, 386434353, 392573967, 398698801, 404808624,
+  410903207, 416982319, 423045732, 429093217, 435124548, 441139496, 447137835, 453119340,
+  459083786, 465030947, 470960600, 476872522, 482766489, 488642281, 494499676, 500338453,
+  506158392, 511959275, 517740883, 523502998, 529245404, 534967884, 540670223, 546352205,
+  552013618, 557654248, 563273883, 568872310, 574449320, 580004702, 585538248, 591049748,
+  596538995, 602005783, 607449906, 612871159, 618269338, 623644239, 628995660, 634323400,
+  639627258, 644907034, 650162530, 655393548, 660599890, 665781362, 670937767, 676068911,
+  681174602, 686254647, 691308855, 696337036, 701339000, 706314559, 711263525, 716185713,
+  721080937, 725949013, 730789757, 735602987, 740388522, 745146182, 749875788, 754577161,
+  759250125, 763894504, 768510122, 773096806, 777654384, 782182683, 786681534, 791150767,
+  795590213, 799999706, 804379079, 808728167, 813046808, 817334838, 821592095, 825818421,
+  830013654, 834177638, 838310216, 842411232, 846480531, 850517961, 854523370, 858496606,
+  862437520, 866345964, 870221790, 874064853, 877875009, 881652112, 885396022, 889106597,
+  892783698, 896427186, 900036924, 903612776, 907154608, 910662286, 914135678, 917574653,
+  920979082, 924348837, 927683790, 930983817, 934248793, 937478595, 940673101, 943832191,
+  946955747, 950043650, 953095785, 956112036, 959092290, 962036435, 964944360, 967815955,
+  970651112, 973449725, 976211688, 978936898, 981625251, 984276646, 986890984, 989468165,
+  992008094, 994510675, 996975812, 999403415, 1001793390, 1004145648, 1006460100, 1008736660,
+  1010975242, 1013175761, 1015338134, 1017462281, 1019548121, 1021595575, 1023604567, 1025575020,
+  1027506862, 1029400018, 1031254418, 1033069992, 1034846671, 1036584389, 1038283080, 1039942680,
+  1041563127, 1043144360, 1044686319, 1046188946, 1047652185, 1049075980, 1050460278, 1051805027,
+  1053110176, 1054375676, 1055601479, 1056787540, 1057933813, 1059040255, 1060106826, 1061133483,
+  1062120190, 1063066909, 1063973603, 1064840240, 1065666786, 1066453210, 1067199483, 1067905576,
+  1068571464, 1069197120, 1069782521, 1070327646, 1070832474, 1071296985, 1071721163, 1072104991,
+  1072448455, 1072751542, 1073014240, 1073236540, 1073418433, 1073559913, 1073660973, 1073721611,
+  1073741824,
+};
+
+// round(atan(i / 256) * 2^32 / (2 * pi)), binary angle of the slope i / 256
+static const uint32_t atanTable[257] =
+{
+  0, 2670163, 5340245, 8010164, 10679838, 13349187, 16018129, 18686582,
+  21354465, 24021698, 26688200, 29353889, 32018685, 34682507, 37345276, 40006910,
+  42667331, 45326458, 47984212, 50640513, 53295284, 55948444, 58599915, 61249621,
+  63897482, 66543421, 69187361, 71829226, 74468939, 77106424, 79741605, 82374407,
+  85004756, 87632577, 90257796, 92880340, 95500135, 98117110, 100731191, 103342309,
+  105950391, 108555367, 111157167, 113755721, 116350962, 118942819, 121531227, 124116117,
+  126697423, 129275078, 131849018, 134419178, 136985493, 139547900, 142106335, 144660738,
+  147211045, 149757197, 152299132, 154836791, 157370116, 159899047, 162423527, 164943499,
+  167458907, 169969696, 172475810, 174977196, 177473799, 179965568, 182452450, 184934394,
+  187411349, 189883266, 192350096, 194811789, 197268300, 199719579, 202165583, 204606264,
+  207041579, 209471483, 211895933, 214314887, 216728303, 219136141, 221538359, 223934919,
+  226325781, 228710908, 231090262, 233463808, 235831508, 238193329, 240549235, 242899194,
+  245243172, 247581137, 249913059, 252238905, 254558647, 256872255, 259179700, 261480955,
+  263775993, 266064788, 268347313, 270623543, 272893455, 275157025, 277414230, 279665048,
+  281909457, 284147437, 286378966, 288604026, 290822599, 293034664, 295240206, 297439207,
+  299631651, 301817523, 303996806, 306169488, 308335554, 310494991, 312647786, 314793928,
+  316933406, 319066208, 321192324, 323311746, 325424463, 327530468, 329629752, 331722309,
+  333808132, 335887214, 337959550, 340025134, 342083962, 344136031, 346181336, 348219874,
+  350251643, 352276640, 354294865, 356306316, 358310992, 360308894, 362300021, 364284375,
+  366261957, 368232767, 370196809, 372154086, 374104599, 376048352, 377985350, 379915596,
+  381839095, 383755852, 385665872, 387569162, 389465727, 391355574, 393238710, 395115141,
+  396984877, 398847924, 400704291, 402553986, 404397019, 406233399, 408063135, 409886237,
+  411702716, 413512582, 415315845, 417112518, 418902610, 420686135, 422463104, 424233528,
+  425997422, 427754796, 429505665, 431250041, 432987938, 434719370, 436444350, 438162893,
+  439875013, 441580724, 443280042, 444972981, 446659557, 448339785, 450013680, 451681259,
+  453342536, 454997530, 456646255, 458288728, 459924966, 461554985, 463178803, 464796437,
+  466407904, 468013221, 469612406, 471205476, 472792449, 474373344, 475948178, 477516969,
+  479079736, 480636498, 482187271, 483732076, 485270931, 486803855, 488330866, 489851983,
+  491367227, 492876615, 494380167, 495877903, 497369841, 498856002, 500336404, 501811068,
+  503280012, 504743258, 506200824, 507652730, 509098996, 510539643, 511974689, 513404156,
+  514828063, 516246430, 517659277, 519066625, 520468494, 521864904, 523255875, 524641427,
+  526021581, 527396357, 528765775, 530129856, 531488619, 532842087, 534190278, 535533213,
+  536870912,
+};
+
+#define _GPS_QUARTER_TURN 0x40000000u
+// 1e-7 degrees to a binary angle: 2^32 / 3.6e9 in Q31
+static inline uint32_t e7ToAngle(int64_t e7)
+{
+  return (uint32_t)((e7 * 2562047788LL) >> 31);
+}
+
+static int32_t sinAngle(uint32_t a)
+{
+  uint32_t x = a & (_GPS_QUARTER_TURN - 1);
+  if (a & _GPS_QUARTER_TURN)
+    x = _GPS_QUARTER_TURN - x;
+  // sin(t + d) = sin(t) cos(d) + cos(t) sin(d), with cos(d) ~ 1 - d^2 / 2 and
+  // sin(d) ~ d for the step d below one table entry (error below 1e-7)
+  const uint32_t i = x >> 22;
+  const int64_t d = ((int64_t)(x & 0x3FFFFF) * 1686629713) >> 30; // Q30 radians
+  const int64_t s = sinTable[i];
+  const int64_t c = sinTable[256 - i];
+  const int32_t v = (int32_t)(s - ((s * ((d * d) >> 30)) >> 31) + ((c * d) >> 30));
+  return a & 0x80000000u ? -v : v;
+}
+
+static inline int32_t cosAngle(uint32_t a)
+{
+  return sinAngle(a + _GPS_QUARTER_TURN);
+}
+
+static uint32_t atan2Angle(int64_t y, int64_t x)
+{
+  const uint64_t ax = x < 0 ? -x : x;
+  const uint64_t ay = y < 0 ? -y : y;
+  if (ax == 0 && ay == 0)
+    return 0;
+  const bool steep = ay > ax;
+  // slope in [0, 1] as Q30, callers keep both inputs below 2^33
+  const uint32_t r = (uint32_t)(((steep ? ax : ay) << 30) / (steep ? ay : ax));
+  const uint32_t i = r >> 22;
+  uint32_t a = atanTable[i];
+  if (i < 256)
+    a += (uint32_t)(((uint64_t)(atanTable[i + 1] - a) * (r & 0x3FFFFF)) >> 22);
+  if (steep)
+    a = _GPS_QUARTER_TURN - a;
+  if (x < 0)
+    a = 2 * _GPS_QUARTER_TURN - a;
+  return y < 0 ? 0 - a : a;
+}
+
+static uint32_t isqrt64(uint64_t v)
+{
+  uint64_t res = 0;
+  uint64_t bit = 1ULL << 62;
+  while (bit > v)
+    bit >>= 2;
+  while (bit)
+  {
+    if (v >= res + bit)
+    {
+      v -= res + bit;
+      res = (res >> 1) + bit;
+    }
+    else
+      res >>= 1;
+    bit >>= 2;
+  }
+  return (uint32_t)res;
+}
+
+// longitude difference wrapped into [-180, 180) degrees
+static inline int64_t deltaLongE7(int32_t long1, int32_t long2)
+{
+  int64_t d = (int64_t)long2 - long1;
+  if (d >= 1800000000)
+    d -= 3600000000LL;
+  else if (d < -1800000000)
+    d += 3600000000LL;
+  return d;
+}
+
+// haversine a = sin^2(dLat / 2) + cos(lat1) cos(lat2) sin^2(dLong / 2) in
+// Q60, so short distances do not lose their few significant bits
+static uint64_t haversineQ60(uint32_t dLat, uint32_t dLong, int64_t cosLats)
+{
+  const int64_t sLat = sinAngle((uint32_t)((int32_t)dLat / 2));
+  const int64_t sLong = sinAngle((uint32_t)((int32_t)dLong / 2));
+  const uint64_t a = (uint64_t)(sLat * sLat) + (uint64_t)(((sLong * cosLats) >> 30) * sLong);
+  return a > 1ULL << 60 ? 1ULL << 60 : a;
+}
+
+// static
+int32_t GPSPlus::degreesE7(const RawDegrees &deg)
+{
+  int32_t ret = deg.deg * 10000000 + (int32_t)((deg.billionths + 50) / 100);
+  return deg.negative ? -ret : ret;
+}
+
+// static
+uint32_t GPSPlus::distanceBetweenFixed(int32_t lat1, int32_t long1, int32_t lat2, int32_t long2)
+{
+  const int64_t dLat = (int64_t)lat2 - lat1;
+  const int64_t dLong = deltaLongE7(long1, long2);
+
+  if (dLat < _GPS_FAST_DISTANCE_E7 && dLat > -_GPS_FAST_DISTANCE_E7 &&
+      dLong < _GPS_FAST_DISTANCE_E7 && dLong > -_GPS_FAST_DISTANCE_E7)
+  {
+    // equirectangular: scale the longitude difference by the cosine of the
+    // mean latitude, then Pythagoras in 1e-7 degrees
+    const int64_t x = (dLong * cosAngle(e7ToAngle(((int64_t)lat1 + lat2) / 2))) >> 30;
+    const uint64_t e7 = isqrt64((uint64_t)(x * x + dLat * dLat));
+    // meters per 1e-7 degree, 0.0111195 in Q32
+    return (uint32_t)((e7 * 47757574 + 0x80000000u) >> 32);
+  }
+
+  // central angle c = 2 atan2(sqrt(a), sqrt(1 - a)). Near the antipode 1 - a
+  // cancels, so take it as the haversine to the antipode of point 2 instead.
+  const int64_t cosLats = ((int64_t)cosAngle(e7ToAngle(lat1)) * cosAngle(e7ToAngle(lat2))) >> 30;
+  const uint64_t a = haversineQ60(e7ToAngle(dLat), e7ToAngle(dLong), cosLats);
+  uint32_t halfC;
+  if (a <= 1ULL << 59)
+    halfC = atan2Angle(isqrt64(a), isqrt64((1ULL << 60) - a));
+  else
+  {
+    const uint64_t b = haversineQ60(e7ToAngle(-((int64_t)lat1 + lat2)), e7ToAngle(dLong) + 2 * _GPS_QUARTER_TURN, cosLats);
+    halfC = atan2Angle(isqrt64((1ULL << 60) - b), isqrt64(b));
+  }
+  return (uint32_t)(((uint64_t)halfC * 2 * _GPS_EARTH_CIRCUMFERENCE + 0x80000000u) >> 32);
+}
+
+// static
+uint16_t GPSPlus::courseToFixed(int32_t lat1, int32_t long1, int32_t lat2, int32_t long2)
+{
+  const int64_t dLat = (int64_t)lat2 - lat1;
+  const int64_t dLong = deltaLongE7(long1, long2);
+  uint32_t angle;
+
+  if (dLat < _GPS_FAST_DISTANCE_E7 && dLat > -_GPS_FAST_DISTANCE_E7 &&
+      dLong < _GPS_FAST_DISTANCE_E7 && dLong > -_GPS_FAST_DISTANCE_E7)
+  {
+    // close points: the plane bearing keeps the resolution of the inputs,
+    // less half the meridian convergence to get the initial great circle
+    // bearing
+    const uint32_t mid = e7ToAngle(((int64_t)lat1 + lat2) / 2);
+    const int64_t x = (dLong * cosAngle(mid)) >> 30;
+    angle = atan2Angle(x, dLat) - (uint32_t)((int32_t)e7ToAngle((dLong * sinAngle(mid)) >> 30) / 2);
+  }
+  else
+  {
+    const uint32_t dLongAngle = e7ToAngle(dLong);
+    const int64_t sinLat1 = sinAngle(e7ToAngle(lat1)), cosLat1 = cosAngle(e7ToAngle(lat1));
+    const int64_t sinLat2 = sinAngle(e7ToAngle(lat2)), cosLat2 = cosAngle(e7ToAngle(lat2));
+    const int64_t y = (sinAngle(dLongAngle) * cosLat2) >> 30;
+    const int64_t x = ((cosLat1 * sinLat2) >> 30) - ((((sinLat1 * cosLat2) >> 30) * cosAngle(dLongAngle)) >> 30);
+    angle = atan2Angle(y, x);
+  }
+
+  // binary angle to hundredths of a degree
+  const uint32_t course = (uint32_t)(((uint64_t)angle * 36000 + 0x80000000u) >> 32);
+  return course == 36000 ? 0 : (uint16_t)course;
+}
+
+// static
+const char *GPSPlus::cardinalFixed(uint32_t course)
+{
+  static const char* directions[] = {"N", "NNE", "NE", "ENE", "E", "ESE", "SE", "SSE", "S", "SSW", "SW", "WSW", "W", "WNW", "NW", "NNW"};
+  return directions[((course + 1125) / 2250) % 16];
+}
+
 void GPSLocation::commit()
 {
    rawLatData = rawNewLatData;
@@ -349,6 +814,18 @@ double GPSLocation::lng()
    return rawLngData.negative ? -ret : ret;
 }
 
+int32_t GPSLocation::latE7()
+{
+   updated = false;
+   return GPSPlus::degreesE7(rawLatData);
+}
+
+int32_t GPSLocation::lngE7()
+{
+   updated = false;
+   return GPSPlus::degreesE7(rawLngData);
+}
+
 void GPSDate::commit()
 {
    date = newDate;
@@ -440,22 +917,22 @@ void GPSInteger::set(const char *term)
    newval = atol(term);
 }
 
-GPSCustom::GPSCustom(GPSPlus &gps, const char *_sentenceName, int _termNumber)
+GPSCustom::GPSCustom(GPSPlus &gps, uint8_t _sentence, uint8_t _termNumber)
 {
-   begin(gps, _sentenceName, _termNumber);
+   begin(gps, _sentence, _termNumber);
 }
 
-void GPSCustom::begin(GPSPlus &gps, const char *_sentenceName, int _termNumber)
+bool GPSCustom::begin(GPSPlus &gps, uint8_t _sentence, uint8_t _termNumber)
 {
    lastCommitTime = 0;
    updated = valid = false;
-   sentenceName = _sentenceName;
+   sentence = _sentence;
    termNumber = _termNumber;
    memset(stagingBuffer, '\0', sizeof(stagingBuffer));
    memset(buffer, '\0', sizeof(buffer));
 
-   // Insert this item into the GPS tree
-   gps.insertCustom(this, _sentenceName, _termNumber);
+   // Register this item with the GPS
+   return gps.addCustom(this);
 }
 
 void GPSCustom::commit()
@@ -470,17 +947,377 @@ void GPSCustom::set(const char *term)
    strncpy(this->stagingBuffer, term, sizeof(this->stagingBuffer) - 1);
 }
 
-void GPSPlus::insertCustom(GPSCustom *pElt, const char *sentenceName, int termNumber)
+bool GPSPlus::addCustom(GPSCustom *pElt)
+{
+   if (pElt->sentence >= GPS_SENTENCE_COUNT || pElt->termNumber >= 32 || customCount == _GPS_MAX_CUSTOM)
+      return false;
+
+   customElts[customCount++] = pElt;
+   customTerms[pElt->sentence] |= 1u << pElt->termNumber;
+   return true;
+}
+
+// static
+size_t GPSPlus::ubxFrame(uint8_t *out, uint8_t msgClass, uint8_t msgId, const uint8_t *payload, uint16_t len)
+{
+   out[0] = UBX_SYNC_1;
+   out[1] = UBX_SYNC_2;
+   out[2] = msgClass;
+   out[3] = msgId;
+   out[4] = (uint8_t)len;
+   out[5] = (uint8_t)(len >> 8);
+   if (len)
+      memcpy(out + 6, payload, len);
+
+   // 8-bit Fletcher over class, id, length and payload
+   uint8_t ckA = 0, ckB = 0;
+   for (size_t i = 2; i < 6u + len; i++)
+   {
+      ckA += out[i];
+      ckB += ckA;
+   }
+   out[6 + len] = ckA;
+   out[7 + len] = ckB;
+   return 8 + len;
+}
+
+// static
+void GPSPlus::setNmeaRate(uart_inst_t *uart, uint8_t nmeaId, uint8_t rate)
+{
+   // CFG-MSG with the short payload sets the rate on the port it arrives on
+   const uint8_t payload[3] = {UBX_CLASS_NMEA, nmeaId, rate};
+   uint8_t frame[8 + sizeof(payload)];
+   size_t len = ubxFrame(frame, UBX_CLASS_CFG, UBX_CFG_MSG, payload, sizeof(payload));
+   uart_write_blocking(uart, frame, len);
+}
+
+// static
+void GPSPlus::disableUnusedSentences(uart_inst_t *uart)
+{
+   // GSA and VTG are parsed, see GPS_DISABLE_UNUSED_NMEA
+   static const uint8_t unused[] = {UBX_NMEA_GSV, UBX_NMEA_GLL};
+   for (size_t i = 0; i < sizeof(unused); i++)
+      setNmeaRate(uart, unused[i], 0);
+}
+
+// static
+void GPSPlus::setMeasurementRate(uart_inst_t *uart, uint16_t measurementMs)
+{
+   // measRate, navRate 1 (a solution per measurement), timeRef 1 (GPS time)
+   const uint8_t payload[6] = {(uint8_t)measurementMs, (uint8_t)(measurementMs >> 8), 1, 0, 1, 0};
+   uint8_t frame[8 + sizeof(payload)];
+   size_t len = ubxFrame(frame, UBX_CLASS_CFG, UBX_CFG_RATE, payload, sizeof(payload));
+   uart_write_blocking(uart, frame, len);
+}
+
+// static
+void GPSPlus::powerDown(uart_inst_t *uart)
+{
+   // duration 0: no timed wake up, flags bit 1: enter backup mode
+   const uint8_t payload[8] = {0, 0, 0, 0, 0x02, 0, 0, 0};
+   uint8_t frame[8 + sizeof(payload)];
+   size_t len = ubxFrame(frame, UBX_CLASS_RXM, UBX_RXM_PMREQ, payload, sizeof(payload));
+   uart_write_blocking(uart, frame, len);
+}
+
+// static
+void GPSPlus::wakeUp(uart_inst_t *uart)
+{
+   // any edge on RXD does it, 0xFF is ignored by both protocol parsers
+   static const uint8_t dummy[4] = {0xFF, 0xFF, 0xFF, 0xFF};
+   uart_write_blocking(uart, dummy, sizeof(dummy));
+}
+
+static inline uint16_t ubxU2(const uint8_t *p)
+{
+   return (uint16_t)(p[0] | p[1] << 8);
+}
+
+static inline uint32_t ubxU4(const uint8_t *p)
+{
+   return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static inline int32_t ubxI4(const uint8_t *p)
+{
+   return (int32_t)ubxU4(p);
+}
+
+// UBX positions are 1e-7 degrees
+static void ubxDegrees(int32_t v, RawDegrees &deg)
+{
+   deg.negative = v < 0;
+   uint32_t a = deg.negative ? (uint32_t)-(int64_t)v : (uint32_t)v;
+   deg.deg = (uint16_t)(a / 10000000UL);
+   deg.billionths = (a % 10000000UL) * 100;
+}
+
+GPSUbx::GPSUbx(GPSPlus &_gps)
+  :  gps(_gps)
+  ,  state(UBX_WAIT_SYNC_1)
+  ,  msgClass(0)
+  ,  msgId(0)
+  ,  msgLength(0)
+  ,  payloadOffset(0)
+  ,  ckA(0)
+  ,  ckB(0)
+  ,  solKnown(false)
+  ,  solHasFix(false)
+  ,  solITow(0)
+  ,  posPending(false)
+  ,  velPending(false)
+  ,  posITow(0)
+  ,  velITow(0)
+  ,  encodedCharCount(0)
+  ,  messagesWithFixCount(0)
+  ,  failedChecksumCount(0)
+  ,  passedChecksumCount(0)
+  ,  unknownMessageCount(0)
+  ,  badLengthCount(0)
+{
+}
+
+bool GPSUbx::encode(uint8_t c)
+{
+    encodedCharCount++;
+
+    switch(state)
+    {
+    case UBX_WAIT_SYNC_1:
+        if (c == UBX_SYNC_1)
+            state = UBX_WAIT_SYNC_2;
+        break;
+    case UBX_WAIT_SYNC_2:
+        state = c == UBX_SYNC_2 ? UBX_CLASS : (c == UBX_SYNC_1 ? UBX_WAIT_SYNC_2 : UBX_WAIT_SYNC_1);
+        break;
+    case UBX_CLASS:
+        ckA = ckB = 0;
+        checksum(c);
+        msgClass = c;
+        state = UBX_ID;
+        break;
+    case UBX_ID:
+        checksum(c);
+        msgId = c;
+        state = UBX_LENGTH_1;
+        break;
+    case UBX_LENGTH_1:
+        checksum(c);
+        msgLength = c;
+        state = UBX_LENGTH_2;
+        break;
+    case UBX_LENGTH_2:
+        checksum(c);
+        msgLength |= (uint16_t)c << 8;
+        // a NAV message longer than the ones decoded, or anything that long,
+        // is a corrupt length: look for the next message right away
+        if (msgLength > _GPS_UBX_MAX_LENGTH || (msgClass == UBX_CLASS_NAV && msgLength > sizeof(payload)))
+        {
+            ++badLengthCount;
+            state = UBX_WAIT_SYNC_1;
+            break;
+        }
+        payloadOffset = 0;
+        state = msgLength ? UBX_PAYLOAD : UBX_CK_A;
+        break;
+    case UBX_PAYLOAD:
+        checksum(c);
+        if (payloadOffset < sizeof(payload))
+            payload[payloadOffset] = c;
+        if (++payloadOffset == msgLength)
+            state = UBX_CK_A;
+        break;
+    case UBX_CK_A:
+        if (c != ckA)
+        {
+            ++failedChecksumCount;
+            state = c == UBX_SYNC_1 ? UBX_WAIT_SYNC_2 : UBX_WAIT_SYNC_1;
+            break;
+        }
+        state = UBX_CK_B;
+        break;
+    case UBX_CK_B:
+        state = UBX_WAIT_SYNC_1;
+        if (c != ckB)
+        {
+            ++failedChecksumCount;
+            break;
+        }
+        ++passedChecksumCount;
+        return endOfMessageHandler();
+    }
+
+    return false;
+}
+
+size_t GPSUbx::encode(const uint8_t *data, size_t len)
 {
-   GPSCustom **ppelt;
+    size_t committed = 0;
+    const uint8_t *p = data;
+    const uint8_t *end = data + len;
 
-   for (ppelt = &this->customElts; *ppelt != NULL; ppelt = &(*ppelt)->next)
+    while (p != end)
+    {
+        if (state == UBX_WAIT_SYNC_1)
+        {
+            // nothing but garbage (or NMEA) until the next sync character
+            const uint8_t *sync = (const uint8_t *)memchr(p, UBX_SYNC_1, end - p);
+            encodedCharCount += (sync ? sync : end) - p;
+            if (sync == NULL)
+                break;
+            p = sync;
+        }
+        else if (state == UBX_PAYLOAD)
+        {
+            // copy and checksum the run of payload bytes in one go
+            size_t n = msgLength - payloadOffset;
+            if (n > (size_t)(end - p))
+                n = end - p;
+            uint8_t a = ckA, b = ckB;
+            for (size_t i = 0; i < n; i++)
+            {
+                a += p[i];
+                b += a;
+            }
+            ckA = a;
+            ckB = b;
+            if (payloadOffset < sizeof(payload))
+                memcpy(payload + payloadOffset, p, payloadOffset + n <= sizeof(payload) ? n : sizeof(payload) - payloadOffset);
+            payloadOffset += n;
+            encodedCharCount += n;
+            p += n;
+            if (payloadOffset == msgLength)
+                state = UBX_CK_A;
+            continue;
+        }
+
+        if (encode(*p++))
+            ++committed;
+    }
+    return committed;
+}
+
+// Processes a message that passed the checksum
+// Returns true if it was one of the decoded NAV messages
+bool GPSUbx::endOfMessageHandler()
+{
+  if (msgClass != UBX_CLASS_NAV)
+  {
+    ++unknownMessageCount;
+    return false;
+  }
+
+  const uint8_t *p = payload;
+  switch(msgId)
+  {
+  case UBX_NAV_POSLLH:
+    if (msgLength != 28)
+      break;
+    posITow = ubxU4(p);
+    ubxDegrees(ubxI4(p + 4), gps.location.rawNewLngData);
+    ubxDegrees(ubxI4(p + 8), gps.location.rawNewLatData);
+    gps.altitude.newval = ubxI4(p + 16) / 10;  // hMSL, mm -> cm
+    posPending = true;
+    commitPending();
+    return true;
+
+  case UBX_NAV_SOL:
+    if (msgLength != 52)
+      break;
+    {
+    const uint8_t gpsFix = p[10];
+    const uint8_t flags = p[11];
+    solITow = ubxU4(p);
+    solKnown = true;
+    solHasFix = (flags & 0x01) && gpsFix >= 2 && gpsFix <= 4;  // gpsFixOk, 2D/3D/GPS+DR
+    const bool diff = flags & 0x02;
+    gps.location.newFixQuality = solHasFix ? (diff ? GPSLocation::DGPS : GPSLocation::GPS) : GPSLocation::Invalid;
+    gps.location.newFixMode = solHasFix ? (diff ? GPSLocation::D : GPSLocation::A) : GPSLocation::N;
+    gps.satellites.newval = p[47];
+    gps.satellites.commit();
+    if (solHasFix)
+      ++messagesWithFixCount;
+    commitPending();
+    return true;
+    }
+
+  case UBX_NAV_VELNED:
+    if (msgLength != 36)
+      break;
+    velITow = ubxU4(p);
+    // ground speed cm/s -> 1/100 knots, heading 1e-5 deg -> 1/100 deg
+    gps.speed.newval = (int32_t)(((uint64_t)ubxU4(p + 20) * 19438 + 5000) / 10000);
+    gps.course.newval = ubxI4(p + 24) / 1000;
+    velPending = true;
+    commitPending();
+    return true;
+
+  case UBX_NAV_TIMEUTC:
+    if (msgLength != 20)
+      break;
+    if (p[19] & 0x04)  // validUTC
+    {
+      int32_t nano = ubxI4(p + 8);
+      uint32_t centis = nano > 0 ? (uint32_t)nano / 10000000UL : 0;
+      gps.time.newTime = p[16] * 1000000UL + p[17] * 10000UL + p[18] * 100UL + centis;
+      gps.date.newDate = p[15] * 10000UL + p[14] * 100UL + ubxU2(p + 12) % 100;
+      gps.time.commit();
+      gps.date.commit();
+    }
+    return true;
+  }
+
+  ++unknownMessageCount;
+  return false;
+}
+
+void GPSUbx::commitPending()
+{
+  if (!solKnown)
+    return;
+
+  if (posPending && posITow == solITow)
+  {
+    posPending = false;
+    if (solHasFix)
+    {
+      gps.location.commit();
+      gps.altitude.commit();
+    }
+  }
+  if (velPending && velITow == solITow)
+  {
+    velPending = false;
+    if (solHasFix)
+    {
+      gps.speed.commit();
+      gps.course.commit();
+    }
+  }
+}
+
+// static
+void GPSUbx::configureUbxOnly(uart_inst_t *uart, uint32_t baudRate)
+{
+   static const uint8_t nav[] = {UBX_NAV_POSLLH, UBX_NAV_SOL, UBX_NAV_VELNED, UBX_NAV_TIMEUTC};
+   uint8_t frame[8 + 20];
+   for (size_t i = 0; i < sizeof(nav); i++)
    {
-      int cmp = strcmp(sentenceName, (*ppelt)->sentenceName);
-      if (cmp < 0 || (cmp == 0 && termNumber < (*ppelt)->termNumber))
-         break;
+      const uint8_t msg[3] = {UBX_CLASS_NAV, nav[i], 1};
+      size_t len = GPSPlus::ubxFrame(frame, UBX_CLASS_CFG, UBX_CFG_MSG, msg, sizeof(msg));
+      uart_write_blocking(uart, frame, len);
    }
 
-   pElt->next = *ppelt;
-   *ppelt = pElt;
-}
\ No newline at end of file
+   // CFG-PRT for UART1: 8N1 at the current baud rate, UBX+NMEA in, UBX out
+   uint8_t prt[20] = {0};
+   prt[0] = 1;                        // portID
+   prt[4] = 0xD0; prt[5] = 0x08;      // mode: 8 bit, no parity, 1 stop bit
+   prt[8] = (uint8_t)baudRate;
+   prt[9] = (uint8_t)(baudRate >> 8);
+   prt[10] = (uint8_t)(baudRate >> 16);
+   prt[11] = (uint8_t)(baudRate >> 24);
+   prt[12] = 0x03;                    // inProtoMask: UBX | NMEA
+   prt[14] = 0x01;                    // outProtoMask: UBX
+   size_t len = GPSPlus::ubxFrame(frame, UBX_CLASS_CFG, UBX_CFG_PRT, prt, sizeof(prt));
+   uart_write_blocking(uart, frame, len);
+}
@@ -2,6 +2,7 @@
 #define __neo6m_h__
 
 #include "pico/time.h"
+#include "hardware/uart.h"
 
 #include <ctype.h>
 #include <cinttypes>
@@ -17,6 +18,47 @@
 #define GPS_STOP_BITS 1
 #define GPS_PARITY    UART_PARITY_NONE
 
+// Send UBX-CFG-MSG at startup so the receiver stops GSV and GLL, which no
+// built-in field comes from. RMC, GGA, GSA (DOPs) and VTG stay on; GSA and
+// VTG cost about 110 of the 960 characters a second at 9600 baud and the
+// time to decode them, and without them the DOPs and VTG fields stay invalid.
+#ifndef GPS_DISABLE_UNUSED_NMEA
+#define GPS_DISABLE_UNUSED_NMEA 1
+#endif
+
+// Switch the receiver to UBX-only output and decode it with GPSUbx
+#ifndef GPS_USE_UBX
+#define GPS_USE_UBX 0
+#endif
+
+#define UBX_SYNC_1      0xB5
+#define UBX_SYNC_2      0x62
+#define UBX_CLASS_CFG   0x06
+#define UBX_CFG_MSG     0x01
+#define UBX_CLASS_NMEA  0xF0
+#define UBX_NMEA_GGA    0x00
+#define UBX_NMEA_GLL    0x01
+#define UBX_NMEA_GSA    0x02
+#define UBX_NMEA_GSV    0x03
+#define UBX_NMEA_RMC    0x04
+#define UBX_NMEA_VTG    0x05
+#define UBX_CFG_PRT     0x00
+#define UBX_CFG_RATE    0x08
+#define UBX_CLASS_NAV   0x01
+#define UBX_NAV_POSLLH  0x02
+#define UBX_NAV_SOL     0x06
+#define UBX_NAV_VELNED  0x12
+#define UBX_NAV_TIMEUTC 0x21
+#define UBX_CLASS_RXM   0x02
+#define UBX_RXM_PMREQ   0x41
+#define UBX_CLASS_ACK   0x05
+#define UBX_ACK_NAK     0x00
+#define UBX_ACK_ACK     0x01
+
+#define _GPS_UBX_MAX_PAYLOAD 52 // NAV-SOL, the largest message decoded
+// longer lengths are taken for corrupt, rather than waiting out up to 64 kB
+#define _GPS_UBX_MAX_LENGTH  512
+
 #define _GPS_MPH_PER_KNOT 1.15077945
 #define _GPS_MPS_PER_KNOT 0.51444444
 #define _GPS_KMPH_PER_KNOT 1.852
@@ -24,7 +66,11 @@
 #define _GPS_KM_PER_METER 0.001
 #define _GPS_FEET_PER_METER 3.2808399
 #define _GPS_MAX_FIELD_SIZE 15
+#define _GPS_MAX_TERMS 20 // built-in fields per sentence, GSA has the most
+#define _GPS_MAX_CUSTOM 8
 #define _GPS_EARTH_MEAN_RADIUS 6371009 // old: 6372795
+#define _GPS_EARTH_CIRCUMFERENCE 40030229 // 2 * pi * _GPS_EARTH_MEAN_RADIUS
+#define _GPS_FAST_DISTANCE_E7 2000000 // 0.2 degrees, about 22 km
 
 static inline uint32_t millis()
 {
@@ -43,6 +89,7 @@ struct RawDegrees
 struct GPSLocation
 {
    friend struct GPSPlus;
+   friend struct GPSUbx;
 public:
    enum Quality { Invalid = '0', GPS = '1', DGPS = '2', PPS = '3', RTK = '4', FloatRTK = '5', Estimated = '6', Manual = '7', Simulated = '8' };
    enum Mode { N = 'N', A = 'A', D = 'D', E = 'E'};
@@ -54,6 +101,9 @@ public:
    const RawDegrees &rawLng()     { updated = false; return rawLngData; }
    double lat();
    double lng();
+   // signed 1e-7 degrees, no floating point
+   int32_t latE7();
+   int32_t lngE7();
    Quality FixQuality()           { updated = false; return fixQuality; }
    Mode FixMode()                 { updated = false; return fixMode; }
 
@@ -74,6 +124,7 @@ private:
 struct GPSDate
 {
    friend struct GPSPlus;
+   friend struct GPSUbx;
 public:
    bool isValid() const       { return valid; }
    bool isUpdated() const     { return updated; }
@@ -98,6 +149,7 @@ private:
 struct GPSTime
 {
    friend struct GPSPlus;
+   friend struct GPSUbx;
 public:
    bool isValid() const       { return valid; }
    bool isUpdated() const     { return updated; }
@@ -123,6 +175,7 @@ private:
 struct GPSDecimal
 {
    friend struct GPSPlus;
+   friend struct GPSUbx;
 public:
    bool isValid() const    { return valid; }
    bool isUpdated() const  { return updated; }
@@ -143,6 +196,7 @@ private:
 struct GPSInteger
 {
    friend struct GPSPlus;
+   friend struct GPSUbx;
 public:
    bool isValid() const    { return valid; }
    bool isUpdated() const  { return updated; }
@@ -166,6 +220,8 @@ struct GPSSpeed : GPSDecimal
    double mph()      { return _GPS_MPH_PER_KNOT * value() / 100.0; }
    double mps()      { return _GPS_MPS_PER_KNOT * value() / 100.0; }
    double kmph()     { return _GPS_KMPH_PER_KNOT * value() / 100.0; }
+   int32_t mmps()    { return value() * 1852 / 360; }   // millimeters per second
+   int32_t kmph100() { return value() * 1852 / 1000; }  // 1/100 km/h
 };
 
 struct GPSCourse : public GPSDecimal
@@ -179,6 +235,7 @@ struct GPSAltitude : GPSDecimal
    double miles()        { return _GPS_MILES_PER_METER * value() / 100.0; }
    double kilometers()   { return _GPS_KM_PER_METER * value() / 100.0; }
    double feet()         { return _GPS_FEET_PER_METER * value() / 100.0; }
+   int32_t centimeters() { return value(); }
 };
 
 struct GPSHDOP : GPSDecimal
@@ -186,13 +243,50 @@ struct GPSHDOP : GPSDecimal
    double hdop() { return value() / 100.0; }
 };
 
+struct GPSDOP : GPSDecimal
+{
+   double dop() { return value() / 100.0; }
+};
+
+// NMEA sentence types GPSPlus knows by id. Built-in fields come from RMC,
+// GGA, GSA, VTG and ZDA; GSV and GLL are only there for GPSCustom.
+#define _GPS_SENTENCES(X) X(RMC) X(GGA) X(GSA) X(VTG) X(ZDA) X(GSV) X(GLL)
+#define _GPS_SENTENCE_ENUM(s) GPS_SENTENCE_##s,
+enum GPSSentence { _GPS_SENTENCES(_GPS_SENTENCE_ENUM) GPS_SENTENCE_COUNT, GPS_SENTENCE_OTHER = 0xFF };
+#undef _GPS_SENTENCE_ENUM
+
+// The three type characters of a sentence ("RMC" of "$GPRMC") packed into an
+// integer, so sentence types compare without strcmp
+constexpr uint32_t gpsTypeCode(const char *type)
+{
+   return (uint32_t)(uint8_t)type[0] << 16 | (uint32_t)(uint8_t)type[1] << 8 | (uint8_t)type[2];
+}
+
+#define _GPS_SENTENCE_CODE(s) id == GPS_SENTENCE_##s ? gpsTypeCode(#s) :
+constexpr uint32_t gpsSentenceTypeCode(uint8_t id)
+{
+   return _GPS_SENTENCES(_GPS_SENTENCE_CODE) 0;
+}
+#undef _GPS_SENTENCE_CODE
+
+// Sentence id of a type name, GPS_SENTENCE_OTHER if unknown. Meant for
+// compile time: gpsSentenceId("GSV")
+constexpr uint8_t gpsSentenceId(const char *type, uint8_t id = 0)
+{
+   return id == GPS_SENTENCE_COUNT ? (uint8_t)GPS_SENTENCE_OTHER
+        : gpsSentenceTypeCode(id) == gpsTypeCode(type) ? id
+        : gpsSentenceId(type, id + 1);
+}
+
 struct GPSPlus;
 struct GPSCustom
 {
 public:
    GPSCustom() {};
-   GPSCustom(GPSPlus &gps, const char *sentenceName, int termNumber);
-   void begin(GPSPlus &gps, const char *_sentenceName, int _termNumber);
+   GPSCustom(GPSPlus &gps, uint8_t sentence, uint8_t termNumber);
+   // Returns false if the sentence is unknown, the term is out of range or
+   // all _GPS_MAX_CUSTOM slots are taken
+   bool begin(GPSPlus &gps, uint8_t sentence, uint8_t termNumber);
 
    bool isUpdated() const  { return updated; }
    bool isValid() const    { return valid; }
@@ -207,10 +301,9 @@ private:
    char buffer[_GPS_MAX_FIELD_SIZE + 1];
    unsigned long lastCommitTime;
    bool valid, updated;
-   const char *sentenceName;
-   int termNumber;
+   uint8_t sentence;
+   uint8_t termNumber;
    friend struct GPSPlus;
-   GPSCustom *next;
 };
 
 struct GPSPlus
@@ -218,6 +311,25 @@ struct GPSPlus
 public:
     GPSPlus();
     bool encode(char c);
+    // Feeds a whole buffer, returns the number of sentences that passed the
+    // checksum and were committed.
+    size_t encode(const char *data, size_t len);
+
+    // When enabled, a sentence without built-in fields that no GPSCustom
+    // wants is dropped as soon as its first term is read: the rest of
+    // it is skipped up to the next '$' and its checksum is not counted.
+    void skipUnusedSentences(bool enable) { skipUnused = enable; }
+
+    // UBX configuration of the NEO-6M
+    static size_t ubxFrame(uint8_t *out, uint8_t msgClass, uint8_t msgId, const uint8_t *payload, uint16_t len);
+    static void setNmeaRate(uart_inst_t *uart, uint8_t nmeaId, uint8_t rate);
+    static void disableUnusedSentences(uart_inst_t *uart);
+    // Navigation solution (and so NMEA output) every measurementMs
+    static void setMeasurementRate(uart_inst_t *uart, uint16_t measurementMs);
+    // Backup mode (RXM-PMREQ) until activity on the receiver's RX line;
+    // wakeUp() provides that, the receiver then hot starts.
+    static void powerDown(uart_inst_t *uart);
+    static void wakeUp(uart_inst_t *uart);
 
     GPSLocation location;
     GPSDate date;
@@ -227,11 +339,26 @@ public:
     GPSAltitude altitude;
     GPSInteger satellites;
     GPSHDOP hdop;
+    GPSDOP pdop;
+    GPSDOP vdop;
 
     static double distanceBetween(double lat1, double long1, double lat2, double long2);
     static double courseTo(double lat1, double long1, double lat2, double long2);
     static const char *cardinal(double course);
 
+    // Fixed-point versions of the above for the FPU-less RP2040, on signed
+    // 1e-7 degree coordinates (GPSLocation::latE7(), degreesE7()).
+    // distanceBetweenFixed() returns whole meters. Below _GPS_FAST_DISTANCE_E7
+    // in both axes it is an equirectangular approximation, within 2.5 m of
+    // distanceBetween() at the 22 km limit; above it a table haversine within
+    // 20 m anywhere on the globe. courseToFixed() returns hundredths of a
+    // degree like GPSCourse::value(), within 0.06 degree of courseTo() at 10 m
+    // and 0.02 degree beyond 1 km. host/geo_bench measures both.
+    static uint32_t distanceBetweenFixed(int32_t lat1, int32_t long1, int32_t lat2, int32_t long2);
+    static uint16_t courseToFixed(int32_t lat1, int32_t long1, int32_t lat2, int32_t long2);
+    static const char *cardinalFixed(uint32_t course);
+    static int32_t degreesE7(const RawDegrees &deg);
+
     static int32_t parseDecimal(const char *term);
     static void parseDegrees(const char *term, RawDegrees &deg);
 
@@ -239,10 +366,9 @@ public:
     uint32_t sentencesWithFix() const { return sentencesWithFixCount; }
     uint32_t failedChecksum()   const { return failedChecksumCount; }
     uint32_t passedChecksum()   const { return passedChecksumCount; }
+    uint32_t sentencesSkipped() const { return skippedSentenceCount; }
 
 private:
-    enum {GPS_SENTENCE_GGA, GPS_SENTENCE_RMC, GPS_SENTENCE_OTHER};
-
     // parsing state variables
     uint8_t parity;
     bool isChecksumTerm;
@@ -251,22 +377,91 @@ private:
     uint8_t curTermNumber;
     uint8_t curTermOffset;
     bool sentenceHasFix;
+    bool skipUnused;
+    bool skippingSentence;
 
-    // custom element support
+    // custom element support: customTerms has a bit for every term of a
+    // sentence that has a GPSCustom registered
     friend struct GPSCustom;
-    GPSCustom *customElts;
-    GPSCustom *customCandidates;
-    void insertCustom(GPSCustom *pElt, const char *sentenceName, int index);
+    GPSCustom *customElts[_GPS_MAX_CUSTOM];
+    uint8_t customCount;
+    uint32_t customTerms[GPS_SENTENCE_COUNT];
+    bool addCustom(GPSCustom *pElt);
 
     // statistics
     uint32_t encodedCharCount;
     uint32_t sentencesWithFixCount;
     uint32_t failedChecksumCount;
     uint32_t passedChecksumCount;
+    uint32_t skippedSentenceCount;
 
     // internal utilities
+    static bool isDelimiter(char c)
+    {
+        // every NMEA delimiter sorts at or below ',', so data characters
+        // usually fail the first comparison
+        return (uint8_t)c <= ',' && (c == ',' || c == '*' || c == '$' || c == '\r' || c == '\n');
+    }
     int fromHex(char a);
+    bool encodeDelimiter(char c);
     bool endOfTermHandler();
 };
 
+// Incremental decoder for the UBX binary protocol of the NEO-6M. It handles
+// NAV-POSLLH, NAV-SOL, NAV-VELNED and NAV-TIMEUTC and commits them into the
+// location, date, time, speed, course, altitude and satellites of the
+// GPSPlus it is attached to, so readers do not care which protocol is used.
+// Position and velocity of an epoch are committed once the NAV-SOL of the
+// same iTOW reports a valid fix.
+struct GPSUbx
+{
+public:
+    GPSUbx(GPSPlus &gps);
+    // Both return whether / how many known messages passed the checksum
+    bool encode(uint8_t c);
+    size_t encode(const uint8_t *data, size_t len);
+
+    // Enables the four NAV messages and turns NMEA output off on UART1
+    static void configureUbxOnly(uart_inst_t *uart, uint32_t baudRate);
+
+    uint32_t charsProcessed()   const { return encodedCharCount; }
+    uint32_t messagesWithFix()  const { return messagesWithFixCount; }
+    uint32_t failedChecksum()   const { return failedChecksumCount; }
+    uint32_t passedChecksum()   const { return passedChecksumCount; }
+    uint32_t unknownMessages()  const { return unknownMessageCount; }
+    uint32_t badLengths()       const { return badLengthCount; }
+
+private:
+    enum {UBX_WAIT_SYNC_1, UBX_WAIT_SYNC_2, UBX_CLASS, UBX_ID, UBX_LENGTH_1, UBX_LENGTH_2, UBX_PAYLOAD, UBX_CK_A, UBX_CK_B};
+
+    GPSPlus &gps;
+
+    // parsing state variables
+    uint8_t state;
+    uint8_t msgClass, msgId;
+    uint16_t msgLength;
+    uint16_t payloadOffset;
+    uint8_t ckA, ckB;
+    uint8_t payload[_GPS_UBX_MAX_PAYLOAD];
+
+    // epoch state: NAV-SOL decides whether position and velocity commit
+    bool solKnown, solHasFix;
+    uint32_t solITow;
+    bool posPending, velPending;
+    uint32_t posITow, velITow;
+
+    // statistics
+    uint32_t encodedCharCount;
+    uint32_t messagesWithFixCount;
+    uint32_t failedChecksumCount;
+    uint32_t passedChecksumCount;
+    uint32_t unknownMessageCount;
+    uint32_t badLengthCount;
+
+    // internal utilities
+    void checksum(uint8_t c) { ckA += c; ckB += ckA; }
+    bool endOfMessageHandler();
+    void commitPending();
+};
+
 #endif
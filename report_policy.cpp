@@ -0,0 +1,110 @@
+#include "report_policy.h"
+
+// per tier: normal, low, critical
+static const uint32_t gpsPeriods[] = {1000, 5000, 30000};
+static const uint32_t reportPeriods[] = {30000, 120000, 600000};
+
+// The tier for mv without hysteresis
+static BATTERY_TIER tierFor(uint32_t mv)
+{
+    if (mv < POLICY_BATTERY_CRITICAL_MV)
+        return BATTERY_TIER::CRITICAL;
+    if (mv < POLICY_BATTERY_LOW_MV)
+        return BATTERY_TIER::LOW;
+    return BATTERY_TIER::NORMAL;
+}
+
+bool ReportPolicy::update(const SIM800L &modem, uint32_t nowMs)
+{
+    int32_t sum = 0;
+    int n = 0;
+    for (size_t i = 0; i < modem.signal.count() && n < POLICY_SIGNAL_SAMPLES; i++)
+    {
+        const SignalSample &s = modem.signal[i];
+        if (nowMs - s.atMs > POLICY_SAMPLE_MAX_AGE_MS)
+            break;
+        sum += s.known() ? s.dbm : SIM800L::rssiToDbm(0);
+        n++;
+    }
+    dbm = n ? (int16_t)(sum / n) : 0;
+    if (n && dbm >= POLICY_GOOD_DBM)
+        good = true;
+    else if (!n || dbm < POLICY_POOR_DBM)
+        good = false;
+
+    if (modem.battery.count() == 0)
+        return false;
+    const BatterySample &b = modem.battery[0];
+    BATTERY_TIER t = batteryTier;
+    if (b.chargeState != 0)
+        t = BATTERY_TIER::NORMAL;
+    else if (tierFor(b.mv) > t)
+        t = tierFor(b.mv);
+    else if (tierFor(b.mv > POLICY_BATTERY_HYST_MV ? b.mv - POLICY_BATTERY_HYST_MV : 0) < t)
+        t = tierFor(b.mv - POLICY_BATTERY_HYST_MV);
+    if (t == batteryTier)
+        return false;
+    batteryTier = t;
+    tierChanges++;
+    return true;
+}
+
+uint32_t ReportPolicy::gpsPeriodMs() const
+{
+    return gpsPeriods[(int)batteryTier];
+}
+
+uint32_t ReportPolicy::reportPeriodMs() const
+{
+    return reportPeriods[(int)batteryTier];
+}
+
+size_t ReportPolicy::uploadCount(size_t pending, uint32_t oldestMs, uint32_t nowMs)
+{
+    if (pending == 0)
+        return 0;
+    const bool due = pending >= POLICY_BATCH || nowMs - oldestMs >= POLICY_MAX_WAIT_MS;
+    if (!release(due))
+        return 0;
+    return pending < POLICY_MAX_BATCH ? pending : POLICY_MAX_BATCH;
+}
+
+bool ReportPolicy::sendStored(bool pending)
+{
+    return pending && release(true);
+}
+
+// Holds due uploads back while the signal is poor, and lets everything go
+// once it has recovered
+bool ReportPolicy::release(bool due)
+{
+    if (!good)
+    {
+        if (due && !holding)
+        {
+            holding = true;
+            deferrals++;
+        }
+        return false;
+    }
+    if (holding)
+    {
+        holding = false;
+        recoveries++;
+        return true;
+    }
+    return due;
+}
+
+const char *ReportPolicy::tierName(BATTERY_TIER t)
+{
+    switch (t)
+    {
+    case BATTERY_TIER::LOW:
+        return "low";
+    case BATTERY_TIER::CRITICAL:
+        return "critical";
+    default:
+        return "normal";
+    }
+}
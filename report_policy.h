@@ -0,0 +1,76 @@
+#ifndef __report_policy_H__
+#define __report_policy_H__
+
+#include "sim800l.h"
+
+#include <cinttypes>
+#include <cstddef>
+
+// Signal is the average of the newest known AT+CSQ samples, unknown (99)
+// counting as the weakest. Uploads are held back once it drops below
+// POLICY_POOR_DBM and resume at POLICY_GOOD_DBM or better. Sending at a poor
+// signal costs several times the energy per byte and ends in retries.
+#define POLICY_SIGNAL_SAMPLES    3
+#define POLICY_SAMPLE_MAX_AGE_MS 60000
+#define POLICY_POOR_DBM          -101   // CSQ 6
+#define POLICY_GOOD_DBM          -93    // CSQ 10
+
+// Reports go up POLICY_BATCH at a time, or earlier once the oldest has
+// waited POLICY_MAX_WAIT_MS. What piled up while the signal was poor goes
+// in one upload when it recovers, up to POLICY_MAX_BATCH. A batch is a
+// report frame, and it takes ten fixes to a frame for a moving fix to come
+// under 8 bytes (see fix_bench); at five it is 9 to 12.
+#define POLICY_BATCH             10
+#define POLICY_MAX_BATCH         64
+#define POLICY_MAX_WAIT_MS       600000
+
+// Battery tiers from the AT+CBC voltage when not charging. A tier is left
+// upwards only POLICY_BATTERY_HYST_MV above the threshold that entered it.
+#define POLICY_BATTERY_LOW_MV      3700
+#define POLICY_BATTERY_CRITICAL_MV 3500
+#define POLICY_BATTERY_HYST_MV     50
+
+enum class BATTERY_TIER {
+    NORMAL,
+    LOW,
+    CRITICAL
+};
+
+// Decides when reports are uploaded and how often the GPS measures and a
+// report is taken, from the modem's signal and battery history.
+class ReportPolicy {
+public:
+    // Re-evaluates from the modem's samples; true if the battery tier changed
+    bool update(const SIM800L &modem, uint32_t nowMs);
+
+    BATTERY_TIER tier() const { return batteryTier; }
+    bool signalGood() const { return good; }
+    // the average behind signalGood(), 0 without recent samples
+    int16_t signalDbm() const { return dbm; }
+    // GPS measurement period and report period of the tier
+    uint32_t gpsPeriodMs() const;
+    uint32_t reportPeriodMs() const;
+
+    // How many of the pending reports (the oldest taken at oldestMs) to
+    // upload now, 0 to keep them
+    size_t uploadCount(size_t pending, uint32_t oldestMs, uint32_t nowMs);
+    // Whether reports stored already, and so due, go up now
+    bool sendStored(bool pending);
+
+    static const char *tierName(BATTERY_TIER t);
+
+    // statistics
+    uint32_t deferrals = 0;     // uploads due but held back for the signal
+    uint32_t recoveries = 0;    // held back uploads sent when it came back
+    uint32_t tierChanges = 0;
+
+private:
+    BATTERY_TIER batteryTier = BATTERY_TIER::NORMAL;
+    bool good = false;
+    bool holding = false;
+    int16_t dbm = 0;
+
+    bool release(bool due);
+};
+
+#endif
@@ -1,153 +1,221 @@
 #include "sim800l.h"
 
+#include "at_parse.h"
 #include "secrets.h"
-#include "ssd1306_i2c.h"
 
-#include <algorithm>
+#include <cstdio>
+#include <cstring>
 
-void SIM800L::init()
-{
-    at_send_and_await_response("AT+CPIN?\r", 5000);
-    std::string cpinSetCmd = std::string("AT+CPIN=") + SIM_PIN_CODE + "\r";
-    at_send_and_await_response(cpinSetCmd.c_str(), 5000);
-    at_send_and_await_response("AT+CPIN?\r", 5000);
-    return;
-
-
-    // disable echo mode to save bits, command is stored anyway
-    at_send_and_await_response("ATE0\r", 100);
+// engine polling interval of the blocking commands
+#define SIM800L_BLOCKING_POLL_MS 10
 
-    init_sim_pin();
+SIM800L::SIM800L()
+  : at(SIM800L_UART_ID)
+{
+    at.onUrc("+CPIN:", &onUrc, this);
+    at.onUrc("RING", &onUrc, this);
+    at.onUrc("+CMTI:", &onUrc, this);
+    at.onUrc("UNDER-VOLTAGE", &onUrc, this);
+    at.onUrc("Call Ready", &onUrc, this);
+    at.onUrc("SMS Ready", &onUrc, this);
 }
 
-void SIM800L::init_sim_pin()
+void SIM800L::begin()
 {
-    at_send_and_await_response("AT+CPIN?\r", 5000);
-    sleep_ms(1000);
-
-    if (simCardState == SIM_CARD_STATE::INVALID || simCardState == SIM_CARD_STATE::ERROR)
-    {
-        state = SIM_STATE::ERROR;
-        return;
-    }
+    state = SIM_STATE::INVALID;
+    pinAttempts = 0;
+    at.send("AT+CPIN?", 5000, &onPinQuery, this);
+}
 
-    if (simCardState == SIM_CARD_STATE::READY)
-    {
-        state = SIM_STATE::READY;
-        return;
-    }
+void SIM800L::onPinQuery(AT_RESULT result, const char *response, void *ctx)
+{
+    SIM800L *self = (SIM800L *)ctx;
+    if (result == AT_RESULT::OK && strstr(response, "SIM PIN"))
+        self->simCardState = SIM_CARD_STATE::WAITING_FOR_PIN;
+    else if (result == AT_RESULT::OK && strstr(response, "READY"))
+        self->simCardState = SIM_CARD_STATE::READY;
+    else if (result == AT_RESULT::ERROR)
+        self->simCardState = SIM_CARD_STATE::ERROR;
+    else
+        self->simCardState = SIM_CARD_STATE::INVALID;
 
-    if (simCardState == SIM_CARD_STATE::WAITING_FOR_PIN)
+    switch (self->simCardState)
     {
-        std::string cpinSetCmd = std::string("AT+CPIN=") + SIM_PIN_CODE + "\r";
-        at_send_and_await_response(cpinSetCmd.c_str(), 5000);
-
-        at_send_and_await_response("AT+CPIN?\r", 5000);
-        if (simCardState == SIM_CARD_STATE::WAITING_FOR_PIN)
+    case SIM_CARD_STATE::READY:
+        self->state = SIM_STATE::READY;
+        self->at.send("AT+CLTS?", 1000, &onClockSetting, self);
+        break;
+    case SIM_CARD_STATE::WAITING_FOR_PIN:
+        if (self->pinAttempts == SIM800L_PIN_ATTEMPTS)
         {
-            // send again and hope
-            at_send_and_await_response(cpinSetCmd.c_str(), 5000);
-
-            at_send_and_await_response("AT+CPIN?\r", 5000);
-            if (simCardState == SIM_CARD_STATE::READY)
-            {
-                state = SIM_STATE::READY;
-                return;
-            }
-
             // no chance
-            state = SIM_STATE::FLAG;
-            return;
-            if (simCardState == SIM_CARD_STATE::INVALID || simCardState == SIM_CARD_STATE::ERROR)
-            {
-                state = SIM_STATE::ERROR;
-                return;
-            }
-        }
-
-        if (simCardState == SIM_CARD_STATE::READY)
-        {
-            state = SIM_STATE::READY;
-            return;
+            self->state = SIM_STATE::FLAG;
+            break;
         }
+        char cmd[AT_CMD_MAX];
+        snprintf(cmd, sizeof(cmd), "AT+CPIN=%s", SIM_PIN_CODE);
+        self->pinAttempts++;
+        self->at.send(cmd, 5000, &onPinSet, self);
+        break;
+    default:
+        self->state = SIM_STATE::ERROR;
+        break;
     }
 }
 
-void SIM800L::handleStateChange()
+void SIM800L::onPinSet(AT_RESULT, const char *, void *ctx)
+{
+    // a wrong PIN answers +CME ERROR: 16, either way ask again
+    SIM800L *self = (SIM800L *)ctx;
+    self->at.send("AT+CPIN?", 5000, &onPinQuery, self);
+}
+
+void SIM800L::onClockSetting(AT_RESULT result, const char *response, void *ctx)
+{
+    // AT&W rewrites the profile in NVRAM, only when the setting is not saved yet
+    SIM800L *self = (SIM800L *)ctx;
+    AtTokens tokens;
+    const char *line = AtTokens::findLine(response, "+CLTS");
+    int32_t enabled;
+    if (result != AT_RESULT::OK || !line || !tokens.parse(line, "+CLTS") || !tokens.integer(0, &enabled)
+        || enabled != 0)
+        return;
+    self->at.send("AT+CLTS=1", 1000);
+    self->at.send("AT&W", 1000);
+}
+
+void SIM800L::onUrc(const char *line, void *ctx)
 {
-    if (lastCommandSent.find("AT+CPIN?") != std::string::npos)
+    SIM800L *self = (SIM800L *)ctx;
+    if (!strncmp(line, "RING", 4))
+        self->rings++;
+    else if (!strncmp(line, "+CMTI:", 6))
     {
-        if (response.find("SIM PIN") != std::string::npos)
-        {
-            simCardState = SIM_CARD_STATE::WAITING_FOR_PIN;
-        }
-        else if (response.find("READY") != std::string::npos)
+        // +CMTI: "SM",<index>
+        AtTokens tokens;
+        int32_t index;
+        self->smsReceived++;
+        if (tokens.parse(line, "+CMTI") && tokens.integer(1, &index))
+            self->lastSmsIndex = index;
+    }
+    else if (!strncmp(line, "UNDER-VOLTAGE", 13))
+    {
+        // UNDER-VOLTAGE WARNNING, or POWER DOWN after which the module is off
+        self->underVoltage++;
+        if (strstr(line, "POWER DOWN"))
         {
-            simCardState = SIM_CARD_STATE::READY;
+            self->state = SIM_STATE::INVALID;
+            self->simCardState = SIM_CARD_STATE::INVALID;
         }
-        else if (response.find("ERROR") != std::string::npos)
+    }
+    else if (!strncmp(line, "+CPIN:", 6))
+    {
+        if (strstr(line, "READY"))
         {
-            simCardState = SIM_CARD_STATE::ERROR;
+            self->simCardState = SIM_CARD_STATE::READY;
+            self->readyUrcs++;
         }
-        else
+        else if (strstr(line, "NOT INSERTED"))
         {
-            simCardState = SIM_CARD_STATE::INVALID;
+            self->simCardState = SIM_CARD_STATE::ERROR;
+            self->state = SIM_STATE::ERROR;
         }
     }
+    else
+        self->readyUrcs++;
+}
 
-    const bool isBatteryStatus = lastCommandSent.find("AT+CBC") != std::string::npos;
-    if (isBatteryStatus || lastCommandSent.find("AT+CSQ") != std::string::npos)
-    {
-        response.erase(std::remove_if(response.begin(), response.end(), [](char c) -> bool
-            {
-                return ('A' < c && c < 'Z') || ('a' < c && c < 'z') || c == '\r' || c == '\n';
-            }), response.end());
-        if (isBatteryStatus)
-            batteryStatus = response;
-        else
-            connectionStatus = response;
-    }
+int16_t SIM800L::rssiToDbm(uint8_t rssi)
+{
+    if (rssi == 0)
+        return -115;
+    if (rssi == 1)
+        return -111;
+    if (rssi <= 30)
+        return (int16_t)(-110 + 2 * (rssi - 2));
+    if (rssi == 31)
+        return -52;
+    return 0;
 }
 
-void SIM800L::at_send_and_await_response(const char* cmd, size_t timeout)
+bool SIM800L::parseSignal(const char *response, SignalSample *s)
 {
-    response.clear();
-    uart_puts(SIM800L_UART_ID, cmd);
-    lastCommandSent = cmd;
-    constexpr size_t sleepms = 50;
-    const size_t timeoutCnt = timeout / sleepms;
-    for (int i = 0; i < timeoutCnt; i++)
+    AtTokens tokens;
+    const char *line = AtTokens::findLine(response, "+CSQ");
+    int32_t rssi, ber;
+    if (!line || !tokens.parse(line, "+CSQ") || !tokens.integer(0, &rssi) || !tokens.integer(1, &ber))
+        return false;
+    if (rssi < 0 || (rssi > 31 && rssi != SIM800L_CSQ_UNKNOWN) || ber < 0 || (ber > 7 && ber != SIM800L_CSQ_UNKNOWN))
+        return false;
+    s->rssi = (uint8_t)rssi;
+    s->ber = (uint8_t)ber;
+    s->dbm = rssiToDbm(s->rssi);
+    return true;
+}
+
+bool SIM800L::parseBattery(const char *response, BatterySample *b)
+{
+    AtTokens tokens;
+    const char *line = AtTokens::findLine(response, "+CBC");
+    int32_t state, percent, mv;
+    if (!line || !tokens.parse(line, "+CBC") || !tokens.integer(0, &state) || !tokens.integer(1, &percent)
+        || !tokens.integer(2, &mv))
+        return false;
+    if (state < 0 || state > 2 || percent < 0 || percent > 100 || mv < 0 || mv > UINT16_MAX)
+        return false;
+    b->chargeState = (uint8_t)state;
+    b->percent = (uint8_t)percent;
+    b->mv = (uint16_t)mv;
+    return true;
+}
+
+void SIM800L::onSignal(AT_RESULT result, const char *response, void *ctx)
+{
+    SIM800L *self = (SIM800L *)ctx;
+    SignalSample s;
+    if (result == AT_RESULT::OK && parseSignal(response, &s))
     {
-        sleep_ms(sleepms);
-        if (!processResponse().empty())
-            break;
+        s.atMs = to_ms_since_boot(get_absolute_time());
+        self->signal.add(s);
     }
 }
 
-void SIM800L::processChar(char c)
+void SIM800L::onBattery(AT_RESULT result, const char *response, void *ctx)
 {
-    response += c;
+    SIM800L *self = (SIM800L *)ctx;
+    BatterySample b;
+    if (result == AT_RESULT::OK && parseBattery(response, &b))
+    {
+        b.atMs = to_ms_since_boot(get_absolute_time());
+        self->battery.add(b);
+    }
 }
 
-std::string SIM800L::processResponse()
+bool SIM800L::command(const char *cmd, uint32_t timeoutMs)
 {
-    if (response.back() == '\n' && (response.find("OK\r\n") != std::string::npos
-                  || response.find("CME ERROR") != std::string::npos
-                  || response.find("CMS ERROR") != std::string::npos))
+    struct Wait {
+        bool done;
+        AT_RESULT result;
+    } wait = {false, AT_RESULT::TIMEOUT};
+    auto done = [](AT_RESULT result, const char *, void *ctx)
     {
-        while (response.back() == '\r' || response.back() == '\n')
-            response.pop_back();
-        while (response.front() == '\r' || response.front() == '\n')
-            response.erase(0, 1);
-
-        handleStateChange();
-        showString(response.c_str());
-        return response;
+        Wait *w = (Wait *)ctx;
+        w->done = true;
+        w->result = result;
+    };
+    if (!at.send(cmd, timeoutMs, done, &wait))
+        return false;
+    while (true)
+    {
+        at.poll();
+        if (wait.done)
+            break;
+        sleep_ms(SIM800L_BLOCKING_POLL_MS);
     }
-    return "";
+    return wait.result == AT_RESULT::OK;
 }
 
-void SIM800L::info()
+void SIM800L::requestInfo()
 {
     /*
     AT+CSQ
@@ -171,9 +239,8 @@ void SIM800L::info()
     0...7 As RXQUAL values in the table in GSM 05.08 [20] subclause 7.2.4
     99 Not known or not detectable
     */
-    at_send_and_await_response("AT+CSQ\r", 1000);
+    at.send("AT+CSQ", 1000, &onSignal, this);
 
-    //sleep_ms(1000);
     /*
     AT+CBC
     Response
@@ -190,7 +257,96 @@ void SIM800L::info()
     <bcl> Battery connection level: 1...100 battery has 1-100 percent of capacity remaining
     <voltage> Battery voltage(mV)
     */
-    //at_send_and_await_response("AT+CBC\r", 500);
+    at.send("AT+CBC", 1000, &onBattery, this);
+}
+
+bool SIM800L::requestNetworkTime(sim800l_time_fn fn, void *ctx)
+{
+    /*
+    AT+CCLK?
+    Response
+    +CCLK: <time>
+    OK
+
+    Parameters
+    <time> String type value; format is "yy/MM/dd,hh:mm:ss+zz", where
+    characters indicate year (two last digits), month, day, hour, minutes,
+    seconds and time zone (indicates the difference, expressed in quarters
+    of an hour, between the local time and GMT; range -47...+48).
+    */
+    if (timeFn || !at.send("AT+CCLK?", 1000, &onNetworkTime, this))
+        return false;
+    timeFn = fn;
+    timeCtx = ctx;
+    return true;
+}
+
+void SIM800L::onNetworkTime(AT_RESULT result, const char *response, void *ctx)
+{
+    SIM800L *self = (SIM800L *)ctx;
+    const sim800l_time_fn fn = self->timeFn;
+    self->timeFn = nullptr;
+    datetime_t local;
+    int zoneQuarters;
+    if (result == AT_RESULT::OK && parseNetworkTime(response, &local, &zoneQuarters))
+        fn(local, zoneQuarters, self->timeCtx);
+}
+
+// "yy/MM/dd,hh:mm:ss+zz" into its seven numbers, the zone signed
+static bool parseClock(const AtField &f, int v[7])
+{
+    static const char separators[] = "//,::";
+    const char *p = f.text, *end = f.text + f.len;
+    for (int i = 0; i < 7; i++)
+    {
+        int sign = 1;
+        if (i == 6)
+        {
+            if (p == end || (*p != '+' && *p != '-'))
+                return false;
+            sign = *p++ == '-' ? -1 : 1;
+        }
+        else if (i > 0)
+        {
+            if (p == end || *p != separators[i - 1])
+                return false;
+            p++;
+        }
+        int n = 0, digits = 0;
+        for (; p < end && *p >= '0' && *p <= '9' && digits < 4; p++, digits++)
+            n = n * 10 + (*p - '0');
+        if (digits == 0)
+            return false;
+        v[i] = sign * n;
+    }
+    return p == end;
+}
+
+bool SIM800L::parseNetworkTime(const char *response, datetime_t *local, int *zoneQuarters)
+{
+    AtTokens tokens;
+    const char *line = AtTokens::findLine(response, "+CCLK");
+    int v[7];
+    if (!line || !tokens.parse(line, "+CCLK") || tokens.count() != 1 || !tokens[0].quoted
+        || !parseClock(tokens[0], v))
+        return false;
+    const int yy = v[0], MM = v[1], dd = v[2], hh = v[3], mm = v[4], ss = v[5], zz = v[6];
+    // the module's own clock starts at 2004-01-01 until the network sets it
+    if (yy < SIM800L_MIN_NETWORK_YEAR % 100)
+        return false;
+    // out of range fields would be normalised into a wrong date for the RTC;
+    // the zone is at most 14 hours off UTC
+    if (MM < 1 || MM > 12 || dd < 1 || dd > 31 || hh > 23 || mm > 59 || ss > 59 || zz < -56 || zz > 56)
+        return false;
+    local->year = (int16_t)(2000 + yy);
+    local->month = (int8_t)MM;
+    local->day = (int8_t)dd;
+    local->dotw = 0;
+    local->hour = (int8_t)hh;
+    local->min = (int8_t)mm;
+    local->sec = (int8_t)ss;
+    *zoneQuarters = zz;
+    return true;
 }
 
 void SIM800L::sleep()
@@ -211,4 +367,14 @@ void SIM800L::sleep()
         port), module can enter sleep mode. Otherwise, it will quit sleep
         mode. 
     */
+    command("AT+CSCLK=2", 1000);
+}
+
+void SIM800L::wake()
+{
+    // The first character only wakes the module up and is lost, so the
+    // rest of this line is rejected. Commands are taken after 100 ms.
+    uart_puts(SIM800L_UART_ID, "AT\r");
+    sleep_ms(100);
+    command("AT+CSCLK=0", 1000);
 }
\ No newline at end of file
@@ -4,12 +4,19 @@
 #include "pico/time.h"
 #include "hardware/uart.h"
 
+#include "at_engine.h"
+#include "uart_dma_rx.h"
+
 #include <cinttypes>
-#include <cstdlib>
-#include <string>
 
-#define SIM800L_UART_TX_PIN 4
-#define SIM800L_UART_RX_PIN 5
+// GPIO 4/5, UART1's default pins, are the MPU6050's I2C0 (mpu6050_i2c.h).
+// Boards wired to 4/5 before have to move the modem's RX/TX to 8/9.
+#ifndef SIM800L_UART_TX_PIN
+#define SIM800L_UART_TX_PIN 8
+#endif
+#ifndef SIM800L_UART_RX_PIN
+#define SIM800L_UART_RX_PIN 9
+#endif
 
 #define SIM800L_UART_ID   uart1
 #define SIM800L_BAUD_RATE 9600
@@ -17,6 +24,18 @@
 #define SIM800L_STOP_BITS 1
 #define SIM800L_PARITY    UART_PARITY_NONE
 
+// AT+CCLK? answers before this year are the module's unset clock
+#define SIM800L_MIN_NETWORK_YEAR 2020
+
+// AT+CPIN=<pin> attempts before giving up (the SIM locks after three)
+#define SIM800L_PIN_ATTEMPTS 2
+
+// AT+CSQ / AT+CBC samples kept, newest first
+#define SIM800L_HISTORY 8
+
+// rssi and ber when the module cannot tell
+#define SIM800L_CSQ_UNKNOWN 99
+
 enum class SIM_STATE {
     READY,
     ERROR,
@@ -24,18 +43,94 @@ enum class SIM_STATE {
     INVALID
 };
 
-class SIM800L {
+// AT+CSQ
+struct SignalSample {
+    uint8_t rssi;       // 0...31, SIM800L_CSQ_UNKNOWN
+    uint8_t ber;        // RXQUAL 0...7, SIM800L_CSQ_UNKNOWN
+    int16_t dbm;        // -115...-52, 0 if unknown
+    uint32_t atMs;      // to_ms_since_boot() when read
+
+    bool known() const { return rssi != SIM800L_CSQ_UNKNOWN; }
+};
+
+// AT+CBC
+struct BatterySample {
+    uint8_t chargeState;    // 0 not charging, 1 charging, 2 charged
+    uint8_t percent;
+    uint16_t mv;
+    uint32_t atMs;
+};
+
+// The last few samples, newest first
+template <typename T>
+class SampleHistory {
 public:
-    SIM800L() {}
-    void init();
-    void at_send_and_await_response(const char* cmd, size_t timeout);
-    
+    void add(const T &v)
+    {
+        head = (head + 1) % SIM800L_HISTORY;
+        samples[head] = v;
+        if (n < SIM800L_HISTORY)
+            n++;
+    }
+    size_t count() const { return n; }
+    // i = 0 is the newest
+    const T &operator[](size_t i) const { return samples[(head + SIM800L_HISTORY - i) % SIM800L_HISTORY]; }
 
-    void processChar(char c);
-    std::string processResponse();
+private:
+    T samples[SIM800L_HISTORY];
+    size_t head = 0, n = 0;
+};
 
-    void info();
+// Local network time and zone in quarter hours east of UTC
+typedef void (*sim800l_time_fn)(const datetime_t &local, int zoneQuarters, void *ctx);
+
+// SIM800L on top of the AT engine. The request functions only queue
+// commands; poll() from the main loop moves them along and the results
+// arrive in the members below or through callbacks. Only sleep() and wake()
+// wait for the modem, for parking.
+class SIM800L {
+public:
+    SIM800L();
+    // Unlocks the SIM (AT+CPIN?, AT+CPIN=<pin> if it asks for it) and has the
+    // module take the time from the network when it registers (AT+CLTS=1,
+    // saved with AT&W unless AT+CLTS? says it already is). state leaves
+    // INVALID when the SIM is ready or failed.
+    void begin();
+    void poll() { at.poll(); }
+    // true while commands are queued or in flight
+    bool busy() const { return !at.idle(); }
+    // a command is partly sent, poll again within a character time or two
+    bool transmitting() const { return at.transmitting(); }
+
+    // Called from the RX interrupt, true at the end of a line
+    bool processChar(char c) { return at.rxChar(c); }
+    // Read responses from a DMA receive buffer instead of processChar()
+    void attachDmaRx(uart_dma_rx_t *dma) { at.attachDmaRx(dma); }
+
+    uint32_t rxOverflows() const { return at.lineOverflows(); }
+    uint32_t rxHighWater() const { return at.linesHighWater(); }
+
+    // Signal quality (AT+CSQ) and battery (AT+CBC) into signal and battery
+    void requestInfo();
+    // "+CSQ: <rssi>,<ber>" and "+CBC: <bcs>,<bcl>,<voltage>" from a response;
+    // atMs is left to the caller
+    static bool parseSignal(const char *response, SignalSample *s);
+    static bool parseBattery(const char *response, BatterySample *b);
+    // AT+CSQ rssi in dBm, 0 for SIM800L_CSQ_UNKNOWN
+    static int16_t rssiToDbm(uint8_t rssi);
+    // Network time (NITZ) with AT+CCLK?. fn is only called with a time the
+    // network has set.
+    bool requestNetworkTime(sim800l_time_fn fn, void *ctx);
+    // "+CCLK: "yy/MM/dd,hh:mm:ss+zz"" from an AT+CCLK? response
+    static bool parseNetworkTime(const char *response, datetime_t *local, int *zoneQuarters);
+
+    // Slow clock mode (AT+CSCLK=2): the module sleeps while the serial
+    // port is idle. wake() brings it back and disables the mode. Both block
+    // until the modem answered.
     void sleep();
+    void wake();
+
+    AtEngine at;
 
 private:
     enum class SIM_CARD_STATE {
@@ -45,21 +140,35 @@ private:
         INVALID
     };
 
-    void init_sim_pin();
+    // Sends cmd and polls the engine until it completes
+    bool command(const char *cmd, uint32_t timeoutMs);
 
-    void handleStateChange();
+    static void onPinQuery(AT_RESULT result, const char *response, void *ctx);
+    static void onPinSet(AT_RESULT result, const char *response, void *ctx);
+    static void onClockSetting(AT_RESULT result, const char *response, void *ctx);
+    static void onSignal(AT_RESULT result, const char *response, void *ctx);
+    static void onBattery(AT_RESULT result, const char *response, void *ctx);
+    static void onNetworkTime(AT_RESULT result, const char *response, void *ctx);
+    static void onUrc(const char *line, void *ctx);
 
 public:
     volatile SIM_STATE state = SIM_STATE::INVALID;
 
-    std::string batteryStatus;
-    std::string connectionStatus;
+    SampleHistory<SignalSample> signal;
+    SampleHistory<BatterySample> battery;
 
-private:
-    std::string lastCommandSent;
-    std::string response;
+    // unsolicited result codes
+    uint32_t rings = 0;
+    uint32_t smsReceived = 0;       // +CMTI
+    int lastSmsIndex = -1;
+    uint32_t underVoltage = 0;      // warnings and power downs
+    uint32_t readyUrcs = 0;         // +CPIN: READY, Call Ready, SMS Ready
 
+private:
     SIM_CARD_STATE simCardState = SIM_CARD_STATE::INVALID;
+    int pinAttempts = 0;
+    sim800l_time_fn timeFn = nullptr;
+    void *timeCtx = nullptr;
 };
 
-#endif
\ No newline at end of file
+#endif
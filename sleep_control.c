@@ -1,39 +1,148 @@
 #include "sleep_control.h"
 
 #include "pico/sleep.h"
+#include "pico/time.h"
+#include "hardware/clocks.h"
+#include "hardware/rosc.h"
+#include "hardware/structs/clocks.h"
+#include "hardware/structs/scb.h"
+
+
+static rpi_sleep_stats_t stats;
+static rtc_callback_t user_callback;
+static uint64_t woke_us;
+
+static uint32_t scb_orig;
+static uint32_t sleep_en0_orig;
+static uint32_t sleep_en1_orig;
+
+
+// Days since 1970-01-01 of a proleptic Gregorian date
+static int32_t days_from_civil(int32_t y, uint32_t m, uint32_t d)
+{
+    y -= m <= 2;
+    const int32_t era = (y >= 0 ? y : y - 399) / 400;
+    const uint32_t yoe = (uint32_t)(y - era * 400);
+    const uint32_t doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+    const uint32_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + (int32_t)doe - 719468;
+}
+
+int64_t rpi_datetime_to_seconds(const datetime_t *t)
+{
+    return (int64_t)days_from_civil(t->year, t->month, t->day) * 86400 + t->hour * 3600 + t->min * 60 + t->sec;
+}
+
+void rpi_datetime_from_seconds(int64_t s, datetime_t *t)
+{
+    int32_t z = (int32_t)(s / 86400);
+    const int32_t rem = (int32_t)(s % 86400);
+    t->dotw = (int8_t)((z + 4) % 7);  // 1970-01-01 was a Thursday
+    z += 719468;
+    const int32_t era = (z >= 0 ? z : z - 146096) / 146097;
+    const uint32_t doe = (uint32_t)(z - era * 146097);
+    const uint32_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    const uint32_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    const uint32_t mp = (5 * doy + 2) / 153;
+    const uint32_t m = mp < 10 ? mp + 3 : mp - 9;
+    t->year = (int16_t)(yoe + era * 400 + (m <= 2));
+    t->month = (int8_t)m;
+    t->day = (int8_t)(doy - (153 * mp + 2) / 5 + 1);
+    t->hour = (int8_t)(rem / 3600);
+    t->min = (int8_t)(rem / 60 % 60);
+    t->sec = (int8_t)(rem % 60);
+}
 
 
 void rpi_sleep_init()
 {
+    // rtc_init() resets the RTC, so it always starts from the default time
+    rtc_init();
+    datetime_t t = RPI_SLEEP_DEFAULT_TIME;
+    rtc_set_datetime(&t);
+    // the new time takes a few RTC clock cycles to show
+    sleep_us(64);
+}
+
+static void sleep_wake_callback(void)
+{
+    woke_us = time_us_64();
+    if (user_callback)
+        user_callback();
+}
+
+static void sleep_prepare(void)
+{
+    scb_orig = scb_hw->scr;
+    sleep_en0_orig = clocks_hw->sleep_en0;
+    sleep_en1_orig = clocks_hw->sleep_en1;
+
     sleep_run_from_xosc();
+}
 
-    // Start the RTC
-    rtc_init();
+// Undoes sleep_prepare() and what the sleep itself changed: the ROSC was
+// stopped, deep sleep left enabled and every clock but the RTC gated.
+static void sleep_recover(void)
+{
+    rosc_enable();
+    scb_hw->scr = scb_orig;
+    clocks_hw->sleep_en0 = sleep_en0_orig;
+    clocks_hw->sleep_en1 = sleep_en1_orig;
+    // PLLs, clk_sys at full speed, clk_peri and clk_usb back on them
+    clocks_init();
+
+    const uint32_t latency = (uint32_t)(time_us_64() - woke_us);
+    stats.last_wake_latency_us = latency;
+    if (latency > stats.max_wake_latency_us)
+        stats.max_wake_latency_us = latency;
+}
+
+bool rpi_sleep_until(const datetime_t *t, rtc_callback_t callback)
+{
+    datetime_t now;
+    if (!rtc_get_datetime(&now))
+        return false;
+    const int64_t at = rpi_datetime_to_seconds(t);
+    if (at <= rpi_datetime_to_seconds(&now))
+        return false;
+
+    // fully specified alarm with a consistent day of the week
+    datetime_t alarm;
+    rpi_datetime_from_seconds(at, &alarm);
+
+    user_callback = callback;
+    sleep_prepare();
+    sleep_goto_sleep_until(&alarm, &sleep_wake_callback);
+    sleep_recover();
+    stats.sleeps++;
+    return true;
 }
 
+bool rpi_sleep_for(uint32_t ms, rtc_callback_t callback)
+{
+    datetime_t now;
+    if (!rtc_get_datetime(&now))
+        return false;
+    const uint32_t seconds = ms < 1000 ? 1 : (ms + 999) / 1000;
+    datetime_t t;
+    rpi_datetime_from_seconds(rpi_datetime_to_seconds(&now) + seconds, &t);
+    return rpi_sleep_until(&t, callback);
+}
 
-void rpi_sleep(rtc_callback_t callback)
+
+void rpi_dormant_until_pin(uint gpio, bool edge, bool high)
 {
-    datetime_t t = {
-            .year  = 2024,
-            .month = 10,
-            .day   = 21,
-            .dotw  = 1, // 0 is Sunday, so 5 is Friday
-            .hour  = 20,
-            .min   = 00,
-            .sec   = 00
-    };
-    rtc_set_datetime(&t);
+    // the dormant wake up restarts the oscillator the clocks run from
+    sleep_prepare();
 
-    datetime_t t_alarm = {
-            .year  = 2024,
-            .month = 10,
-            .day   = 21,
-            .dotw  = 1, // 0 is Sunday, so 5 is Friday
-            .hour  = 20,
-            .min   = 00,
-            .sec   = 03
-    };
-
-    sleep_goto_sleep_until(&t_alarm, callback);
-}
\ No newline at end of file
+    sleep_goto_dormant_until_pin(gpio, edge, high);
+
+    woke_us = time_us_64();
+    sleep_recover();
+    stats.dormant++;
+}
+
+const rpi_sleep_stats_t *rpi_sleep_stats()
+{
+    return &stats;
+}
@@ -3,15 +3,48 @@
 
 #include "hardware/rtc.h"
 
+#include <stdint.h>
+
+// Set by rpi_sleep_init(), until the time is synced
+#ifndef RPI_SLEEP_DEFAULT_TIME
+#define RPI_SLEEP_DEFAULT_TIME { .year = 2024, .month = 1, .day = 1, .dotw = 1, .hour = 0, .min = 0, .sec = 0 }
+#endif
+
 #ifdef __cplusplus
 extern "C"{
 #endif
 
+    typedef struct {
+        uint32_t sleeps;
+        uint32_t dormant;
+        uint32_t last_wake_latency_us;  // wake up to clocks restored
+        uint32_t max_wake_latency_us;
+    } rpi_sleep_stats_t;
+
     void rpi_sleep_init();
-    void rpi_sleep(rtc_callback_t callback);
+
+    // Sleep with only the RTC running until it reaches t (false if t is not
+    // in the future) or for ms milliseconds, rounded up to whole RTC
+    // seconds of which the current one is already partly over. The clocks
+    // run from the XOSC while asleep and are restored before returning;
+    // callback runs from the RTC interrupt on wake up.
+    bool rpi_sleep_until(const datetime_t *t, rtc_callback_t callback);
+    bool rpi_sleep_for(uint32_t ms, rtc_callback_t callback);
+
+    // Stops all clocks until the pin sees the edge (or level) given, for
+    // a wake up source outside the chip. The RTC stops as well and is
+    // behind by the time spent dormant.
+    void rpi_dormant_until_pin(uint gpio, bool edge, bool high);
+
+    const rpi_sleep_stats_t *rpi_sleep_stats();
+
+    // Seconds since 1970-01-01 of a date and time, and back (with dotw),
+    // for RTC arithmetic across day, month and year boundaries
+    int64_t rpi_datetime_to_seconds(const datetime_t *t);
+    void rpi_datetime_from_seconds(int64_t s, datetime_t *t);
 
 #ifdef __cplusplus
 }
 #endif
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,138 @@
+#ifndef __spsc_ring_H__
+#define __spsc_ring_H__
+
+#include <atomic>
+#include <cinttypes>
+#include <cstddef>
+#include <cstring>
+
+// Single producer, single consumer ring buffer for handing data from an
+// interrupt handler (or the other core) to the main loop without locks.
+//
+// head and tail are free-running counters, masked with N - 1 when indexing,
+// so all N slots are usable and size() is head - tail. Only the producer
+// writes head and only the consumer writes tail. The producer fills the
+// slots before publishing head with release ordering and the consumer
+// reads head with acquire ordering before touching them (and the other way
+// round for tail), which on the RP2040 comes down to plain loads/stores and
+// a DMB.
+//
+// Overflow and high-water counters are written by the producer only.
+template <typename T, size_t N>
+class SpscRing {
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "SpscRing size must be a power of two");
+
+public:
+    SpscRing() : head(0), tail(0), overflowCount(0), highWaterMark(0) {}
+
+    static constexpr size_t capacity() { return N; }
+
+    // consumer side view, producer side it is a lower bound
+    size_t size() const
+    {
+        return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+    }
+    bool empty() const { return size() == 0; }
+
+    // Producer: returns false and counts an overflow if the ring is full.
+    bool push(const T &v)
+    {
+        const uint32_t h = head.load(std::memory_order_relaxed);
+        const uint32_t used = h - tail.load(std::memory_order_acquire);
+        if (used == N)
+        {
+            overflowCount++;
+            return false;
+        }
+        buffer[h & (N - 1)] = v;
+        head.store(h + 1, std::memory_order_release);
+        if (used + 1 > highWaterMark)
+            highWaterMark = used + 1;
+        return true;
+    }
+
+    // Producer: pushes as much of data as fits, counts the rest as
+    // overflows and returns the number of elements pushed.
+    size_t push(const T *data, size_t len)
+    {
+        const uint32_t h = head.load(std::memory_order_relaxed);
+        const uint32_t used = h - tail.load(std::memory_order_acquire);
+        size_t n = N - used;
+        if (len > n)
+            overflowCount += len - n;
+        else
+            n = len;
+        if (n == 0)
+            return 0;
+
+        const size_t start = h & (N - 1);
+        const size_t first = n < N - start ? n : N - start;
+        memcpy(&buffer[start], data, first * sizeof(T));
+        memcpy(&buffer[0], data + first, (n - first) * sizeof(T));
+        head.store(h + n, std::memory_order_release);
+        if (used + n > highWaterMark)
+            highWaterMark = used + n;
+        return n;
+    }
+
+    // Consumer: returns false if the ring is empty.
+    bool pop(T &v)
+    {
+        const uint32_t t = tail.load(std::memory_order_relaxed);
+        if (head.load(std::memory_order_acquire) == t)
+            return false;
+        v = buffer[t & (N - 1)];
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer: pops up to len elements into data, returns how many.
+    size_t pop(T *data, size_t len)
+    {
+        const uint32_t t = tail.load(std::memory_order_relaxed);
+        size_t n = head.load(std::memory_order_acquire) - t;
+        if (n > len)
+            n = len;
+        if (n == 0)
+            return 0;
+
+        const size_t start = t & (N - 1);
+        const size_t first = n < N - start ? n : N - start;
+        memcpy(data, &buffer[start], first * sizeof(T));
+        memcpy(data + first, &buffer[0], (n - first) * sizeof(T));
+        tail.store(t + n, std::memory_order_release);
+        return n;
+    }
+
+    // Consumer: points data at the oldest element and returns how many can
+    // be read from there without wrapping, for parsing in place. The
+    // elements stay owned by the consumer until released with skip().
+    size_t peek(const T **data) const
+    {
+        const uint32_t t = tail.load(std::memory_order_relaxed);
+        const size_t n = head.load(std::memory_order_acquire) - t;
+        const size_t start = t & (N - 1);
+        *data = &buffer[start];
+        return n < N - start ? n : N - start;
+    }
+
+    // Consumer: releases len elements returned by peek().
+    void skip(size_t len)
+    {
+        tail.store(tail.load(std::memory_order_relaxed) + len, std::memory_order_release);
+    }
+
+    // elements dropped because the ring was full
+    uint32_t overflows() const { return overflowCount; }
+    // most elements ever queued at once
+    uint32_t highWater() const { return highWaterMark; }
+
+private:
+    std::atomic<uint32_t> head;
+    std::atomic<uint32_t> tail;
+    volatile uint32_t overflowCount;
+    volatile uint32_t highWaterMark;
+    T buffer[N];
+};
+
+#endif
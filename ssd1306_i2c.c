@@ -9,6 +9,8 @@
 #include "hardware/i2c.h"
 #include "raspberry26x32.h"
 #include "ssd1306_font.h"
+#include "timing.h"
+#include "trace.h"
 
 // Define the size of the display we have attached. This can vary, make sure you
 // have the right size defined or the output will look rather odd!
@@ -72,10 +74,8 @@
 
    Connections on Raspberry Pi Pico board, other boards may vary.
 
-   GPIO PICO_DEFAULT_I2C_SDA_PIN (on Pico this is GP4 (pin 6)) -> SDA on display
-   board
-   GPIO PICO_DEFAULT_I2C_SCL_PIN (on Pico this is GP5 (pin 7)) -> SCL on
-   display board
+   GPIO i2c_OLED_SDA (GP6 (pin 9)) -> SDA on display board
+   GPIO i2c_OLED_SCL (GP7 (pin 10)) -> SCL on display board
    3.3v (pin 36) -> VCC on display board
    GND (pin 38)  -> GND on display board
 */
@@ -113,6 +113,8 @@ void SSD1306_send_buf(uint8_t buf[], int buflen) {
     // in horizontal addressing mode, the column address pointer auto-increments
     // and then wraps around to the next page, so we can send the entire frame
     // buffer in one gooooooo!
+    TRACE_BEGIN(TRACE_DISPLAY_FLUSH, 0);
+    TIMING_BEGIN(t0);
 
     // copy our frame buffer into a new buffer because we need to add the control byte
     // to the beginning
@@ -125,6 +127,8 @@ void SSD1306_send_buf(uint8_t buf[], int buflen) {
     i2c_write_blocking(i2c_OLED, SSD1306_I2C_ADDR, temp_buf, buflen + 1, false);
 
     free(temp_buf);
+    TIMING_END(TIMING_DISPLAY_SEND, t0);
+    TRACE_END(TRACE_DISPLAY_FLUSH, 0, buflen);
 }
 
 void SSD1306_init_() {
@@ -194,6 +198,7 @@ void SSD1306_scroll(bool on) {
 
 void render(uint8_t *buf, struct render_area *area) {
     // update a portion of the display with a render area
+    TIMING_BEGIN(t0);
     uint8_t cmds[] = {
         SSD1306_SET_COL_ADDR,
         area->start_col,
@@ -205,6 +210,7 @@ void render(uint8_t *buf, struct render_area *area) {
     
     SSD1306_send_cmd_list(cmds, count_of(cmds));
     SSD1306_send_buf(buf, area->buflen);
+    TIMING_END(TIMING_DISPLAY_RENDER, t0);
 }
 
 static void SetPixel(uint8_t *buf, int x,int y, bool on) {
@@ -0,0 +1,176 @@
+#include "task_scheduler.h"
+#include "trace.h"
+
+#include "hardware/sync.h"
+#include "hardware/timer.h"
+
+#include <stdio.h>
+
+
+static sched_task_t *tasks = NULL;
+static int sched_alarm = -1;
+static volatile bool sched_pending = false;
+static uint32_t sleep_count = 0;
+
+static void sched_alarm_callback(uint alarm_num)
+{
+    (void)alarm_num;
+    sched_pending = true;
+}
+
+void sched_init(void)
+{
+    sched_alarm = hardware_alarm_claim_unused(true);
+    hardware_alarm_set_callback(sched_alarm, &sched_alarm_callback);
+}
+
+void sched_add(sched_task_t *task, const char *name, sched_fn_t fn, void *arg, uint32_t period_ms, uint32_t deadline_ms)
+{
+    task->name = name;
+    task->fn = fn;
+    task->arg = arg;
+    task->period_us = period_ms * 1000;
+    task->deadline_us = deadline_ms * 1000;
+    task->due_us = period_ms ? time_us_64() : SCHED_NEVER;
+    task->next = NULL;
+    task->runs = 0;
+    task->misses = 0;
+    task->max_late_us = 0;
+    task->max_run_us = 0;
+    task->run_us = 0;
+
+    sched_task_t **p = &tasks;
+    uint16_t id = 0;
+    while (*p)
+    {
+        p = &(*p)->next;
+        id++;
+    }
+    *p = task;
+    task->id = id;
+    TRACE_LABEL(TRACE_TASK, id, name);
+}
+
+void sched_signal(sched_task_t *task)
+{
+    if (!task->signalled)
+    {
+        task->signalled_at = time_us_32();
+        task->signalled = true;
+    }
+    sched_pending = true;
+}
+
+void sched_wake_at(sched_task_t *task, absolute_time_t t)
+{
+    const uint64_t us = to_us_since_boot(t);
+    if (us < task->due_us)
+        task->due_us = us;
+}
+
+void sched_set_period(sched_task_t *task, uint32_t period_ms)
+{
+    task->period_us = period_ms * 1000;
+    task->due_us = period_ms ? time_us_64() + task->period_us : SCHED_NEVER;
+}
+
+static void sched_run_task(sched_task_t *task, uint32_t late)
+{
+    if (late > task->max_late_us)
+        task->max_late_us = late;
+    if (task->deadline_us && late > task->deadline_us)
+        task->misses++;
+
+    const uint64_t start = time_us_64();
+    TRACE_BEGIN(TRACE_TASK, task->id);
+    task->fn(task->arg);
+    TRACE_END(TRACE_TASK, task->id, late);
+    const uint64_t took = time_us_64() - start;
+
+    task->runs++;
+    task->run_us += took;
+    if (took > task->max_run_us)
+        task->max_run_us = (uint32_t)took;
+}
+
+// Runs what is ready and returns when the next task is due
+static uint64_t sched_dispatch(void)
+{
+    uint64_t next = SCHED_NEVER;
+    // cleared first, so a signal raised while the tasks run is not lost
+    sched_pending = false;
+
+    for (sched_task_t *task = tasks; task; task = task->next)
+    {
+        const uint64_t now = time_us_64();
+        const bool timed = task->due_us <= now;
+        if (timed || task->signalled)
+        {
+            const uint32_t late = timed ? (uint32_t)(now - task->due_us) : time_us_32() - task->signalled_at;
+            task->signalled = false;
+            if (timed)
+            {
+                if (task->period_us)
+                {
+                    // skip the periods missed while something blocked
+                    task->due_us += task->period_us;
+                    if (task->due_us <= now)
+                        task->due_us = now + task->period_us;
+                }
+                else
+                    task->due_us = SCHED_NEVER;
+            }
+            sched_run_task(task, late);
+        }
+        if (task->due_us < next)
+            next = task->due_us;
+    }
+    return next;
+}
+
+void sched_run_once(void)
+{
+    const uint64_t next = sched_dispatch();
+
+    if (next != SCHED_NEVER && hardware_alarm_set_target(sched_alarm, from_us_since_boot(next)))
+        return;  // due already
+
+    // A signal or the alarm between the check and __wfi still ends the
+    // sleep: the interrupt stays pending while masked and wakes the core
+    const uint32_t status = save_and_disable_interrupts();
+    if (!sched_pending)
+    {
+        sleep_count++;
+        TRACE_BEGIN(TRACE_SLEEP, 0);
+        __wfi();
+        TRACE_END(TRACE_SLEEP, 0, 0);
+    }
+    restore_interrupts(status);
+}
+
+void sched_run(void)
+{
+    while (true)
+        sched_run_once();
+}
+
+void sched_rebase(void)
+{
+    const uint64_t now = time_us_64();
+    for (sched_task_t *task = tasks; task; task = task->next)
+        if (task->due_us != SCHED_NEVER)
+            task->due_us = now;
+}
+
+uint32_t sched_sleeps(void)
+{
+    return sleep_count;
+}
+
+void sched_print_stats(void)
+{
+    for (sched_task_t *task = tasks; task; task = task->next)
+        printf("task %-8s runs %6lu  missed %4lu  max late %8lu us  max run %8lu us  busy %10llu us\n",
+            task->name, (unsigned long)task->runs, (unsigned long)task->misses, (unsigned long)task->max_late_us,
+            (unsigned long)task->max_run_us, (unsigned long long)task->run_us);
+}
@@ -0,0 +1,71 @@
+#ifndef __task_scheduler_H__
+#define __task_scheduler_H__
+
+#include "pico/time.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Tickless cooperative scheduler for core0. Tasks run to completion, in the
+// order they were added, when their period comes round or when they are
+// signalled (from an interrupt handler or another task). In between the
+// core sleeps in __wfi with a single timer alarm armed for the earliest
+// due task, so there is no periodic tick to wake up for.
+
+// due time of a task that only runs when signalled
+#define SCHED_NEVER UINT64_MAX
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+    typedef void (*sched_fn_t)(void *arg);
+
+    typedef struct sched_task {
+        const char *name;
+        sched_fn_t fn;
+        void *arg;
+        uint32_t period_us;       // 0: runs only when signalled or woken
+        uint32_t deadline_us;     // allowed lateness, 0 for none
+        uint64_t due_us;          // next timed run or SCHED_NEVER
+        volatile bool signalled;
+        volatile uint32_t signalled_at;  // time_us_32() of the first pending signal
+        struct sched_task *next;
+        uint16_t id;              // position in the list, names the task in traces
+
+        // statistics
+        uint32_t runs;
+        uint32_t misses;          // runs started later than the deadline
+        uint32_t max_late_us;
+        uint32_t max_run_us;
+        uint64_t run_us;
+    } sched_task_t;
+
+    // Claims a timer alarm for the wake-ups
+    void sched_init(void);
+    // Periodic tasks are due at once, then every period_ms
+    void sched_add(sched_task_t *task, const char *name, sched_fn_t fn, void *arg, uint32_t period_ms, uint32_t deadline_ms);
+    // Runs the task as soon as possible, safe from interrupt handlers
+    void sched_signal(sched_task_t *task);
+    // One-off run at t, unless the task is due earlier anyway
+    void sched_wake_at(sched_task_t *task, absolute_time_t t);
+    // New period, the next timed run is period_ms from now
+    void sched_set_period(sched_task_t *task, uint32_t period_ms);
+
+    // Runs the due and signalled tasks, then sleeps until the next one
+    void sched_run_once(void);
+    void sched_run(void);
+
+    // Makes every timed task due now without counting it late, for after a
+    // gap the tasks should not make up for (dormant sleep)
+    void sched_rebase(void);
+
+    uint32_t sched_sleeps(void);
+    // One line per task through printf
+    void sched_print_stats(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
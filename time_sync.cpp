@@ -0,0 +1,78 @@
+#include "time_sync.h"
+
+#include "hardware/rtc.h"
+#include "pico/time.h"
+#include "sleep_control.h"
+
+bool TimeSync::set(int64_t utc, TIME_SOURCE from)
+{
+    datetime_t now;
+    const bool running = rtc_get_datetime(&now);
+    const int64_t rtc = running ? rpi_datetime_to_seconds(&now) : utc;
+    const int64_t step = utc - rtc;
+    if (source == from && (step < 0 ? -step : step) < TIME_SYNC_STEP_S)
+        return false;
+
+    datetime_t t;
+    rpi_datetime_from_seconds(utc, &t);
+    if (!rtc_set_datetime(&t))
+        return false;
+    source = from;
+    lastStepS = (int32_t)step;
+    syncedUs = time_us_64();
+    return true;
+}
+
+bool TimeSync::fromGps(uint32_t date, uint32_t time, uint32_t ageMs)
+{
+    if (ageMs > TIME_SYNC_MAX_GPS_AGE_MS)
+        return false;
+    datetime_t t;
+    t.year = (int16_t)(2000 + date % 100);
+    t.month = (int8_t)(date / 100 % 100);
+    t.day = (int8_t)(date / 10000);
+    t.dotw = 0;
+    t.hour = (int8_t)(time / 1000000);
+    t.min = (int8_t)(time / 10000 % 100);
+    t.sec = (int8_t)(time / 100 % 100);
+    if (t.month < 1 || t.month > 12 || t.day < 1 || t.day > 31)
+        return false;
+
+    // the time is that of the epoch start; add the centiseconds and how long
+    // ago it was decoded, rounded to the nearest second
+    const uint32_t ms = time % 100 * 10 + ageMs;
+    if (!set(rpi_datetime_to_seconds(&t) + (ms + 500) / 1000, TIME_SOURCE::GPS))
+        return false;
+    gpsSyncs++;
+    return true;
+}
+
+bool TimeSync::fromGps(GPSDate &date, GPSTime &time)
+{
+    if (!date.isValid() || !time.isValid())
+        return false;
+    return fromGps(date.value(), time.value(), time.age());
+}
+
+bool TimeSync::fromNetwork(const datetime_t &local, int zoneQuarters)
+{
+    if (source == TIME_SOURCE::GPS)
+        return false;
+    if (!set(rpi_datetime_to_seconds(&local) - zoneQuarters * 15 * 60, TIME_SOURCE::NETWORK))
+        return false;
+    networkSyncs++;
+    return true;
+}
+
+const char *TimeSync::sourceName(TIME_SOURCE s)
+{
+    switch (s)
+    {
+    case TIME_SOURCE::GPS:
+        return "gps";
+    case TIME_SOURCE::NETWORK:
+        return "network";
+    default:
+        return "none";
+    }
+}
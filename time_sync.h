@@ -0,0 +1,56 @@
+#ifndef __time_sync_H__
+#define __time_sync_H__
+
+#include "pico/types.h"
+
+#include "neo6m.h"
+
+#include <cinttypes>
+
+// The RTC is stepped only if it is off by this many seconds or more. It
+// counts whole seconds and is set to within half a second, so a second of
+// difference is just the two roundings.
+#ifndef TIME_SYNC_STEP_S
+#define TIME_SYNC_STEP_S 2
+#endif
+
+// GPS time older than this is not used
+#ifndef TIME_SYNC_MAX_GPS_AGE_MS
+#define TIME_SYNC_MAX_GPS_AGE_MS 1000
+#endif
+
+enum class TIME_SOURCE {
+    NONE,
+    NETWORK,
+    GPS
+};
+
+// Keeps the RTC on UTC. GPS time (with a fix) is preferred; the modem's
+// network time is the fallback until there is one, e.g. right after boot.
+class TimeSync {
+public:
+    // Sets the RTC from a committed GPS date and time (ddmmyy, hhmmsscc)
+    // decoded ageMs ago, if it is not synced yet or has drifted. Returns
+    // true if the RTC was set.
+    bool fromGps(uint32_t date, uint32_t time, uint32_t ageMs);
+    bool fromGps(GPSDate &date, GPSTime &time);
+    // Sets the RTC from the modem's network time (local time and the zone in
+    // quarter hours east of UTC) unless GPS time is in use
+    bool fromNetwork(const datetime_t &local, int zoneQuarters);
+    // The RTC stopped (dormant) or was set by someone else
+    void invalidate() { source = TIME_SOURCE::NONE; }
+
+    bool synced() const { return source != TIME_SOURCE::NONE; }
+    static const char *sourceName(TIME_SOURCE s);
+
+    TIME_SOURCE source = TIME_SOURCE::NONE;
+    uint32_t gpsSyncs = 0;
+    uint32_t networkSyncs = 0;
+    int32_t lastStepS = 0;     // UTC minus the RTC before the last sync
+    uint64_t syncedUs = 0;     // time_us_64() of the last sync
+
+private:
+    bool set(int64_t utc, TIME_SOURCE from);
+};
+
+#endif
@@ -0,0 +1,90 @@
+#include "timing.h"
+
+#if TRACKER_TIMING
+
+#include <stdio.h>
+#include <string.h>
+
+static timing_stats_t sites[TIMING_SITES];
+
+static const char *const names[TIMING_SITES] = {
+    "gps rx irq",
+    "sim800 rx irq",
+    "gps sentence",
+    "mpu6050 read",
+    "display render",
+    "display send",
+    "at command",
+};
+
+static void add(timing_stats_t *s, uint32_t us)
+{
+    if (s->count == 0 || us < s->min_us)
+        s->min_us = us;
+    if (us > s->max_us)
+        s->max_us = us;
+    s->count++;
+    s->total_us += us;
+    uint32_t b = us ? 32 - __builtin_clz(us) : 0;
+    if (b >= TIMING_BUCKETS)
+        b = TIMING_BUCKETS - 1;
+    s->hist[b]++;
+}
+
+void timing_record(timing_site_t site, uint32_t us)
+{
+    add(&sites[site], us);
+}
+
+void timing_record_n(timing_site_t site, uint32_t us, uint32_t n)
+{
+    timing_stats_t *s = &sites[site];
+    us += s->pending_us;
+    if (n == 0)
+    {
+        s->pending_us = us;
+        return;
+    }
+    s->pending_us = 0;
+    const uint32_t each = us / n;
+    for (uint32_t i = 0; i < n; i++)
+        add(s, each);
+    // the remainder of the division goes to the total only
+    s->total_us += us - each * n;
+}
+
+const timing_stats_t *timing_stats(timing_site_t site)
+{
+    return &sites[site];
+}
+
+const char *timing_site_name(timing_site_t site)
+{
+    return names[site];
+}
+
+void timing_reset(void)
+{
+    memset(sites, 0, sizeof(sites));
+}
+
+void timing_print(void)
+{
+    for (int i = 0; i < TIMING_SITES; i++)
+    {
+        const timing_stats_t *s = &sites[i];
+        if (s->count == 0)
+            continue;
+        printf("timing %-14s n %7lu  min %7lu  avg %7lu  max %7lu us ", names[i], (unsigned long)s->count,
+            (unsigned long)s->min_us, (unsigned long)(s->total_us / s->count), (unsigned long)s->max_us);
+        // upper bound of each bucket: <1 <2 <4 ..., the last one open
+        for (int b = 0; b < TIMING_BUCKETS - 1; b++)
+            if (s->hist[b])
+                printf(" <%lu:%lu", 1ul << b, (unsigned long)s->hist[b]);
+        if (s->hist[TIMING_BUCKETS - 1])
+            printf(" >=%lu:%lu", 1ul << (TIMING_BUCKETS - 2), (unsigned long)s->hist[TIMING_BUCKETS - 1]);
+        printf("\n");
+    }
+}
+
+#endif
@@ -0,0 +1,72 @@
+#ifndef __timing_H__
+#define __timing_H__
+
+#include "pico/time.h"
+
+#include <stdint.h>
+
+// Hot path instrumentation: per site call counts, min/max/total and a log2
+// histogram of durations from the microsecond timer. Each site is recorded
+// from one context only (one interrupt handler or one core's main loop).
+// With TRACKER_TIMING 0 the macros expand to nothing and timing.c is empty.
+// In the host simulation time only passes in blocking calls, so sites that
+// only compute read 0 there.
+#ifndef TRACKER_TIMING
+#define TRACKER_TIMING 0
+#endif
+
+// bucket 0 counts durations under 1 us, bucket b those of [2^(b-1), 2^b) us,
+// the last one everything longer
+#define TIMING_BUCKETS 24
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+    typedef enum {
+        TIMING_GPS_RX_IRQ,
+        TIMING_SIM800_RX_IRQ,
+        TIMING_GPS_SENTENCE,    // decoder time per committed sentence
+        TIMING_MPU6050_READ,
+        TIMING_DISPLAY_RENDER,
+        TIMING_DISPLAY_SEND,
+        TIMING_AT_COMMAND,      // AT command sent to response or timeout
+        TIMING_SITES
+    } timing_site_t;
+
+    typedef struct {
+        uint32_t count;
+        uint32_t min_us;
+        uint32_t max_us;
+        uint64_t total_us;
+        uint32_t pending_us;    // carried over to the next event, see timing_record_n()
+        uint32_t hist[TIMING_BUCKETS];
+    } timing_stats_t;
+
+    void timing_record(timing_site_t site, uint32_t us);
+    // n events that took us together, each counted as us / n. With n = 0
+    // the time is added to the next call, for work that did not finish an
+    // event yet (a sentence split over two buffers).
+    void timing_record_n(timing_site_t site, uint32_t us, uint32_t n);
+
+    const timing_stats_t *timing_stats(timing_site_t site);
+    const char *timing_site_name(timing_site_t site);
+    void timing_reset(void);
+    // One line per site that was hit, with the non-empty histogram buckets
+    void timing_print(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#if TRACKER_TIMING
+#define TIMING_BEGIN(t)            const uint32_t t = time_us_32()
+#define TIMING_END(site, t)        timing_record((site), time_us_32() - (t))
+#define TIMING_END_N(site, t, n)   timing_record_n((site), time_us_32() - (t), (n))
+#else
+#define TIMING_BEGIN(t)
+#define TIMING_END(site, t)        ((void)0)
+#define TIMING_END_N(site, t, n)   ((void)0)
+#endif
+
+#endif
@@ -0,0 +1,187 @@
+#include "trace.h"
+
+#if TRACKER_TRACE
+
+#include "hardware/sync.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define TRACE_LABELS 16
+
+static_assert(sizeof(trace_record_t) == 12, "trace records are 12 bytes");
+static_assert((TRACE_RECORDS & (TRACE_RECORDS - 1)) == 0, "TRACE_RECORDS must be a power of two");
+
+typedef struct {
+    volatile uint32_t head;     // records written, free running
+    uint32_t tail;              // records flushed
+    uint32_t lost;              // overwritten before they were flushed
+    trace_record_t rec[TRACE_RECORDS];
+} trace_ring_t;
+
+typedef struct {
+    uint8_t event;
+    uint16_t a;
+    const char *name;
+} trace_label_t;
+
+static trace_ring_t rings[NUM_CORES];
+static trace_label_t labels[TRACE_LABELS];
+static uint32_t label_count;
+static uint32_t labels_flushed;
+
+static const char *const names[TRACE_EVENTS] = {
+    "gps rx irq",
+    "sim800 rx irq",
+    "gps decode",
+    "mpu6050 read",
+    "display flush",
+    "at command",
+    "task",
+    "sleep",
+    "park",
+};
+
+void trace_record(trace_event_t event, trace_phase_t phase, uint16_t a, uint32_t b)
+{
+    trace_ring_t *r = &rings[get_core_num()];
+    // other writers on this core are interrupt handlers
+    const uint32_t irq = save_and_disable_interrupts();
+    const uint32_t h = r->head;
+    trace_record_t *rec = &r->rec[h & (TRACE_RECORDS - 1)];
+    rec->ts = time_us_32();
+    rec->event = (uint8_t)event;
+    rec->phase = (uint8_t)phase;
+    rec->a = a;
+    rec->b = b;
+    __dmb();
+    r->head = h + 1;
+    restore_interrupts(irq);
+}
+
+void trace_label(trace_event_t event, uint16_t a, const char *name)
+{
+    if (label_count == TRACE_LABELS)
+        return;
+    labels[label_count].event = (uint8_t)event;
+    labels[label_count].a = a;
+    labels[label_count].name = name;
+    label_count++;
+}
+
+static void put16(uint8_t *p, uint16_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static void put32(uint8_t *p, uint32_t v)
+{
+    put16(p, (uint16_t)v);
+    put16(p + 2, (uint16_t)(v >> 16));
+}
+
+static bool flush_labels(trace_sink_t sink, void *ctx)
+{
+    uint8_t block[8 + 255];
+    for (uint32_t i = labels_flushed; i < label_count; i++)
+    {
+        size_t len = strlen(labels[i].name);
+        if (len > 255)
+            len = 255;
+        block[0] = 'T';
+        block[1] = 'R';
+        block[2] = TRACE_BLOCK_LABEL_TYPE;
+        block[3] = labels[i].event;
+        put16(block + 4, labels[i].a);
+        put16(block + 6, (uint16_t)len);
+        memcpy(block + 8, labels[i].name, len);
+        if (!sink(block, 8 + len, ctx))
+            return false;
+        labels_flushed = i + 1;
+    }
+    return true;
+}
+
+uint32_t trace_flush(trace_sink_t sink, void *ctx)
+{
+    uint32_t flushed = 0;
+    if (!flush_labels(sink, ctx))
+        return 0;
+    for (uint core = 0; core < NUM_CORES; core++)
+    {
+        trace_ring_t *r = &rings[core];
+        // what is written meanwhile waits for the next flush
+        const uint32_t end = r->head;
+        __dmb();
+        if (end - r->tail > TRACE_RECORDS)
+        {
+            r->lost += end - r->tail - TRACE_RECORDS;
+            r->tail = end - TRACE_RECORDS;
+        }
+        while ((int32_t)(end - r->tail) > 0)
+        {
+            uint32_t n = end - r->tail;
+            if (n > TRACE_BLOCK_RECORDS)
+                n = TRACE_BLOCK_RECORDS;
+
+            uint8_t block[10 + TRACE_BLOCK_RECORDS * sizeof(trace_record_t)];
+            for (uint32_t i = 0; i < n; i++)
+                memcpy(block + 10 + i * sizeof(trace_record_t), &r->rec[(r->tail + i) & (TRACE_RECORDS - 1)],
+                    sizeof(trace_record_t));
+
+            // drop what the writer lapped while it was copied, the record
+            // at head may be half written
+            __dmb();
+            const uint32_t oldest = r->head + 1 - TRACE_RECORDS;
+            uint32_t skip = (int32_t)(oldest - r->tail) > 0 ? oldest - r->tail : 0;
+            if (skip > n)
+                skip = n;
+            r->lost += skip;
+
+            block[0] = 'T';
+            block[1] = 'R';
+            block[2] = TRACE_BLOCK_RECORDS_TYPE;
+            block[3] = (uint8_t)core;
+            put16(block + 4, (uint16_t)(n - skip));
+            put32(block + 6, r->lost);
+            memmove(block + 10, block + 10 + skip * sizeof(trace_record_t), (n - skip) * sizeof(trace_record_t));
+            // the lapped records are gone either way, the others stay for
+            // the next flush unless the sink took them
+            r->tail += skip;
+            if (!sink(block, 10 + (n - skip) * sizeof(trace_record_t), ctx))
+                return flushed;
+            r->tail += n - skip;
+            flushed += n - skip;
+        }
+    }
+    return flushed;
+}
+
+bool trace_text_sink(const uint8_t *data, size_t len, void *ctx)
+{
+    static const char hex[] = "0123456789abcdef";
+    FILE *out = ctx ? (FILE *)ctx : stdout;
+    fputs("trace:", out);
+    for (size_t i = 0; i < len; i++)
+    {
+        fputc(hex[data[i] >> 4], out);
+        fputc(hex[data[i] & 15], out);
+    }
+    return fputc('\n', out) != EOF && !ferror(out);
+}
+
+uint32_t trace_lost(void)
+{
+    uint32_t lost = 0;
+    for (int core = 0; core < NUM_CORES; core++)
+        lost += rings[core].lost;
+    return lost;
+}
+
+const char *trace_event_name(trace_event_t event)
+{
+    return event < TRACE_EVENTS ? names[event] : "?";
+}
+
+#endif
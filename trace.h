@@ -0,0 +1,106 @@
+#ifndef __trace_H__
+#define __trace_H__
+
+#include "pico/time.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Binary event trace: 12 byte records (timestamp, event, phase, two
+// arguments) go into a RAM ring per core from any context, interrupt
+// handlers included, without formatting anything. trace_flush() hands the
+// records written since the last flush to a sink in blocks; trace_text_sink
+// prints each block as a "trace:" line of hex between the normal output
+// (USB stdio) and host/trace_decode turns a capture of them into a Chrome trace / Perfetto
+// JSON timeline. When a ring wraps before it is flushed the oldest records
+// are lost and counted.
+//
+// With TRACKER_TRACE 0 the macros expand to nothing and trace.c is empty.
+#ifndef TRACKER_TRACE
+#define TRACKER_TRACE 0
+#endif
+
+// records per core, a power of two
+#ifndef TRACE_RECORDS
+#define TRACE_RECORDS 256
+#endif
+
+// most records per flushed block
+#define TRACE_BLOCK_RECORDS 16
+
+// Blocks are little endian, records as they are in memory.
+// record block: 'T', 'R', 'R', core, count (u16), lost so far (u32), records
+#define TRACE_BLOCK_RECORDS_TYPE 'R'
+// label block: 'T', 'R', 'L', event, arg (u16), length (u16), name
+#define TRACE_BLOCK_LABEL_TYPE   'L'
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+    typedef enum {
+        TRACE_GPS_RX_IRQ,
+        TRACE_SIM800_RX_IRQ,
+        TRACE_GPS_DECODE,       // end: a = sentences committed
+        TRACE_MPU6050_READ,
+        TRACE_DISPLAY_FLUSH,    // b = bytes
+        TRACE_AT_COMMAND,       // end: a = 1 if answered
+        TRACE_TASK,             // a = task, labelled with its name
+        TRACE_SLEEP,            // scheduler in __wfi
+        TRACE_PARK,             // dormant
+        TRACE_EVENTS
+    } trace_event_t;
+
+    // Chrome trace phases
+    typedef enum {
+        TRACE_PH_BEGIN = 'B',
+        TRACE_PH_END = 'E',
+        TRACE_PH_INSTANT = 'i',
+    } trace_phase_t;
+
+    typedef struct {
+        uint32_t ts;            // time_us_32()
+        uint8_t event;
+        uint8_t phase;
+        uint16_t a;
+        uint32_t b;
+    } trace_record_t;
+
+    // Receives flushed blocks; returns false if it did not take the whole
+    // block, which stops the flush and leaves the block for the next one
+    typedef bool (*trace_sink_t)(const uint8_t *data, size_t len, void *ctx);
+
+    void trace_record(trace_event_t event, trace_phase_t phase, uint16_t a, uint32_t b);
+    // Names argument a of an event (a task number, say) in the decoded
+    // trace. name must stay valid, it is only read by trace_flush().
+    void trace_label(trace_event_t event, uint16_t a, const char *name);
+
+    // Passes new labels and the records written since the last flush to
+    // sink, core by core and oldest first. Returns the records passed.
+    // Flush from one place only.
+    uint32_t trace_flush(trace_sink_t sink, void *ctx);
+    // "trace:<hex>\n" per block to the FILE * in ctx, stdout if NULL; false
+    // on a write error
+    bool trace_text_sink(const uint8_t *data, size_t len, void *ctx);
+
+    uint32_t trace_lost(void);
+    const char *trace_event_name(trace_event_t event);
+
+#ifdef __cplusplus
+}
+#endif
+
+#if TRACKER_TRACE
+#define TRACE_BEGIN(event, a)      trace_record((event), TRACE_PH_BEGIN, (a), 0)
+#define TRACE_END(event, a, b)     trace_record((event), TRACE_PH_END, (a), (b))
+#define TRACE_INSTANT(event, a, b) trace_record((event), TRACE_PH_INSTANT, (a), (b))
+#define TRACE_LABEL(event, a, name) trace_label((event), (a), (name))
+#else
+#define TRACE_BEGIN(event, a)      ((void)0)
+#define TRACE_END(event, a, b)     ((void)0)
+#define TRACE_INSTANT(event, a, b) ((void)0)
+#define TRACE_LABEL(event, a, name) ((void)0)
+#endif
+
+#endif
@@ -0,0 +1,274 @@
+#include "track_log.h"
+
+#include "hardware/regs/addressmap.h"
+#include "hardware/sync.h"
+
+#include <cstring>
+
+#define SECTOR_MAGIC    0x00314C54u     // "TL1"
+#define NO_SECTOR       UINT32_MAX
+
+// header fields
+#define HDR_FIRST       12
+#define HDR_OPEN_CRC    16
+#define HDR_COUNT       18
+#define HDR_LAST        20
+#define HDR_SEAL_CRC    24
+
+// record: the FixRecord, its CRC, two spare bytes
+#define REC_CRC         28
+
+static_assert(sizeof(FixRecord) == REC_CRC && alignof(FixRecord) <= 4, "FixRecord is stored as it is");
+static_assert(FLASH_PAGE_SIZE % TRACK_LOG_RECORD_SIZE == 0, "a record is in one page");
+
+static uint16_t get16(const uint8_t *p)
+{
+    return (uint16_t)(p[0] | p[1] << 8);
+}
+
+static uint32_t get32(const uint8_t *p)
+{
+    return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static void put16(uint8_t *p, uint16_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static void put32(uint8_t *p, uint32_t v)
+{
+    put16(p, (uint16_t)v);
+    put16(p + 2, (uint16_t)(v >> 16));
+}
+
+TrackLog::TrackLog(uint32_t offset, uint32_t size)
+  : base(offset), sectors(size / FLASH_SECTOR_SIZE), newest(NO_SECTOR)
+{
+}
+
+const uint8_t *TrackLog::at(uint32_t seq, uint32_t off) const
+{
+    return (const uint8_t *)(XIP_BASE + base + (seq % sectors) * FLASH_SECTOR_SIZE + off);
+}
+
+const FixRecord &TrackLog::entry(uint32_t seq, uint32_t index) const
+{
+    return *(const FixRecord *)at(seq, TRACK_LOG_HEADER_SIZE + index * TRACK_LOG_RECORD_SIZE);
+}
+
+bool TrackLog::sectorValid(uint32_t seq) const
+{
+    const uint8_t *h = at(seq, 0);
+    return get32(h) == SECTOR_MAGIC && get32(h + 4) == seq && get32(h + 8) == ~seq
+        && get16(h + HDR_OPEN_CRC) == fix_crc16(h, HDR_OPEN_CRC);
+}
+
+uint32_t TrackLog::sectorFirst(uint32_t seq) const
+{
+    return get32(at(seq, HDR_FIRST));
+}
+
+uint32_t TrackLog::sectorCount(uint32_t seq) const
+{
+    if (seq == newest)
+        return headCount;
+    const uint8_t *h = at(seq, 0);
+    if (get16(h + HDR_SEAL_CRC) == fix_crc16(h + HDR_COUNT, HDR_SEAL_CRC - HDR_COUNT))
+        return get16(h + HDR_COUNT);
+    // a power failure before it was sealed
+    uint32_t n = 0;
+    while (n < TRACK_LOG_PER_SECTOR && recordValid(seq, n))
+        n++;
+    return n;
+}
+
+bool TrackLog::recordValid(uint32_t seq, uint32_t index) const
+{
+    const uint8_t *r = at(seq, TRACK_LOG_HEADER_SIZE + index * TRACK_LOG_RECORD_SIZE);
+    return get32(r) != UINT32_MAX && get16(r + REC_CRC) == fix_crc16(r, REC_CRC);
+}
+
+void TrackLog::recover()
+{
+    newest = NO_SECTOR;
+    for (uint32_t slot = 0; slot < sectors; slot++)
+    {
+        const uint32_t seq = get32(at(slot, 4));
+        if (seq % sectors == slot && sectorValid(seq) && (newest == NO_SECTOR || seq > newest))
+            newest = seq;
+    }
+    headCount = 0;
+    headLast = 0;
+    headFull = true;
+    if (newest == NO_SECTOR)
+    {
+        oldest = 0;
+        return;
+    }
+    oldest = newest;
+    while (oldest > 0 && newest - oldest + 1 < sectors && sectorValid(oldest - 1))
+        oldest--;
+
+    while (headCount < TRACK_LOG_PER_SECTOR && recordValid(newest, headCount))
+        headCount++;
+    // a record cut short: the rest of the sector stays as it is
+    headFull = headCount < TRACK_LOG_PER_SECTOR
+        && get32(at(newest, TRACK_LOG_HEADER_SIZE + headCount * TRACK_LOG_RECORD_SIZE)) != UINT32_MAX;
+    corrupt += headFull;
+    // without records, the one whose append opened the sector did not make it
+    headLast = headCount ? entry(newest, headCount - 1).time : sectorFirst(newest) - 1;
+}
+
+bool TrackLog::append(const FixRecord &fix)
+{
+    if (newest != NO_SECTOR && fix.time <= headLast)
+    {
+        refused++;
+        return false;
+    }
+    if (headFull || headCount == TRACK_LOG_PER_SECTOR)
+        openSector(fix.time);
+
+    const uint32_t off = base + (newest % sectors) * FLASH_SECTOR_SIZE + TRACK_LOG_HEADER_SIZE
+        + headCount * TRACK_LOG_RECORD_SIZE;
+    uint8_t *r = page + off % FLASH_PAGE_SIZE;
+    memset(page, 0xFF, sizeof(page));
+    memcpy(r, &fix, sizeof(fix));
+    put16(r + REC_CRC, fix_crc16(r, REC_CRC));
+    programPage(off - off % FLASH_PAGE_SIZE);
+    headCount++;
+    headLast = fix.time;
+    appended++;
+    return true;
+}
+
+// Starts the next sector in the next slot, erasing it
+void TrackLog::openSector(uint32_t firstTime)
+{
+    if (newest != NO_SECTOR)
+        seal();
+    const uint32_t seq = newest + 1;
+    if (seq - oldest >= sectors)
+        oldest++;
+
+    const uint32_t off = base + (seq % sectors) * FLASH_SECTOR_SIZE;
+    const uint32_t irq = save_and_disable_interrupts();
+    flash_range_erase(off, FLASH_SECTOR_SIZE);
+    restore_interrupts(irq);
+    erases++;
+
+    memset(page, 0xFF, sizeof(page));
+    put32(page, SECTOR_MAGIC);
+    put32(page + 4, seq);
+    put32(page + 8, ~seq);
+    put32(page + HDR_FIRST, firstTime);
+    put16(page + HDR_OPEN_CRC, fix_crc16(page, HDR_OPEN_CRC));
+    programPage(off);
+    newest = seq;
+    headCount = 0;
+    headFull = false;
+}
+
+// Writes the record count and the last time into the newest sector's header
+void TrackLog::seal()
+{
+    memset(page, 0xFF, sizeof(page));
+    put16(page + HDR_COUNT, (uint16_t)headCount);
+    put32(page + HDR_LAST, headCount ? entry(newest, headCount - 1).time : 0);
+    put16(page + HDR_SEAL_CRC, fix_crc16(page + HDR_COUNT, HDR_SEAL_CRC - HDR_COUNT));
+    programPage(base + (newest % sectors) * FLASH_SECTOR_SIZE);
+}
+
+bool TrackLog::find(uint32_t from, uint32_t to, Cursor &c) const
+{
+    c.done = true;
+    if (newest == NO_SECTOR || from > to)
+        return false;
+
+    // the last sector starting at or before from
+    uint32_t lo = oldest, hi = newest;
+    while (lo < hi)
+    {
+        const uint32_t mid = lo + (hi - lo + 1) / 2;
+        if (sectorFirst(mid) <= from)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+    // then its first record at or after from
+    uint32_t index = 0;
+    if (sectorFirst(lo) <= from)
+    {
+        uint32_t n = sectorCount(lo);
+        while (index < n)
+        {
+            const uint32_t mid = index + (n - index) / 2;
+            if (entry(lo, mid).time < from)
+                index = mid + 1;
+            else
+                n = mid;
+        }
+    }
+    c.seq = lo;
+    c.index = index;
+    c.to = to;
+    c.done = false;
+
+    // skip to the sector the record is in
+    while (c.seq <= newest && c.index >= sectorCount(c.seq))
+    {
+        c.seq++;
+        c.index = 0;
+    }
+    c.done = c.seq > newest || entry(c.seq, c.index).time > to;
+    return !c.done;
+}
+
+size_t TrackLog::read(Cursor &c, record_fn fn, void *ctx, size_t max) const
+{
+    size_t n = 0;
+    for (; !c.done && c.seq <= newest; c.seq++, c.index = 0)
+    {
+        // overwritten while the query was going on
+        if (c.seq < oldest)
+        {
+            c.seq = oldest;
+            c.index = 0;
+        }
+        const uint32_t count = sectorCount(c.seq);
+        for (; c.index < count; c.index++)
+        {
+            const FixRecord &fix = entry(c.seq, c.index);
+            if (fix.time > c.to)
+            {
+                c.done = true;
+                return n;
+            }
+            if (n == max || !fn(fix, ctx))
+                return n;
+            n++;
+        }
+    }
+    c.done = true;
+    return n;
+}
+
+bool TrackLog::empty() const
+{
+    return newest == NO_SECTOR;
+}
+
+uint32_t TrackLog::firstTime() const
+{
+    return newest == NO_SECTOR ? 0 : sectorFirst(oldest);
+}
+
+// Programs the page buffer
+void TrackLog::programPage(uint32_t off)
+{
+    const uint32_t irq = save_and_disable_interrupts();
+    flash_range_program(off, page, FLASH_PAGE_SIZE);
+    restore_interrupts(irq);
+}
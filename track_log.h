@@ -0,0 +1,106 @@
+#ifndef __track_log_H__
+#define __track_log_H__
+
+#include "pico.h"
+#include "hardware/flash.h"
+
+#include "fix_codec.h"
+#include "flash_queue.h"
+
+#include <cinttypes>
+#include <cstddef>
+
+// A fix logged every TRACK_LOG_PERIOD_S (main.cpp), to a region right below
+// the flash queue, 127 fixes a sector: the default keeps 5 to 6 days
+#ifndef TRACK_LOG_PERIOD_S
+#define TRACK_LOG_PERIOD_S  15
+#endif
+#ifndef TRACK_LOG_SIZE
+#define TRACK_LOG_SIZE      (256 * FLASH_SECTOR_SIZE)
+#endif
+#ifndef TRACK_LOG_OFFSET
+#define TRACK_LOG_OFFSET    (FLASH_QUEUE_OFFSET - TRACK_LOG_SIZE)
+#endif
+
+// Track history in flash, for time range queries. Sectors are used in turn
+// like the flash queue's (flash_queue.h). Each holds a 32 byte header and
+// fixed size records in time order:
+//
+//   FixRecord as it is in RAM, CRC-16 of it (u16 LE), 0xFFFF
+//
+// The header is the sector's index: magic, sequence number and its
+// complement, the time of the first record and a CRC-16 of those, written
+// when the sector is opened; the record count, the time of the last record
+// and a CRC-16 of both, written when it is full. With fixed size records
+// the offset of record i follows from i, so a query binary searches the
+// sectors by their first time, then the records of one sector, and reads
+// no more than a few dozen records and headers to find where a range
+// starts. Records are handed out in place in flash, nothing is copied.
+//
+// Times only go forward: a fix not later than the last one is refused.
+// When the region is full the oldest sector is erased. A record cut short
+// by a power failure fails its CRC and ends its sector. Like the flash
+// queue, erasing and programming stall the flash with interrupts off, and
+// core1 must not run from flash meanwhile.
+#define TRACK_LOG_RECORD_SIZE   32
+#define TRACK_LOG_HEADER_SIZE   32
+#define TRACK_LOG_PER_SECTOR    ((FLASH_SECTOR_SIZE - TRACK_LOG_HEADER_SIZE) / TRACK_LOG_RECORD_SIZE)
+
+class TrackLog {
+public:
+    TrackLog(uint32_t offset = TRACK_LOG_OFFSET, uint32_t size = TRACK_LOG_SIZE);
+
+    // Finds the newest record after a reset, starts an empty log in a region
+    // that holds none
+    void recover();
+    // false if the fix is not later than the last one
+    bool append(const FixRecord &fix);
+
+    // Where a query has got to
+    struct Cursor {
+        uint32_t seq;       // sector of the log
+        uint32_t index;     // record in it
+        uint32_t to;        // last time of the range
+        bool done;
+    };
+    // Starts a query for the records from from to to (unix seconds, both
+    // included); false if there are none
+    bool find(uint32_t from, uint32_t to, Cursor &c) const;
+    // Called with a record of the range in flash, false stops
+    typedef bool (*record_fn)(const FixRecord &fix, void *ctx);
+    // Hands up to max records of the range to fn, returns how many it took
+    size_t read(Cursor &c, record_fn fn, void *ctx, size_t max) const;
+
+    bool empty() const;
+    // time of the oldest and the newest record
+    uint32_t firstTime() const;
+    uint32_t lastTime() const { return headLast; }
+
+    // statistics
+    uint32_t appended = 0;
+    uint32_t refused = 0;       // not later than the last fix
+    uint32_t erases = 0;
+    uint32_t corrupt = 0;       // records failing the CRC, from power failures
+
+private:
+    const uint8_t *at(uint32_t seq, uint32_t off) const;
+    const FixRecord &entry(uint32_t seq, uint32_t index) const;
+    bool sectorValid(uint32_t seq) const;
+    uint32_t sectorFirst(uint32_t seq) const;
+    // number of records of a sector
+    uint32_t sectorCount(uint32_t seq) const;
+    bool recordValid(uint32_t seq, uint32_t index) const;
+    void openSector(uint32_t firstTime);
+    void seal();
+    void programPage(uint32_t off);
+
+    uint32_t base, sectors;
+    uint32_t oldest = 0;        // sequence numbers of the sectors in use
+    uint32_t newest = 0;
+    uint32_t headCount = 0;     // records in the newest sector
+    uint32_t headLast = 0;      // time of the last record
+    bool headFull = true;       // next record goes to a new sector
+    uint8_t page[FLASH_PAGE_SIZE];
+};
+
+#endif
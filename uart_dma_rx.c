@@ -0,0 +1,96 @@
+#include "uart_dma_rx.h"
+
+#include "hardware/dma.h"
+#include "hardware/sync.h"
+
+
+void uart_dma_rx_init(uart_dma_rx_t *rx, uart_inst_t *uart, uint8_t *buffer, uint size_bits, uint32_t transfers)
+{
+    rx->uart = uart;
+    rx->buffer = buffer;
+    rx->mask = (1u << size_bits) - 1;
+    rx->transfers = transfers;
+    rx->base = 0;
+    rx->tail = 0;
+    rx->overruns = 0;
+    rx->high_water = 0;
+    rx->rearms = 0;
+    rx->seq = 0;
+
+    // The FIFO holds what arrives while the channel is being re-armed
+    uart_set_fifo_enabled(uart, true);
+
+    rx->dma_chan = dma_claim_unused_channel(true);
+    dma_channel_config c = dma_channel_get_default_config(rx->dma_chan);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
+    channel_config_set_read_increment(&c, false);
+    channel_config_set_write_increment(&c, true);
+    channel_config_set_ring(&c, true, size_bits);
+    channel_config_set_dreq(&c, uart_get_dreq(uart, false));
+    dma_channel_configure(rx->dma_chan, &c, buffer, &uart_get_hw(uart)->dr, transfers, true);
+
+    // RX and RX-timeout interrupts, only raised while the channel is stopped
+    uart_set_irq_enables(uart, true, false);
+}
+
+void uart_dma_rx_irq(uart_dma_rx_t *rx)
+{
+    if (dma_channel_is_busy(rx->dma_chan))
+        return;
+
+    // The finished run wrote exactly transfers bytes and left the write
+    // address where the next one continues
+    rx->seq++;
+    __dmb();
+    rx->base += rx->transfers;
+    rx->rearms++;
+    dma_channel_set_trans_count(rx->dma_chan, rx->transfers, true);
+    __dmb();
+    rx->seq++;
+}
+
+// Total bytes written so far. base and the transfer count change together
+// in uart_dma_rx_irq(), which may run on the other core, so read them
+// seqlock style until no update happened around the reads.
+static uint32_t uart_dma_rx_head(uart_dma_rx_t *rx)
+{
+    uint32_t seq, base, remaining;
+    do
+    {
+        seq = rx->seq;
+        __dmb();
+        base = rx->base;
+        remaining = dma_channel_hw_addr(rx->dma_chan)->transfer_count;
+        __dmb();
+    } while ((seq & 1) || seq != rx->seq);
+    return base + (rx->transfers - remaining);
+}
+
+size_t uart_dma_rx_available(uart_dma_rx_t *rx)
+{
+    const uint32_t head = uart_dma_rx_head(rx);
+    uint32_t used = head - rx->tail;
+    if (used > rx->mask + 1)
+    {
+        // the DMA lapped the reader, what was there is gone
+        rx->overruns += used - (rx->mask + 1);
+        rx->tail = head;
+        used = 0;
+    }
+    if (used > rx->high_water)
+        rx->high_water = used;
+    return used;
+}
+
+size_t uart_dma_rx_peek(uart_dma_rx_t *rx, const uint8_t **data)
+{
+    const size_t used = uart_dma_rx_available(rx);
+    const uint32_t start = rx->tail & rx->mask;
+    *data = rx->buffer + start;
+    return used < rx->mask + 1 - start ? used : rx->mask + 1 - start;
+}
+
+void uart_dma_rx_skip(uart_dma_rx_t *rx, size_t len)
+{
+    rx->tail += len;
+}
@@ -0,0 +1,66 @@
+#ifndef __uart_dma_rx_H__
+#define __uart_dma_rx_H__
+
+#include "hardware/uart.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+// UART receive through DMA instead of one interrupt per character: a DMA
+// channel paced by the UART RX DREQ writes into a ring buffer (DMA ring mode,
+// so the buffer must be aligned to its size) and the main loop reads the
+// written span in place. The FIFO stays enabled to absorb DMA latency, and
+// the RX / RX-timeout interrupt only fires if the FIFO fills up because the
+// channel ran out of transfers, in which case uart_dma_rx_irq() re-arms it.
+
+// Receive data through DMA; 0 keeps the per-character RX interrupt path
+#ifndef UART_RX_DMA
+#define UART_RX_DMA 1
+#endif
+
+// Transfers per DMA run before the interrupt has to re-arm the channel
+#define UART_DMA_RX_TRANSFERS 0xFFFFFFFFu
+
+#define UART_DMA_RX_BUFFER(name, size_bits) \
+    static uint8_t name[1u << (size_bits)] __attribute__((aligned(1u << (size_bits))))
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+    typedef struct {
+        uart_inst_t *uart;
+        uint8_t *buffer;
+        uint32_t mask;
+        int dma_chan;
+        uint32_t transfers;
+        volatile uint32_t base;  // bytes written by finished DMA runs
+        uint32_t tail;           // bytes consumed, free running like base
+        uint32_t overruns;       // bytes overwritten before they were read
+        uint32_t high_water;     // most bytes waiting at once
+        volatile uint32_t rearms;
+        volatile uint32_t seq;   // odd while the interrupt moves base and the count
+    } uart_dma_rx_t;
+
+    // Claims a DMA channel and starts receiving into buffer (1 << size_bits
+    // bytes, aligned to its size). The UART must be initialised and its IRQ
+    // handler must call uart_dma_rx_irq().
+    void uart_dma_rx_init(uart_dma_rx_t *rx, uart_inst_t *uart, uint8_t *buffer, uint size_bits, uint32_t transfers);
+    // For the UART RX interrupt handler
+    void uart_dma_rx_irq(uart_dma_rx_t *rx);
+
+    // The reader functions below may run on the other core than the
+    // interrupt handler, but all of them on the same one.
+
+    // Bytes received and not yet consumed
+    size_t uart_dma_rx_available(uart_dma_rx_t *rx);
+    // Points data at the oldest unread byte and returns how many can be read
+    // from there without wrapping. Release them with uart_dma_rx_skip().
+    size_t uart_dma_rx_peek(uart_dma_rx_t *rx, const uint8_t **data);
+    void uart_dma_rx_skip(uart_dma_rx_t *rx, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif